@@ -25,7 +25,10 @@
 
 #include <map>
 #include <exception>
+#include <stdexcept>
 #include <mutex>
+#include <atomic>
+#include <cstddef>
 #include "AADefine.h"
 
 namespace ArmyAnt {
@@ -33,7 +36,7 @@ namespace ArmyAnt {
 
 /*	* @ author			: Jason
 	* @ date			: 13/11/2015
-	* @ last update	    : 23/05/2017
+	* @ last update	    : 17/10/2026
 	* @ summary			: 此类用于保护性隐藏C++类中的私有成员
 	* @ uncompleted		:
 	* @ untested		:
@@ -45,12 +48,85 @@ namespace ArmyAnt {
 //T_Out参数代表原类型，T_In参数代表包含私有成员的类型，T_Handle代表句柄的类型，可从任意整型中选择，默认为uint32
 //使用时，不要把管理器实例或者T_In类的任何信息，暴露在cpp文件之外
 
-template <class T_Out, class T_In>
+// 句柄管理器的存储模式
+enum class HandleManagerMode : uint8
+{
+	// 旧模式: 全局互斥锁 + std::map, 每次查询都要加锁, 仅用于对比测试或兼容
+	MapMutex,
+	// 默认模式: 分片开放寻址哈希表, 查询无锁(只读原子变量), 写入只锁定对应的分片
+	Sharded
+};
+
+template <class T_Out, class T_In, HandleManagerMode mode = HandleManagerMode::Sharded>
 class ClassPrivateHandleManager
 {
-	ClassPrivateHandleManager() :handleMap(), _mutex() {}
+	// 分片数量, 必须为2的幂
+	static const uint32 c_shardCount = 64;
+	// 每个分片哈希表的初始容量, 必须为2的幂
+	static const uint32 c_initCapacity = 16;
+
+	// 哈希表的一个槽位, 键为外部实例地址, 值为内部实例地址
+	struct Slot
+	{
+		std::atomic<const T_Out*> key;
+		std::atomic<T_In*> value;
+	};
+
+	// 一张线性探测哈希表. 扩容后旧表不会立即释放(无锁读者可能还在读), 而是挂在新表的retired上, 随管理器一同释放
+	// 由于表只扩不缩, 且删除采用后移法不留墓碑, 旧表总大小不超过当前表的大小
+	struct Table
+	{
+		Table(uint32 capacity, Table* retired)
+			:capacity(capacity), mask(capacity - 1), shift(shiftOf(capacity)), slots(new Slot[capacity]), retired(retired)
+		{
+			for(uint32 i = 0; i < capacity; ++i)
+			{
+				slots[i].key.store(nullptr, std::memory_order_relaxed);
+				slots[i].value.store(nullptr, std::memory_order_relaxed);
+			}
+		}
+		~Table()
+		{
+			delete[] slots;
+			delete retired;
+		}
+
+		// 元素的初始位置. 乘法散列只会把低位向高位扩散, 低位不够随机(对齐的地址乘积最低位恒为0),
+		// 因此取分片号(最高6位)下方的若干高位作为表内位置
+		uint32 indexOf(uint64 hash)const{ return uint32(hash >> shift) & mask; }
+
+		static uint32 shiftOf(uint32 capacity)
+		{
+			uint32 bits = 0;
+			while((uint32(1) << bits) < capacity)
+				++bits;
+			return 58 - bits;
+		}
+
+		const uint32 capacity;
+		const uint32 mask;
+		const uint32 shift;
+		Slot* const slots;
+		Table* const retired;
+
+		AA_FORBID_COPY_CTOR(Table);
+		AA_FORBID_ASSGN_OPR(Table);
+	};
+
+	// 分片, 按缓存行对齐, 避免不同分片的写操作互相干扰
+	// 写者持有mutex修改, 并用顺序计数器sequence通知读者; 读者只读不写, 遇到计数器变化时重读
+	struct alignas(64) Shard
+	{
+		std::atomic<uint32> sequence{0};
+		std::atomic<Table*> table{nullptr};
+		// 有效元素数, 仅在持有mutex时访问
+		uint32 alive = 0;
+		std::mutex mutex;
+	};
+
+	constexpr ClassPrivateHandleManager() {}
 public:
-	~ClassPrivateHandleManager() {}
+	~ClassPrivateHandleManager();
 
 	//创建一个内部类实例，这通常是在建立外部实例时进行调用的
 	void GetHandle(const T_Out* src, T_In* newObject = new T_In());
@@ -61,36 +137,335 @@ public:
 	//根据句柄获取外部实例，这通常是用于对C接口时的调用，C语言使用句柄
 	const T_Out* GetSourceByHandle(const T_In* in);
 	//根据句柄获取内部实例，所有外部对象的公有函数，都需要调用此函数才能访问内部数据
+	//本函数不加锁, 也不写入任何共享内存, 多线程同时查询不会产生缓存行争用
 	T_In* GetDataByHandle(const T_Out* out, bool noWonderNull = false);
 
 	//根据句柄获取内部实例，是GetDataByHandle的快捷调用法
 	T_In* operator[](const T_Out* out);
 
+	//所有分片中, 元素距其初始位置的最大探测步数, 用于检查散列分布
+	uint32 GetMaxProbeLength();
+
+	static ClassPrivateHandleManager<T_Out, T_In, mode>& getInstance();
+
+private:
+	static inline uint64 hashOf(const T_Out* out);
+	inline Shard& shardOf(uint64 hash){ return shards[hash >> 58 & (c_shardCount - 1)]; }
+	// 以下函数须在持有分片锁时调用
+	static void beginWrite(Shard& shard);
+	static void endWrite(Shard& shard);
+	static void insertLocked(Shard& shard, uint64 hash, const T_Out* out, T_In* in);
+	// isWriting为true时, 调用者已经进入写状态
+	static T_In* eraseLocked(Shard& shard, uint64 hash, const T_Out* out, bool isWriting = false);
+
+private:
+	Shard shards[c_shardCount];
+
+	static  ClassPrivateHandleManager<T_Out, T_In, mode> instance;
+
+	AA_FORBID_COPY_CTOR(ClassPrivateHandleManager);
+	AA_FORBID_ASSGN_OPR(ClassPrivateHandleManager);
+};
+
+// 旧的 std::map + 全局互斥锁 实现, 保留以便对比和回退
+template <class T_Out, class T_In>
+class ClassPrivateHandleManager<T_Out, T_In, HandleManagerMode::MapMutex>
+{
+	ClassPrivateHandleManager() :handleMap(), _mutex() {}
+public:
+	~ClassPrivateHandleManager() {}
+
+	void GetHandle(const T_Out* src, T_In* newObject = new T_In());
+	void MoveTo(const T_Out* oldOut, const T_Out* newOut);
+    T_In* ReleaseHandle(const T_Out* src);
+	const T_Out* GetSourceByHandle(const T_In* in);
+	T_In* GetDataByHandle(const T_Out* out, bool noWonderNull = false);
+	T_In* operator[](const T_Out* out);
 
-	static ClassPrivateHandleManager<T_Out, T_In>& getInstance();
+	static ClassPrivateHandleManager<T_Out, T_In, HandleManagerMode::MapMutex>& getInstance();
 
 private:
 	//内外实例以及句柄的表图, 为了保证线程安全性, 禁止外部获取此变量, 现已改为私有成员
 	std::map<const T_Out*, T_In*> handleMap;
 	std::mutex _mutex;
 
-	static  ClassPrivateHandleManager<T_Out, T_In> instance;
+	static  ClassPrivateHandleManager<T_Out, T_In, HandleManagerMode::MapMutex> instance;
 
 	AA_FORBID_COPY_CTOR(ClassPrivateHandleManager);
 	AA_FORBID_ASSGN_OPR(ClassPrivateHandleManager);
 };
 
 /******************************** Source Code *********************************/
+template <class T_Out, class T_In, HandleManagerMode mode>
+ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, mode> ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, mode>::instance;
+
+template <class T_Out, class T_In, HandleManagerMode mode>
+ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, mode>& ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, mode>::getInstance(){
+	return instance;
+}
+
+template <class T_Out, class T_In, HandleManagerMode mode>
+ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, mode>::~ClassPrivateHandleManager()
+{
+	// 静态析构顺序不确定, 析构后仍可能有查询, 因此把表指针置空, 之后的查询都将返回nullptr
+	for(uint32 i = 0; i < c_shardCount; ++i)
+	{
+		std::lock_guard<std::mutex> lock(shards[i].mutex);
+		delete shards[i].table.exchange(nullptr, std::memory_order_acq_rel);
+	}
+}
+
+template <class T_Out, class T_In, HandleManagerMode mode>
+uint64 ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, mode>::hashOf(const T_Out* out)
+{
+	// 对象地址的低位总是对齐的, 用乘法散列把地址打散到高位, 最高6位用于选择分片, 其下的位用于表内定位
+	return (uint64(uintptr_t(out)) >> 3) * 0x9E3779B97F4A7C15ull;
+}
+
+template <class T_Out, class T_In, HandleManagerMode mode>
+void ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, mode>::beginWrite(Shard& shard)
+{
+	// 计数器为奇数时表示正在写入
+	shard.sequence.store(shard.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+template <class T_Out, class T_In, HandleManagerMode mode>
+void ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, mode>::endWrite(Shard& shard)
+{
+	shard.sequence.store(shard.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+template <class T_Out, class T_In, HandleManagerMode mode>
+void ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, mode>::insertLocked(Shard& shard, uint64 hash, const T_Out* out, T_In* in)
+{
+	auto table = shard.table.load(std::memory_order_relaxed);
+	// 负载超过一半时扩容. 新表在发布之前对读者不可见, 因此填充新表时无需进入写状态
+	if(table == nullptr || (shard.alive + 1) * 2 > table->capacity)
+	{
+		auto newTable = new Table(table == nullptr ? c_initCapacity : table->capacity * 2, table);
+		if(table != nullptr)
+		{
+			for(uint32 i = 0; i < table->capacity; ++i)
+			{
+				auto key = table->slots[i].key.load(std::memory_order_relaxed);
+				if(key == nullptr)
+					continue;
+				auto pos = newTable->indexOf(hashOf(key));
+				while(newTable->slots[pos].key.load(std::memory_order_relaxed) != nullptr)
+					pos = (pos + 1) & newTable->mask;
+				newTable->slots[pos].value.store(table->slots[i].value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+				newTable->slots[pos].key.store(key, std::memory_order_relaxed);
+			}
+		}
+		shard.table.store(newTable, std::memory_order_release);
+		table = newTable;
+	}
+	auto pos = table->indexOf(hash);
+	while(table->slots[pos].key.load(std::memory_order_relaxed) != nullptr)
+		pos = (pos + 1) & table->mask;
+	// 插入空槽不会改变其他键的位置, 先写值再写键, 读者读到键时值必然已经可见
+	table->slots[pos].value.store(in, std::memory_order_relaxed);
+	table->slots[pos].key.store(out, std::memory_order_release);
+	++shard.alive;
+}
+
+template <class T_Out, class T_In, HandleManagerMode mode>
+T_In* ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, mode>::eraseLocked(Shard& shard, uint64 hash, const T_Out* out, bool isWriting)
+{
+	auto table = shard.table.load(std::memory_order_relaxed);
+	if(table == nullptr)
+		return nullptr;
+	auto i = table->indexOf(hash);
+	while(true)
+	{
+		auto key = table->slots[i].key.load(std::memory_order_relaxed);
+		if(key == nullptr)
+			return nullptr;
+		if(key == out)
+			break;
+		i = (i + 1) & table->mask;
+	}
+	auto result = table->slots[i].value.load(std::memory_order_relaxed);
+	// 后移删除: 把后续探测链上的元素前移填补空位, 这样表中永远没有墓碑
+	// 元素移动期间读者可能漏读, 所以整个过程处于写状态, 读者会据此重读
+	if(!isWriting)
+		beginWrite(shard);
+	auto j = i;
+	while(true)
+	{
+		j = (j + 1) & table->mask;
+		auto key = table->slots[j].key.load(std::memory_order_relaxed);
+		if(key == nullptr)
+			break;
+		auto home = table->indexOf(hashOf(key));
+		// home 循环地落在 (i, j] 区间内时, 该元素不能前移到i
+		if(i <= j ? (i < home && home <= j) : (i < home || home <= j))
+			continue;
+		table->slots[i].value.store(table->slots[j].value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		table->slots[i].key.store(key, std::memory_order_relaxed);
+		i = j;
+	}
+	table->slots[i].key.store(nullptr, std::memory_order_relaxed);
+	table->slots[i].value.store(nullptr, std::memory_order_relaxed);
+	if(!isWriting)
+		endWrite(shard);
+	--shard.alive;
+	return result;
+}
+
+template <class T_Out, class T_In, HandleManagerMode mode>
+void ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, mode>::GetHandle(const T_Out* src, T_In* newObject)
+{
+	auto hash = hashOf(src);
+	auto& shard = shardOf(hash);
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		//设置句柄，创建内部实例，并关联到外部实例
+		if(GetDataByHandle(src, true) == nullptr)
+		{
+			insertLocked(shard, hash, src, newObject);
+			return;
+		}
+	}
+	throw std::out_of_range("the handle has been existed");
+}
+
+template <class T_Out, class T_In, HandleManagerMode mode>
+void ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, mode>::MoveTo(const T_Out* oldOut, const T_Out* newOut)
+{
+	auto oldHash = hashOf(oldOut);
+	auto newHash = hashOf(newOut);
+	auto& oldShard = shardOf(oldHash);
+	auto& newShard = shardOf(newHash);
+	// 两个分片按地址顺序加锁, 避免与反向的移动死锁
+	auto first = &oldShard < &newShard ? &oldShard : &newShard;
+	auto second = &oldShard < &newShard ? &newShard : &oldShard;
+	std::lock_guard<std::mutex> firstLock(first->mutex);
+	std::unique_lock<std::mutex> secondLock;
+	if(second != first)
+		secondLock = std::unique_lock<std::mutex>(second->mutex);
+	// 删除和插入期间两个分片都处于写状态, 无锁读者会等到移动完成后再读, 不会出现新旧句柄都查不到的情况
+	beginWrite(*first);
+	if(second != first)
+		beginWrite(*second);
+	auto strp = eraseLocked(oldShard, oldHash, oldOut, true);
+	if(strp != nullptr)
+		insertLocked(newShard, newHash, newOut, strp);
+	if(second != first)
+		endWrite(*second);
+	endWrite(*first);
+	AAAssert(strp != nullptr,);
+}
+
+template <class T_Out, class T_In, HandleManagerMode mode>
+T_In* ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, mode>::ReleaseHandle(const T_Out* src)
+{
+	auto hash = hashOf(src);
+	auto& shard = shardOf(hash);
+	//销毁内部实例，解除关联
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	return eraseLocked(shard, hash, src);
+}
+
+template <class T_Out, class T_In, HandleManagerMode mode>
+const T_Out* ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, mode>::GetSourceByHandle(const T_In* in)
+{
+	for(uint32 i = 0; i < c_shardCount; ++i)
+	{
+		std::lock_guard<std::mutex> lock(shards[i].mutex);
+		auto table = shards[i].table.load(std::memory_order_relaxed);
+		if(table == nullptr)
+			continue;
+		for(uint32 n = 0; n < table->capacity; ++n)
+		{
+			auto key = table->slots[n].key.load(std::memory_order_relaxed);
+			if(key != nullptr && table->slots[n].value.load(std::memory_order_relaxed) == in)
+				return key;
+		}
+	}
+	return nullptr;
+}
+
+template <class T_Out, class T_In, HandleManagerMode mode>
+T_In* ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, mode>::GetDataByHandle(const T_Out* out, bool noWonderNull)
+{
+	auto hash = hashOf(out);
+	auto& shard = shardOf(hash);
+	T_In* result = nullptr;
+	while(true)
+	{
+		auto sequence = shard.sequence.load(std::memory_order_acquire);
+		if(sequence & 1)
+			continue;
+		result = nullptr;
+		auto table = shard.table.load(std::memory_order_acquire);
+		if(table != nullptr)
+		{
+			auto pos = table->indexOf(hash);
+			while(true)
+			{
+				auto key = table->slots[pos].key.load(std::memory_order_acquire);
+				if(key == out)
+				{
+					result = table->slots[pos].value.load(std::memory_order_relaxed);
+					break;
+				}
+				if(key == nullptr)
+					break;
+				pos = (pos + 1) & table->mask;
+			}
+		}
+		// 期间没有发生后移删除, 则读到的结果可信
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(shard.sequence.load(std::memory_order_relaxed) == sequence)
+			break;
+	}
+	if(result == nullptr && !noWonderNull)
+		AAAssert(false, nullptr);
+	return result;
+}
+
+template <class T_Out, class T_In, HandleManagerMode mode>
+T_In* ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, mode>::operator[](const T_Out* out)
+{
+	return GetDataByHandle(out);
+}
+
+template <class T_Out, class T_In, HandleManagerMode mode>
+uint32 ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, mode>::GetMaxProbeLength()
+{
+	uint32 result = 0;
+	for(uint32 i = 0; i < c_shardCount; ++i)
+	{
+		std::lock_guard<std::mutex> lock(shards[i].mutex);
+		auto table = shards[i].table.load(std::memory_order_relaxed);
+		if(table == nullptr)
+			continue;
+		for(uint32 n = 0; n < table->capacity; ++n)
+		{
+			auto key = table->slots[n].key.load(std::memory_order_relaxed);
+			if(key == nullptr)
+				continue;
+			auto length = (n - table->indexOf(hashOf(key))) & table->mask;
+			if(length > result)
+				result = length;
+		}
+	}
+	return result;
+}
+
+/*************************** Source Code (MapMutex) ***************************/
 template <class T_Out, class T_In>
-ArmyAnt::ClassPrivateHandleManager<T_Out, T_In> ArmyAnt::ClassPrivateHandleManager<T_Out, T_In>::instance;
+ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, HandleManagerMode::MapMutex> ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, HandleManagerMode::MapMutex>::instance;
 
 template <class T_Out, class T_In>
-ArmyAnt::ClassPrivateHandleManager<T_Out, T_In>& ArmyAnt::ClassPrivateHandleManager<T_Out, T_In>::getInstance(){
+ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, HandleManagerMode::MapMutex>& ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, HandleManagerMode::MapMutex>::getInstance(){
 	return instance;
 }
 
 template <class T_Out, class T_In>
-void ArmyAnt::ClassPrivateHandleManager<T_Out, T_In>::GetHandle(const T_Out* src, T_In* newObject)
+void ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, HandleManagerMode::MapMutex>::GetHandle(const T_Out* src, T_In* newObject)
 {
 	_mutex.lock();
     //设置句柄，创建内部实例，并关联到外部实例
@@ -106,12 +481,13 @@ void ArmyAnt::ClassPrivateHandleManager<T_Out, T_In>::GetHandle(const T_Out* src
 }
 
 template <class T_Out, class T_In>
-void ArmyAnt::ClassPrivateHandleManager<T_Out, T_In>::MoveTo(const T_Out* oldOut, const T_Out* newOut){
+void ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, HandleManagerMode::MapMutex>::MoveTo(const T_Out* oldOut, const T_Out* newOut){
 	_mutex.lock();
 	auto ret = handleMap.find(oldOut);
 	if(ret == handleMap.end()){
 		_mutex.unlock();
 		AAAssert(false,);
+		return;
 	}
 	auto strp = ret->second;
 	handleMap.erase(ret);
@@ -120,7 +496,7 @@ void ArmyAnt::ClassPrivateHandleManager<T_Out, T_In>::MoveTo(const T_Out* oldOut
 }
 
 template <class T_Out, class T_In>
-T_In* ArmyAnt::ClassPrivateHandleManager<T_Out, T_In>::ReleaseHandle(const T_Out* src)
+T_In* ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, HandleManagerMode::MapMutex>::ReleaseHandle(const T_Out* src)
 {
 	_mutex.lock();
 	auto ret = handleMap.find(src);
@@ -137,7 +513,7 @@ T_In* ArmyAnt::ClassPrivateHandleManager<T_Out, T_In>::ReleaseHandle(const T_Out
 }
 
 template <class T_Out, class T_In>
-const T_Out* ArmyAnt::ClassPrivateHandleManager<T_Out, T_In>::GetSourceByHandle(const T_In* in)
+const T_Out* ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, HandleManagerMode::MapMutex>::GetSourceByHandle(const T_In* in)
 {
 	_mutex.lock();
     for (auto i = handleMap.begin(); i != handleMap.end(); ++i)
@@ -152,7 +528,7 @@ const T_Out* ArmyAnt::ClassPrivateHandleManager<T_Out, T_In>::GetSourceByHandle(
 }
 
 template <class T_Out, class T_In>
-T_In* ArmyAnt::ClassPrivateHandleManager<T_Out, T_In>::GetDataByHandle(const T_Out* out, bool noWonderNull)
+T_In* ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, HandleManagerMode::MapMutex>::GetDataByHandle(const T_Out* out, bool noWonderNull)
 {
 	_mutex.lock();
 	auto ret = handleMap.find(out);
@@ -162,12 +538,13 @@ T_In* ArmyAnt::ClassPrivateHandleManager<T_Out, T_In>::GetDataByHandle(const T_O
 			AAAssert(false, nullptr);
 		return nullptr;
 	}
+	auto result = ret->second;
 	_mutex.unlock();
-	return ret->second;
+	return result;
 }
 
 template <class T_Out, class T_In>
-T_In* ArmyAnt::ClassPrivateHandleManager<T_Out, T_In>::operator[](const T_Out* out)
+T_In* ArmyAnt::ClassPrivateHandleManager<T_Out, T_In, HandleManagerMode::MapMutex>::operator[](const T_Out* out)
 {
 	return GetDataByHandle(out);
 }
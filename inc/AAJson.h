@@ -40,6 +40,10 @@ enum class EJsonValueType : uint8{
 	Array
 };
 
+class JsonParser;
+class JsonSerializer;
+class JsonValue;
+
 class ARMYANTLIB_API JsonUnit{
 public:
 	JsonUnit(){};
@@ -49,7 +53,7 @@ public:
     virtual uint64 toJsonString(char*str)const = 0;
     virtual String toJsonString()const = 0;
     virtual uint64 getJsonStringLength()const = 0;
-	virtual bool fromJsonString(const char*str)=0;
+	virtual bool fromJsonString(StringView str)=0;
 	virtual EJsonValueType getType()const=0;
 	/*virtual bool isObject()const final;
 	virtual bool isDefined()const final;
@@ -61,10 +65,17 @@ public:
 	virtual bool operator !=(const JsonUnit&value)const;*/
 
 public:
-	static JsonUnit* create(const char*value);
+	/*	* 单次扫描解析整段JSON文本, 根据第一个非空白字符决定节点类型
+		* 解析失败时返回nullptr, 若errorOffset不为空, 则写入出错位置相对于value开头的字节偏移; 成功时写入-1
+		* 文本为null时同样返回nullptr, 此时errorOffset为-1
+		*/
+	static JsonUnit* create(StringView value, int64* errorOffset = nullptr);
 	static bool release(JsonUnit*& ptr);
 
 private:
+	friend class JsonParser;
+	friend class JsonSerializer;
+	friend class JsonValue;
 	bool isCreated = false;
 };
 
@@ -77,13 +88,16 @@ public:
 	virtual uint64 toJsonString(char*str)const override;
     virtual String toJsonString()const override;
     virtual uint64 getJsonStringLength()const override;
-	virtual bool fromJsonString(const char*str)override;
+	virtual bool fromJsonString(StringView str)override;
 	virtual EJsonValueType getType()const override{ return EJsonValueType::Boolean; };
 
 public:
 	bool getBoolean()const;
 
 private:
+	friend class JsonParser;
+	friend class JsonSerializer;
+	friend class JsonValue;
 	bool value;
 };
 
@@ -96,7 +110,7 @@ public:
 	virtual uint64 toJsonString(char*str)const override;
     virtual String toJsonString()const override;
     virtual uint64 getJsonStringLength()const override;
-	virtual bool fromJsonString(const char*str)override;
+	virtual bool fromJsonString(StringView str)override;
 	virtual EJsonValueType getType()const override{ return EJsonValueType::Numeric; }
 
 public:
@@ -105,6 +119,9 @@ public:
 	virtual double getDouble()const;
 
 private:
+	friend class JsonParser;
+	friend class JsonSerializer;
+	friend class JsonValue;
 	union{
 		int32 ivalue;
 		int64 lvalue;
@@ -123,13 +140,16 @@ public:
 	virtual uint64 toJsonString(char*str)const override;
     virtual String toJsonString()const override;
     virtual uint64 getJsonStringLength()const override;
-	virtual bool fromJsonString(const char*str)override;
+	virtual bool fromJsonString(StringView str)override;
 	virtual EJsonValueType getType()const override{ return EJsonValueType::String; };
 
 public:
 	const char* getString()const;
 
 private:
+	friend class JsonParser;
+	friend class JsonSerializer;
+	friend class JsonValue;
 	String value;
 };
 
@@ -142,7 +162,7 @@ public:
 	virtual uint64 toJsonString(char*str)const override;
     virtual String toJsonString()const override;
     virtual uint64 getJsonStringLength()const override;
-	virtual bool fromJsonString(const char*str)override;
+	virtual bool fromJsonString(StringView str)override;
 	virtual EJsonValueType getType()const override;
 
 public:
@@ -161,7 +181,7 @@ public:
 	virtual uint64 toJsonString(char*str)const override;
     virtual String toJsonString()const override;
     virtual uint64 getJsonStringLength()const override;
-	virtual bool fromJsonString(const char*str)override;
+	virtual bool fromJsonString(StringView str)override;
 
 public:
 	virtual JsonUnit* getChild(const char*key)override;
@@ -180,11 +200,11 @@ public:
 class JsonException : public std::exception
 {
 public:
-	JsonException(const char* msg)
+	JsonException(const char* msg, int64 offset = -1)
 #ifdef OS_WINDOWS
-		:std::exception(msg) {}
+		:std::exception(msg), offset(offset) {}
 #else
-		: std::exception(), message(msg) {}
+		: std::exception(), message(msg), offset(offset) {}
 #ifdef OS_BSD
     virtual const char* what()const _NOEXCEPT override
 #else
@@ -194,6 +214,13 @@ public:
 protected:
 	String message;
 #endif
+
+public:
+	// 解析错误所在的字节偏移, 与文本位置无关的异常为-1
+	int64 getOffset()const { return offset; }
+
+protected:
+	int64 offset;
 };
 
 
@@ -0,0 +1,101 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ */
+
+#ifndef AA_JSON_DOCUMENT_H_2026_10_17
+#define AA_JSON_DOCUMENT_H_2026_10_17
+
+#include "AAJson.h"
+
+namespace ArmyAnt{
+
+struct JsonNode;
+class JsonDocument;
+class JsonSerializer;
+
+/*	* JsonDocument 中节点的只读视图, 只包含一个指针, 可以按值传递
+	* 访问接口与 JsonObject / JsonArray / JsonNumeric 等保持一致, 类型不符时返回空值或0
+	* 视图在所属文档被 clear, 重新 parse 或析构后失效
+	*/
+class ARMYANTLIB_API JsonValue{
+public:
+	JsonValue() :node(nullptr){}
+
+public:
+	// 空视图返回 EJsonValueType::Undefined
+	EJsonValueType getType()const;
+	bool isNull()const;
+	bool getBoolean()const;
+	int32 getInteger()const;
+	int64 getLong()const;
+	double getDouble()const;
+	// 字符串保存在文档的内存池中, 以'\0'结尾
+	const char* getString()const;
+	StringView getStringView()const;
+
+public:
+	// 对象的成员数或数组的元素数
+	uint32 size()const;
+	JsonValue getChild(StringView key)const;
+	JsonValue getChild(int32 index)const;
+	// 按顺序访问对象的成员
+	StringView getKey(uint32 index)const;
+	JsonValue getValue(uint32 index)const;
+
+public:
+	String toJsonString()const;
+	// 复制为可修改的 JsonUnit 树, 使用完毕后需调用 JsonUnit::release 释放
+	JsonUnit* toJsonUnit()const;
+
+	explicit operator bool()const{ return node != nullptr; }
+
+private:
+	friend class JsonDocument;
+	friend class JsonSerializer;
+	JsonValue(const JsonNode*node) :node(node){}
+	const JsonNode* node;
+};
+
+/*	* 使用内存池存放整棵树的 JSON 文档
+	* 所有节点都是紧凑的定长结构, 对象的成员是连续的键值对数组, 数组的元素是连续的节点数组, 字符串也分配在内存池中
+	* 释放整个文档只需重置一次内存池
+	*/
+class ARMYANTLIB_API JsonDocument{
+public:
+	JsonDocument(uint64 chunkSize = 64 * 1024);
+	~JsonDocument();
+
+public:
+	// 解析前会先清空文档. 失败时返回false, 若errorOffset不为空, 写入出错的字节偏移
+	bool parse(StringView str, int64* errorOffset = nullptr);
+	JsonValue getRoot()const;
+	// 重置内存池, 保留最近一块内存供下次解析使用
+	void clear();
+	// 内存池当前占用的字节数
+	uint64 getMemoryUsage()const;
+
+	AA_FORBID_COPY_CTOR(JsonDocument);
+	AA_FORBID_ASSGN_OPR(JsonDocument);
+};
+
+}
+
+#endif // AA_JSON_DOCUMENT_H_2026_10_17
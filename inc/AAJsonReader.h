@@ -0,0 +1,95 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ */
+
+#ifndef AA_JSON_READER_H_2026_10_17
+#define AA_JSON_READER_H_2026_10_17
+
+#include "AAJson.h"
+#include "AAIStream.h"
+
+namespace ArmyAnt{
+
+enum class EJsonReadEvent : uint8{
+	NeedMore,		// 已有的输入不足以读出下一个事件, 需要继续 feed
+	StartObject,
+	EndObject,
+	StartArray,
+	EndArray,
+	Key,
+	String,
+	Numeric,
+	Boolean,
+	Null,
+	End,			// 输入已经结束, 且最后一个值是完整的
+	Error
+};
+
+/*	* 拉取式的 JSON 读取器, 每次调用 next 读出一个事件, 不构建节点树
+	* 只缓存还未读完的那一个记号 (字符串或数字) 和一块输入, 内存占用与整个输入的大小无关
+	* 有两种输入方式:
+	*	无参构造: 调用者通过 feed 分块提供数据, 如在 TCPClient 的接收回调中直接传入收到的数据, 输入全部提供后调用 finish
+	*	StaticStream: 从流的当前位置开始按块读取, next 不会返回 NeedMore
+	* 一个值读完后, 如果还有输入, 会继续读下一个值, 因此也可以读取按行分隔的多条 JSON 记录
+	* 出错后读取器停止, 之后的 next 都返回 Error
+	*/
+class ARMYANTLIB_API JsonReader{
+public:
+	JsonReader();
+	JsonReader(StaticStream& stream, uint32 chunkSize = 64 * 1024);
+	~JsonReader();
+
+public:
+	// 追加一块输入, 流模式或已调用 finish 时返回false. 数据会被复制, 调用后即可释放. 调用后上一个事件的字符串视图失效
+	bool feed(const void* data, uint64 length);
+	// 标记输入结束, 此后末尾不完整的值会被当作错误
+	void finish();
+	// 读出下一个事件. 上一个事件的字符串视图在此调用之后失效
+	EJsonReadEvent next();
+	// 跳过一个值, 之后的 next 返回这个值之后的事件
+	// 在 Key 事件后调用, 跳过这个键对应的值; 在 StartObject 或 StartArray 事件后调用, 跳过这个容器余下的内容
+	void skipValue();
+
+public:
+	// 最近一次 next 返回的事件
+	EJsonReadEvent getEvent()const;
+	// 当前所在容器的层数, 顶层为0
+	uint32 getDepth()const;
+	// Key 或 String 事件的内容, 已处理转义
+	StringView getStringView()const;
+	bool getBoolean()const;
+	int32 getInteger()const;
+	int64 getLong()const;
+	double getDouble()const;
+	// 数值是否为小数或超出 int64 范围
+	bool isDouble()const;
+	// 已经读过的字节数
+	uint64 getOffset()const;
+	// 出错时, 出错位置从输入开头算起的字节偏移; 没有出错时为-1
+	int64 getErrorOffset()const;
+
+	AA_FORBID_COPY_CTOR(JsonReader);
+	AA_FORBID_ASSGN_OPR(JsonReader);
+};
+
+}
+
+#endif // AA_JSON_READER_H_2026_10_17
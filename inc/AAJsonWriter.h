@@ -0,0 +1,80 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ */
+
+#ifndef AA_JSON_WRITER_H_2026_10_17
+#define AA_JSON_WRITER_H_2026_10_17
+
+#include "AAJsonDocument.h"
+#include "AAIStream.h"
+
+namespace ArmyAnt{
+
+/*	* 单次遍历的流式 JSON 序列化器, 可用于 JsonUnit 树和 JsonDocument 中的 JsonValue
+	* 根据构造方式不同, 输出到以下目标之一:
+	*	无参构造: 不输出, 只统计长度
+	*	String: 追加到字符串末尾, 按需增长
+	*	定长缓冲区: 写满后 write 返回 false, 调用者取走缓冲区的内容后调用 resume 继续, 直到返回 true
+	*	StaticStream: 先写入内部缓冲区, 缓冲区满时写入流, 结束时自动 flush
+	* 使用定长缓冲区可以分块发送很大的 JSON, 无需在内存中保留完整的序列化结果, 如:
+	*	JsonWriter writer(buffer, sizeof(buffer));
+	*	bool finished = writer.write(json);
+	*	server.send(index, buffer, writer.getBufferedLength());
+	*	while(!finished){
+	*		finished = writer.resume(buffer, sizeof(buffer));
+	*		server.send(index, buffer, writer.getBufferedLength());
+	*	}
+	* 序列化过程中不能修改被序列化的树
+	*/
+class ARMYANTLIB_API JsonWriter{
+public:
+	JsonWriter();
+	JsonWriter(String& output);
+	JsonWriter(char* buffer, uint64 capacity);
+	JsonWriter(StaticStream& stream, uint32 bufferSize = 4096);
+	~JsonWriter();
+
+public:
+	// 序列化一个节点, nullptr 或空视图输出 null. 全部输出完成时返回true
+	// 返回false时, 若 isPending 为true, 表示定长缓冲区已满; 否则表示写入流失败
+	// 上一次的输出还未完成时调用, 会丢弃未完成的部分
+	bool write(const JsonUnit* unit);
+	bool write(JsonValue value);
+	// 换用新的定长缓冲区 (也可以是已取走内容的同一块缓冲区), 继续未完成的输出, 返回值同 write
+	bool resume(char* buffer, uint64 capacity);
+	// 将内部缓冲区中的数据写入流, 仅对 StaticStream 有效
+	bool flush();
+
+public:
+	// 是否有等待 resume 的输出
+	bool isPending()const;
+	// 最近一次 write 或 resume 写入当前定长缓冲区的字节数
+	uint64 getBufferedLength()const;
+	// 最近一次 write 开始以来输出的总字节数, 不包括'\0'
+	uint64 getWrittenLength()const;
+
+	AA_FORBID_COPY_CTOR(JsonWriter);
+	AA_FORBID_ASSGN_OPR(JsonWriter);
+};
+
+}
+
+#endif // AA_JSON_WRITER_H_2026_10_17
@@ -23,12 +23,86 @@
 #ifndef AALOG_H_20180524
 #define AALOG_H_20180524
 
+#include <cstring>
 #include <iostream>
+#include <string>
+#include <type_traits>
+#include <vector>
 #include "AADefine.h"
 #include "AA_start.h"
 
 namespace ArmyAnt{
 
+// Argument encoding of deferred-format logs, each argument is a 1-byte type followed by its raw bytes
+// The logging thread and Logger::decodeBinaryLog decode them by the same rule
+namespace LogArgument{
+
+enum class Type : uint8{
+	Int = 1,		// int64
+	UInt = 2,		// uint64
+	Double = 3,		// double
+	String = 4,		// uint32 length + bytes, without the trailing 0
+	Char = 5,		// 1 byte
+	Bool = 6,		// 1 byte
+};
+
+inline uint32 getLength(bool){ return 2; }
+inline uint32 getLength(char){ return 2; }
+inline uint32 getLength(const char* value){ return 5 + (value == nullptr ? 0 : uint32(strlen(value))); }
+inline uint32 getLength(const std::string& value){ return 5 + uint32(value.size()); }
+template<class T>
+inline typename std::enable_if<std::is_arithmetic<T>::value, uint32>::type getLength(T){ return 9; }
+
+inline char* writeNumber(char* out, Type type, const void* value){
+	*out = char(type);
+	memcpy(out + 1, value, 8);
+	return out + 9;
+}
+inline char* writeString(char* out, const char* value, uint32 length){
+	*out = char(Type::String);
+	memcpy(out + 1, &length, 4);
+	if(length > 0)
+		memcpy(out + 5, value, length);
+	return out + 5 + length;
+}
+inline char* write(char* out, bool value){
+	out[0] = char(Type::Bool);
+	out[1] = value ? 1 : 0;
+	return out + 2;
+}
+inline char* write(char* out, char value){
+	out[0] = char(Type::Char);
+	out[1] = value;
+	return out + 2;
+}
+inline char* write(char* out, const char* value){ return writeString(out, value, value == nullptr ? 0 : uint32(strlen(value))); }
+inline char* write(char* out, const std::string& value){ return writeString(out, value.data(), uint32(value.size())); }
+template<class T>
+inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, char*>::type write(char* out, T value){
+	int64 number = value;
+	return writeNumber(out, Type::Int, &number);
+}
+template<class T>
+inline typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value, char*>::type write(char* out, T value){
+	uint64 number = value;
+	return writeNumber(out, Type::UInt, &number);
+}
+template<class T>
+inline typename std::enable_if<std::is_floating_point<T>::value, char*>::type write(char* out, T value){
+	double number = value;
+	return writeNumber(out, Type::Double, &number);
+}
+
+inline uint32 getTotalLength(){ return 0; }
+template<class First, class... Rest>
+inline uint32 getTotalLength(const First& first, const Rest&... rest){ return getLength(first) + getTotalLength(rest...); }
+
+inline char* writeAll(char* out){ return out; }
+template<class First, class... Rest>
+inline char* writeAll(char* out, const First& first, const Rest&... rest){ return writeAll(write(out, first), rest...); }
+
+} // namespace LogArgument
+
 class ARMYANTLIB_API Logger{
 public:
 	enum class AlertLevel : uint8{
@@ -42,17 +116,62 @@ public:
 	};
 	static const char*convertLevelToString(AlertLevel level);
 
+	// Format of a log file: plain text lines, or binary records that can be converted to text by decodeBinaryLog
+	enum class FileFormat : uint8{
+		Text = 0,
+		Binary = 1
+	};
+
+	// Compression of rotated log files
+	enum class Compression : uint8{
+		None = 0,
+		Gzip = 1,
+		Zstd = 2		// Only available when built with zstd (AA_LOG_ZSTD)
+	};
+
+	// Rolling of the log file. The active file always keeps the path given to setLogFile,
+	// a rotated file is renamed to "<path>.<yyyyMMdd-HHmmss>[.n]" and then compressed in a low-priority background thread
+	struct ARMYANTLIB_API Rotation{
+		uint64 maxFileSize;			// Rotate before a record would make the file exceed this size in bytes, 0 means no limit
+		uint32 intervalSeconds;		// Rotate at every multiple of this interval since the epoch (UTC), 0 means never
+		uint32 maxRetainedFiles;	// Rotated files kept besides the active one, older ones are deleted, 0 means keeping all
+		Compression compression;
+
+		Rotation();
+		static Rotation make(uint64 maxFileSize, uint32 intervalSeconds = 0, uint32 maxRetainedFiles = 0, Compression compression = Compression::None);
+		// Check whether the settings are valid and the compression is supported
+		bool isValid()const;
+	};
+
+	// Static format descriptor of a deferred-format log call site, registered once when constructed
+	// "{}" in the format string is replaced by the arguments in order
+	class ARMYANTLIB_API Format{
+	public:
+		Format(const char* format, AlertLevel level, const char* tag = nullptr);
+
+	public:
+		const AlertLevel level;
+		const uint32 id;
+
+		AA_FORBID_COPY_CTOR(Format);
+		AA_FORBID_ASSGN_OPR(Format);
+	};
+
 public:
 	Logger(const char* logFilePath = nullptr);
 	~Logger();
 
 public:
-	// Output log to std::cout
+	// Output log to std::cout, written by the logging thread together with the log file
 	void setConsoleLevel(AlertLevel level = AlertLevel::Import);
 	AlertLevel getConsoleLevel()const;
 
 	// Output log to a disk file
-	bool setLogFile(const char* path);
+	bool setLogFile(const char* path, FileFormat format = FileFormat::Text);
+	FileFormat getFileFormat()const;
+	// Rotation is done by the logging thread between two records, producers are never blocked
+	bool setRotation(const Rotation& rotation);
+	Rotation getRotation()const;
 	const char*getLogFilePath()const;
 	void setFileLevel(AlertLevel level = AlertLevel::Verbose);
 	AlertLevel getFileLevel()const;
@@ -68,7 +187,18 @@ public:
 	bool pushLogOnlyInConsole(const char* content, AlertLevel level, const char*tag = nullptr);
 	bool pushLogOnlyInFile(const char* content, AlertLevel level, const char*tag = nullptr);
 
+	// Deferred-format log: only copies the raw argument bytes and a timestamp, the text is produced by the logging thread,
+	// or not at all if the file is binary. Use AA_LOG_DEFERRED to skip evaluating the arguments of a filtered level
+	template<class... Args>
+	bool pushDeferredLog(const Format& format, const Args&... args);
+	// Whether a log of this level would be output anywhere
+	bool isLevelEnabled(AlertLevel level)const;
+
+	// Convert a binary log file to text lines
+	static bool decodeBinaryLog(const char* binaryPath, std::ostream& output);
+
 protected:
+	bool pushDeferredLogArguments(const Format& format, const char* arguments, uint32 length);
 	bool pushLogToConsole(const char* wholeContent);
 	bool pushLogToFile(const char* wholeContent);
 	bool pushLogToUserStream(const char* wholeContent);
@@ -78,7 +208,32 @@ protected:
 	AA_FORBID_ASSGN_OPR(Logger);
 };
 
+template<class... Args>
+inline bool Logger::pushDeferredLog(const Format & format, const Args&... args){
+	auto length = LogArgument::getTotalLength(args...);
+	// Arguments are usually short enough to be encoded on the stack
+	char stackBuffer[256];
+	std::vector<char> heapBuffer;
+	auto buffer = stackBuffer;
+	if(length > sizeof(stackBuffer)){
+		heapBuffer.resize(length);
+		buffer = heapBuffer.data();
+	}
+	LogArgument::writeAll(buffer, args...);
+	return pushDeferredLogArguments(format, buffer, length);
+}
+
 } // namespace ArmyAntServer 
 
+// Deferred-format log, the arguments are not evaluated when the level is filtered out
+// The format of a call site is registered the first time it runs, so level, tag and format must not change between calls
+#define AA_LOG_DEFERRED(logger, level, tag, format, ...) \
+	do{ \
+		if((logger).isLevelEnabled(level)){ \
+			static const ArmyAnt::Logger::Format aa_log_deferred_format(format, level, tag); \
+			(logger).pushDeferredLog(aa_log_deferred_format, ##__VA_ARGS__); \
+		} \
+	} while(0)
+
 
 #endif // AALOG_H_20180524
\ No newline at end of file
@@ -24,6 +24,7 @@
 #define AA_SOCKET_H_2016_3_28
 
 #include <functional>
+#include <memory>
 
 #include "AA_start.h"
 #include "AADefine.h"
@@ -170,6 +171,45 @@ public:
 	int code;
 };
 
+//用于零拷贝发送的数据块, 记录数据的地址和长度, 以及数据的释放方式
+//发送时数据块的所有权转交给Socket, 数据写出完成或失败后才释放, 在此之前调用者不得修改数据
+//数据块只能移动不能复制, 构造, 移动和释放都不会分配内存
+class ARMYANTLIB_API SendingBuffer{
+public:
+	//释放数据的回调, 参数分别为数据地址, 用户传入参数
+	typedef void(*Deleter)(const void*data, void*pUser);
+
+public:
+	SendingBuffer();
+	//引用调用者的数据, 写出完成或失败后调用deleter; deleter为空时, 调用者需自行保证数据在发送完成前有效
+	SendingBuffer(const void*data, uint64 len, Deleter deleter = nullptr, void*pUser = nullptr);
+	//接管数据的所有权, 写出完成或失败后以delete[]释放
+	SendingBuffer(std::unique_ptr<uint8[]> data, uint64 len);
+	//共享引用计数的数据, data和len可以只是owner所持有数据的一部分, 写出完成或失败后释放对owner的引用
+	SendingBuffer(std::shared_ptr<const void> owner, const void*data, uint64 len);
+	SendingBuffer(SendingBuffer&&moved);
+	~SendingBuffer();
+
+public:
+	SendingBuffer&operator=(SendingBuffer&&moved);
+
+public:
+	const void*getData()const;
+	uint64 getLength()const;
+	//立即释放数据, 此后数据块为空
+	void reset();
+
+private:
+	const void*data;
+	uint64 len;
+	Deleter deleter;
+	void*pUser;
+	std::shared_ptr<const void> owner;
+
+	AA_FORBID_COPY_CTOR(SendingBuffer);
+	AA_FORBID_ASSGN_OPR(SendingBuffer);
+};
+
 //作为通信操作的公共基类
 class ARMYANTLIB_API Socket
 {
@@ -178,6 +218,7 @@ class ARMYANTLIB_API Socket
 	// 因此建议回调中仅接收数据, 数据处理建议在另一线程中
 public:
 	//TCP服务器得到连接回调，参数分别为客户端IPv4, 客户端端口号, 用户传入参数, 服务器的客户端索引, 返回true表示接受连接, 返回false表示拒绝连接
+	//客户端索引在连接断开后即失效, 之后分配给新连接的索引不会与之相同(同一槽位被重复使用2048次后索引才会循环)
 	typedef std::function<bool(uint32 clientIndex, void*pUser)> ServerConnectCall;
 	//TCP服务器收到数据回调，参数分别为对方IPv4，对方端口号，数据包，数据包容量大小（不是数据包大小），用户传入参数
 	typedef std::function<void(uint32 clientIndex, const void*data, mac_uint datalen, void*pUser)> ServerGettingCall;
@@ -193,9 +234,24 @@ public:
 
 	//UDP收到数据回调，参数分别为对方IPv4，对方端口号，数据包，数据包容量大小（不是数据包大小），用户传入参数
 	typedef std::function<void(const IPAddr&addr, uint16 port, uint8*data, mac_uint datalen, void*pUser)> UDPGettingCall;
+	//UDP数据报, 用于批量收发. 批量接收时地址和数据都只在回调期间有效
+	struct UDPDatagram
+	{
+		const IPAddr* addr;
+		uint16 port;
+		const void* data;
+		mac_uint datalen;
+	};
+	//UDP批量收到数据回调, 参数分别为一次收到的一批数据报, 数据报的数量, 用户传入参数
+	typedef std::function<void(const UDPDatagram* datagrams, uint32 count, void*pUser)> UDPBatchGettingCall;
 
-	//异步发送回执
+	//异步发送回执, 每条消息写出完成或失败后调用一次, 失败时sendedSize为0
+	//由多个SendingBuffer组成的消息, 按顺序对每个数据块各调用一次, sendedData和len为该数据块的地址和长度
+	//写出失败意味着连接已断开, 不会再重试, 因此retriedTimes总为0, 返回值也不再使用
 	typedef std::function<bool(mac_uint sendedSize, uint32 retriedTimes, uint32 index, const void*sendedData, uint64 len, void* pUser)> SendingResp;
+	//发送队列状态回调, 参数为连接索引(客户端为0), 队列中待写出的字节数, 是否触及高水位, 用户传入参数
+	//队列触及高水位时调用一次(isOverHighWater为true), 之后回落到高水位的一半以下时再调用一次(isOverHighWater为false)
+	typedef std::function<void(uint32 index, uint64 queuedBytes, bool isOverHighWater, void* pUser)> SendingQueueCall;
 	//socket连接及连通时错误信息回调, 参数为 异常体, 对方地址, 对方端口, 出错的函数名
 	typedef std::function<void(const SocketException&err, const IPAddr&addr, uint16 port, String functionName, void*pUser)> ErrorInfoCall;
 
@@ -208,6 +264,64 @@ public:
 	{
 #include "AASocket_ProtocolTypes.txt"
 	};
+	//异步发送队列触及高水位时的处理方式
+	enum class SendingQueuePolicy :uint8
+	{
+		Block,	//阻塞发送者直到队列回落. 在反应器线程(即各回调)中发送时无法等待, 按Drop处理
+		Drop,	//丢弃本次发送的消息, 并报告错误
+		Signal	//照常入队, 只通过发送队列状态回调通知发送者
+	};
+	//TCP服务器使用的I/O后端
+	enum class IOBackend :uint8
+	{
+		Asio,		//boost::asio的反应器, 在Linux上即epoll
+		IOUring		//Linux的io_uring, 用多次触发的accept和recv接受连接和接收数据, 接收缓冲区注册到内核. 内核不支持时自动退回到Asio
+	};
+	//TCP接收数据的分帧方式. 分帧后收到数据回调每次给出一条完整的消息, 而不是一次读取到的任意片段
+	enum class FramingType :uint8
+	{
+		None,			//不分帧, 每次读取到的数据直接回调(默认)
+		FixedHeader,	//固定长度的消息头, 消息头中含有消息长度字段
+		Varint,			//消息以varint(每字节低7位有效, 低位在前)编码的长度开头
+		Delimiter		//消息以分隔符结尾
+	};
+	//分帧设定, 用make系列函数构造后可以再修改各字段
+	struct ARMYANTLIB_API Framing
+	{
+		FramingType type;
+		uint32 headerLen;			//FixedHeader: 消息头的总长度
+		uint32 lengthOffset;		//FixedHeader: 长度字段在消息头中的偏移
+		uint8 lengthBytes;			//FixedHeader: 长度字段的字节数, 可以是1, 2, 4, 8
+		bool isBigEndian;			//FixedHeader: 长度字段是否为网络字节序
+		bool isLengthWithHeader;	//FixedHeader: 长度字段的值是否包含消息头本身
+		bool isKeepingHeader;		//回调的数据是否保留消息头, 长度前缀或分隔符, 默认不保留
+		uint8 delimiterLen;			//Delimiter: 分隔符的长度, 1到8
+		char delimiter[8];			//Delimiter: 分隔符
+		uint32 maxMessageLen;		//消息体的最大长度, 默认16MB, 超过时报告错误并断开连接
+
+		Framing();
+		static Framing makeFixedHeader(uint32 headerLen = 4, uint32 lengthOffset = 0, uint8 lengthBytes = 4, bool isBigEndian = true, bool isLengthWithHeader = false);
+		static Framing makeVarint();
+		static Framing makeDelimiter(const char* delimiter, uint8 delimiterLen);
+		//检查设定是否有效
+		bool isValid()const;
+	};
+	//websocket的permessage-deflate压缩设定, 握手时与对方协商, 双方都提供时才会启用
+	struct ARMYANTLIB_API WebSocketDeflate
+	{
+		bool isEnabled;					//是否提供压缩扩展, 默认不提供
+		uint8 serverMaxWindowBits;		//服务器端压缩窗口大小(以2为底的对数), 9到15, 默认15. 窗口越小每个连接占用的内存越少, 压缩率也越低
+		uint8 clientMaxWindowBits;		//客户端压缩窗口大小, 同上
+		bool isServerNoContextTakeover;	//服务器端是否每条消息独立压缩, 独立压缩不需要在消息之间保留压缩上下文
+		bool isClientNoContextTakeover;	//客户端是否每条消息独立压缩
+		uint8 compLevel;				//压缩级别, 0到9, 默认8
+		uint8 memLevel;					//zlib内存级别, 1到9, 默认4
+
+		WebSocketDeflate();
+		static WebSocketDeflate makeEnabled(uint8 serverMaxWindowBits = 15, uint8 clientMaxWindowBits = 15, bool isNoContextTakeover = false);
+		//检查设定是否有效
+		bool isValid()const;
+	};
 	struct IPAddrInfo
 	{
 		const IPAddr* clientAddr;
@@ -221,6 +335,10 @@ public:
 	virtual bool setMaxIOBufferLen(uint32 len = 65530);
 	//设定异步发送回执回调
 	bool setSendingResponseCallBack(SendingResp sendingRespCB, void*pUser = nullptr);
+	//设定每个连接的异步发送队列的高水位(字节数)和触及高水位时的处理方式, 0表示不限制. 默认为64MB, Block
+	bool setSendingQueueLimit(uint64 highWaterBytes, SendingQueuePolicy policy = SendingQueuePolicy::Block);
+	//设定发送队列状态回调
+	bool setSendingQueueCallBack(SendingQueueCall sendingQueueCB, void*pUser = nullptr);
 	//设定错误报告回调. 如不设, 则出错时会抛出异常
 	bool setErrorReportCallBack(ErrorInfoCall errorReportCB, void*pUser = nullptr);
 
@@ -239,7 +357,9 @@ class ARMYANTLIB_API TCPServer :public Socket
 public:
 	//默认构造函数，参数为：
 	// nMaxConnNum：最大允许同时连接的数量
-	TCPServer(int32 maxConnNum = 65536);
+	// threadNum：反应器线程数, 每个线程运行独立的io_service, 连接会分配到其中一个线程上, 此后该连接的所有回调都在这个线程中执行
+	//            0表示与CPU核心数相同, 1(默认)表示所有连接共用一个线程. 多于1个时, 不同连接的回调会在不同线程中同时执行
+	TCPServer(int32 maxConnNum = 65536, uint32 threadNum = 1);
 
 	//析构函数不应负责关闭服务器，请调用者务必遵守调用规则,自行调用关闭服务器的函数,以此规范代码层次结构
 	virtual ~TCPServer(void);
@@ -257,6 +377,18 @@ public:
 	virtual bool setMaxConnNum(int32 maxClientNum);
 
 	virtual bool setMaxIOBufferLen(uint32 len = 65530) override;
+	//设定反应器线程数, 含义同构造函数的参数, 服务器运行期间不可设定
+	virtual bool setThreadNum(uint32 threadNum);
+	//设定接收数据的分帧方式, 对之后建立的连接生效, 服务器运行期间不可设定. websocket本身按消息接收, 不使用此设定
+	//完整的消息在接收缓冲区中直接回调, 不复制, 一次读取到的多条消息依次回调
+	virtual bool setFraming(const Framing& framing);
+	//设定连接超时(毫秒), 0表示不限制. readIdle: 超过此时间没有收到数据, 可用于清除半开连接; writeIdle: 超过此时间没有发出数据; lifetime: 连接建立后最长的存在时间
+	//超时的连接会回调ServerLostCall并断开, 精度为100毫秒. 服务器运行期间不可设定
+	virtual bool setIdleTimeout(uint32 readIdle, uint32 writeIdle = 0, uint32 lifetime = 0);
+	//设定I/O后端, 服务器运行期间不可设定. io_uring只用于普通TCP连接的接受和接收, websocket服务器和发送仍使用boost::asio
+	virtual bool setIOBackend(IOBackend backend);
+	//获取I/O后端, 服务器运行期间返回实际使用的后端, 即请求io_uring但内核不支持时返回Asio
+	IOBackend getIOBackend()const;
 
 public:
 	//以下是连接和实际收发操作
@@ -269,14 +401,22 @@ public:
 	virtual bool givenUpClient(uint32 index);
 	virtual bool givenUpClient(const IPAddr& addr, uint16 port);
 	virtual bool givenUpAllClients();
-	//向指定索引的客户端发送数据
+	//向指定索引的客户端发送数据, 数据会被复制
+	//异步发送的消息进入该连接的发送队列, 按发送顺序依次写出, 返回入队的字节数, 未能入队返回0
+	//同步发送会等待队列中之前的消息写出后再直接写出, 返回写出的字节数. 在反应器线程中发送且队列不空时, 改为复制后入队
 	virtual mac_uint send(uint32 index, void*data, uint64 len, bool isAsync = true);
+	//向指定索引的客户端发送数据块, 不复制数据, 数据块的所有权转交给服务器
+	virtual mac_uint send(uint32 index, SendingBuffer&&buffer, bool isAsync = true);
+	//将多个数据块按顺序合并为一次写出(如协议头和数据体), 不复制数据, 各数据块的所有权转交给服务器, buffers中的数据块将被清空
+	virtual mac_uint send(uint32 index, SendingBuffer*buffers, uint32 count, bool isAsync = true);
 
 public:
 	//以下是获取状态
 
 	//获取最大可连接的客户端数
 	virtual int getMaxConnNum() const;
+	//获取反应器线程数, 服务器运行期间返回实际的线程数
+	virtual uint32 getThreadNum() const;
 	//获取当前连接的客户端数
 	virtual int getNowConnNum() const;
 	//根据索引获取对应客户端的基本信息
@@ -285,6 +425,8 @@ public:
 	virtual void getAllClients(IPAddrInfo* ref) const;
 	//根据地址和端口号获取客户端索引
 	virtual int getIndexByAddrPort(const IPAddr& clientAddr, uint16 port);
+	//获取指定客户端的发送队列深度, 包括正在写出的消息, 索引无效时返回false
+	virtual bool getSendingQueueDepth(uint32 index, uint32&messageCount, uint64&byteCount) const;
 	//服务器是否正在监听
 	virtual bool isStarting() const;
 
@@ -314,6 +456,8 @@ public:
 	virtual bool setLostServerCallBack(ClientLostCall disconnCB, void*pUser);
 	//设定收到信息回调
 	virtual bool setGettingCallBack(ClientGettingCall recvCB, void*pUser = nullptr);
+	//设定接收数据的分帧方式, 规则与TCPServer::setFraming相同, 连接期间不可设定
+	virtual bool setFraming(const Framing& framing);
 
 public:
 	//以下是连接和实际收发操作
@@ -324,8 +468,12 @@ public:
     virtual bool connectServer(uint16 port, bool isAsync, ClientConnectCall asyncConnectCallBack = nullptr, void* asyncConnectCallData = nullptr);
 	//断开连接
 	virtual bool disconnectServer(uint32 waitTime);
-	//向服务器发送消息
+	//向服务器发送消息, 数据会被复制. 发送队列的规则与TCPServer::send相同
 	virtual mac_uint send(const void*pBuffer, size_t len, bool isAsync = false);
+	//向服务器发送数据块, 不复制数据, 数据块的所有权转交给客户端
+	virtual mac_uint send(SendingBuffer&&buffer, bool isAsync = false);
+	//将多个数据块按顺序合并为一次写出, 不复制数据, 各数据块的所有权转交给客户端, buffers中的数据块将被清空
+	virtual mac_uint send(SendingBuffer*buffers, uint32 count, bool isAsync = false);
 
 public:
 	//以下是获取状态
@@ -338,6 +486,8 @@ public:
 	virtual uint16 getLocalPort()const;
 	//是否在连接状态
 	virtual bool isConnection() const;
+	//获取发送队列深度, 包括正在写出的消息, 未连接时返回false
+	virtual bool getSendingQueueDepth(uint32&messageCount, uint64&byteCount) const;
 
 	AA_FORBID_COPY_CTOR(TCPClient);
 	AA_FORBID_ASSGN_OPR(TCPClient);
@@ -356,13 +506,20 @@ public:
 public:
 	//设定收到信息回调
 	bool setGettingCallBack(UDPGettingCall recvCB, void*pUser = nullptr);
+	//设定批量收到信息回调, 设定后收到的数据报按批回调, 不再逐个调用收到信息回调
+	bool setBatchGettingCallBack(UDPBatchGettingCall recvCB, void*pUser = nullptr);
+	//设定一次最多接收的数据报数, 监听期间不可设定. 接收缓冲区在开始监听时一次分配, 大小为此数量乘以setMaxIOBufferLen设定的单个数据报最大长度
+	//Linux下一次系统调用(recvmmsg)即可收取一批数据报, 其他系统逐个收取后合为一批回调
+	bool setBatchSize(uint32 batchSize = 32);
 
 	//以下是实际收发操作
 
-	//开始监听
-	bool startListening(bool isIPv4 = true);
+	//开始监听, port为0时由系统分配端口
+	bool startListening(bool isIPv4 = true, uint16 port = 0);
 	//向指定地址和端口发送（无须初始化套接字）
 	mac_uint send(const IPAddr& addr, uint16 port, void*data, size_t len, bool isAsync = false);
+	//批量发送数据报, 同步进行, 返回成功发出的数据报数. Linux下一次系统调用(sendmmsg)即可发出多个数据报
+	uint32 send(const UDPDatagram* datagrams, uint32 count);
 	//关闭收发端口套接字
 	bool stopListening(uint32 waitTime);
 
@@ -371,15 +528,18 @@ public:
 
 	//UDP是否正在监听
 	bool isListening() const;
+	//获取本地端口, 未打开套接字时返回0
+	uint16 getLocalPort() const;
 
 	AA_FORBID_COPY_CTOR(UDPSilgle);
 	AA_FORBID_ASSGN_OPR(UDPSilgle);
 };
 
 // 用于WebSocket的服务器类
+// 每收到一条完整的websocket消息回调一次ServerGettingCall, 数据位于连接复用的接收缓冲区中, 只在回调期间有效
 class ARMYANTLIB_API TCPWebSocketServer : public TCPServer{
 public:
-	TCPWebSocketServer(int32 maxConnNum = 65536);
+	TCPWebSocketServer(int32 maxConnNum = 65536, uint32 threadNum = 1);
 	virtual ~TCPWebSocketServer();
 
 public:
@@ -387,12 +547,16 @@ public:
 	virtual bool start(uint16 port, bool ipv6 = false) override;
 	//停止服务器，关闭套接字和所有传入连接,输入参数为最大等待时间，超过此时限就强制关闭线程
 	virtual bool stop(uint32 waitTime) override;
+	//设定permessage-deflate压缩, 只能在服务器启动前设定, 此后建立的连接在握手时协商
+	bool setDeflate(const WebSocketDeflate& deflate);
 	//断开客户端
 	//virtual bool givenUpClient(uint32 index) override;
 	//virtual bool givenUpClient(const IPAddr& addr, uint16 port) override;
 	//virtual bool givenUpAllClients() override;
-	//向指定索引的客户端发送数据
+	//向指定索引的客户端发送数据, 每次发送作为一条websocket消息
 	virtual mac_uint send(uint32 index, void*data, uint64 len, bool isAsync = true) override;
+	virtual mac_uint send(uint32 index, SendingBuffer&&buffer, bool isAsync = true) override;
+	virtual mac_uint send(uint32 index, SendingBuffer*buffers, uint32 count, bool isAsync = true) override;
 
 };
 
@@ -405,7 +569,11 @@ public:
     // 连接到websocket服务器, 第一个参数port无效, 因为websocket客户端不能指定本地端口
     virtual bool connectServer(uint16 port, bool isAsync, ClientConnectCall asyncConnectCallBack = nullptr, void* asyncConnectCallData = nullptr) override;
 	virtual bool disconnectServer(uint32 waitTime) override;
+	//设定permessage-deflate压缩, 只能在连接前设定
+	bool setDeflate(const WebSocketDeflate& deflate);
 	virtual mac_uint send(const void*pBuffer, size_t len, bool isAsync = false) override;
+	virtual mac_uint send(SendingBuffer&&buffer, bool isAsync = false) override;
+	virtual mac_uint send(SendingBuffer*buffers, uint32 count, bool isAsync = false) override;
 	
 };
 
@@ -47,32 +47,32 @@ public:
 	virtual int64 getViewsCount()=0;
 	virtual int64 getTableNameList(ArmyAnt::String*&tables, uint32 maxCount = 0)=0;
 	virtual int64 getViewNameList(ArmyAnt::String*&views, uint32 maxCount = 0)=0;
-    virtual SqlTable getWholeTable(const String&tableName);
-    virtual SqlTable getWholeView(const String&tableName);
+    virtual SqlTable getWholeTable(StringView tableName);
+    virtual SqlTable getWholeView(StringView tableName);
 	virtual int64 getTableAllFields(const ArmyAnt::String&table, ArmyAnt::String*&fields, uint32 maxCount = 0) = 0;
 
 public:
     // select * from [tableName]
-    virtual SqlTable select(const String&tableName, const SqlClause*clauses = nullptr, int clausesNum = 0);
+    virtual SqlTable select(StringView tableName, const SqlClause*clauses = nullptr, int clausesNum = 0);
     // select [columnNames] from [tableName]
-    virtual SqlTable select( const String&tableName, const String*columnNames, int columnNum, const SqlClause*clauses = nullptr, int clausesNum = 0);
+    virtual SqlTable select( StringView tableName, const String*columnNames, int columnNum, const SqlClause*clauses = nullptr, int clausesNum = 0);
     // update [tableName] set [updatedData ( k=value , k=value ... )]
-    virtual int64 update(const String&tableName, const SqlRow&updatedData, const SqlClause*clauses = nullptr, int clausesNum = 0);
+    virtual int64 update(StringView tableName, const SqlRow&updatedData, const SqlClause*clauses = nullptr, int clausesNum = 0);
     // insert into [tableName] [insertedData (k , k , k ... ) values ( value , value , value ... )]
-    virtual int64 insertRow(const String&tableName, const SqlRow&insertedData);
+    virtual int64 insertRow(StringView tableName, const SqlRow&insertedData);
     // alter table [tableName] add [columnHead name dataType (others)...]
-    virtual int64 insertColumn(const String&tableName, const SqlFieldHead&columnHead);
-    virtual int64 insertColumn(const String&tableName, const SqlColumn&column);
+    virtual int64 insertColumn(StringView tableName, const SqlFieldHead&columnHead);
+    virtual int64 insertColumn(StringView tableName, const SqlColumn&column);
     // delete from [tableName]
-    virtual int64 deleteRow(const String&tableName, const SqlClause*where = nullptr);
+    virtual int64 deleteRow(StringView tableName, const SqlClause*where = nullptr);
     // alter table [tableName] drop column [columnName]
-    virtual int64 deleteColumn(const String&tableName, const String&columnName);
+    virtual int64 deleteColumn(StringView tableName, StringView columnName);
 
 public:
-    virtual int64 createDatabase(const String&dbName);
-    virtual int64 deleteDatabase(const String&dbName);
-    virtual int64 createTable(const String&tableName, const SqlColumn&column, const SqlTableInfo*tableInfo = nullptr);
-    virtual int64 deleteTable(const String&tableName);
+    virtual int64 createDatabase(StringView dbName);
+    virtual int64 deleteDatabase(StringView dbName);
+    virtual int64 createTable(StringView tableName, const SqlColumn&column, const SqlTableInfo*tableInfo = nullptr);
+    virtual int64 deleteTable(StringView tableName);
 
 public:
     virtual String organizeColumnInfo(const SqlFieldHead&column);
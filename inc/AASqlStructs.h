@@ -268,11 +268,11 @@ private:
 // SQL表达式类
 class ARMYANTLIB_API SqlExpress{
 public:
-    SqlExpress(const String&str="");
+    SqlExpress(StringView str = "");
     ~SqlExpress();
 
 public:
-    bool pushValue(const String& value);
+    bool pushValue(StringView value);
     bool pushValues(const String*values, uint32 num);
     bool removeValue(uint32 index);
     bool clear();
@@ -285,7 +285,7 @@ public:
 class ARMYANTLIB_API SqlClause
 {
 public:
-    SqlClause(const String&str = "");
+    SqlClause(StringView str = "");
     ~SqlClause();
 
 public:
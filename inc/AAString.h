@@ -25,6 +25,7 @@
 
 #include "AA_start.h"
 #include "AADefine.h"
+#include "AAStringView.h"
 #include <iostream>
 #include <cstring>
 
@@ -50,7 +51,8 @@ public:
     String(const int64&num);
     String(double num, int32 behindFloat = -1);
     String(const String&value);
-    String(String&&_moved);
+    String(const StringView&value);
+    String(String&&_moved) noexcept;
     ~String();
 
 public:
@@ -67,6 +69,10 @@ public:
 public:
     bool encode(Encoding encode);
     void clear();
+    // 预留至少 newCapacity 字节的容量 (不含结尾的'\0'), 不会缩小已有容量
+    void reserve(uint64 newCapacity);
+    uint64 capacity()const;
+    String& append(const char*value, uint64 length);
     String& upsideDown();
     uint64 copyTo(char*dest, uint64 maxLength = 0);
 
@@ -127,6 +133,8 @@ public:
     String getReplaced(const char*src, const String&tar)const;
     String getReplaced(const char*src, const char*tar)const;
 
+    // 返回引用自身数据的视图, 不复制字符. 视图在本字符串被修改或析构后失效
+    StringView getSubView(int64 start, int64 end = 0)const;
     String getSubString(int64 start)const;
     String getSubString(int64 start, int64 end)const;
     String getSubString(int64 start, char endc)const;
@@ -153,6 +161,7 @@ public:
 public:
     // overloaded operators
     String& operator=(const String&value);
+    String& operator=(String&&_moved) noexcept;
     String& operator=(const char*value);
     String& operator=(char c);
     String& operator=(int64 value);
@@ -162,15 +171,19 @@ public:
     bool operator!=(const String&value)const;
     bool operator==(const char*value)const;
     bool operator!=(const char*value)const;
+    bool operator==(const StringView&value)const;
+    bool operator!=(const StringView&value)const;
 	operator const char*()const;
     bool operator!()const;
     String operator+(const String&value)const;
     String operator+(const char*value)const;
+    String operator+(const StringView&value)const;
     String operator+(char c)const;
     String operator+(int64 value)const;
     String operator+(double value)const;
     String& operator+=(const String&value);
     String& operator+=(const char*value);
+    String& operator+=(const StringView&value);
     String& operator+=(char c);
     String& operator+=(int64 value);
     String& operator+=(double value);
@@ -247,6 +260,41 @@ private:
 	const char* v;
 #endif
 	void resetValue();
+
+private:
+	/*	* 短字符串优化: 长度不超过 c_shortCapacity (64位下为22) 的内容直接存放在对象内部, 不进行堆分配
+		* 两种存储方式共用同一块内存, 以最后一个字节区分: 短模式下为字符串长度, 长模式下为 c_longFlag
+		*/
+	struct LongStorage{
+		char* data;
+		uint64 length;
+		uint32 capacityLow;
+		uint16 capacityHigh;
+		uint8 reserved;
+		uint8 flag;
+	};
+	static const uint8 c_longFlag = 0xFF;
+	static const uint64 c_shortCapacity = sizeof(LongStorage) - 2;
+	struct ShortStorage{
+		char data[c_shortCapacity + 1];
+		uint8 length;
+	};
+
+	bool isLong()const;
+	char* buffer();
+	const char* buffer()const;
+	void setLength(uint64 length);
+	void setLongCapacity(uint64 newCapacity);
+	void assign(const char*value, uint64 length);
+	void grow(uint64 minCapacity);
+	void releaseStorage();
+	// 替换所有不重叠的 src, 替换后不变长时原地进行
+	bool replaceAll(StringView src, StringView tar);
+
+	union{
+		LongStorage heap;
+		ShortStorage local;
+	};
 };
 
 String ARMYANTLIB_API operator+(const char*value, const String&str);
@@ -257,6 +305,8 @@ String ARMYANTLIB_API operator-(int headLength, const String&str);
 bool ARMYANTLIB_API operator==(const char*cstr, const String&str);
 bool ARMYANTLIB_API operator!=(const char*cstr, const String&str);
 
+inline StringView::StringView(const String&str) :head(str.c_str()), length(str.size()){}
+
 
 template<class Type_Num>
 inline bool String::itoa(char * str, Type_Num num)
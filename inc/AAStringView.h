@@ -0,0 +1,87 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ */
+
+#ifndef AA_STRING_VIEW_H_2026_10_17
+#define AA_STRING_VIEW_H_2026_10_17
+
+#include "AA_start.h"
+#include "AADefine.h"
+#include <cstring>
+
+namespace ArmyAnt
+{
+
+class String;
+
+/*	* 非拥有的字符串视图, 只保存指向外部字符数据的指针和长度, 截取和分割都不会复制字符
+	* 视图内容不保证以'\0'结尾, 使用者需自行保证被引用的数据在视图使用期间有效
+	*/
+class ARMYANTLIB_API StringView
+{
+public:
+	StringView() :head(""), length(0){}
+	StringView(const char*str) :head(str == nullptr ? "" : str), length(str == nullptr ? 0 : strlen(str)){}
+	StringView(const char*str, uint64 len) :head(str == nullptr ? "" : str), length(str == nullptr ? 0 : len){}
+	StringView(const String&str);
+
+public:
+	const char* data()const{ return head; }
+	uint64 size()const{ return length; }
+	bool empty()const{ return length == 0; }
+	char operator[](uint64 index)const{ return head[index]; }
+	// 负数下标表示从末尾倒数
+	char getChar(int64 index)const{ return head[index < 0 ? int64(length) + index : index]; }
+
+public:
+	int64 find(char c, uint64 start = 0)const;
+	int64 find(StringView str, uint64 start = 0)const;
+	int64 findLast(char c)const;
+	bool startsWith(StringView str)const;
+	bool endsWith(StringView str)const;
+	int32 compare(StringView str)const;
+	static const int64 c_npos = -1;
+
+	// 截取规则与 String::subString 相同: 负数的start从末尾倒数, end小于等于0时从末尾倒数
+	StringView subView(int64 start, int64 end = 0)const;
+	StringView trimFront()const;
+	StringView trimBack()const;
+	StringView trim()const;
+	// 按分隔符分割, 最多写入maxCount段到results中, 返回总段数. results为nullptr时只计数
+	uint32 split(char separator, StringView*results, uint32 maxCount)const;
+
+	int32 toInteger()const;
+	int64 toLong()const;
+	double toDemical()const;
+
+public:
+	bool operator==(StringView str)const{ return length == str.length && memcmp(head, str.head, length) == 0; }
+	bool operator!=(StringView str)const{ return !operator==(str); }
+	bool operator<(StringView str)const{ return compare(str) < 0; }
+
+private:
+	const char* head;
+	uint64 length;
+};
+
+}
+
+#endif // AA_STRING_VIEW_H_2026_10_17
@@ -31,9 +31,29 @@ namespace ArmyAnt{
 
 namespace TimeUtilities{
 
+// ǰʱı, "Sat Oct 17 13:32:52 2026", з. ȡÿʽһεĻ
 ArmyAnt::String ARMYANTLIB_API getTimeStamp();
+// ǰʱ, 1970
 int64 ARMYANTLIB_API getCurrentTime();
 
+// ʱ(), ϵͳʱӰ, ֻڼʱ
+int64 ARMYANTLIB_API getMonotonicNanoseconds();
+// ȷǽʱ, 1970
+int64 ARMYANTLIB_API getWallNanoseconds();
+// Եǽʱ(), ɺ̨߳ÿһ, ȡֻһԭӶ
+// 1ûжȡʱֹ̨߳ͣ, ֮ĵһζȡֱȡȷʱ䲢
+// һεñ, formatCoarseTimeStampticksToNanosecondsʱ̨߳, ̨߳Լ1У׼ʱ
+int64 ARMYANTLIB_API getCoarseWallNanoseconds();
+// getCoarseWallNanosecondsʱı(ʽͬgetTimeStamp)дout, out32ֽ, زβ0ĳ
+// ıɺ̨߳ÿʽһ, ʱֻ, 
+uint32 ARMYANTLIB_API formatCoarseTimeStamp(char* out);
+
+// CPUʱ(x86Ϊrdtsc), getMonotonicNanoseconds, ڲ̵ܶʱ
+// CPUֺ֧㶨Ƶʵʱʱ, ͬgetMonotonicNanoseconds
+int64 ARMYANTLIB_API getTicks();
+// getTicksĲΪ, ɺ̨߳ʱУ׼, У׼֮ǰʱʱ
+int64 ARMYANTLIB_API ticksToNanoseconds(int64 ticks);
+
 }
 
 }
@@ -75,6 +75,7 @@
 #include "AAConfiguration.h"
 // The JSON file encoder and decoder
 #include "AAJson.h"
+#include "AAJsonWriter.h"
 
 // Mathematic library classes
 #include "AAMath.h"
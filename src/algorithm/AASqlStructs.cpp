@@ -449,7 +449,7 @@ class SqlExpress_inner{
     std::vector<String> expresses;
 };
 
-SqlExpress::SqlExpress(const String & str)
+SqlExpress::SqlExpress(StringView str)
     :type(SqlOperatorType::none){
     AA_SQL_EXPRESS_HANDLE_MANAGER.GetHandle(this);
     AAAssert(pushValue(str), );
@@ -459,7 +459,7 @@ SqlExpress::~SqlExpress(){
     delete AA_SQL_EXPRESS_HANDLE_MANAGER.ReleaseHandle(this);
 }
 
-bool SqlExpress::pushValue(const String & value){
+bool SqlExpress::pushValue(StringView value){
     // TODO
     return false;
 }
@@ -472,10 +472,10 @@ class SqlClause_inner{
 };
 
 
-SqlClause::SqlClause(const String & str)
+SqlClause::SqlClause(StringView str)
     :type(SqlClauseType::Null){
     AA_SQL_CLAUSE_HANDLE_MANAGER.GetHandle(this);
-    AAAssert(pushExpress(SqlExpress(str)));
+    AAAssert(pushExpress(SqlExpress(str)), );
 }
 
 SqlClause::~SqlClause(){
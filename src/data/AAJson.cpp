@@ -26,10 +26,11 @@
 #include "../../inc/ArmyAntLib.h"
 #include "../../inc/AAClassPrivateHandle.hpp"
 #include "../../inc/AAString.h"
+#include "../../inc/AAJsonWriter.h"
+#include "AAJson_Private.hxx"
+#include "AAJsonScanner.hxx"
 
 #include <inttypes.h>
-#include <vector>
-#include <map>
 #include <boost/lexical_cast.hpp>
 
 
@@ -37,154 +38,248 @@
 
 namespace ArmyAnt {
 
-static const char* sg_spaceCleans[] = {"\r","\n"," ","\t"};
-static const int sg_spaceCleanLen = 4;
-static inline JsonException getWrongFormatException(){
-    return JsonException("");
-};
+/*	* 单次扫描的递归下降JSON解析器, 构建 JsonUnit 节点树
+	* 根据当前第一个非空白字符决定值的类型, 直接在扫描过程中构建节点树, 不生成中间字符串
+	* 出错时抛出带有字节偏移的 JsonException. 为了兼容旧的数据, 字符串和键也可以使用单引号
+	* null 值在容器中以 nullptr 表示
+	*/
+class JsonParser : public JsonScanner {
+public:
+	JsonParser(StringView str) :JsonScanner(str) {}
 
-struct JO_Private {
-	EJsonValueType type;
-	union{
-		std::map<String, JsonUnit*>* object;
-		std::vector<JsonUnit*>* array;
-	}children;
 public:
-	JO_Private(){
-		children.object = nullptr;
-		type = EJsonValueType::Object;
+	// 解析整段文本中唯一的一个值, 值后面只允许出现空白
+	JsonUnit* parseDocument() {
+		skipSpace();
+		auto ret = parseValue(0);
+		if (!expectEnd()) {
+			JsonUnit::release(ret);
+			fail("unexpected content after the json value");
+		}
+		return ret;
 	}
 
-	~JO_Private() {}
+	// 以下 parseXXXDocument 用于各类型的 fromJsonString, 将整段文本解析到已有的节点中
+	void parseObjectDocument(JsonObject* node) {
+		skipSpace();
+		if (cur >= end || *cur != '{')
+			fail("expected '{'");
+		parseObject(node, 0);
+		if (!expectEnd())
+			fail("unexpected content after the json object");
+	}
 
-	void initChildren(){
-		if(children.object != nullptr)
-			return;
-		if(type == EJsonValueType::Object)
-			children.object = new std::map<String, JsonUnit*>();
-		else
-			children.array = new std::vector<JsonUnit*>();
+	void parseArrayDocument(JsonArray* node) {
+		skipSpace();
+		if (cur >= end || *cur != '[')
+			fail("expected '['");
+		parseArray(node, 0);
+		if (!expectEnd())
+			fail("unexpected content after the json array");
 	}
-	void recycleChildren(){
-		if(children.object != nullptr){
-			if(type == EJsonValueType::Object){
-				for(auto i = children.object->begin(); i != children.object->end(); ++i){
-					if(i->second != nullptr)
-						JsonUnit::release(i->second);
+
+	void parseStringDocument(JsonString* node) {
+		skipSpace();
+		String value;
+		parseString(value);
+		if (!expectEnd())
+			fail("unexpected content after the json string");
+		node->value = std::move(value);
+	}
+
+	void parseBooleanDocument(JsonBoolean* node) {
+		skipSpace();
+		node->value = parseBoolean();
+		if (!expectEnd())
+			fail("unexpected content after the json boolean");
+	}
+
+	void parseNumericDocument(JsonNumeric* node) {
+		skipSpace();
+		parseNumeric(node);
+		if (!expectEnd())
+			fail("unexpected content after the json number");
+	}
+
+private:
+	template <class T_Node>
+	static T_Node* createNode() {
+		auto ret = new T_Node();
+		ret->isCreated = true;
+		return ret;
+	}
+
+	JsonUnit* parseValue(uint32 depth) {
+		if (cur >= end)
+			fail("unexpected end of input");
+		switch (*cur) {
+			case '{': {
+				auto ret = createNode<JsonObject>();
+				parseChildren(ret, depth);
+				return ret;
+			}
+			case '[': {
+				auto ret = createNode<JsonArray>();
+				parseChildren(ret, depth);
+				return ret;
+			}
+			case '"':
+			case '\'': {
+				auto ret = createNode<JsonString>();
+				try {
+					parseString(ret->value);
+				} catch (JsonException&) {
+					delete ret;
+					throw;
 				}
-				delete children.object;
-			} else{
-				for(auto i = children.array->begin(); i != children.array->end(); ++i){
-					JsonUnit::release(*i);
+				return ret;
+			}
+			case 't':
+			case 'f': {
+				auto value = parseBoolean();
+				auto ret = createNode<JsonBoolean>();
+				ret->value = value;
+				return ret;
+			}
+			case 'n':
+				if (!skipWord("null", 4))
+					fail("invalid literal");
+				return nullptr;
+			default: {
+				if (*cur != '-' && (*cur < '0' || *cur > '9'))
+					fail("unexpected character");
+				auto ret = createNode<JsonNumeric>();
+				try {
+					parseNumeric(ret);
+				} catch (JsonException&) {
+					delete ret;
+					throw;
 				}
-				delete children.array;
+				return ret;
 			}
-			children.object = nullptr;
 		}
 	}
 
-	static std::pair<String, String> cutKeyValue(String str) {
-		str.clearBothSides(sg_spaceCleans, sg_spaceCleanLen);
-		char isSingleKey = str[0];
-		if (str[0] != '"' && str[0] != '\'')
-			throw getWrongFormatException();
-		String key = "";
-		size_t count = 1;
-		while (count < str.size()) {
-			if (str[count] == isSingleKey)
-				break;
-			else
-				key += str[count++];
+	// 解析容器内容, 出错时释放已经构建的部分
+	template <class T_Node>
+	void parseChildren(T_Node* node, uint32 depth) {
+		JsonUnit* unit = node;
+		try {
+			parseContainer(node, depth);
+		} catch (JsonException&) {
+			JsonUnit::release(unit);
+			throw;
 		}
-        str.clearBothSides(sg_spaceCleans, sg_spaceCleanLen);
-        str.subString(int(count + 1));
-		if (str[0] != ':')
-			throw getWrongFormatException();
-        str.subString(1);
-        str.clearBothSides(sg_spaceCleans, sg_spaceCleanLen);
-		return std::make_pair(key, str);
 	}
 
-	static std::vector<String> CutByComma(const String&value) {
-		String str = value;
-        str.clearBothSides(sg_spaceCleans, sg_spaceCleanLen);
-        std::vector<String> ret;
-		String tmp = "";
-		bool isInSingleString = false;
-		bool isInDoubleString = false;
-		int deepInArray = 0;
-		int deepInObject = 0;
-		for (int32 i = 0; i < str.size(); i++) {
-			if (str[i] == '\'' && !isInDoubleString) {
-				if (isInSingleString) {
-					if (i == 0 || str[i - 1] != '\\')
-						isInSingleString = false;
-				} else
-					isInSingleString = true;
-			} else if (str[i] == '"' && !isInSingleString) {
-				if (isInDoubleString) {
-					if (i == 0 || str[i - 1] != '\\')
-						isInDoubleString = false;
-				} else
-					isInDoubleString = true;
-			} else if (str[i] == '[' && !isInSingleString && !isInDoubleString)
-				++deepInArray;
-			else if (str[i] == '{' && !isInSingleString && !isInDoubleString)
-				++deepInObject;
-			else if (str[i] == ']' && !isInSingleString && !isInDoubleString)
-				--deepInArray;
-			else if (str[i] == '}' && !isInSingleString && !isInDoubleString)
-				--deepInObject;
-			if (deepInArray < 0 || deepInObject < 0)
-				throw getWrongFormatException();
-			if (deepInArray == 0 && deepInObject == 0 && !isInSingleString && !isInDoubleString && str[i] == ',') {
-				ret.push_back(tmp);
-				tmp = "";
-                str.clearBothSides(sg_spaceCleans, sg_spaceCleanLen);
-                str.subString(int(i + 1));
-                i = -1;
-			} else
-				tmp += str[i];
-		}
-		ret.push_back(tmp);
-		return ret;
+	void parseContainer(JsonArray* node, uint32 depth) {
+		parseArray(node, depth);
 	}
-};
 
-JsonUnit * JsonUnit::create(const char * value) {
-	JsonUnit* i = new JsonObject();
-	if (i->fromJsonString(value)) {
-		i->isCreated = true;
-		return i;
+	void parseContainer(JsonObject* node, uint32 depth) {
+		parseObject(node, depth);
 	}
-	delete i;
-	i = new JsonArray();
-	if (i->fromJsonString(value)) {
-		i->isCreated = true;
-		return i;
+
+	void parseObject(JsonObject* node, uint32 depth) {
+		if (depth >= c_maxDepth)
+			fail("json nesting is too deep");
+		auto hd = AA_HANDLE_MANAGER[node];
+		hd->recycleChildren();
+		hd->initChildren();
+		auto& children = *(hd->children.object);
+		++cur;
+		skipSpace();
+		if (cur < end && *cur == '}') {
+			++cur;
+			return;
+		}
+		while (true) {
+			if (cur >= end || (*cur != '"' && *cur != '\''))
+				fail("expected a key string");
+			String key;
+			parseString(key);
+			skipSpace();
+			if (cur >= end || *cur != ':')
+				fail("expected ':'");
+			++cur;
+			skipSpace();
+			auto child = parseValue(depth + 1);
+			// 重复的键以最后一个为准
+			auto inserted = children.insert(std::make_pair(std::move(key), child));
+			if (!inserted.second) {
+				JsonUnit::release(inserted.first->second);
+				inserted.first->second = child;
+			}
+			skipSpace();
+			if (cur >= end)
+				fail("unexpected end of input in json object");
+			if (*cur == ',') {
+				++cur;
+				skipSpace();
+			} else if (*cur == '}') {
+				++cur;
+				return;
+			} else
+				fail("expected ',' or '}'");
+		}
 	}
-	delete i;
-	i = new JsonString();
-	if (i->fromJsonString(value)) {
-		i->isCreated = true;
-		return i;
+
+	void parseArray(JsonArray* node, uint32 depth) {
+		if (depth >= c_maxDepth)
+			fail("json nesting is too deep");
+		auto hd = AA_HANDLE_MANAGER[node];
+		hd->recycleChildren();
+		hd->initChildren();
+		auto& children = *(hd->children.array);
+		++cur;
+		skipSpace();
+		if (cur < end && *cur == ']') {
+			++cur;
+			return;
+		}
+		while (true) {
+			children.push_back(parseValue(depth + 1));
+			skipSpace();
+			if (cur >= end)
+				fail("unexpected end of input in json array");
+			if (*cur == ',') {
+				++cur;
+				skipSpace();
+			} else if (*cur == ']') {
+				++cur;
+				return;
+			} else
+				fail("expected ',' or ']'");
+		}
 	}
-	delete i;
-	i = new JsonBoolean();
-	if (i->fromJsonString(value)) {
-		i->isCreated = true;
-		return i;
+
+	void parseNumeric(JsonNumeric* node) {
+		auto token = JsonScanner::parseNumeric();
+		node->whatvalue = token.kind;
+		node->rightLength = token.rightLength;
+		if (token.kind == 3)
+			node->value.dvalue = token.value.dvalue;
+		else if (token.kind == 2)
+			node->value.lvalue = token.value.lvalue;
+		else {
+			node->value.lvalue = token.value.lvalue;
+			node->value.ivalue = int32(token.value.lvalue);
+		}
 	}
-    String cst = value;
-    cst.clearBothSides(sg_spaceCleans, sg_spaceCleanLen);
-	delete i;
-	i = new JsonNumeric();
-	if (i->fromJsonString(value)) {
-		i->isCreated = true;
-		return i;
+};
+
+JsonUnit * JsonUnit::create(StringView value, int64* errorOffset) {
+	JsonParser parser(value);
+	try {
+		auto ret = parser.parseDocument();
+		if (errorOffset != nullptr)
+			*errorOffset = -1;
+		return ret;
+	} catch (JsonException& e) {
+		if (errorOffset != nullptr)
+			*errorOffset = e.getOffset();
+		return nullptr;
 	}
-	delete i;
-	return nullptr;
 }
 
 bool JsonUnit::release(JsonUnit* & ptr) {
@@ -221,15 +316,12 @@ uint64 JsonBoolean::getJsonStringLength() const {
 	return value ? 5 : 6;
 }
 
-bool JsonBoolean::fromJsonString(const char * str) {
-    String strtmp = str;
-    strtmp.clearBothSides(sg_spaceCleans, sg_spaceCleanLen);
-	if (strtmp == "true")
-		value = true;
-	else if (strtmp == "false")
-		value = false;
-	else
+bool JsonBoolean::fromJsonString(StringView str) {
+	try {
+		JsonParser(str).parseBooleanDocument(this);
+	} catch (JsonException&) {
 		return false;
+	}
 	return true;
 }
 
@@ -246,24 +338,12 @@ JsonNumeric::~JsonNumeric() {
 }
 
 uint64 JsonNumeric::toJsonString(char*str) const {
-	char tmpstr[64] = "";
 	if (str == nullptr)
-		str = tmpstr;
-	switch (whatvalue) {
-		case 1:
-			sprintf(str, "%d", value.ivalue);
-			break;
-		case 2:
-			sprintf(str, "%lld", value.lvalue);
-			break;
-		case 3:
-			sprintf(tmpstr, "%%.%df", rightLength);
-			sprintf(str, tmpstr, value.dvalue);
-			break;
-		default:
-			return 0;
-	}
-	return strlen(str);
+		return whatvalue == 0 ? 0 : getJsonStringLength() - 1;
+	JsonWriter writer(str, AA_UINT64_MAX);
+	writer.write(this);
+	str[writer.getWrittenLength()] = '\0';
+	return writer.getWrittenLength();
 }
 
 String JsonNumeric::toJsonString() const
@@ -274,44 +354,33 @@ String JsonNumeric::toJsonString() const
             return value.ivalue;
         case 2:
             return value.lvalue;
-        case 3:
-            return String(value.dvalue, rightLength);
+        case 3:{
+            char text[32];
+            formatJsonDouble(text, value.dvalue);
+            return text;
+        }
         default:
             return nullptr;
     }
 }
 
 uint64 JsonNumeric::getJsonStringLength() const {
-	switch (whatvalue) {
-		case 1:
-			return String(value.ivalue).size() + 1;
-		case 2:
-			return String(value.lvalue).size() + 1;
-		case 3:
-			return String(int64(value.dvalue)).size() + 1 + rightLength + 1;
-		default:
-			return 0;
-	}
+	if (whatvalue == 0)
+		return 0;
+	JsonWriter counter;
+	counter.write(this);
+	return counter.getWrittenLength() + 1;
 }
 
-bool JsonNumeric::fromJsonString(const char * str)
+bool JsonNumeric::fromJsonString(StringView str)
 {
-    String strtmp = str;
-    strtmp.clearBothSides(sg_spaceCleans, sg_spaceCleanLen);
-    if (strtmp.isFloat())
+    try
     {
-        value.dvalue = strtmp.toDemical();
-        whatvalue = 3;
+        JsonParser(str).parseNumericDocument(this);
     }
-    else
+    catch (JsonException&)
     {
-        value.lvalue = strtmp.toLong();
-        if (value.lvalue <= AA_INT32_MAX)
-        {
-            value.ivalue = int32(value.lvalue);
-            whatvalue = 1;
-        }
-        else whatvalue = 2;
+        return false;
     }
     return true;
 }
@@ -336,30 +405,32 @@ JsonString::~JsonString() {
 }
 
 uint64 JsonString::toJsonString(char*str) const {
-	if (str != nullptr) 
-		strcpy(str, ('"'+value+'"').c_str());
-	return value.size() + 3;
+	if (str == nullptr)
+		return getJsonStringLength();
+	JsonWriter writer(str, AA_UINT64_MAX);
+	writer.write(this);
+	str[writer.getWrittenLength()] = '\0';
+	return writer.getWrittenLength() + 1;
 }
 
 String JsonString::toJsonString() const
 {
-    return '"' + value + '"';
+    String ret;
+    ret.reserve(getEscapedLength(value) + 2);
+    JsonWriter(ret).write(this);
+    return ret;
 }
 
 uint64 JsonString::getJsonStringLength() const {
-	return value.size() + 3;
+	return getEscapedLength(value) + 3;
 }
 
-bool JsonString::fromJsonString(const char*str) {
-	String realValue = str;
-	realValue.clearBothSides(sg_spaceCleans, sg_spaceCleanLen);
-	if(realValue[0] != '"' || realValue.getChar(-1) != '"'){
-		if(realValue[0] != '\'' || realValue.getChar(-1) != '\''){
-			return false;
-		}
+bool JsonString::fromJsonString(StringView str) {
+	try {
+		JsonParser(str).parseStringDocument(this);
+	} catch (JsonException&) {
+		return false;
 	}
-    realValue.subString(1,-1);
-	value = realValue;
     return true;
 }
 
@@ -379,66 +450,32 @@ JsonObject::~JsonObject() {
 uint64 JsonObject::toJsonString(char * str) const {
 	if (str == nullptr)
 		return 0;
-    auto ret = toJsonString();
-	strcpy(str, ret.c_str());
-	return ret.size();
+	JsonWriter writer(str, AA_UINT64_MAX);
+	writer.write(this);
+	str[writer.getWrittenLength()] = '\0';
+	return writer.getWrittenLength();
 }
 
 String JsonObject::toJsonString() const
 {
-    auto hd = AA_HANDLE_MANAGER[this];
-	hd->initChildren();
-    String ret = "{";
-    for (auto i = hd->children.object->begin(); ;)
-    {
-        ret += '"' + i->first + '"' + ':';
-        if (i->second->getJsonStringLength() > 0)
-        {
-            ret += i->second->toJsonString();
-        }
-        ++i;
-        if (i != hd->children.object->end())
-            ret += ",";
-        else break;
-    }
-    ret += "}";
+    String ret;
+    JsonWriter(ret).write(this);
     return ret;
 }
 
 uint64 JsonObject::getJsonStringLength() const {
-	auto hd = AA_HANDLE_MANAGER[this];
-	hd->initChildren();
-	uint64 length = 3;
-	for (auto i = hd->children.object->begin(); i != hd->children.object->end(); ++i) {
-		length += 3 + i->first.size() + i->second->getJsonStringLength();
-	}
-	return length;
+	JsonWriter counter;
+	counter.write(this);
+	return counter.getWrittenLength() + 1;
 }
 
-bool JsonObject::fromJsonString(const char * str)
+bool JsonObject::fromJsonString(StringView str)
 {
-    String stdstr = str;
-    stdstr.clearBothSides(sg_spaceCleans, sg_spaceCleanLen);
-    if (stdstr[0] != '{' || stdstr.getChar(-1) != '}')
-        return false;
-    if (!stdstr.subString(1, -2))
-        return false;
-    if (!stdstr.clearBothSides(sg_spaceCleans, sg_spaceCleanLen))
-        return false;
-    auto hd = AA_HANDLE_MANAGER[this];
-	hd->initChildren();
-    hd->children.object->clear();
-    if (stdstr != "")
-        try
+    try
     {
-        auto res = JO_Private::CutByComma(stdstr);
-        for (size_t i = 0; i < res.size(); i++)
-        {
-            auto ins = JO_Private::cutKeyValue(res[i]);
-            hd->children.object->insert(std::make_pair(ins.first, JsonUnit::create(ins.second.c_str())));
-        }
+        JsonParser(str).parseObjectDocument(this);
     }
-    catch (JsonException)
+    catch (JsonException&)
     {
         return false;
     }
@@ -493,65 +530,25 @@ JsonArray::~JsonArray() {
 }
 
 uint64 JsonArray::toJsonString(char * str) const {
-    auto ret = toJsonString();
-	strcpy(str, ret.c_str());
-	return ret.size();
+	return JsonObject::toJsonString(str);
 }
 
 String JsonArray::toJsonString() const
 {
-    auto hd = AA_HANDLE_MANAGER[this];
-	hd->initChildren();
-    String ret = "[";
-    for (size_t i = 0;; ++i)
-    {
-        ret += (*(hd->children.array))[i]->toJsonString();
-        if (i < hd->children.array->size() - 1)
-        {
-            ret += ",";
-        }
-        else
-        {
-            ret += "]";
-            break;
-        }
-    }
-    return ret;
+    return JsonObject::toJsonString();
 }
 
 uint64 JsonArray::getJsonStringLength() const {
-	auto hd = AA_HANDLE_MANAGER[this];
-	hd->initChildren();
-	uint64 length = 2;
-	for (auto i = hd->children.array->begin(); i != hd->children.array->end(); ++i) {
-		length += (*i)->getJsonStringLength();
-	}
-	return length;
+	return JsonObject::getJsonStringLength();
 }
 
-bool JsonArray::fromJsonString(const char * str)
+bool JsonArray::fromJsonString(StringView str)
 {
-    String realValue = str;
-    realValue.clearBothSides(sg_spaceCleans, sg_spaceCleanLen);
-    if (realValue[0] != '[' || realValue.getChar(-1) != ']')
+    try
     {
-        return false;
-    }
-    if(!realValue.subString(1, -2))
-        realValue.clearBothSides(sg_spaceCleans, sg_spaceCleanLen);
-    if (realValue != "")
-        try
-    {
-        auto res = JO_Private::CutByComma(realValue);
-        auto hd = AA_HANDLE_MANAGER[this];
-		hd->initChildren();
-        hd->children.array->clear();
-        for (size_t i = 0; i < res.size(); i++)
-        {
-            hd->children.array->push_back(JsonUnit::create(res[i].c_str()));
-        }
+        JsonParser(str).parseArrayDocument(this);
     }
-    catch (JsonException)
+    catch (JsonException&)
     {
         return false;
     }
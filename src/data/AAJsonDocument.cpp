@@ -0,0 +1,476 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+#include "../../inc/AAJsonDocument.h"
+#include "../../inc/AAJsonWriter.h"
+#include "../../inc/AAClassPrivateHandle.hpp"
+#include "AAJsonNode.hxx"
+#include "AAJsonScanner.hxx"
+
+#include <vector>
+
+
+namespace ArmyAnt{
+
+// 只增不减的内存池, 按块分配, 块大小几何增长
+class JsonArena{
+	struct Chunk{
+		Chunk* next;
+		uint64 capacity;
+		uint64 used;
+	};
+	static const uint64 c_maxChunkSize = 16 * 1024 * 1024;
+
+public:
+	JsonArena(uint64 chunkSize) :chunkSize(chunkSize < 256 ? 256 : chunkSize), head(nullptr), usage(0){}
+	~JsonArena(){
+		freeChunks(head);
+	}
+
+public:
+	void* allocate(uint64 size){
+		size = (size + 7) & ~uint64(7);
+		if(head == nullptr || head->used + size > head->capacity){
+			auto capacity = head == nullptr ? chunkSize : head->capacity * 2;
+			if(capacity > c_maxChunkSize)
+				capacity = c_maxChunkSize > chunkSize ? c_maxChunkSize : chunkSize;
+			if(capacity < size)
+				capacity = size;
+			auto chunk = reinterpret_cast<Chunk*>(new char[sizeof(Chunk) + capacity]);
+			chunk->next = head;
+			chunk->capacity = capacity;
+			chunk->used = 0;
+			head = chunk;
+		}
+		auto ret = reinterpret_cast<char*>(head + 1) + head->used;
+		head->used += size;
+		usage += size;
+		return ret;
+	}
+
+	// 只保留最近分配的 (也是最大的) 一块
+	void reset(){
+		if(head != nullptr){
+			freeChunks(head->next);
+			head->next = nullptr;
+			head->used = 0;
+		}
+		usage = 0;
+	}
+
+	uint64 getUsage()const{
+		return usage;
+	}
+
+private:
+	static void freeChunks(Chunk* chunk){
+		while(chunk != nullptr){
+			auto next = chunk->next;
+			delete[] reinterpret_cast<char*>(chunk);
+			chunk = next;
+		}
+	}
+
+	uint64 chunkSize;
+	Chunk* head;
+	uint64 usage;
+};
+
+class JsonDocument_Private{
+public:
+	JsonDocument_Private(uint64 chunkSize) :arena(chunkSize){
+		root.type = EJsonValueType::Undefined;
+	}
+
+	JsonArena arena;
+	JsonNode root;
+};
+
+/*	* 构建 JsonDocument 的解析器
+	* 容器的子节点先压入临时栈, 容器结束时再整体复制到内存池中, 因此每个容器的子节点都是连续存放的
+	*/
+class JsonDocumentParser : public JsonScanner{
+public:
+	JsonDocumentParser(StringView str, JsonArena& arena) :JsonScanner(str), arena(arena){}
+
+public:
+	void parseDocument(JsonNode& root){
+		skipSpace();
+		parseValue(root, 0);
+		if(!expectEnd())
+			fail("unexpected content after the json value");
+	}
+
+private:
+	void parseValue(JsonNode& node, uint32 depth){
+		node.numericKind = 0;
+		node.rightLength = 0;
+		node.length = 0;
+		node.lvalue = 0;
+		if(cur >= end)
+			fail("unexpected end of input");
+		switch(*cur){
+			case '{':
+				parseObject(node, depth);
+				break;
+			case '[':
+				parseArray(node, depth);
+				break;
+			case '"':
+			case '\'':
+				node.type = EJsonValueType::String;
+				node.string = storeString(node.length);
+				break;
+			case 't':
+			case 'f':
+				node.type = EJsonValueType::Boolean;
+				node.boolean = parseBoolean();
+				break;
+			case 'n':
+				if(!skipWord("null", 4))
+					fail("invalid literal");
+				node.type = EJsonValueType::Null;
+				break;
+			default:{
+				if(*cur != '-' && (*cur < '0' || *cur > '9'))
+					fail("unexpected character");
+				auto token = parseNumeric();
+				node.type = EJsonValueType::Numeric;
+				node.numericKind = token.kind;
+				node.rightLength = token.rightLength;
+				if(token.kind == 3)
+					node.dvalue = token.value.dvalue;
+				else
+					node.lvalue = token.value.lvalue;
+			}
+		}
+	}
+
+	// 解码到复用的临时缓冲区, 再复制到内存池并以'\0'结尾
+	const char* storeString(uint32& length){
+		scratch.clear();
+		parseString(scratch);
+		if(scratch.size() > AA_UINT32_MAX)
+			fail("string is too long");
+		auto ret = static_cast<char*>(arena.allocate(scratch.size() + 1));
+		memcpy(ret, scratch.c_str(), scratch.size() + 1);
+		length = uint32(scratch.size());
+		return ret;
+	}
+
+	void parseObject(JsonNode& node, uint32 depth){
+		if(depth >= c_maxDepth)
+			fail("json nesting is too deep");
+		node.type = EJsonValueType::Object;
+		node.members = nullptr;
+		auto base = memberStack.size();
+		++cur;
+		skipSpace();
+		if(cur < end && *cur == '}'){
+			++cur;
+			return;
+		}
+		while(true){
+			if(cur >= end || (*cur != '"' && *cur != '\''))
+				fail("expected a key string");
+			JsonMember member;
+			member.key = storeString(member.keyLength);
+			skipSpace();
+			if(cur >= end || *cur != ':')
+				fail("expected ':'");
+			++cur;
+			skipSpace();
+			parseValue(member.value, depth + 1);
+			memberStack.push_back(member);
+			skipSpace();
+			if(cur >= end)
+				fail("unexpected end of input in json object");
+			if(*cur == ','){
+				++cur;
+				skipSpace();
+			} else if(*cur == '}'){
+				++cur;
+				break;
+			} else
+				fail("expected ',' or '}'");
+		}
+		auto count = memberStack.size() - base;
+		if(count > AA_UINT32_MAX)
+			fail("too many members in json object");
+		node.length = uint32(count);
+		node.members = static_cast<JsonMember*>(arena.allocate(count * sizeof(JsonMember)));
+		memcpy(node.members, &memberStack[base], count * sizeof(JsonMember));
+		memberStack.resize(base);
+	}
+
+	void parseArray(JsonNode& node, uint32 depth){
+		if(depth >= c_maxDepth)
+			fail("json nesting is too deep");
+		node.type = EJsonValueType::Array;
+		node.elements = nullptr;
+		auto base = elementStack.size();
+		++cur;
+		skipSpace();
+		if(cur < end && *cur == ']'){
+			++cur;
+			return;
+		}
+		while(true){
+			JsonNode element;
+			parseValue(element, depth + 1);
+			elementStack.push_back(element);
+			skipSpace();
+			if(cur >= end)
+				fail("unexpected end of input in json array");
+			if(*cur == ','){
+				++cur;
+				skipSpace();
+			} else if(*cur == ']'){
+				++cur;
+				break;
+			} else
+				fail("expected ',' or ']'");
+		}
+		auto count = elementStack.size() - base;
+		if(count > AA_UINT32_MAX)
+			fail("too many elements in json array");
+		node.length = uint32(count);
+		node.elements = static_cast<JsonNode*>(arena.allocate(count * sizeof(JsonNode)));
+		memcpy(node.elements, &elementStack[base], count * sizeof(JsonNode));
+		elementStack.resize(base);
+	}
+
+private:
+	JsonArena& arena;
+	String scratch;
+	std::vector<JsonMember> memberStack;
+	std::vector<JsonNode> elementStack;
+};
+
+}
+
+
+/*************************** JsonValue ***************************/
+
+namespace ArmyAnt{
+
+EJsonValueType JsonValue::getType() const{
+	return node == nullptr ? EJsonValueType::Undefined : node->type;
+}
+
+bool JsonValue::isNull() const{
+	return node != nullptr && node->type == EJsonValueType::Null;
+}
+
+bool JsonValue::getBoolean() const{
+	return node != nullptr && node->type == EJsonValueType::Boolean && node->boolean;
+}
+
+int32 JsonValue::getInteger() const{
+	return int32(getLong());
+}
+
+int64 JsonValue::getLong() const{
+	if(node == nullptr || node->type != EJsonValueType::Numeric)
+		return 0;
+	return node->numericKind == 3 ? int64(node->dvalue) : node->lvalue;
+}
+
+double JsonValue::getDouble() const{
+	if(node == nullptr || node->type != EJsonValueType::Numeric)
+		return 0.0;
+	return node->numericKind == 3 ? node->dvalue : double(node->lvalue);
+}
+
+const char * JsonValue::getString() const{
+	if(node == nullptr || node->type != EJsonValueType::String)
+		return nullptr;
+	return node->string;
+}
+
+StringView JsonValue::getStringView() const{
+	if(node == nullptr || node->type != EJsonValueType::String)
+		return StringView();
+	return StringView(node->string, node->length);
+}
+
+uint32 JsonValue::size() const{
+	if(node == nullptr || (node->type != EJsonValueType::Object && node->type != EJsonValueType::Array))
+		return 0;
+	return node->length;
+}
+
+JsonValue JsonValue::getChild(StringView key) const{
+	if(node == nullptr || node->type != EJsonValueType::Object)
+		return JsonValue();
+	// 重复的键以最后一个为准, 因此从后向前查找
+	for(auto i = node->length; i > 0; --i){
+		auto& member = node->members[i - 1];
+		if(member.keyLength == key.size() && memcmp(member.key, key.data(), key.size()) == 0)
+			return JsonValue(&member.value);
+	}
+	return JsonValue();
+}
+
+JsonValue JsonValue::getChild(int32 index) const{
+	if(node == nullptr || node->type != EJsonValueType::Array)
+		return JsonValue();
+	auto size = int64(node->length);
+	auto realIndex = index < 0 ? size + index : int64(index);
+	if(realIndex < 0 || realIndex >= size)
+		return JsonValue();
+	return JsonValue(&node->elements[realIndex]);
+}
+
+StringView JsonValue::getKey(uint32 index) const{
+	if(node == nullptr || node->type != EJsonValueType::Object || index >= node->length)
+		return StringView();
+	return StringView(node->members[index].key, node->members[index].keyLength);
+}
+
+JsonValue JsonValue::getValue(uint32 index) const{
+	if(node == nullptr || node->type != EJsonValueType::Object || index >= node->length)
+		return JsonValue();
+	return JsonValue(&node->members[index].value);
+}
+
+String JsonValue::toJsonString() const{
+	String ret;
+	if(node != nullptr)
+		JsonWriter(ret).write(*this);
+	return ret;
+}
+
+JsonUnit * JsonValue::toJsonUnit() const{
+	if(node == nullptr)
+		return nullptr;
+	JsonUnit* ret = nullptr;
+	switch(node->type){
+		case EJsonValueType::Boolean:{
+			auto unit = new JsonBoolean();
+			unit->value = node->boolean;
+			ret = unit;
+			break;
+		}
+		case EJsonValueType::Numeric:{
+			auto unit = new JsonNumeric();
+			unit->whatvalue = node->numericKind;
+			unit->rightLength = node->rightLength;
+			if(node->numericKind == 3)
+				unit->value.dvalue = node->dvalue;
+			else{
+				unit->value.lvalue = node->lvalue;
+				if(node->numericKind == 1)
+					unit->value.ivalue = int32(node->lvalue);
+			}
+			ret = unit;
+			break;
+		}
+		case EJsonValueType::String:{
+			auto unit = new JsonString();
+			unit->value = getStringView();
+			ret = unit;
+			break;
+		}
+		case EJsonValueType::Object:{
+			auto unit = new JsonObject();
+			for(uint32 i = 0; i < node->length; ++i){
+				auto key = node->members[i].key;
+				auto child = JsonValue(&node->members[i].value).toJsonUnit();
+				if(!unit->putChild(key, child)){
+					unit->removeChild(key);
+					unit->putChild(key, child);
+				}
+			}
+			ret = unit;
+			break;
+		}
+		case EJsonValueType::Array:{
+			auto unit = new JsonArray();
+			for(uint32 i = 0; i < node->length; ++i)
+				unit->putChild(JsonValue(&node->elements[i]).toJsonUnit());
+			ret = unit;
+			break;
+		}
+		default:
+			return nullptr;
+	}
+	ret->isCreated = true;
+	return ret;
+}
+
+}
+
+
+/*************************** JsonDocument ***************************/
+
+#define AA_HANDLE_MANAGER ClassPrivateHandleManager<JsonDocument, JsonDocument_Private>::getInstance()
+
+namespace ArmyAnt{
+
+JsonDocument::JsonDocument(uint64 chunkSize){
+	AA_HANDLE_MANAGER.GetHandle(this, new JsonDocument_Private(chunkSize));
+}
+
+JsonDocument::~JsonDocument(){
+	delete AA_HANDLE_MANAGER.ReleaseHandle(this);
+}
+
+bool JsonDocument::parse(StringView str, int64 * errorOffset){
+	auto hd = AA_HANDLE_MANAGER[this];
+	hd->arena.reset();
+	hd->root.type = EJsonValueType::Undefined;
+	try{
+		JsonDocumentParser(str, hd->arena).parseDocument(hd->root);
+	} catch(JsonException& e){
+		hd->arena.reset();
+		hd->root.type = EJsonValueType::Undefined;
+		if(errorOffset != nullptr)
+			*errorOffset = e.getOffset();
+		return false;
+	}
+	if(errorOffset != nullptr)
+		*errorOffset = -1;
+	return true;
+}
+
+JsonValue JsonDocument::getRoot() const{
+	auto hd = AA_HANDLE_MANAGER[this];
+	if(hd->root.type == EJsonValueType::Undefined)
+		return JsonValue();
+	return JsonValue(&hd->root);
+}
+
+void JsonDocument::clear(){
+	auto hd = AA_HANDLE_MANAGER[this];
+	hd->arena.reset();
+	hd->root.type = EJsonValueType::Undefined;
+}
+
+uint64 JsonDocument::getMemoryUsage() const{
+	return AA_HANDLE_MANAGER[this]->arena.getUsage();
+}
+
+}
+
+#undef AA_HANDLE_MANAGER
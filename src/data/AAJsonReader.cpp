@@ -0,0 +1,408 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+#include "../../inc/AAJsonReader.h"
+#include "../../inc/AAClassPrivateHandle.hpp"
+#include "AAJsonScanner.hxx"
+
+#include <vector>
+#include <cstring>
+
+
+namespace ArmyAnt{
+
+/*	* JsonReader 的私有数据, 用状态机代替递归, 每次只读出一个事件
+	* 输入缓冲区中只保留还没有读过的部分, 遇到不完整的记号时不移动读取位置, 等补充输入后从记号开头重新读取
+	* 扫描器的 begin 始终指向缓冲区开头, consumed 记录缓冲区开头之前已经丢弃的字节数
+	*/
+class JsonReader_Private : public JsonScanner{
+	enum class State : uint8{
+		Done,			// 还没有开始, 或一个顶层值已经读完
+		Value,
+		ValueOrEnd,		// 数组的第一个元素或 ]
+		KeyOrEnd,		// 对象的第一个键或 }
+		Key,
+		Colon,
+		CommaOrEnd,
+		Failed
+	};
+
+public:
+	JsonReader_Private(StaticStream* stream, uint32 chunkSize)
+		:JsonScanner(StringView()), stream(stream), chunkSize(chunkSize == 0 ? 1 : chunkSize), finished(false), consumed(0),
+		state(State::Done), event(EJsonReadEvent::NeedMore), skipDepth(-1), errorOffset(-1), boolean(false), scanned(0), isStringEscaped(false){
+		begin = cur = end = nullptr;
+		number.kind = 1;
+		number.rightLength = 0;
+		number.value.lvalue = 0;
+	}
+
+public:
+	bool feed(const void* data, uint64 length){
+		if(stream != nullptr || finished)
+			return false;
+		if(length > 0){
+			auto offset = reserveInput(length);
+			memcpy(buffer.data() + offset, data, length);
+			end += length;
+		}
+		return true;
+	}
+
+	void finish(){
+		finished = true;
+	}
+
+	EJsonReadEvent next(){
+		if(state == State::Failed)
+			return event = EJsonReadEvent::Error;
+		try{
+			while(true){
+				auto ret = readEvent();
+				if(ret == EJsonReadEvent::NeedMore){
+					if(readStream())
+						continue;
+					return event = ret;
+				}
+				if(skipDepth >= 0 && ret != EJsonReadEvent::End){
+					// 跳过的值以标量或容器的结束事件收尾
+					bool isValueEnd = ret != EJsonReadEvent::StartObject && ret != EJsonReadEvent::StartArray && ret != EJsonReadEvent::Key;
+					if(isValueEnd && int64(stack.size()) <= skipDepth)
+						skipDepth = -1;
+					continue;
+				}
+				skipDepth = -1;
+				return event = ret;
+			}
+		} catch(JsonException& e){
+			state = State::Failed;
+			errorOffset = int64(consumed) + e.getOffset();
+			return event = EJsonReadEvent::Error;
+		}
+	}
+
+	uint64 getOffset()const{
+		return consumed + uint64(cur - begin);
+	}
+
+	void skipValue(){
+		if(event == EJsonReadEvent::StartObject || event == EJsonReadEvent::StartArray)
+			skipDepth = int64(stack.size()) - 1;
+		else
+			skipDepth = int64(stack.size());
+	}
+
+private:
+	EJsonReadEvent readEvent(){
+		while(true){
+			skipSpace();
+			if(cur == end){
+				if(!finished)
+					return EJsonReadEvent::NeedMore;
+				if(state == State::Done)
+					return EJsonReadEvent::End;
+				fail("unexpected end of input");
+			}
+			switch(state){
+				case State::Done:
+					state = State::Value;
+					break;
+				case State::Value:
+					return readValue();
+				case State::ValueOrEnd:
+					if(*cur == ']'){
+						++cur;
+						return closeContainer();
+					}
+					return readValue();
+				case State::KeyOrEnd:
+					if(*cur == '}'){
+						++cur;
+						return closeContainer();
+					}
+					return readKey();
+				case State::Key:
+					return readKey();
+				case State::Colon:
+					if(*cur != ':')
+						fail("expected ':'");
+					++cur;
+					state = State::Value;
+					break;
+				case State::CommaOrEnd:{
+					bool isObject = stack.back() == '{';
+					if(*cur == ','){
+						++cur;
+						state = isObject ? State::Key : State::Value;
+						break;
+					}
+					if(*cur == (isObject ? '}' : ']')){
+						++cur;
+						return closeContainer();
+					}
+					fail(isObject ? "expected ',' or '}'" : "expected ',' or ']'");
+				}
+				default:
+					fail("invalid reader state");
+			}
+		}
+	}
+
+	EJsonReadEvent readValue(){
+		switch(*cur){
+			case '{':
+			case '[':
+				if(stack.size() >= c_maxDepth)
+					fail("json nesting is too deep");
+				stack.push_back(*cur);
+				state = *cur == '{' ? State::KeyOrEnd : State::ValueOrEnd;
+				return *cur++ == '{' ? EJsonReadEvent::StartObject : EJsonReadEvent::StartArray;
+			case '"':
+			case '\'':
+				if(!readString())
+					return EJsonReadEvent::NeedMore;
+				finishValue();
+				return EJsonReadEvent::String;
+			case 't':
+			case 'f':
+			case 'n':{
+				auto word = *cur == 't' ? "true" : *cur == 'f' ? "false" : "null";
+				auto length = uint64(end - cur);
+				if(length < strlen(word) && !finished){
+					// 已有的部分必须与关键字相符
+					if(memcmp(cur, word, length) != 0)
+						fail("invalid literal");
+					return EJsonReadEvent::NeedMore;
+				}
+				if(*cur == 'n'){
+					if(!skipWord("null", 4))
+						fail("invalid literal");
+					finishValue();
+					return EJsonReadEvent::Null;
+				}
+				boolean = parseBoolean();
+				finishValue();
+				return EJsonReadEvent::Boolean;
+			}
+			default:
+				if(*cur != '-' && (*cur < '0' || *cur > '9'))
+					fail("unexpected character");
+				if(!finished){
+					// 数字可能在这块输入的末尾被截断
+					auto p = cur;
+					while(p < end && ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E'))
+						++p;
+					if(p == end)
+						return EJsonReadEvent::NeedMore;
+				}
+				number = parseNumeric();
+				finishValue();
+				return EJsonReadEvent::Numeric;
+		}
+	}
+
+	EJsonReadEvent readKey(){
+		if(*cur != '"' && *cur != '\'')
+			fail("expected a key string");
+		if(!readString())
+			return EJsonReadEvent::NeedMore;
+		state = State::Colon;
+		return EJsonReadEvent::Key;
+	}
+
+	// 字符串不完整时返回false, 已扫描的位置保存在 scanned 中, 补充输入后不必从头扫描
+	bool readString(){
+		auto quote = *cur;
+		auto length = uint64(end - cur);
+		auto i = scanned == 0 ? 1 : scanned;
+		while(i < length){
+			i = uint64(scan.findQuoteOrBackslash(cur + i, end, quote) - cur);
+			if(i >= length || cur[i] == quote)
+				break;
+			// 反斜杠和被转义的字符一起跳过
+			if(i + 1 >= length)
+				break;
+			isStringEscaped = true;
+			i += 2;
+		}
+		if((i >= length || cur[i] != quote) && !finished){
+			scanned = i;
+			return false;
+		}
+		if(isStringEscaped || i >= length){
+			// 有转义时解码到 decoded 中, 输入已结束但字符串不完整时由 parseString 报错
+			decoded.clear();
+			parseString(decoded);
+			text = StringView(decoded);
+		} else{
+			text = StringView(cur + 1, i - 1);
+			cur += i + 1;
+		}
+		scanned = 0;
+		isStringEscaped = false;
+		return true;
+	}
+
+	EJsonReadEvent closeContainer(){
+		bool isObject = stack.back() == '{';
+		stack.pop_back();
+		finishValue();
+		return isObject ? EJsonReadEvent::EndObject : EJsonReadEvent::EndArray;
+	}
+
+	void finishValue(){
+		state = stack.empty() ? State::Done : State::CommaOrEnd;
+	}
+
+	// 丢弃已经读过的部分, 为新的输入留出 length 字节, 返回新输入应写入的位置
+	uint64 reserveInput(uint64 length){
+		auto remain = uint64(end - cur);
+		if(cur != begin){
+			consumed += uint64(cur - begin);
+			if(remain > 0)
+				memmove(buffer.data(), cur, remain);
+		}
+		buffer.resize(remain + length);
+		begin = cur = buffer.data();
+		end = begin + remain;
+		return remain;
+	}
+
+	bool readStream(){
+		if(stream == nullptr || finished)
+			return false;
+		auto offset = reserveInput(chunkSize);
+		auto length = stream->Read(buffer.data() + offset, chunkSize);
+		if(length <= 0)
+			finished = true;
+		else
+			end += length;
+		return true;
+	}
+
+public:
+	StaticStream* stream;
+	uint32 chunkSize;
+	bool finished;
+	uint64 consumed;
+	std::vector<char> buffer;
+	std::vector<char> stack;
+
+	State state;
+	EJsonReadEvent event;
+	int64 skipDepth;
+	int64 errorOffset;
+
+	StringView text;
+	String decoded;
+	JsonNumberToken number;
+	bool boolean;
+	uint64 scanned;
+	bool isStringEscaped;
+};
+
+
+#define AA_HANDLE_MANAGER ClassPrivateHandleManager<JsonReader, JsonReader_Private>::getInstance()
+
+JsonReader::JsonReader(){
+	AA_HANDLE_MANAGER.GetHandle(this, new JsonReader_Private(nullptr, 0));
+}
+
+JsonReader::JsonReader(StaticStream & stream, uint32 chunkSize){
+	AA_HANDLE_MANAGER.GetHandle(this, new JsonReader_Private(&stream, chunkSize));
+}
+
+JsonReader::~JsonReader(){
+	delete AA_HANDLE_MANAGER.ReleaseHandle(this);
+}
+
+bool JsonReader::feed(const void * data, uint64 length){
+	return AA_HANDLE_MANAGER[this]->feed(data, length);
+}
+
+void JsonReader::finish(){
+	AA_HANDLE_MANAGER[this]->finish();
+}
+
+EJsonReadEvent JsonReader::next(){
+	return AA_HANDLE_MANAGER[this]->next();
+}
+
+void JsonReader::skipValue(){
+	AA_HANDLE_MANAGER[this]->skipValue();
+}
+
+EJsonReadEvent JsonReader::getEvent() const{
+	return AA_HANDLE_MANAGER[this]->event;
+}
+
+uint32 JsonReader::getDepth() const{
+	return uint32(AA_HANDLE_MANAGER[this]->stack.size());
+}
+
+StringView JsonReader::getStringView() const{
+	auto hd = AA_HANDLE_MANAGER[this];
+	if(hd->event != EJsonReadEvent::Key && hd->event != EJsonReadEvent::String)
+		return StringView();
+	return hd->text;
+}
+
+bool JsonReader::getBoolean() const{
+	auto hd = AA_HANDLE_MANAGER[this];
+	return hd->event == EJsonReadEvent::Boolean && hd->boolean;
+}
+
+int32 JsonReader::getInteger() const{
+	return int32(getLong());
+}
+
+int64 JsonReader::getLong() const{
+	auto hd = AA_HANDLE_MANAGER[this];
+	if(hd->event != EJsonReadEvent::Numeric)
+		return 0;
+	return hd->number.kind == 3 ? int64(hd->number.value.dvalue) : hd->number.value.lvalue;
+}
+
+double JsonReader::getDouble() const{
+	auto hd = AA_HANDLE_MANAGER[this];
+	if(hd->event != EJsonReadEvent::Numeric)
+		return 0.0;
+	return hd->number.kind == 3 ? hd->number.value.dvalue : double(hd->number.value.lvalue);
+}
+
+bool JsonReader::isDouble() const{
+	auto hd = AA_HANDLE_MANAGER[this];
+	return hd->event == EJsonReadEvent::Numeric && hd->number.kind == 3;
+}
+
+uint64 JsonReader::getOffset() const{
+	return AA_HANDLE_MANAGER[this]->getOffset();
+}
+
+int64 JsonReader::getErrorOffset() const{
+	return AA_HANDLE_MANAGER[this]->errorOffset;
+}
+
+}
+
+#undef AA_HANDLE_MANAGER
@@ -0,0 +1,300 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+#ifndef AA_JSON_SCANNER_PRIVATE_HEADER_2026_10_17
+#define AA_JSON_SCANNER_PRIVATE_HEADER_2026_10_17
+
+#include "../../inc/AAJson.h"
+#include "../tool/AAStringScan.hxx"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace ArmyAnt{
+
+// 能够精确还原 double 的最短十进制形式(最多17位有效数字), 返回写入的长度, buffer 至少32字节
+// JSON 不能表示 inf 和 nan, 这两种值输出为 null
+inline uint32 formatJsonDouble(char* buffer, double value){
+	if(value != value || value - value != 0.0){
+		memcpy(buffer, "null", 5);
+		return 4;
+	}
+	int length = 0;
+	for(int precision = 15; precision <= 17; ++precision){
+		length = snprintf(buffer, 32, "%.*g", precision, value);
+		if(strtod(buffer, nullptr) == value)
+			break;
+	}
+	return uint32(length);
+}
+
+// 扫描得到的数字, kind 与 JsonNumeric 的 whatvalue 含义相同: 1为int32, 2为int64, 3为double
+struct JsonNumberToken{
+	int8 kind;
+	int8 rightLength;
+	union{
+		int64 lvalue;
+		double dvalue;
+	} value;
+};
+
+/*	* JSON 词法扫描的公共部分, 供构建 JsonUnit 树的 JsonParser 和构建 JsonDocument 的解析器共用
+	* 出错时抛出带有字节偏移的 JsonException
+	*/
+class JsonScanner{
+public:
+	JsonScanner(StringView str) :begin(str.data()), cur(str.data()), end(str.data() + str.size()), scan(StringScan::get()){}
+
+protected:
+	static const uint32 c_maxDepth = 512;
+
+	[[noreturn]] void fail(const char* message) const{
+		throw JsonException(message, int64(cur - begin));
+	}
+
+	void skipSpace(){
+		// 紧凑的 JSON 中记号之间大多没有空白, 先检查一个字符再批量扫描
+		if(cur < end && (*cur == ' ' || *cur == '\n' || *cur == '\r' || *cur == '\t'))
+			cur = scan.skipSpace(cur + 1, end);
+	}
+
+	bool expectEnd(){
+		skipSpace();
+		return cur == end;
+	}
+
+	bool skipWord(const char* word, uint64 length){
+		if(uint64(end - cur) < length || memcmp(cur, word, length) != 0)
+			return false;
+		cur += length;
+		return true;
+	}
+
+	bool parseBoolean(){
+		if(skipWord("true", 4))
+			return true;
+		if(skipWord("false", 5))
+			return false;
+		fail("invalid literal");
+	}
+
+	static int32 hexValue(char c){
+		if(c >= '0' && c <= '9')
+			return c - '0';
+		if(c >= 'a' && c <= 'f')
+			return c - 'a' + 10;
+		if(c >= 'A' && c <= 'F')
+			return c - 'A' + 10;
+		return -1;
+	}
+
+	uint32 parseHex4(){
+		if(end - cur < 4)
+			fail("invalid unicode escape");
+		uint32 ret = 0;
+		for(int i = 0; i < 4; ++i){
+			auto digit = hexValue(cur[i]);
+			if(digit < 0)
+				fail("invalid unicode escape");
+			ret = (ret << 4) | uint32(digit);
+		}
+		cur += 4;
+		return ret;
+	}
+
+	template <class T_Out>
+	static void appendUtf8(T_Out& out, uint32 code){
+		char bytes[4];
+		uint64 length;
+		if(code < 0x80){
+			bytes[0] = char(code);
+			length = 1;
+		} else if(code < 0x800){
+			bytes[0] = char(0xC0 | (code >> 6));
+			bytes[1] = char(0x80 | (code & 0x3F));
+			length = 2;
+		} else if(code < 0x10000){
+			bytes[0] = char(0xE0 | (code >> 12));
+			bytes[1] = char(0x80 | ((code >> 6) & 0x3F));
+			bytes[2] = char(0x80 | (code & 0x3F));
+			length = 3;
+		} else{
+			bytes[0] = char(0xF0 | (code >> 18));
+			bytes[1] = char(0x80 | ((code >> 12) & 0x3F));
+			bytes[2] = char(0x80 | ((code >> 6) & 0x3F));
+			bytes[3] = char(0x80 | (code & 0x3F));
+			length = 4;
+		}
+		out.append(bytes, length);
+	}
+
+	/*	* 解析带引号的字符串并处理转义, 没有转义的片段整段追加到 out 中
+		* T_Out 需要提供 append(const char*, uint64) 和 operator+=(char)
+		* 解码后的长度不会超过原文的长度, 调用者可以据此预先分配空间
+		*/
+	template <class T_Out>
+	void parseString(T_Out& out){
+		if(cur >= end || (*cur != '"' && *cur != '\''))
+			fail("expected a string");
+		char quote = *cur++;
+		while(true){
+			auto segment = cur;
+			cur = scan.findQuoteOrBackslash(cur, end, quote);
+			out.append(segment, uint64(cur - segment));
+			if(cur >= end)
+				fail("unterminated string");
+			if(*cur == quote){
+				++cur;
+				return;
+			}
+			++cur;
+			if(cur >= end)
+				fail("unterminated string");
+			switch(*cur++){
+				case '"': out += '"'; break;
+				case '\'': out += '\''; break;
+				case '\\': out += '\\'; break;
+				case '/': out += '/'; break;
+				case 'b': out += '\b'; break;
+				case 'f': out += '\f'; break;
+				case 'n': out += '\n'; break;
+				case 'r': out += '\r'; break;
+				case 't': out += '\t'; break;
+				case 'u': {
+					auto code = parseHex4();
+					if(code >= 0xD800 && code < 0xDC00 && end - cur >= 6 && cur[0] == '\\' && cur[1] == 'u'){
+						cur += 2;
+						auto low = parseHex4();
+						if(low < 0xDC00 || low >= 0xE000)
+							fail("invalid unicode surrogate pair");
+						code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+					}
+					appendUtf8(out, code);
+					break;
+				}
+				default:
+					--cur;
+					fail("invalid escape character");
+			}
+		}
+	}
+
+	JsonNumberToken parseNumeric(){
+		JsonNumberToken ret;
+		auto start = cur;
+		bool isNegative = false;
+		if(cur < end && *cur == '-'){
+			isNegative = true;
+			++cur;
+		}
+		if(cur >= end || *cur < '0' || *cur > '9')
+			fail("invalid number");
+		uint64 integer = 0;
+		bool isOverflow = false;
+		for(; cur < end && *cur >= '0' && *cur <= '9'; ++cur){
+			if(integer > (AA_UINT64_MAX - 9) / 10)
+				isOverflow = true;
+			integer = integer * 10 + uint64(*cur - '0');
+		}
+		int32 rightLength = 0;
+		bool isFloat = false;
+		if(cur < end && *cur == '.'){
+			isFloat = true;
+			++cur;
+			if(cur >= end || *cur < '0' || *cur > '9')
+				fail("invalid number");
+			for(; cur < end && *cur >= '0' && *cur <= '9'; ++cur)
+				++rightLength;
+		}
+		if(cur < end && (*cur == 'e' || *cur == 'E')){
+			isFloat = true;
+			++cur;
+			if(cur < end && (*cur == '+' || *cur == '-'))
+				++cur;
+			if(cur >= end || *cur < '0' || *cur > '9')
+				fail("invalid number");
+			while(cur < end && *cur >= '0' && *cur <= '9')
+				++cur;
+		}
+		uint64 limit = isNegative ? uint64(AA_INT64_MAX) + 1 : uint64(AA_INT64_MAX);
+		if(isFloat || isOverflow || integer > limit){
+			ret.kind = 3;
+			// 只作记录, 输出时不按它截断; double 超过17位的小数没有意义
+			ret.rightLength = int8(rightLength > 17 ? 17 : rightLength);
+			ret.value.dvalue = StringView(start, uint64(cur - start)).toDemical();
+			return ret;
+		}
+		ret.rightLength = 0;
+		ret.value.lvalue = isNegative ? int64(0 - integer) : int64(integer);
+		ret.kind = ret.value.lvalue >= AA_INT32_MIN && ret.value.lvalue <= AA_INT32_MAX ? 1 : 2;
+		return ret;
+	}
+
+protected:
+	const char* begin;
+	const char* cur;
+	const char* end;
+	const StringScan& scan;
+};
+
+// 将序列化字符串时需要转义的字符写为转义序列, out 至少需要6字节, 返回转义序列的长度
+inline uint8 getEscapeSequence(uint8 c, char* out){
+	out[0] = '\\';
+	switch(c){
+		case '"': out[1] = '"'; return 2;
+		case '\\': out[1] = '\\'; return 2;
+		case '\b': out[1] = 'b'; return 2;
+		case '\f': out[1] = 'f'; return 2;
+		case '\n': out[1] = 'n'; return 2;
+		case '\r': out[1] = 'r'; return 2;
+		case '\t': out[1] = 't'; return 2;
+		default:{
+			static const char c_hex[] = "0123456789abcdef";
+			out[1] = 'u';
+			out[2] = '0';
+			out[3] = '0';
+			out[4] = c_hex[c >> 4];
+			out[5] = c_hex[c & 0xF];
+			return 6;
+		}
+	}
+}
+
+// 返回转义后的长度
+inline uint64 getEscapedLength(StringView str){
+	auto& scan = StringScan::get();
+	auto end = str.data() + str.size();
+	uint64 ret = str.size();
+	for(auto i = scan.findEscapedChar(str.data(), end); i < end; i = scan.findEscapedChar(i + 1, end)){
+		auto c = uint8(*i);
+		if(c == '"' || c == '\\' || c == '\b' || c == '\f' || c == '\n' || c == '\r' || c == '\t')
+			ret += 1;
+		else
+			ret += 5;
+	}
+	return ret;
+}
+
+} // namespace ArmyAnt
+
+#endif // AA_JSON_SCANNER_PRIVATE_HEADER_2026_10_17
@@ -0,0 +1,493 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+#include "../../inc/AAJsonWriter.h"
+#include "../../inc/AAClassPrivateHandle.hpp"
+#include "AAJson_Private.hxx"
+#include "AAJsonNode.hxx"
+#include "AAJsonScanner.hxx"
+
+#include <cstring>
+
+
+namespace ArmyAnt{
+
+// 等待输出的一段文本, 输出被截断时原地前移
+struct JsonPiece{
+	const char* data;
+	uint64 length;
+	bool escaped;		// 输出时是否按 JSON 字符串转义
+};
+
+/*	* JsonWriter 的私有数据, 用显式的栈代替递归遍历, 以便在定长缓冲区写满时保存进度
+	* 每一步把下一个节点拆成若干文本片段, 片段全部输出后才进行下一步
+	* 片段只引用树中的字符串或本对象中的临时区, 不复制节点内容
+	*/
+class JsonSerializer{
+	enum class Target : uint8{
+		Count,
+		String,
+		Buffer,
+		Stream
+	};
+
+	enum class FrameType : uint8{
+		UnitObject,
+		UnitArray,
+		NodeObject,
+		NodeArray
+	};
+
+	struct Frame{
+		FrameType type;
+		uint64 index;
+		union{
+			const JO_Private* unit;
+			const JsonNode* node;
+		};
+		std::map<String, JsonUnit*>::const_iterator member;
+	};
+
+	// 每一步最多产生的片段数: 成员前缀, 键, 冒号, 以及值的引号, 内容, 引号
+	static const uint32 c_maxPieces = 8;
+
+public:
+	JsonSerializer() :target(Target::Count), output(nullptr), stream(nullptr), buffer(nullptr), capacity(0), used(0){
+		reset();
+	}
+	JsonSerializer(String& output) :JsonSerializer(){
+		target = Target::String;
+		this->output = &output;
+	}
+	JsonSerializer(char* buffer, uint64 capacity) :JsonSerializer(){
+		target = Target::Buffer;
+		this->buffer = buffer;
+		this->capacity = capacity;
+	}
+	JsonSerializer(StaticStream& stream, uint32 bufferSize) :JsonSerializer(){
+		target = Target::Stream;
+		this->stream = &stream;
+		capacity = bufferSize < 64 ? 64 : bufferSize;
+		buffer = new char[capacity];
+	}
+	~JsonSerializer(){
+		if(target == Target::Stream){
+			flush();
+			delete[] buffer;
+		}
+	}
+
+public:
+	bool write(const JsonUnit* unit){
+		reset();
+		pushUnit(unit);
+		return run();
+	}
+
+	bool write(JsonValue value){
+		reset();
+		if(value.node == nullptr)
+			pushText("null", 4);
+		else
+			pushNode(value.node);
+		return run();
+	}
+
+	bool resume(char* buffer, uint64 capacity){
+		if(target != Target::Buffer || buffer == nullptr)
+			return false;
+		this->buffer = buffer;
+		this->capacity = capacity;
+		used = 0;
+		return run();
+	}
+
+	bool flush(){
+		if(target != Target::Stream)
+			return false;
+		if(used == 0)
+			return true;
+		// Write 的长度参数为0时会按字符串写入, 所以上面需要先排除空缓冲区
+		auto length = used;
+		used = 0;
+		return stream->Write(buffer, int64(length)) == int64(length);
+	}
+
+	bool isPending()const{
+		return pieceHead < pieceCount || !stack.empty();
+	}
+
+	uint64 getBufferedLength()const{
+		return target == Target::Buffer ? used : 0;
+	}
+
+	uint64 getWrittenLength()const{
+		return written;
+	}
+
+private:
+	void reset(){
+		stack.clear();
+		pieceHead = 0;
+		pieceCount = 0;
+		escapePos = 0;
+		escapeLength = 0;
+		written = 0;
+		// 流模式下内部缓冲区中可能还有上一次未写入流的数据
+		if(target != Target::Stream)
+			used = 0;
+	}
+
+	bool run(){
+		while(true){
+			for(; pieceHead < pieceCount; ++pieceHead){
+				if(!outputPiece(pieces[pieceHead])){
+					// 只有定长缓冲区写满时才能继续, 写入流失败则放弃剩余的输出
+					if(target != Target::Buffer){
+						stack.clear();
+						pieceHead = pieceCount = 0;
+					}
+					return false;
+				}
+			}
+			pieceHead = 0;
+			pieceCount = 0;
+			if(stack.empty())
+				return target != Target::Stream || flush();
+			step();
+		}
+	}
+
+	void step(){
+		auto& top = stack.back();
+		switch(top.type){
+			case FrameType::UnitObject:{
+				if(top.member == top.unit->children.object->end()){
+					pushText("}", 1);
+					stack.pop_back();
+					break;
+				}
+				auto member = top.member++;
+				if(top.index++ == 0)
+					pushText("\"", 1);
+				else
+					pushText(",\"", 2);
+				pushEscaped(member->first.c_str(), member->first.size());
+				pushText("\":", 2);
+				pushUnit(member->second);
+				break;
+			}
+			case FrameType::UnitArray:{
+				auto& children = *top.unit->children.array;
+				if(top.index == children.size()){
+					pushText("]", 1);
+					stack.pop_back();
+					break;
+				}
+				if(top.index != 0)
+					pushText(",", 1);
+				pushUnit(children[top.index++]);
+				break;
+			}
+			case FrameType::NodeObject:{
+				if(top.index == top.node->length){
+					pushText("}", 1);
+					stack.pop_back();
+					break;
+				}
+				auto& member = top.node->members[top.index];
+				if(top.index++ == 0)
+					pushText("\"", 1);
+				else
+					pushText(",\"", 2);
+				pushEscaped(member.key, member.keyLength);
+				pushText("\":", 2);
+				pushNode(&member.value);
+				break;
+			}
+			case FrameType::NodeArray:{
+				if(top.index == top.node->length){
+					pushText("]", 1);
+					stack.pop_back();
+					break;
+				}
+				if(top.index != 0)
+					pushText(",", 1);
+				pushNode(&top.node->elements[top.index++]);
+				break;
+			}
+		}
+	}
+
+	void pushUnit(const JsonUnit* unit){
+		if(unit == nullptr){
+			pushText("null", 4);
+			return;
+		}
+		switch(unit->getType()){
+			case EJsonValueType::Boolean:{
+				auto value = static_cast<const JsonBoolean*>(unit)->value;
+				pushText(value ? "true" : "false", value ? 4 : 5);
+				break;
+			}
+			case EJsonValueType::Numeric:{
+				auto numeric = static_cast<const JsonNumeric*>(unit);
+				switch(numeric->whatvalue){
+					case 1:
+						pushInteger(numeric->value.ivalue);
+						break;
+					case 2:
+						pushInteger(numeric->value.lvalue);
+						break;
+					case 3:
+						pushDouble(numeric->value.dvalue);
+						break;
+				}
+				break;
+			}
+			case EJsonValueType::String:{
+				auto& value = static_cast<const JsonString*>(unit)->value;
+				pushText("\"", 1);
+				pushEscaped(value.c_str(), value.size());
+				pushText("\"", 1);
+				break;
+			}
+			case EJsonValueType::Object:
+			case EJsonValueType::Array:{
+				auto hd = ClassPrivateHandleManager<JsonObject, JO_Private>::getInstance()[static_cast<const JsonObject*>(unit)];
+				bool isObject = hd->type == EJsonValueType::Object;
+				// 未初始化的子节点容器视为空
+				if(hd->children.object == nullptr || (isObject ? hd->children.object->empty() : hd->children.array->empty())){
+					pushText(isObject ? "{}" : "[]", 2);
+					break;
+				}
+				pushText(isObject ? "{" : "[", 1);
+				Frame frame;
+				frame.type = isObject ? FrameType::UnitObject : FrameType::UnitArray;
+				frame.index = 0;
+				frame.unit = hd;
+				if(isObject)
+					frame.member = hd->children.object->begin();
+				stack.push_back(frame);
+				break;
+			}
+			default:
+				pushText("null", 4);
+		}
+	}
+
+	void pushNode(const JsonNode* node){
+		switch(node->type){
+			case EJsonValueType::Boolean:
+				pushText(node->boolean ? "true" : "false", node->boolean ? 4 : 5);
+				break;
+			case EJsonValueType::Numeric:
+				if(node->numericKind == 3)
+					pushDouble(node->dvalue);
+				else
+					pushInteger(node->lvalue);
+				break;
+			case EJsonValueType::String:
+				pushText("\"", 1);
+				pushEscaped(node->string, node->length);
+				pushText("\"", 1);
+				break;
+			case EJsonValueType::Object:
+			case EJsonValueType::Array:{
+				bool isObject = node->type == EJsonValueType::Object;
+				if(node->length == 0){
+					pushText(isObject ? "{}" : "[]", 2);
+					break;
+				}
+				pushText(isObject ? "{" : "[", 1);
+				Frame frame;
+				frame.type = isObject ? FrameType::NodeObject : FrameType::NodeArray;
+				frame.index = 0;
+				frame.node = node;
+				stack.push_back(frame);
+				break;
+			}
+			default:
+				pushText("null", 4);
+		}
+	}
+
+	void pushText(const char* data, uint64 length){
+		pieces[pieceCount].data = data;
+		pieces[pieceCount].length = length;
+		pieces[pieceCount].escaped = false;
+		++pieceCount;
+	}
+
+	void pushEscaped(const char* data, uint64 length){
+		pushText(data, length);
+		pieces[pieceCount - 1].escaped = true;
+	}
+
+	// 数字写入临时区, 同一步中最多只有一个数字
+	void pushInteger(int64 value){
+		pushText(number, uint64(snprintf(number, sizeof(number), "%lld", static_cast<long long>(value))));
+	}
+
+	void pushDouble(double value){
+		// 与 JsonNumeric::toJsonString 使用相同的格式, 输出能精确还原的最短形式
+		pushText(number, formatJsonDouble(number, value));
+	}
+
+	bool outputPiece(JsonPiece& piece){
+		if(!piece.escaped){
+			auto length = put(piece.data, piece.length);
+			piece.data += length;
+			piece.length -= length;
+			return piece.length == 0;
+		}
+		while(true){
+			// 先输出上次被截断的转义序列
+			if(escapePos < escapeLength){
+				escapePos += uint8(put(escape + escapePos, escapeLength - escapePos));
+				if(escapePos < escapeLength)
+					return false;
+			}
+			auto plain = uint64(StringScan::get().findEscapedChar(piece.data, piece.data + piece.length) - piece.data);
+			if(plain > 0){
+				auto length = put(piece.data, plain);
+				piece.data += length;
+				piece.length -= length;
+				if(length < plain)
+					return false;
+			}
+			if(piece.length == 0)
+				return true;
+			escapeLength = getEscapeSequence(uint8(*piece.data), escape);
+			escapePos = 0;
+			++piece.data;
+			--piece.length;
+		}
+	}
+
+	// 返回实际输出的字节数, 只有定长缓冲区写满或写入流失败时才会小于 length
+	uint64 put(const char* data, uint64 length){
+		switch(target){
+			case Target::Count:
+				break;
+			case Target::String:
+				output->append(data, length);
+				break;
+			case Target::Buffer:
+				if(length > capacity - used)
+					length = capacity - used;
+				memcpy(buffer + used, data, length);
+				used += length;
+				break;
+			case Target::Stream:{
+				uint64 done = 0;
+				while(done < length){
+					if(used == capacity && !flush()){
+						written += done;
+						return done;
+					}
+					auto count = length - done < capacity - used ? length - done : capacity - used;
+					memcpy(buffer + used, data + done, count);
+					used += count;
+					done += count;
+				}
+				break;
+			}
+		}
+		written += length;
+		return length;
+	}
+
+private:
+	Target target;
+	String* output;
+	StaticStream* stream;
+	char* buffer;
+	uint64 capacity;
+	uint64 used;
+	uint64 written;
+
+	std::vector<Frame> stack;
+	JsonPiece pieces[c_maxPieces];
+	uint32 pieceHead;
+	uint32 pieceCount;
+	char number[32];
+	char escape[8];
+	uint8 escapePos;
+	uint8 escapeLength;
+};
+
+
+#define AA_HANDLE_MANAGER ClassPrivateHandleManager<JsonWriter, JsonSerializer>::getInstance()
+
+JsonWriter::JsonWriter(){
+	AA_HANDLE_MANAGER.GetHandle(this, new JsonSerializer());
+}
+
+JsonWriter::JsonWriter(String & output){
+	AA_HANDLE_MANAGER.GetHandle(this, new JsonSerializer(output));
+}
+
+JsonWriter::JsonWriter(char * buffer, uint64 capacity){
+	AA_HANDLE_MANAGER.GetHandle(this, new JsonSerializer(buffer, capacity));
+}
+
+JsonWriter::JsonWriter(StaticStream & stream, uint32 bufferSize){
+	AA_HANDLE_MANAGER.GetHandle(this, new JsonSerializer(stream, bufferSize));
+}
+
+JsonWriter::~JsonWriter(){
+	delete AA_HANDLE_MANAGER.ReleaseHandle(this);
+}
+
+bool JsonWriter::write(const JsonUnit * unit){
+	return AA_HANDLE_MANAGER[this]->write(unit);
+}
+
+bool JsonWriter::write(JsonValue value){
+	return AA_HANDLE_MANAGER[this]->write(value);
+}
+
+bool JsonWriter::resume(char * buffer, uint64 capacity){
+	return AA_HANDLE_MANAGER[this]->resume(buffer, capacity);
+}
+
+bool JsonWriter::flush(){
+	return AA_HANDLE_MANAGER[this]->flush();
+}
+
+bool JsonWriter::isPending() const{
+	return AA_HANDLE_MANAGER[this]->isPending();
+}
+
+uint64 JsonWriter::getBufferedLength() const{
+	return AA_HANDLE_MANAGER[this]->getBufferedLength();
+}
+
+uint64 JsonWriter::getWrittenLength() const{
+	return AA_HANDLE_MANAGER[this]->getWrittenLength();
+}
+
+}
+
+#undef AA_HANDLE_MANAGER
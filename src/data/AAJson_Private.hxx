@@ -0,0 +1,77 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+#ifndef AA_JSON_PRIVATE_HEADER_2026_10_17
+#define AA_JSON_PRIVATE_HEADER_2026_10_17
+
+#include "../../inc/AAJson.h"
+#include <vector>
+#include <map>
+
+namespace ArmyAnt{
+
+// JsonObject 和 JsonArray 的私有数据, 由 ClassPrivateHandleManager 管理
+struct JO_Private {
+	EJsonValueType type;
+	union{
+		std::map<String, JsonUnit*>* object;
+		std::vector<JsonUnit*>* array;
+	}children;
+public:
+	JO_Private(){
+		children.object = nullptr;
+		type = EJsonValueType::Object;
+	}
+
+	~JO_Private() {}
+
+	void initChildren(){
+		if(children.object != nullptr)
+			return;
+		if(type == EJsonValueType::Object)
+			children.object = new std::map<String, JsonUnit*>();
+		else
+			children.array = new std::vector<JsonUnit*>();
+	}
+	void recycleChildren(){
+		if(children.object != nullptr){
+			if(type == EJsonValueType::Object){
+				for(auto i = children.object->begin(); i != children.object->end(); ++i){
+					if(i->second != nullptr)
+						JsonUnit::release(i->second);
+				}
+				delete children.object;
+			} else{
+				for(auto i = children.array->begin(); i != children.array->end(); ++i){
+					JsonUnit::release(*i);
+				}
+				delete children.array;
+			}
+			children.object = nullptr;
+		}
+	}
+};
+
+} // namespace ArmyAnt
+
+#endif // AA_JSON_PRIVATE_HEADER_2026_10_17
@@ -26,12 +26,22 @@
 #include "../../inc/AAString.h"
 #include "../../inc/AASocket.h"
 #include "../../inc/AAClassPrivateHandle.hpp"
-
-#include <map>
-#include <queue>
+#include "AASocketSlotTable.hxx"
+#include "AASocketBufferPool.hxx"
+#include "AASocketSendingQueue.hxx"
+#include "AASocketFramer.hxx"
+#include "AASocketErrorDispatcher.hxx"
+#include "AASocketTimerWheel.hxx"
+#include "AASocketUring.hxx"
+
+#include <vector>
 #include <thread>
 #include <mutex>
 #include <memory>
+#include <future>
+#include <atomic>
+#include <limits>
+#include <unordered_set>
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
 
@@ -40,18 +50,37 @@
 #include <in6addr.h>
 #include <ws2tcpip.h>
 #else
-#include <list>
 #include <netinet/in.h>
+#include <sys/socket.h>
 #endif
 
 
 #define AA_HANDLE_MANAGER ClassPrivateHandleManager<Socket, Socket_Private>::getInstance()
 
+// Linux下多个套接字可以用SO_REUSEPORT监听同一端口, 内核会把新连接均匀分配给它们
+#if defined OS_LINUX && defined SO_REUSEPORT
+#define AA_SOCKET_REUSE_PORT
+#endif
+
+// Linux下可以用recvmmsg和sendmmsg一次系统调用收发多个UDP数据报
+#if defined OS_LINUX && defined MSG_WAITFORONE
+#define AA_SOCKET_MMSG
+#endif
+
 
 namespace ArmyAnt{
 
+#if defined AA_SOCKET_REUSE_PORT
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> ReusePortOption;
+#endif
+
 /**************** Source file private functions **************************/
 
+// 单调时钟的毫秒数, 用于记录连接的读写时间
+inline static int64 getSteadyMilliseconds(){
+	return int64(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
 // 将socket的ipv4地址转换为ArmyAnt::IPAddr_v4
 inline static IPAddr_v4 toAAAddr(in_addr addr){
 #ifdef OS_WINDOWS
@@ -124,15 +153,18 @@ inline static addrinfo toCAddr(const IPAddr& addr){
 
 // 将boost的ip地址,转换成ArmyAnt::IPAddr
 inline static IPAddr& toAAAddr(boost::asio::ip::address addr){
+	// 多个反应器线程会同时调用, 因此每个线程使用各自的返回值对象
 	if(addr.is_v4()){
-		static auto ret = IPAddr_v4(addr.to_v4().to_ulong());
+		static thread_local IPAddr_v4 ret(0, 0, 0, 0);
+		ret = IPAddr_v4(addr.to_v4().to_ulong());
 		return ret;
 	} else{
 		auto bts = addr.to_v6().to_bytes();
 		uint8 ip[16];
 		for(int i = 0; i < 16; i++)
 			ip[i] = bts[i];
-		static auto ret = IPAddr_v6(ip);
+		static thread_local IPAddr_v6 ret(nullptr);
+		ret = IPAddr_v6(ip);
 		return ret;
 	}
 }
@@ -157,6 +189,43 @@ inline static bool getLocalMachineIsBigEnding(){
 	return u.c != 1;
 }
 
+// 池化接收: 先等待套接字可读, 再按可读的字节数从缓冲池借出缓冲区读取, 回调结束后立即归还, 因此空闲的连接不占用接收缓冲区
+// 单次读取的长度不超过maxLen, 回调原型为 void(boost::system::error_code err, const uint8* data, std::size_t size), data只在回调期间有效
+// framer不为空且暂存有不完整的消息时, 直接读入分帧器的暂存区
+template<class Executor, class Handler>
+static void asyncReceivePooled(std::shared_ptr<boost::asio::ip::tcp::socket> s, uint32 maxLen, SocketFramer* framer, const Executor& executor, Handler handler){
+	s->async_wait(boost::asio::ip::tcp::socket::wait_read, boost::asio::bind_executor(executor, [s, maxLen, framer, executor, handler](boost::system::error_code err){
+		if(err){
+			handler(err, nullptr, 0);
+			return;
+		}
+		auto available = s->available(err);
+		if(err){
+			handler(err, nullptr, 0);
+			return;
+		}
+		if(available == 0){
+			// 可读却没有数据, 一般是对方已关闭或连接出错, 借出最小的缓冲区异步读取, 以得到确切的结果
+			std::shared_ptr<SocketBuffer> buffer(new SocketBuffer(SocketBufferPool::minSize));
+			s->async_read_some(boost::asio::buffer(buffer->data(), buffer->size()), boost::asio::bind_executor(executor, [buffer, handler](boost::system::error_code err, std::size_t size){
+				handler(err, buffer->data(), size);
+			}));
+			return;
+		}
+		// 数据已经到达, 同步读取不会阻塞
+		auto len = uint32(std::min<std::size_t>(available, maxLen));
+		auto target = framer != nullptr ? framer->prepare(len) : nullptr;
+		if(target != nullptr){
+			auto size = s->read_some(boost::asio::buffer(target, len), err);
+			handler(err, target, size);
+			return;
+		}
+		SocketBuffer buffer(len);
+		auto size = s->read_some(boost::asio::buffer(buffer.data(), buffer.size()), err);
+		handler(err, buffer.data(), size);
+	}));
+}
+
 /************* Source for class IPAddr and its derived classes ************/
 
 
@@ -561,10 +630,80 @@ SocketException::SocketException(const SocketException & value)
 SocketException::SocketException(SocketException && moved)
 	: type(moved.type), message(moved.message), code(moved.code){}
 
+/******************* Source for class SendingBuffer ***********************/
+
+// 以delete[]释放数据, 用于接管了所有权的数据块
+static void deleteSendingArray(const void*data, void*){
+	delete[] static_cast<const uint8*>(data);
+}
+
+SendingBuffer::SendingBuffer()
+	:data(nullptr), len(0), deleter(nullptr), pUser(nullptr), owner(){}
+
+SendingBuffer::SendingBuffer(const void * data, uint64 len, Deleter deleter, void * pUser)
+	: data(data), len(len), deleter(deleter), pUser(pUser), owner(){}
+
+SendingBuffer::SendingBuffer(std::unique_ptr<uint8[]> data, uint64 len)
+	: data(data.release()), len(len), deleter(deleteSendingArray), pUser(nullptr), owner(){}
+
+SendingBuffer::SendingBuffer(std::shared_ptr<const void> owner, const void * data, uint64 len)
+	: data(data), len(len), deleter(nullptr), pUser(nullptr), owner(std::move(owner)){}
+
+SendingBuffer::SendingBuffer(SendingBuffer && moved)
+	: data(moved.data), len(moved.len), deleter(moved.deleter), pUser(moved.pUser), owner(std::move(moved.owner)){
+	moved.data = nullptr;
+	moved.len = 0;
+	moved.deleter = nullptr;
+	moved.pUser = nullptr;
+}
+
+SendingBuffer::~SendingBuffer(){
+	reset();
+}
+
+SendingBuffer & SendingBuffer::operator=(SendingBuffer && moved){
+	if(this != &moved){
+		reset();
+		data = moved.data;
+		len = moved.len;
+		deleter = moved.deleter;
+		pUser = moved.pUser;
+		owner = std::move(moved.owner);
+		moved.data = nullptr;
+		moved.len = 0;
+		moved.deleter = nullptr;
+		moved.pUser = nullptr;
+	}
+	return *this;
+}
+
+const void * SendingBuffer::getData() const{
+	return data;
+}
+
+uint64 SendingBuffer::getLength() const{
+	return len;
+}
+
+void SendingBuffer::reset(){
+	if(deleter != nullptr)
+		deleter(data, pUser);
+	data = nullptr;
+	len = 0;
+	deleter = nullptr;
+	pUser = nullptr;
+	owner.reset();
+}
+
 /***************** Defination for private data structs ********************/
 
 // 代表一个TCP连接的socket套接字数据
+struct TCPServer_UringOp;
+
 struct TCP_Socket_Datas{
+	// 连接所属io_service上的strand, 保证同一连接的回调串行执行
+	typedef boost::asio::strand<boost::asio::io_service::executor_type> Strand;
+
 	TCP_Socket_Datas();
 	TCP_Socket_Datas(std::shared_ptr <boost::beast::websocket::stream<boost::asio::ip::tcp::socket>> webs, const IPAddr* addr, uint16 port, const IPAddr* localAddr, uint16 localport);
 	TCP_Socket_Datas(std::shared_ptr<boost::asio::ip::tcp::socket> s, const IPAddr* addr, uint16 port, const IPAddr* localAddr, uint16 localport);
@@ -583,10 +722,14 @@ struct TCP_Socket_Datas{
 	uint16 port = 0;				// 对方端口
 	IPAddr* localAddr = nullptr;	// 我方使用的ip地址
 	uint16 localport = 0;			// 我方使用的端口
-	boost::asio::strand<boost::asio::executor>* strand;
-#if defined OS_LINUX
-        std::mutex linuxWebsocketMutex;
-#endif
+	Strand* strand;
+	std::shared_ptr<SendingQueue> sendingQueue;	// 异步发送队列, 每次设定新的套接字时重建, 关闭套接字时关闭
+	std::unique_ptr<SocketFramer> framer;		// 接收分帧器, 不分帧时为空, 只在连接的接收回调中使用
+	boost::beast::flat_buffer webReceiving;		// websocket的接收缓冲区, 每条消息回调后清空复用, 只在连接的接收回调中使用
+	int64 connectedTime = getSteadyMilliseconds();				// 建立连接的时间(毫秒)
+	std::atomic<int64> lastReading{getSteadyMilliseconds()};	// 最后一次收到数据的时间, 用于空闲超时
+	std::atomic<int64> lastWriting{getSteadyMilliseconds()};	// 最后一次写出数据的时间, 同步发送时在调用者线程中更新
+	TCPServer_UringOp* uringReceive = nullptr;	// 使用io_uring接收时, 进行中的多次触发接收操作, 只在反应器线程中访问
 
 private:
 	std::shared_ptr<boost::asio::ip::tcp::socket> s;	//boost的socket连接对象
@@ -601,19 +744,24 @@ struct Socket_Private{
 	Socket_Private();
 	virtual ~Socket_Private();
 
-#if defined OS_LINUX
-	void onTCPSendingResponse(uint32 index, std::shared_ptr<uint8> buffer, boost::asio::ip::tcp::socket*s, boost::system::error_code err, std::size_t size, uint64 realSize, std::mutex*mutex);
-#else
-	void onTCPSendingResponse(uint32 index, std::shared_ptr<uint8> buffer, boost::asio::ip::tcp::socket*s, boost::system::error_code err, std::size_t size, uint64 realSize);
-#endif
+	// 通过连接的发送队列发送一组数据块, 返回写出或入队的字节数, 出错时返回0并通过reportError报告
+	// 同步发送在队列空闲时直接写出调用者的数据块, 完成后将其清空; 异步发送时数据块移交给发送队列, 写出完成或失败后才释放
+	// keepAlive用于在异步写出期间保持服务器的连接数据存活, 客户端传入nullptr
+	template<class Stream, class Executor>
+	mac_uint sendBuffers(std::shared_ptr<TCP_Socket_Datas> keepAlive, TCP_Socket_Datas& conn, std::shared_ptr<Stream> stream, const Executor& executor, uint32 index, SendingBuffer* buffers, uint32 count, bool isAsync, const char* functionName);
 
-	uint32 maxBufferLen = 65530;		// 接收数据的buffer的最大长度
+	uint32 maxBufferLen = 65530;		// 单次接收数据的最大长度, 接收缓冲区按实际到达的数据量从缓冲池借出
 	boost::asio::io_service localService;
 	std::shared_ptr<std::thread> localServiceThread = nullptr;
 
 	Socket::SendingResp asyncResp = nullptr;
 	void* asyncRespUserData = nullptr;
-	uint32 asyncRespTimes = 0;
+	uint64 sendingQueueHighWater = 64 * 1024 * 1024;	// 每个连接的发送队列高水位, 0表示不限制
+	Socket::SendingQueuePolicy sendingQueuePolicy = Socket::SendingQueuePolicy::Block;
+	Socket::SendingQueueCall sendingQueueCall = nullptr;
+	void* sendingQueueCallData = nullptr;
+	Socket::Framing framing;			// TCP接收的分帧方式, 建立连接时为连接创建分帧器
+	Socket::WebSocketDeflate deflate;	// websocket的压缩设定, 握手前设置到连接上
 
 	struct ErrorInfo{
 		SocketException err;
@@ -630,15 +778,9 @@ struct Socket_Private{
 		}
 		~ErrorInfo(){ AA_SAFE_DEL(addr); }
 	};
-	std::mutex errorThreadMutex;
-	std::queue<ErrorInfo> errorInfos;
-	bool isErrorThreadRunning = false;
-	std::thread* errorReportThread = nullptr;
 	Socket::ErrorInfoCall errorReportCallBack = nullptr;
 	void* errorReportUserData = nullptr;
-	static void errorThreading(Socket_Private*self);
-	void startErrorReportThread();
-	void endErrorReportThread();
+	// 设置了错误报告回调时, 通过共用的分发器异步回调, 否则抛出异常
 	void reportError(SocketException err, IPAddr&addr, uint16 port, String functionName);
 
 	bool isAsync = false;				// 是否异步监听, 对于服务器, 总是true
@@ -648,30 +790,136 @@ struct Socket_Private{
 	AA_FORBID_ASSGN_OPR(Socket_Private);
 };
 
+// TCP服务器的反应器, 每个反应器拥有独立的io_service和运行线程, 连接在其整个生命周期内都只属于一个反应器
+struct TCPServer_Reactor{
+	TCPServer_Reactor() :service(), acceptor(service), work(boost::asio::make_work_guard(service)), idleTimer(service), idleWheel(uint64(getSteadyMilliseconds() / idleTick)){}
+	~TCPServer_Reactor();
+
+	static const int64 idleTick = 100;			// 检查连接超时的间隔(毫秒), 即时间轮的一个tick
+	static const int64 acceptRetryDelay = 100;	// accept因资源不足失败后, 重新提交前等待的时间(毫秒)
+
+	boost::asio::io_service service;
+	boost::asio::ip::tcp::acceptor acceptor;	// 使用SO_REUSEPORT时每个反应器各自监听, 否则只有第一个反应器监听
+	boost::asio::executor_work_guard<boost::asio::io_service::executor_type> work;	// 保证没有连接时反应器线程也不会退出
+	boost::asio::steady_timer idleTimer;		// 推进时间轮的定时器, 设定了连接超时才会启动
+	TimerWheel idleWheel;						// 本反应器上连接的超时定时器, 只在反应器线程中访问
+#if defined AA_SOCKET_URING
+	std::unique_ptr<SocketUring> uring;			// 使用io_uring时的提交和完成队列, 只在反应器线程中访问
+	std::unique_ptr<boost::asio::posix::stream_descriptor> uringEvent;	// 在io_service上等待io_uring的完成通知
+	std::unordered_set<TCPServer_UringOp*> uringOps;	// 进行中的多次触发操作, 反应器销毁时释放
+	bool isUringAcceptSupported = true;			// 内核不支持多次触发的accept时, 改用boost::asio接受连接
+	bool isUringReceiveSupported = true;		// 内核不支持多次触发的recv时, 之后的连接改用boost::asio接收
+	boost::asio::steady_timer uringAcceptRetryTimer{service};	// accept因资源不足失败时, 延迟一段时间再重新提交
+#endif
+	std::shared_ptr<std::thread> thread = nullptr;
+
+	AA_FORBID_COPY_CTOR(TCPServer_Reactor);
+	AA_FORBID_ASSGN_OPR(TCPServer_Reactor);
+};
+
+const int64 TCPServer_Reactor::idleTick;
+const int64 TCPServer_Reactor::acceptRetryDelay;
+
+// io_uring中进行中的一个多次触发操作, 地址作为提交项的user_data, 最后一个完成项(不带IORING_CQE_F_MORE)处理后释放
+struct TCPServer_UringOp{
+	enum class Type :uint8{
+		Accept,
+		Receive
+	};
+	Type type = Type::Accept;
+	TCPServer_Reactor* reactor = nullptr;
+	uint32 reactorIndex = 0;					// Accept: 监听的反应器
+	std::shared_ptr<TCP_Socket_Datas> client;	// Receive: 接收的连接
+	uint32 index = 0;
+	bool isCanceled = false;					// 已请求取消, 之后的完成项不再回调
+};
+
+TCPServer_Reactor::~TCPServer_Reactor(){
+#if defined AA_SOCKET_URING
+	// 反应器线程退出时内核已取消该线程提交的所有操作, 操作持有的连接需要在io_service销毁前释放
+	for(auto i = uringOps.begin(); i != uringOps.end(); ++i){
+		if((*i)->client != nullptr)
+			(*i)->client->uringReceive = nullptr;
+		delete *i;
+	}
+	uringOps.clear();
+	uringEvent.reset();
+#endif
+}
+
+// 连接在时间轮中的超时定时器, 每个连接一个
+// 连接读写时只更新时间, 不操作定时器; 定时器到期时再按最新的读写时间计算, 未超时则重新放回时间轮
+// 连接断开后定时器仍留在时间轮中, 到期时发现连接已不在客户端表中才删除
+struct TCPServer_IdleTimer : public TimerWheel::Node{
+	std::weak_ptr<TCP_Socket_Datas> client;
+	uint32 index = 0;
+};
+
 // TCPServer类的私有数据
 struct TCPServer_Private : public Socket_Private{
-	TCPServer_Private(int32 maxClientNum) :Socket_Private(), maxClientNum(maxClientNum), acceptor(localService){};
+	TCPServer_Private(int32 maxClientNum, uint32 threadNum) :Socket_Private(), maxClientNum(maxClientNum), threadNum(threadNum){};
 	virtual ~TCPServer_Private();
 
 	bool start(uint16 port, bool ipv6);
 	bool startWeb(uint16 port, bool ipv6);
 	bool stop(uint32 waitTime);
 
-	void onConnectShared(std::shared_ptr<boost::asio::ip::tcp::socket> s, boost::system::error_code err);
-	void onConnectUnshared(std::shared_ptr<boost::beast::websocket::stream<boost::asio::ip::tcp::socket>> s, boost::system::error_code err);
-	void onReceivedShared(std::shared_ptr<boost::asio::ip::tcp::socket> s, uint32 index, boost::system::error_code err, std::size_t size, std::shared_ptr<uint8>);
-	void onReceivedUnshared(std::shared_ptr < boost::beast::websocket::stream<boost::asio::ip::tcp::socket>> s, uint32 index, boost::system::error_code err, std::size_t size, std::shared_ptr<boost::beast::multi_buffer> buffer);
+	bool startReactors(uint16 port, bool ipv6, bool web);
+	void accept(uint32 reactorIndex);
+	TCPServer_Reactor& getAcceptTarget(uint32 reactorIndex);
+	uint32 addClient(std::shared_ptr<TCP_Socket_Datas> client);
+
+	// 查找连接所属的反应器
+	TCPServer_Reactor* findReactor(const TCP_Socket_Datas& client);
+#if defined AA_SOCKET_URING
+	// 为每个反应器创建io_uring, 任何一个创建失败时都不使用io_uring
+	bool startUring();
+	void armUringAccept(uint32 reactorIndex);
+	bool armUringReceive(std::shared_ptr<TCP_Socket_Datas> client, uint32 index);
+	void cancelUringReceive(TCP_Socket_Datas& client);
+	void waitUring(TCPServer_Reactor* reactor);
+	void onUringCompletion(TCPServer_Reactor* reactor, uint64 userData, int32 result, uint32 flags, const uint8* data);
+	void onUringAccepted(TCPServer_UringOp* op, int32 result, bool isFinal);
+	void retryUringAccept(TCPServer_Reactor* reactor, uint32 reactorIndex);
+	void onUringReceived(TCPServer_UringOp* op, int32 result, const uint8* data);
+#endif
+
+	bool isIdleChecking()const;
+	void startIdleTimer(TCPServer_Reactor* reactor);
+	void onIdleTick(TCPServer_Reactor* reactor, boost::system::error_code err);
+	void onIdleTimerExpired(TCPServer_Reactor& reactor, TCPServer_IdleTimer* timer, int64 now);
+	// 连接最早的超时时间(毫秒)
+	int64 getIdleDeadline(const TCP_Socket_Datas& client)const;
+
+	void onConnectShared(uint32 reactorIndex, std::shared_ptr<boost::asio::ip::tcp::socket> s, boost::system::error_code err);
+	void onAcceptedShared(std::shared_ptr<boost::asio::ip::tcp::socket> s);
+	void onConnectUnshared(uint32 reactorIndex, std::shared_ptr<boost::beast::websocket::stream<boost::asio::ip::tcp::socket>> s, boost::system::error_code err);
+	void receiveShared(std::shared_ptr<TCP_Socket_Datas> client, uint32 index);
+	void onReceivedShared(std::shared_ptr<TCP_Socket_Datas> client, uint32 index, boost::system::error_code err, const uint8* data, std::size_t size);
+	void receiveUnshared(std::shared_ptr<TCP_Socket_Datas> client, uint32 index);
+	void onReceivedUnshared(std::shared_ptr<TCP_Socket_Datas> client, uint32 index, boost::system::error_code err, std::size_t size);
 
 	bool givenUpClient(uint32 index);
 	bool givenUpClient(const IPAddr& addr, uint16 port);
 	bool givenUpAllClients();
+	void closeClient(std::shared_ptr<TCP_Socket_Datas> client);
 
 	int getIndexByAddrPort(const IPAddr&clientAddr, uint16 port);
 
-	boost::asio::ip::tcp::acceptor acceptor;		// 连接接受对象
+	std::vector<std::unique_ptr<TCPServer_Reactor>> reactors;	// 反应器列表, 在start时创建, stop时销毁
+	uint32 nextReactor = 0;		// 不使用SO_REUSEPORT时, 下一个接受连接的反应器
+	bool isReusePort = false;	// 是否每个反应器各自监听端口, 由内核分配连接
+	bool isWeb = false;			// 是否为websocket服务器
+	bool isIPv6 = false;
+	Socket::IOBackend ioBackend = Socket::IOBackend::Asio;		// 设定的I/O后端
+	Socket::IOBackend usingBackend = Socket::IOBackend::Asio;	// 实际使用的I/O后端, 在start时确定
 
 	uint16 serverPort = 0;
 	int32 maxClientNum = 0;
+	uint32 threadNum = 1;		// 反应器数量, 0表示与CPU核心数相同
+	uint32 readIdleTimeout = 0;		// 连接超时设定(毫秒), 0表示不限制
+	uint32 writeIdleTimeout = 0;
+	uint32 lifetime = 0;
 
 	Socket::ServerConnectCall connectCallBack = nullptr;	// 收到连接时的回调
 	void* connetcCallData = nullptr;
@@ -680,8 +928,8 @@ struct TCPServer_Private : public Socket_Private{
 	Socket::ServerGettingCall gettingCallBack = nullptr;	// 接受信息时的回调
 	void* gettingCallData = nullptr;	// 接受信息时的回调要传递的额外数据
 
-	std::map<uint32, TCP_Socket_Datas*> clients;
-	std::mutex clientMutex;
+	// 客户端表, 读写回调自身持有连接的引用, 只有按索引操作连接时才需要查表
+	SlotTable<TCP_Socket_Datas> clients;
 
 private:
 
@@ -696,11 +944,15 @@ struct TCPClient_Private : public Socket_Private, public TCP_Socket_Datas{
 	bool connectServer(bool isAsync, TCPClient::ClientConnectCall asyncConnectCallBack, void* asyncConnectCallData, boost::asio::ip::tcp::socket* socket);
 	bool connectServer(bool isAsync, TCPClient::ClientConnectCall asyncConnectCallBack, void* asyncConnectCallData, std::shared_ptr<boost::beast::websocket::stream<boost::asio::ip::tcp::socket>> socket);
 	bool disconnectServer(uint32 waitTime);
+	// 检查连接状态和待发送的数据块, 通过时len返回数据总长度
+	bool checkSending(const SendingBuffer* buffers, uint32 count, uint64& len, const char* functionName);
 
 	void onAsyncConnect(bool needHandshake, Socket::ClientConnectCall asyncConnectCallBack, void* asyncConnectCallData, boost::system::error_code err);
 	void onConnect(Socket::ClientConnectCall asyncConnectCallBack, void* asyncConnectCallData, boost::system::error_code err);
-	void onReceivedShared(Socket::ClientConnectCall asyncConnectCallBack, void* asyncConnectCallData, boost::system::error_code err, std::size_t size, std::shared_ptr<uint8> buffer);
-	void onReceivedUnshared(Socket::ClientConnectCall asyncConnectCallBack, void* asyncConnectCallData, boost::system::error_code err, std::size_t size, std::shared_ptr<boost::beast::multi_buffer> buffer);
+	void receiveShared(Socket::ClientConnectCall asyncConnectCallBack, void* asyncConnectCallData);
+	void onReceivedShared(Socket::ClientConnectCall asyncConnectCallBack, void* asyncConnectCallData, boost::system::error_code err, const uint8* data, std::size_t size);
+	void receiveUnshared(Socket::ClientConnectCall asyncConnectCallBack, void* asyncConnectCallData);
+	void onReceivedUnshared(Socket::ClientConnectCall asyncConnectCallBack, void* asyncConnectCallData, boost::system::error_code err, std::size_t size);
 
 	Socket::ClientLostCall lostCallBack = nullptr;
 	void* lostCallData = nullptr;
@@ -717,15 +969,39 @@ private:
 struct UDPSingle_Private : public Socket_Private{
 	UDPSingle_Private();
 
+	// 打开套接字, 已打开时不做任何事
+	bool openSocket(bool isIPv4, const char* functionName);
+	void closeSocket();
+	// 按批量大小分配接收缓冲区
+	void prepareReceiving();
+	// 等待套接字可读, 可读后批量收取并回调, 再继续等待
+	void receive();
+	void onReadable(boost::system::error_code err);
+	// 非阻塞地收取一批数据报, 返回收到的数量, 没有数据时返回0
+	uint32 receiveBatch(boost::system::error_code& err);
+	// 转换第index个数据报的来源地址
+	void setSender(uint32 index, const boost::asio::ip::udp::endpoint& sender);
+
 	boost::asio::ip::udp::socket* s = nullptr;	//boost的socket连接对象
 	IPAddr* localAddr = nullptr;
 	uint16 localPort = 0;
-	boost::asio::ip::udp::endpoint recver;
-	std::list<boost::asio::mutable_buffer> recvbuffer;		//接受信息的buffer
-	std::list<boost::asio::mutable_buffer> sendBuffer;	//发送信息的buffer
+
+	uint32 batchSize = 32;									// 一次最多接收的数据报数
+	uint32 slotLen = 0;										// 接收缓冲区中每个数据报的容量, 即开始监听时的maxBufferLen
+	std::unique_ptr<uint8[]> recvRing;						// 接收缓冲区, 开始监听时一次分配, 之后每批接收都复用
+	std::vector<Socket::UDPDatagram> datagrams;				// 每批收到的数据报, 与接收缓冲区的槽位一一对应
+	std::vector<IPAddr_v4> senders4;						// 每个槽位的来源地址, 复用以避免逐个分配
+	std::vector<IPAddr_v6> senders6;
+#if defined AA_SOCKET_MMSG
+	std::vector<mmsghdr> recvMsgs;
+	std::vector<iovec> recvIovs;
+	std::vector<sockaddr_storage> recvAddrs;
+#endif
 
 	Socket::UDPGettingCall gettingCallBack = nullptr;	// 接受信息时的回调
 	void* gettingCallData = nullptr;	// 接受信息时的回调要传递的额外数据
+	Socket::UDPBatchGettingCall batchGettingCallBack = nullptr;	// 批量接受信息时的回调
+	void* batchGettingCallData = nullptr;
 
 	AA_FORBID_COPY_CTOR(UDPSingle_Private);
 	AA_FORBID_ASSGN_OPR(UDPSingle_Private);
@@ -738,10 +1014,10 @@ struct UDPSingle_Private : public Socket_Private{
 TCP_Socket_Datas::TCP_Socket_Datas() :webs(nullptr), s(nullptr), addr(nullptr), port(0), localAddr(nullptr), localport(0), strand(nullptr){}
 
 TCP_Socket_Datas::TCP_Socket_Datas(std::shared_ptr < boost::beast::websocket::stream<boost::asio::ip::tcp::socket>> webs, const IPAddr * addr, uint16 port, const IPAddr * localAddr, uint16 localport)
-	:webs(webs), s(nullptr), addr(IPAddr::clone(*addr)), port(port), localAddr(IPAddr::clone(*localAddr)), localport(localport), strand(new boost::asio::strand<boost::asio::executor>(*webs->get_executor().target<boost::asio::executor>())){}
+	:webs(webs), s(nullptr), addr(IPAddr::clone(*addr)), port(port), localAddr(IPAddr::clone(*localAddr)), localport(localport), strand(new Strand(*webs->get_executor().target<boost::asio::io_service::executor_type>())), sendingQueue(new SendingQueue(true)){}
 
 TCP_Socket_Datas::TCP_Socket_Datas(std::shared_ptr<boost::asio::ip::tcp::socket> s, const IPAddr * addr, uint16 port, const IPAddr* localAddr, uint16 localport)
-	: webs(nullptr), s(s), addr(IPAddr::clone(*addr)), port(port), localAddr(IPAddr::clone(*localAddr)), localport(localport), strand(nullptr){}
+	: webs(nullptr), s(s), addr(IPAddr::clone(*addr)), port(port), localAddr(IPAddr::clone(*localAddr)), localport(localport), strand(new Strand(*s->get_executor().target<boost::asio::io_service::executor_type>())), sendingQueue(new SendingQueue(false)){}
 
 TCP_Socket_Datas::~TCP_Socket_Datas(){
 	if(s != nullptr){
@@ -761,18 +1037,24 @@ TCP_Socket_Datas::~TCP_Socket_Datas(){
 }
 
 void TCP_Socket_Datas::setSocket(std::nullptr_t){
+	if(sendingQueue != nullptr)
+		sendingQueue->close();
 	s.reset();
 	webs.reset();
 }
 
 void TCP_Socket_Datas::setSocket(boost::asio::ip::tcp::socket * socket){
-	if(s.get() != socket)
+	if(s.get() != socket){
 		s.reset(socket);
+		sendingQueue = std::make_shared<SendingQueue>(false);
+	}
 }
 
 void TCP_Socket_Datas::setSocket(std::shared_ptr<boost::beast::websocket::stream<boost::asio::ip::tcp::socket>> websocket){
-	if(webs.get() != websocket.get())
+	if(webs.get() != websocket.get()){
 		webs = websocket;
+		sendingQueue = std::make_shared<SendingQueue>(true);
+	}
 }
 
 boost::asio::ip::tcp::socket * TCP_Socket_Datas::getSocket() const{
@@ -795,6 +1077,8 @@ std::shared_ptr <boost::beast::websocket::stream<boost::asio::ip::tcp::socket>>
 
 void TCP_Socket_Datas::closeSocket(bool noReset){
 	boost::system::error_code err;
+	if(sendingQueue != nullptr)
+		sendingQueue->close();
 	if(s != nullptr && s->is_open())
 		s->close(err);
 	if(webs != nullptr && webs->is_open())
@@ -805,64 +1089,236 @@ void TCP_Socket_Datas::closeSocket(bool noReset){
 	}
 }
 
-void Socket_Private::onTCPSendingResponse(uint32 index, std::shared_ptr<uint8>buffer, boost::asio::ip::tcp::socket*s, boost::system::error_code err, std::size_t size, uint64 realSize
-#if defined OS_LINUX
-, std::mutex* mutex){
-	if(mutex != nullptr)
-	        mutex->unlock();
-	if(asyncResp != nullptr && asyncResp(size, asyncRespTimes++, index, buffer.get(), realSize, asyncRespUserData) && err){
-		if(mutex != nullptr)
-	        	mutex->lock();
-		s->async_write_some(boost::asio::buffer(buffer.get(), realSize), std::bind(&Socket_Private::onTCPSendingResponse, this, index, buffer, s, std::placeholders::_1, std::placeholders::_2, realSize, mutex));
-	}
-#else
-){
-	if(asyncResp != nullptr && asyncResp(size, asyncRespTimes++, index, buffer.get(), realSize, asyncRespUserData) && err)
-		s->async_write_some(boost::asio::buffer(buffer.get(), realSize), std::bind(&Socket_Private::onTCPSendingResponse, this, index, buffer, s, std::placeholders::_1, std::placeholders::_2, realSize));
-#endif
+// 将一组SendingBuffer适配为boost的ConstBufferSequence, 写出时不需要复制数据, 也不需要另建缓冲区列表
+class SendingBufferSequence{
+public:
+	class const_iterator{
+	public:
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef boost::asio::const_buffer value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const boost::asio::const_buffer* pointer;
+		typedef boost::asio::const_buffer reference;
+
+		const_iterator(const SendingBuffer* ptr = nullptr) :ptr(ptr){}
+		reference operator*()const{ return boost::asio::const_buffer(ptr->getData(), std::size_t(ptr->getLength())); }
+		const_iterator& operator++(){ ++ptr; return *this; }
+		const_iterator operator++(int){ auto ret = *this; ++ptr; return ret; }
+		const_iterator& operator--(){ --ptr; return *this; }
+		const_iterator operator--(int){ auto ret = *this; --ptr; return ret; }
+		bool operator==(const const_iterator& value)const{ return ptr == value.ptr; }
+		bool operator!=(const const_iterator& value)const{ return ptr != value.ptr; }
+
+	private:
+		const SendingBuffer* ptr;
+	};
+	typedef boost::asio::const_buffer value_type;
+
+public:
+	SendingBufferSequence(const SendingBuffer* buffers, std::size_t count) :first(buffers), last(buffers + count){}
+	const_iterator begin()const{ return const_iterator(first); }
+	const_iterator end()const{ return const_iterator(last); }
+
+private:
+	const SendingBuffer* first;
+	const SendingBuffer* last;
+};
+
+// 同步写出全部数据, websocket的一次写出作为一条二进制消息
+inline static std::size_t writeBuffers(boost::asio::ip::tcp::socket& s, const SendingBufferSequence& buffers, boost::system::error_code& err){
+	return boost::asio::write(s, buffers, err);
 }
 
-Socket_Private::Socket_Private() :localService(){
-	startErrorReportThread();
+inline static std::size_t writeBuffers(boost::beast::websocket::stream<boost::asio::ip::tcp::socket>& s, const SendingBufferSequence& buffers, boost::system::error_code& err){
+	s.binary(true);   // 必须设置为二进制, 才能传输二进制数据
+	return s.write(buffers, err);
 }
-Socket_Private::~Socket_Private(){
-	endErrorReportThread();
-}
-
-void Socket_Private::errorThreading(Socket_Private*self){
-	while(self->isErrorThreadRunning){
-		std::this_thread::sleep_for(std::chrono::milliseconds(1));
-		self->errorThreadMutex.lock();
-		while(!self->errorInfos.empty()){
-			auto errorInfo = self->errorInfos.front();
-			if(self->errorReportCallBack != nullptr)
-				self->errorReportCallBack(errorInfo.err, *errorInfo.addr, errorInfo.port, errorInfo.functionName, self->errorReportUserData);
-			self->errorInfos.pop();
+
+// 异步写出全部数据, 不会只写出一部分就回调
+template<class Handler>
+inline static void asyncWriteBuffers(boost::asio::ip::tcp::socket& s, const SendingBufferSequence& buffers, Handler&& handler){
+	boost::asio::async_write(s, buffers, std::forward<Handler>(handler));
+}
+
+template<class Handler>
+inline static void asyncWriteBuffers(boost::beast::websocket::stream<boost::asio::ip::tcp::socket>& s, const SendingBufferSequence& buffers, Handler&& handler){
+	s.binary(true);   // 必须设置为二进制, 才能传输二进制数据
+	s.async_write(buffers, std::forward<Handler>(handler));
+}
+
+// 将压缩设定设置到websocket连接上, 需在握手前调用. 作为服务器时只提供服务器角色的扩展, 客户端同理
+inline static void setDeflateOption(boost::beast::websocket::stream<boost::asio::ip::tcp::socket>& s, const Socket::WebSocketDeflate& deflate, bool isServer){
+	if(!deflate.isEnabled)
+		return;
+	boost::beast::websocket::permessage_deflate option;
+	option.server_enable = isServer;
+	option.client_enable = !isServer;
+	option.server_max_window_bits = deflate.serverMaxWindowBits;
+	option.client_max_window_bits = deflate.clientMaxWindowBits;
+	option.server_no_context_takeover = deflate.isServerNoContextTakeover;
+	option.client_no_context_takeover = deflate.isClientNoContextTakeover;
+	option.compLevel = deflate.compLevel;
+	option.memLevel = deflate.memLevel;
+	s.set_option(option);
+}
+
+// 关闭websocket连接的Nagle算法, 需在连接建立后调用
+// beast会把一条消息分成多次写出(客户端按写缓冲区大小分块掩码), 不关闭的话后面的块要等对方的延迟确认, 每条较长的消息多出约40毫秒
+inline static void setNoDelay(boost::beast::websocket::stream<boost::asio::ip::tcp::socket>& s){
+	boost::system::error_code err;
+	s.next_layer().set_option(boost::asio::ip::tcp::no_delay(true), err);
+}
+
+// 读取下一条websocket消息前清空接收缓冲区. 缓冲区保留容量供下一条消息复用, 但超长消息撑大的部分会释放, 以免每个连接长期占用大块内存
+inline static void consumeWebReceiving(boost::beast::flat_buffer& buffer, uint32 maxBufferLen){
+	buffer.consume(buffer.size());
+	if(buffer.capacity() > maxBufferLen)
+		buffer.shrink_to_fit();
+	if(buffer.capacity() < maxBufferLen)
+		buffer.reserve(maxBufferLen);
+}
+
+// 判断当前线程是否正在运行连接所属的io_service, 此时等待发送队列会使队列永远无法写出
+inline static bool isInExecutorThread(const TCP_Socket_Datas::Strand& executor){
+	return executor.get_inner_executor().running_in_this_thread();
+}
+
+inline static bool isInExecutorThread(const boost::asio::io_service::executor_type& executor){
+	return executor.running_in_this_thread();
+}
+
+// 发送队列的写出操作, 在连接的执行器上写出队列取出的一批数据, 完成后继续写出排在后面的数据, 直到队列为空
+// 无参数调用时发起写出, 以(err, size)调用时为写出完成
+template<class Stream, class Executor>
+class SendingQueueOp{
+public:
+	SendingQueueOp(Socket_Private* owner, std::shared_ptr<TCP_Socket_Datas> keepAlive, TCP_Socket_Datas* conn, std::shared_ptr<Stream> stream, const Executor& executor, uint32 index)
+		:owner(owner), keepAlive(keepAlive), conn(conn), stream(stream), queue(conn->sendingQueue), executor(executor), index(index){}
+	SendingQueueOp(SendingQueueOp&& moved)
+		:owner(moved.owner), keepAlive(std::move(moved.keepAlive)), conn(moved.conn), stream(std::move(moved.stream)), queue(std::move(moved.queue)), executor(moved.executor), index(moved.index){}
+
+	void operator()(){
+		auto& s = *stream;
+		auto sequence = SendingBufferSequence(queue->getWriting(), queue->getWritingCount());
+		Executor ex = executor;
+		asyncWriteBuffers(s, sequence, boost::asio::bind_executor(ex, std::move(*this)));
+	}
+
+	void operator()(boost::system::error_code err, std::size_t){
+		if(!err)
+			conn->lastWriting.store(getSteadyMilliseconds(), std::memory_order_relaxed);
+		if(owner->asyncResp != nullptr){
+			auto resp = owner->asyncResp;
+			auto userData = owner->asyncRespUserData;
+			auto idx = index;
+			queue->forEachWriting([&resp, userData, idx, &err](const void* data, uint64 len){
+				resp(err ? 0 : mac_uint(len), 0, idx, data, len, userData);
+			});
 		}
-		self->errorThreadMutex.unlock();
+		if(err){
+			// 写出失败说明连接已断开, 排队的消息也不可能再发出
+			queue->close();
+			owner->reportError(SocketException(SocketException::ErrorType::SystemError, err.message().c_str(), err.value()), *conn->addr, conn->port, "SendingQueue");
+		}
+		uint64 queuedBytes = 0;
+		bool fellToLowWater = false;
+		auto hasMore = queue->finish(queuedBytes, fellToLowWater);
+		if(fellToLowWater && owner->sendingQueueCall != nullptr)
+			owner->sendingQueueCall(index, queuedBytes, false, owner->sendingQueueCallData);
+		if(hasMore)
+			(*this)();
 	}
-}
 
-void Socket_Private::startErrorReportThread(){
-	isErrorThreadRunning = true;
-	errorReportThread = new std::thread(std::bind(errorThreading, this));
+private:
+	Socket_Private* owner;
+	std::shared_ptr<TCP_Socket_Datas> keepAlive;	// 服务器的连接可能在写出期间被移出列表, 需要保持其存活
+	TCP_Socket_Datas* conn;
+	std::shared_ptr<Stream> stream;
+	std::shared_ptr<SendingQueue> queue;
+	Executor executor;
+	uint32 index;
+
+	AA_FORBID_COPY_CTOR(SendingQueueOp);
+	AA_FORBID_ASSGN_OPR(SendingQueueOp);
+};
+
+template<class Stream, class Executor>
+mac_uint Socket_Private::sendBuffers(std::shared_ptr<TCP_Socket_Datas> keepAlive, TCP_Socket_Datas& conn, std::shared_ptr<Stream> stream, const Executor& executor, uint32 index, SendingBuffer* buffers, uint32 count, bool isAsync, const char* functionName){
+	auto queue = conn.sendingQueue;
+	auto canWait = !isInExecutorThread(executor);
+	if(!isAsync){
+		auto result = queue->beginDirect(canWait);
+		if(result == SendingQueue::Result::Start){
+			boost::system::error_code err;
+			auto ret = writeBuffers(*stream, SendingBufferSequence(buffers, count), err);
+			if(!err)
+				conn.lastWriting.store(getSteadyMilliseconds(), std::memory_order_relaxed);
+			for(uint32 i = 0; i < count; ++i)
+				buffers[i].reset();
+			if(queue->endDirect())
+				boost::asio::dispatch(executor, SendingQueueOp<Stream, Executor>(this, keepAlive, &conn, stream, executor, index));
+			if(err){
+				reportError(SocketException(SocketException::ErrorType::SystemError, err.message().c_str(), err.value()), *conn.addr, conn.port, functionName);
+				return 0;
+			}
+			return ret;
+		}
+		if(result == SendingQueue::Result::Queued){
+			// 在反应器线程中无法等待队列写出, 复制数据后入队, 调用者返回后可以立即释放自己的数据
+			for(uint32 i = 0; i < count; ++i){
+				auto len = buffers[i].getLength();
+				if(len == 0)
+					continue;
+				std::unique_ptr<uint8[]> copied(new uint8[len]);
+				memcpy(copied.get(), buffers[i].getData(), len);
+				buffers[i] = SendingBuffer(std::move(copied), len);
+			}
+		}
+	}
+	uint64 len = 0;
+	for(uint32 i = 0; i < count; ++i)
+		len += buffers[i].getLength();
+	uint64 queuedBytes = 0;
+	bool reachedHighWater = false;
+	auto policy = sendingQueuePolicy;
+	auto result = queue->push(buffers, count, sendingQueueHighWater, policy, canWait, queuedBytes, reachedHighWater);
+	if(reachedHighWater && sendingQueueCall != nullptr)
+		sendingQueueCall(index, queuedBytes, true, sendingQueueCallData);
+	switch(result){
+		case SendingQueue::Result::Start:
+			boost::asio::dispatch(executor, SendingQueueOp<Stream, Executor>(this, keepAlive, &conn, stream, executor, index));
+			return mac_uint(len);
+		case SendingQueue::Result::Queued:
+			return mac_uint(len);
+		case SendingQueue::Result::Full:
+			for(uint32 i = 0; i < count; ++i)
+				buffers[i].reset();
+			reportError(SocketException(SocketException::ErrorType::SocketStatueError, "The sending queue is full"), *conn.addr, conn.port, functionName);
+			return 0;
+		default:
+			for(uint32 i = 0; i < count; ++i)
+				buffers[i].reset();
+			reportError(SocketException(SocketException::ErrorType::SocketStatueError, "The connection has been closed"), *conn.addr, conn.port, functionName);
+			return 0;
+	}
 }
 
-void Socket_Private::endErrorReportThread(){
-	isErrorThreadRunning = false;
-	errorReportThread->join();
-	AA_SAFE_DEL(errorReportThread);
-	errorThreadMutex.lock();
-	while(!errorInfos.empty())
-		errorInfos.pop();
-	errorThreadMutex.unlock();
+Socket_Private::Socket_Private() :localService(){
+	SocketErrorDispatcher::get();
+}
+Socket_Private::~Socket_Private(){
+	SocketErrorDispatcher::get().cancel(this);
 }
 
 void Socket_Private::reportError(SocketException err, IPAddr&addr, uint16 port, String functionName){
-	if(errorReportCallBack != nullptr && isErrorThreadRunning){
-		errorThreadMutex.lock();
-		errorInfos.push(ErrorInfo(err, addr, port, functionName));
-		errorThreadMutex.unlock();
+	if(errorReportCallBack != nullptr){
+		ErrorInfo info(err, addr, port, functionName);
+		auto self = this;
+		SocketErrorDispatcher::get().post(this, [self, info](){
+			auto callBack = self->errorReportCallBack;
+			if(callBack != nullptr)
+				callBack(info.err, *info.addr, info.port, info.functionName, self->errorReportUserData);
+		});
 	} else{
 		throw err;
 	}
@@ -871,6 +1327,14 @@ void Socket_Private::reportError(SocketException err, IPAddr&addr, uint16 port,
 TCPServer_Private::~TCPServer_Private(){}
 
 bool TCPServer_Private::start(uint16 port, bool ipv6){
+	return startReactors(port, ipv6, false);
+}
+
+bool ArmyAnt::TCPServer_Private::startWeb(uint16 port, bool ipv6){
+	return startReactors(port, ipv6, true);
+}
+
+bool TCPServer_Private::startReactors(uint16 port, bool ipv6, bool web){
 	std::shared_ptr<IPAddr> ip = nullptr;
 	if(ipv6){
 		std::shared_ptr<IPAddr> ip6(new IPAddr_v6(nullptr));
@@ -888,28 +1352,67 @@ bool TCPServer_Private::start(uint16 port, bool ipv6){
 
 	// 服务器总是异步
 	isAsync = true;
+	isWeb = web;
+	isIPv6 = ipv6;
 	serverPort = port;
+	// 创建反应器, 每个反应器一个线程
+	uint32 reactorNum = threadNum;
+	if(reactorNum == 0)
+		reactorNum = std::max(std::thread::hardware_concurrency(), 1u);
+	for(uint32 i = 0; i < reactorNum; ++i)
+		reactors.push_back(std::unique_ptr<TCPServer_Reactor>(new TCPServer_Reactor()));
+	nextReactor = 0;
+	isReusePort = false;
+#if defined AA_SOCKET_REUSE_PORT
+	// 各反应器使用SO_REUSEPORT监听同一端口, 由内核分配连接, 接受连接时不需要跨线程转交
+	isReusePort = reactorNum > 1;
+#endif
 	// 打开连接接收器
 	auto protocol = ipv6 ? boost::asio::ip::tcp::v6() : boost::asio::ip::tcp::v4();
 	try{
-		auto endP = boost::asio::ip::tcp::endpoint(protocol, port);
-		acceptor.open(protocol);
-		acceptor.bind(endP);
-		// 开始监听
-		acceptor.listen(maxClientNum);
-		// 连接套接字
-		std::shared_ptr<boost::asio::ip::tcp::socket> s(new boost::asio::ip::tcp::socket(localService));
-		acceptor.async_accept(*s, std::bind(&TCPServer_Private::onConnectShared, this, s, std::placeholders::_1));
-		localServiceThread = std::shared_ptr<std::thread>(new std::thread([this, ip, port](){
-			boost::system::error_code err;
-			localService.reset();
-			localService.run(err);
-			auto code = err.value();
-			auto message = err.message();
-			SocketException ex(SocketException::ErrorType::SystemError, message.c_str(), code);
-			reportError(ex, *ip, port, "StartServer localServiceThread");
-		}));
+		for(uint32 i = 0; i < reactorNum && (i == 0 || isReusePort); ++i){
+			auto& acceptor = reactors[i]->acceptor;
+			acceptor.open(protocol);
+#if defined AA_SOCKET_REUSE_PORT
+			if(isReusePort){
+				boost::system::error_code err;
+				acceptor.set_option(ReusePortOption(true), err);
+				// 系统不支持时退回到单个监听者轮流分配连接
+				if(err)
+					isReusePort = false;
+			}
+#endif
+			acceptor.bind(boost::asio::ip::tcp::endpoint(protocol, serverPort));
+			// 端口为0时由系统分配, 其余反应器需要监听同一个端口
+			serverPort = acceptor.local_endpoint().port();
+			// 开始监听
+			acceptor.listen(maxClientNum);
+		}
+		usingBackend = Socket::IOBackend::Asio;
+#if defined AA_SOCKET_URING
+		// websocket的读写都由beast完成, 只有普通TCP连接可以使用io_uring
+		if(ioBackend == Socket::IOBackend::IOUring && !web && startUring())
+			usingBackend = Socket::IOBackend::IOUring;
+#endif
+		for(uint32 i = 0; i < reactorNum; ++i){
+			auto reactor = reactors[i].get();
+			if(reactor->acceptor.is_open())
+				accept(i);
+			if(isIdleChecking())
+				startIdleTimer(reactor);
+			reactor->thread = std::shared_ptr<std::thread>(new std::thread([this, reactor, ip](){
+				boost::system::error_code err;
+				reactor->service.run(err);
+				if(err){
+					auto code = err.value();
+					auto message = err.message();
+					SocketException ex(SocketException::ErrorType::SystemError, message.c_str(), code);
+					reportError(ex, *ip, serverPort, "StartServer reactor thread");
+				}
+			}));
+		}
 	} catch(boost::system::system_error e){
+		reactors.clear();
 		auto code = e.code().value();
 		auto message = e.code().message();
 		SocketException ex(SocketException::ErrorType::SystemError, message.c_str(), code);
@@ -921,144 +1424,388 @@ bool TCPServer_Private::start(uint16 port, bool ipv6){
 	return true;
 }
 
-bool ArmyAnt::TCPServer_Private::startWeb(uint16 port, bool ipv6){
-	std::shared_ptr<IPAddr> ip = nullptr;
-	if(ipv6){
-		std::shared_ptr<IPAddr> ip6(new IPAddr_v6(nullptr));
-		ip = ip6;
-	} else{
-		std::shared_ptr<IPAddr> ip4(new IPAddr_v4(0, 0, 0, 0));
-		ip = ip4;
+bool TCPServer_Private::stop(uint32 waitTime){
+    // TODO: unused parameter waitTime
+	isListening = false;
+	if(reactors.empty()){
+		serverPort = 0;
+		return true;
+	}
+	for(auto i = reactors.begin(); i != reactors.end(); ++i)
+		(*i)->service.stop();
+	for(auto i = reactors.begin(); i != reactors.end(); ++i)
+		if((*i)->thread != nullptr)
+			(*i)->thread->join();
+	for(auto i = reactors.begin(); i != reactors.end(); ++i){
+		boost::system::error_code err;
+		if((*i)->acceptor.is_open())
+			(*i)->acceptor.close(err);
+	}
+	bool ret = givenUpAllClients();
+	if(!ret){
+		auto ip6 = IPAddr_v6(nullptr);
+		SocketException ex(SocketException::ErrorType::SocketStatueError, "GivenUpAllClients failed");
+		reportError(ex, ip6, serverPort, "StopServer");
 	}
+	// 所有反应器线程都已退出, 连接也已释放, 此时才能销毁io_service
+	reactors.clear();
+	serverPort = 0;
+	return ret;
+}
 
-	if(isListening){
-		SocketException ex(SocketException::ErrorType::SocketStatueError, "The server has started");
-		reportError(ex, *ip, port, "StartServer");
-		return false;
+void TCPServer_Private::accept(uint32 reactorIndex){
+#if defined AA_SOCKET_URING
+	// 使用io_uring时提交一次多次触发的accept即可, 提交要在反应器线程中进行
+	if(reactors[reactorIndex]->uring != nullptr && reactors[reactorIndex]->isUringAcceptSupported){
+		boost::asio::post(reactors[reactorIndex]->service, std::bind(&TCPServer_Private::armUringAccept, this, reactorIndex));
+		return;
+	}
+#endif
+	auto& acceptor = reactors[reactorIndex]->acceptor;
+	auto& target = getAcceptTarget(reactorIndex);
+	// 新连接的套接字直接创建在它所属的反应器上
+	if(isWeb){
+		std::shared_ptr<boost::beast::websocket::stream<boost::asio::ip::tcp::socket>> s(new boost::beast::websocket::stream<boost::asio::ip::tcp::socket>{target.service});
+		acceptor.async_accept(s->next_layer(), std::bind(&TCPServer_Private::onConnectUnshared, this, reactorIndex, s, std::placeholders::_1));
+	} else{
+		std::shared_ptr<boost::asio::ip::tcp::socket> s(new boost::asio::ip::tcp::socket(target.service));
+		acceptor.async_accept(*s, std::bind(&TCPServer_Private::onConnectShared, this, reactorIndex, s, std::placeholders::_1));
 	}
+}
 
-	// 服务器总是异步
-	isAsync = true;
-	serverPort = port;
-	// 打开连接接收器
-	auto protocol = ipv6 ? boost::asio::ip::tcp::v6() : boost::asio::ip::tcp::v4();
-	try{
-		auto endP = boost::asio::ip::tcp::endpoint(protocol, port);
-		acceptor.open(protocol);
-		acceptor.bind(endP);
-		// 开始监听
-		acceptor.listen(maxClientNum);
-		// 连接套接字
-		std::shared_ptr<boost::beast::websocket::stream<boost::asio::ip::tcp::socket>> s(new boost::beast::websocket::stream<boost::asio::ip::tcp::socket>{localService});
-		acceptor.async_accept(s->next_layer(), std::bind(&TCPServer_Private::onConnectUnshared, this, s, std::placeholders::_1));
-		localServiceThread = std::shared_ptr<std::thread>(new std::thread([this, ip, port](){
-			boost::system::error_code err;
-			localService.reset();
-			localService.run(err);
-			auto code = err.value();
-			auto message = err.message();
-			SocketException ex(SocketException::ErrorType::SystemError, message.c_str(), code);
-			reportError(ex, *ip, port, "StartServer localServiceThread");
-		}));
-	} catch(boost::system::system_error e){
-		auto code = e.code().value();
-		auto message = e.code().message();
-		SocketException ex(SocketException::ErrorType::SystemError, message.c_str(), code);
-		reportError(ex, *ip, port, "StartServer");
-		return false;
+TCPServer_Reactor& TCPServer_Private::getAcceptTarget(uint32 reactorIndex){
+	// 各自监听时, 连接就属于接受它的反应器
+	if(isReusePort)
+		return *reactors[reactorIndex];
+	// 否则只有第一个反应器在监听, 依次轮流分配给各个反应器, nextReactor只在该反应器线程中访问
+	auto& ret = *reactors[nextReactor];
+	nextReactor = (nextReactor + 1) % uint32(reactors.size());
+	return ret;
+}
+
+uint32 TCPServer_Private::addClient(std::shared_ptr<TCP_Socket_Datas> client){
+	auto index = clients.add(client);
+	if(index == SlotTable<TCP_Socket_Datas>::invalidIndex){
+		client->closeSocket(true);
+		SocketException ex(SocketException::ErrorType::SocketStatueError, "The client table is full");
+		reportError(ex, *client->addr, client->port, "AddClient");
+		return index;
+	}
+	if(isIdleChecking()){
+		// 此时正在连接所属的反应器线程中, 定时器放入该反应器的时间轮
+		auto reactor = findReactor(*client);
+		if(reactor != nullptr){
+			auto timer = new TCPServer_IdleTimer();
+			timer->client = client;
+			timer->index = index;
+			auto deadline = getIdleDeadline(*client);
+			reactor->idleWheel.add(timer, uint64((deadline + TCPServer_Reactor::idleTick - 1) / TCPServer_Reactor::idleTick));
+		}
 	}
+	return index;
+}
 
-	isListening = true;
-	return true;
+TCPServer_Reactor * TCPServer_Private::findReactor(const TCP_Socket_Datas & client){
+	for(auto i = reactors.begin(); i != reactors.end(); ++i)
+		if(&(*i)->service == &client.strand->context())
+			return i->get();
+	return nullptr;
 }
 
-bool TCPServer_Private::stop(uint32 waitTime){
-    // TODO: unused parameter waitTime
-	isListening = false;
-	localService.stop();
-	if(localServiceThread != nullptr)
-		localServiceThread->join();
-	if(acceptor.is_open()){
-		acceptor.cancel();
-		if(!givenUpAllClients()){
-			auto ip4 = IPAddr_v4(0, 0, 0, 0);
-			auto ip6 = IPAddr_v6(nullptr);
-			IPAddr*ip = &ip6;
-			SocketException ex(SocketException::ErrorType::SocketStatueError, "GivenUpAllClients failed");
-			reportError(ex, *ip, serverPort, "StopServer");
+#if defined AA_SOCKET_URING
+
+bool TCPServer_Private::startUring(){
+	// 接收缓冲区不必与maxBufferLen一样大, 一次收到的数据较多时会分成多个完成项
+	auto bufferLen = std::min(maxBufferLen, uint32(16384));
+	for(auto i = reactors.begin(); i != reactors.end(); ++i){
+		(*i)->uring.reset(SocketUring::create(256, 512, bufferLen));
+		if((*i)->uring == nullptr){
+			for(auto j = reactors.begin(); j != reactors.end(); ++j)
+				(*j)->uring.reset();
 			return false;
 		}
-		acceptor.close();
 	}
-	serverPort = 0;
+	for(auto i = reactors.begin(); i != reactors.end(); ++i){
+		auto reactor = i->get();
+		// stream_descriptor关闭时会关闭其持有的描述符, 因此交给它一个复制的eventfd
+		reactor->uringEvent.reset(new boost::asio::posix::stream_descriptor(reactor->service, dup(reactor->uring->getEventFd())));
+		waitUring(reactor);
+	}
+	return true;
+}
+
+void TCPServer_Private::armUringAccept(uint32 reactorIndex){
+	auto reactor = reactors[reactorIndex].get();
+	auto op = new TCPServer_UringOp();
+	op->type = TCPServer_UringOp::Type::Accept;
+	op->reactor = reactor;
+	op->reactorIndex = reactorIndex;
+	reactor->uringOps.insert(op);
+	reactor->uring->prepareMultishotAccept(reactor->acceptor.native_handle(), reinterpret_cast<uint64>(op));
+	reactor->uring->submit();
+}
+
+bool TCPServer_Private::armUringReceive(std::shared_ptr<TCP_Socket_Datas> client, uint32 index){
+	auto reactor = findReactor(*client);
+	if(reactor == nullptr || reactor->uring == nullptr || !reactor->isUringReceiveSupported)
+		return false;
+	auto s = client->getSharedSocket();
+	if(s == nullptr || !s->is_open())
+		return true;
+	auto op = new TCPServer_UringOp();
+	op->type = TCPServer_UringOp::Type::Receive;
+	op->reactor = reactor;
+	op->client = client;
+	op->index = index;
+	reactor->uringOps.insert(op);
+	client->uringReceive = op;
+	reactor->uring->prepareMultishotReceive(s->native_handle(), reinterpret_cast<uint64>(op));
+	reactor->uring->submit();
 	return true;
 }
 
-void TCPServer_Private::onConnectShared(std::shared_ptr<boost::asio::ip::tcp::socket> s, boost::system::error_code err){
-	std::shared_ptr<boost::asio::ip::tcp::socket> news(new boost::asio::ip::tcp::socket(localService));
-	acceptor.async_accept(*news, std::bind(&TCPServer_Private::onConnectShared, this, news, std::placeholders::_1));
+void TCPServer_Private::cancelUringReceive(TCP_Socket_Datas & client){
+	auto op = client.uringReceive;
+	if(op == nullptr)
+		return;
+	// 操作持有套接字的引用, 不取消的话关闭套接字后仍会继续接收
+	op->isCanceled = true;
+	op->reactor->uring->prepareCancel(reinterpret_cast<uint64>(op));
+	op->reactor->uring->submit();
+}
+
+void TCPServer_Private::waitUring(TCPServer_Reactor * reactor){
+	reactor->uringEvent->async_wait(boost::asio::posix::stream_descriptor::wait_read, [this, reactor](boost::system::error_code err){
+		if(err == boost::asio::error::operation_aborted)
+			return;
+		// 先清除通知再处理完成项, 处理期间新到的完成项会再次触发通知
+		reactor->uring->clearEvent();
+		reactor->uring->forEachCompletion([this, reactor](uint64 userData, int32 result, uint32 flags, const uint8* data){
+			onUringCompletion(reactor, userData, result, flags, data);
+		});
+		waitUring(reactor);
+	});
+}
+
+void TCPServer_Private::onUringCompletion(TCPServer_Reactor * reactor, uint64 userData, int32 result, uint32 flags, const uint8 * data){
+	// 取消请求自身的完成项
+	if(userData == 0)
+		return;
+	auto op = reinterpret_cast<TCPServer_UringOp*>(userData);
+	auto isFinal = (flags & IORING_CQE_F_MORE) == 0;
+	if(isFinal){
+		// 在回调之前摘除, 回调中可以重新提交
+		reactor->uringOps.erase(op);
+		if(op->client != nullptr && op->client->uringReceive == op)
+			op->client->uringReceive = nullptr;
+	}
+	if(!op->isCanceled){
+		if(op->type == TCPServer_UringOp::Type::Accept)
+			onUringAccepted(op, result, isFinal);
+		else
+			onUringReceived(op, result, data);
+	}
+	if(isFinal)
+		delete op;
+}
+
+void TCPServer_Private::onUringAccepted(TCPServer_UringOp * op, int32 result, bool isFinal){
+	if(result >= 0){
+		auto& target = getAcceptTarget(op->reactorIndex);
+		std::shared_ptr<boost::asio::ip::tcp::socket> s(new boost::asio::ip::tcp::socket(target.service));
+		boost::system::error_code err;
+		s->assign(isIPv6 ? boost::asio::ip::tcp::v6() : boost::asio::ip::tcp::v4(), result, err);
+		if(err)
+			::close(result);
+		else
+			boost::asio::dispatch(s->get_executor(), std::bind(&TCPServer_Private::onAcceptedShared, this, s));
+	} else if(result == -EINVAL){
+		// 内核不支持多次触发的accept
+		op->reactor->isUringAcceptSupported = false;
+	} else if(isFinal && (result == -EMFILE || result == -ENFILE || result == -ENOMEM || result == -ENOBUFS)){
+		// 文件描述符或内存不足, 立即重新提交只会马上再次失败, 使反应器线程空转
+		if(isListening)
+			retryUringAccept(op->reactor, op->reactorIndex);
+		return;
+	}
+	if(isFinal && isListening)
+		accept(op->reactorIndex);
+}
+
+void TCPServer_Private::retryUringAccept(TCPServer_Reactor * reactor, uint32 reactorIndex){
+	reactor->uringAcceptRetryTimer.expires_after(std::chrono::milliseconds(TCPServer_Reactor::acceptRetryDelay));
+	reactor->uringAcceptRetryTimer.async_wait([this, reactorIndex](boost::system::error_code err){
+		if(err == boost::asio::error::operation_aborted || !isListening)
+			return;
+		accept(reactorIndex);
+	});
+}
+
+void TCPServer_Private::onUringReceived(TCPServer_UringOp * op, int32 result, const uint8 * data){
+	auto client = op->client;
+	if(result > 0){
+		onReceivedShared(client, op->index, boost::system::error_code(), data, std::size_t(result));
+	} else if(result == 0){
+		onReceivedShared(client, op->index, boost::asio::error::eof, nullptr, 0);
+	} else if(result == -ENOBUFS){
+		// 接收缓冲区暂时用完, 前面的完成项处理后已归还, 重新提交即可
+		receiveShared(client, op->index);
+	} else if(result == -EINVAL){
+		// 内核不支持多次触发的recv
+		op->reactor->isUringReceiveSupported = false;
+		receiveShared(client, op->index);
+	} else{
+		onReceivedShared(client, op->index, boost::system::error_code(-result, boost::asio::error::get_system_category()), nullptr, 0);
+	}
+}
+
+#endif // defined AA_SOCKET_URING
+
+bool TCPServer_Private::isIdleChecking() const{
+	return readIdleTimeout != 0 || writeIdleTimeout != 0 || lifetime != 0;
+}
+
+void TCPServer_Private::startIdleTimer(TCPServer_Reactor * reactor){
+	reactor->idleTimer.expires_after(std::chrono::milliseconds(TCPServer_Reactor::idleTick));
+	reactor->idleTimer.async_wait(std::bind(&TCPServer_Private::onIdleTick, this, reactor, std::placeholders::_1));
+}
+
+void TCPServer_Private::onIdleTick(TCPServer_Reactor * reactor, boost::system::error_code err){
+	if(err == boost::asio::error::operation_aborted)
+		return;
+	auto now = getSteadyMilliseconds();
+	reactor->idleWheel.advance(uint64(now / TCPServer_Reactor::idleTick), [this, reactor, now](TimerWheel::Node* node){
+		onIdleTimerExpired(*reactor, static_cast<TCPServer_IdleTimer*>(node), now);
+	});
+	startIdleTimer(reactor);
+}
+
+void TCPServer_Private::onIdleTimerExpired(TCPServer_Reactor & reactor, TCPServer_IdleTimer * timer, int64 now){
+	auto index = timer->index;
+	auto client = timer->client.lock();
+	if(client == nullptr || clients.get(index) != client){
+		delete timer;
+		return;
+	}
+	auto deadline = getIdleDeadline(*client);
+	if(now < deadline){
+		reactor.idleWheel.add(timer, uint64((deadline + TCPServer_Reactor::idleTick - 1) / TCPServer_Reactor::idleTick));
+		return;
+	}
+	delete timer;
+	if(lostCallBack != nullptr)
+		lostCallBack(index, lostCallData);
+	givenUpClient(index);
+}
+
+int64 TCPServer_Private::getIdleDeadline(const TCP_Socket_Datas & client) const{
+	auto ret = std::numeric_limits<int64>::max();
+	if(readIdleTimeout != 0)
+		ret = std::min(ret, client.lastReading.load(std::memory_order_relaxed) + readIdleTimeout);
+	if(writeIdleTimeout != 0)
+		ret = std::min(ret, client.lastWriting.load(std::memory_order_relaxed) + writeIdleTimeout);
+	if(lifetime != 0)
+		ret = std::min(ret, client.connectedTime + lifetime);
+	return ret;
+}
+
+void TCPServer_Private::onConnectShared(uint32 reactorIndex, std::shared_ptr<boost::asio::ip::tcp::socket> s, boost::system::error_code err){
+	if(err == boost::asio::error::operation_aborted)
+		return;
+	accept(reactorIndex);
 	if(!err){
-		uint32 index = 0;
-		clientMutex.lock();
-		for(uint32 i = 0; i < clients.size() + 1; i++)
-			if(clients.find(i) == clients.end()){
-				clients.insert(std::pair<uint32, TCP_Socket_Datas*>(i, new TCP_Socket_Datas(s, &toAAAddr(s->remote_endpoint().address()), s->remote_endpoint().port(), &toAAAddr(s->local_endpoint().address()), s->local_endpoint().port())));
-				index = i;
-				break;
-			}
-		if(connectCallBack == nullptr || connectCallBack(index, connetcCallData)){
-			auto buffer = std::shared_ptr<uint8>(new uint8[maxBufferLen]);
-			s->async_read_some(boost::asio::buffer(buffer.get(), maxBufferLen), std::bind(&TCPServer_Private::onReceivedShared, this, s, index, std::placeholders::_1, std::placeholders::_2, buffer));
-		} else{
-			givenUpClient(index);
-		}
-		clientMutex.unlock();
+		// 转到连接所属的反应器线程中处理, 此后该连接的所有回调都在这个线程中执行
+		boost::asio::dispatch(s->get_executor(), std::bind(&TCPServer_Private::onAcceptedShared, this, s));
 	}
 }
 
-void TCPServer_Private::onConnectUnshared(std::shared_ptr < boost::beast::websocket::stream<boost::asio::ip::tcp::socket>> s, boost::system::error_code err){
-	std::shared_ptr<boost::beast::websocket::stream<boost::asio::ip::tcp::socket>> news(new boost::beast::websocket::stream<boost::asio::ip::tcp::socket>{localService});
-	acceptor.async_accept(news->next_layer(), std::bind(&TCPServer_Private::onConnectUnshared, this, news, std::placeholders::_1));
+void TCPServer_Private::onAcceptedShared(std::shared_ptr<boost::asio::ip::tcp::socket> s){
+	boost::system::error_code err;
+	auto remote = s->remote_endpoint(err);
 	if(err)
-		auto msg = err.message();
-	else{
-		s->async_accept([this, s](boost::system::error_code err){
-			if(err)
-				auto msg = err.message();
-			else{
-				clientMutex.lock();
-				uint32 index = 0;
-				auto clientData = new TCP_Socket_Datas(s, &toAAAddr(s->next_layer().remote_endpoint().address()), s->next_layer().remote_endpoint().port(), &toAAAddr(s->next_layer().local_endpoint().address()), s->next_layer().local_endpoint().port());
-				for(uint32 i = 0; i < clients.size() + 1; i++)
-					if(clients.find(i) == clients.end()){
-						clients.insert(std::pair<uint32, TCP_Socket_Datas*>(i, clientData));
-						index = i;
-						break;
-					}
-				if(connectCallBack == nullptr || connectCallBack(index, connetcCallData)){
-					auto buffer = std::shared_ptr<boost::beast::multi_buffer>(new boost::beast::multi_buffer(maxBufferLen));
-					s->binary(true);   // 必须设置为二进制, 才能传输二进制数据
-					s->async_read_some(boost::asio::buffer(buffer.get(), maxBufferLen), boost::asio::bind_executor<boost::asio::executor>(*clientData->strand, std::bind(&TCPServer_Private::onReceivedUnshared, this, s, index, std::placeholders::_1, std::placeholders::_2, buffer)));
-				} else{
-					givenUpClient(index);
-				}
-				clientMutex.unlock();
-			}
-		});
+		return;
+	auto local = s->local_endpoint(err);
+	if(err)
+		return;
+	// toAAAddr返回的是线程内共用的对象, 第二次调用前需要先复制
+	std::unique_ptr<IPAddr> remoteAddr(IPAddr::clone(toAAAddr(remote.address())));
+	std::shared_ptr<TCP_Socket_Datas> client(new TCP_Socket_Datas(s, remoteAddr.get(), remote.port(), &toAAAddr(local.address()), local.port()));
+	if(framing.type != Socket::FramingType::None)
+		client->framer.reset(new SocketFramer(framing));
+	auto index = addClient(client);
+	if(index == SlotTable<TCP_Socket_Datas>::invalidIndex)
+		return;
+	if(connectCallBack == nullptr || connectCallBack(index, connetcCallData)){
+		receiveShared(client, index);
+	} else{
+		givenUpClient(index);
 	}
 }
 
-void TCPServer_Private::onReceivedShared(std::shared_ptr<boost::asio::ip::tcp::socket> s, uint32 index, boost::system::error_code err, std::size_t size, std::shared_ptr<uint8> buffer){
-	clientMutex.lock();
-	auto client = clients.find(index)->second;
-	clientMutex.unlock();
+void TCPServer_Private::onConnectUnshared(uint32 reactorIndex, std::shared_ptr < boost::beast::websocket::stream<boost::asio::ip::tcp::socket>> s, boost::system::error_code err){
+	if(err == boost::asio::error::operation_aborted)
+		return;
+	accept(reactorIndex);
+	if(err)
+		return;
+	// 握手完成的回调在连接所属的反应器线程中执行
+	setDeflateOption(*s, deflate, true);
+	setNoDelay(*s);
+	s->async_accept([this, s](boost::system::error_code err){
+		if(err)
+			return;
+		auto remote = s->next_layer().remote_endpoint(err);
+		if(err)
+			return;
+		auto local = s->next_layer().local_endpoint(err);
+		if(err)
+			return;
+		std::unique_ptr<IPAddr> remoteAddr(IPAddr::clone(toAAAddr(remote.address())));
+		std::shared_ptr<TCP_Socket_Datas> clientData(new TCP_Socket_Datas(s, remoteAddr.get(), remote.port(), &toAAAddr(local.address()), local.port()));
+		auto index = addClient(clientData);
+		if(index == SlotTable<TCP_Socket_Datas>::invalidIndex)
+			return;
+		if(connectCallBack == nullptr || connectCallBack(index, connetcCallData)){
+			s->binary(true);   // 必须设置为二进制, 才能传输二进制数据
+			receiveUnshared(clientData, index);
+		} else{
+			givenUpClient(index);
+		}
+	});
+}
+
+void TCPServer_Private::receiveShared(std::shared_ptr<TCP_Socket_Datas> client, uint32 index){
+#if defined AA_SOCKET_URING
+	// 多次触发的接收仍在进行时, 不需要再次提交
+	if(client->uringReceive != nullptr)
+		return;
+	if(usingBackend == Socket::IOBackend::IOUring && armUringReceive(client, index))
+		return;
+#endif
+	asyncReceivePooled(client->getSharedSocket(), maxBufferLen, client->framer.get(), *client->strand, std::bind(&TCPServer_Private::onReceivedShared, this, client, index, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
 
+void TCPServer_Private::onReceivedShared(std::shared_ptr<TCP_Socket_Datas> client, uint32 index, boost::system::error_code err, const uint8* data, std::size_t size){
 	if(!err){
-		if(size > 0){
-			gettingCallBack(index, buffer.get(), size, gettingCallData);
-			memset(buffer.get(), 0, maxBufferLen);
+		client->lastReading.store(getSteadyMilliseconds(), std::memory_order_relaxed);
+		if(size > 0 && gettingCallBack != nullptr){
+			if(client->framer == nullptr){
+				gettingCallBack(index, data, size, gettingCallData);
+			} else if(!client->framer->feed(data, uint32(size), [this, index](const uint8* message, uint32 len){ gettingCallBack(index, message, len, gettingCallData); })){
+				// 消息头非法或消息超长, 之后的数据已无法正确切分, 只能断开
+				if(clients.get(index) != client)
+					return;
+				reportError(SocketException(SocketException::ErrorType::InvalidArgument, "Invalid message frame"), *client->addr, client->port, "onReceived");
+				if(lostCallBack != nullptr)
+					lostCallBack(index, lostCallData);
+				givenUpClient(index);
+				return;
+			}
 		}
 	} else{
+		// 已被主动断开的连接, 不再报告错误和回调断开
+		if(clients.get(index) != client)
+			return;
 		auto v = err.value();
 		auto m = err.message();
 		SocketException e(SocketException::ErrorType::SystemError, m.c_str(), v);
@@ -1067,55 +1814,51 @@ void TCPServer_Private::onReceivedShared(std::shared_ptr<boost::asio::ip::tcp::s
 			case boost::asio::error::eof:
 			case boost::asio::error::connection_aborted:
 			case boost::asio::error::connection_reset:
-				lostCallBack(index, lostCallData);
+				if(lostCallBack != nullptr)
+					lostCallBack(index, lostCallData);
 				givenUpClient(index);
 				return;
 		}
 	}
-	memset(buffer.get(), 0, maxBufferLen);
-	s->async_read_some(boost::asio::buffer(buffer.get(), maxBufferLen), boost::asio::bind_executor<boost::asio::executor>(*client->strand, std::bind(&TCPServer_Private::onReceivedShared, this, s, index, std::placeholders::_1, std::placeholders::_2, buffer)));
+	receiveShared(client, index);
+}
+
+void TCPServer_Private::receiveUnshared(std::shared_ptr<TCP_Socket_Datas> client, uint32 index){
+	// 每次读取一条完整的消息, 多个帧组成的消息由beast在缓冲区中拼接
+	consumeWebReceiving(client->webReceiving, maxBufferLen);
+	client->getWebSocket()->async_read(client->webReceiving, boost::asio::bind_executor(*client->strand, std::bind(&TCPServer_Private::onReceivedUnshared, this, client, index, std::placeholders::_1, std::placeholders::_2)));
 }
 
-void TCPServer_Private::onReceivedUnshared(std::shared_ptr < boost::beast::websocket::stream<boost::asio::ip::tcp::socket>> s, uint32 index, boost::system::error_code err, std::size_t size, std::shared_ptr<boost::beast::multi_buffer> buffer){
-	clientMutex.lock();
-	auto client = clients.find(index)->second;
-	clientMutex.unlock();
+void TCPServer_Private::onReceivedUnshared(std::shared_ptr<TCP_Socket_Datas> client, uint32 index, boost::system::error_code err, std::size_t size){
 	if(!err){
-		if(size > 0){
-			std::stringstream strstr;
-			strstr << boost::beast::make_printable(buffer->data());
-			gettingCallBack(index, strstr.str().c_str(), size, gettingCallData);
+		client->lastReading.store(getSteadyMilliseconds(), std::memory_order_relaxed);
+		if(size > 0 && gettingCallBack != nullptr){
+			auto data = client->webReceiving.data();
+			gettingCallBack(index, data.data(), data.size(), gettingCallData);
 		}
 	} else{
-		auto v = err.value();
-		auto m = err.message();
-		SocketException e(SocketException::ErrorType::SystemError, m.c_str(), v);
-		reportError(e, *client->addr, client->port, "onReceived");
-		switch(v){
-			case boost::beast::errc::operation_not_permitted:
-			case boost::asio::error::eof:
-			case boost::asio::error::connection_aborted:
-			case boost::asio::error::connection_reset:
-				lostCallBack(index, lostCallData);
-				givenUpClient(index);
-				return;
+		// 已被主动断开的连接, 不再报告错误和回调断开
+		if(clients.get(index) != client)
+			return;
+		// 对方正常关闭时不作为错误报告
+		if(err != boost::beast::websocket::error::closed){
+			SocketException e(SocketException::ErrorType::SystemError, err.message().c_str(), err.value());
+			reportError(e, *client->addr, client->port, "onReceived");
 		}
+		// websocket连接读取出错后就不能再继续读取, 任何错误都断开连接
+		if(lostCallBack != nullptr)
+			lostCallBack(index, lostCallData);
+		givenUpClient(index);
+		return;
 	}
-	buffer.reset(new boost::beast::multi_buffer(maxBufferLen));
-	s->binary(true);   // 必须设置为二进制, 才能传输二进制数据
-	s->async_read_some(boost::asio::buffer(buffer.get(), maxBufferLen), boost::asio::bind_executor<boost::asio::executor>(*client->strand, std::bind(&TCPServer_Private::onReceivedUnshared, this, s, index, std::placeholders::_1, std::placeholders::_2, buffer)));
+	receiveUnshared(client, index);
 }
 
 bool TCPServer_Private::givenUpClient(uint32 index){
-	clientMutex.lock();
-	auto cl = clients.find(index);
-	if(cl == clients.end()){
-		clientMutex.unlock();
+	auto client = clients.remove(index);
+	if(client == nullptr)
 		return false;
-	}
-	delete cl->second;
-	clients.erase(cl);
-	clientMutex.unlock();
+	closeClient(client);
 	return true;
 }
 
@@ -1127,27 +1870,38 @@ bool TCPServer_Private::givenUpClient(const IPAddr&clientAddr, uint16 port){
 }
 
 bool TCPServer_Private::givenUpAllClients(){
-	clientMutex.lock();
-	auto i = clients.begin();
-	while(i != clients.end()){
-		i->second->closeSocket();
-		delete i->second;
-		i = clients.erase(i);
-	}
-	clientMutex.unlock();
-	return clients.empty();
+	clients.forEach([this](uint32 index, const std::shared_ptr<TCP_Socket_Datas>&){
+		givenUpClient(index);
+		return true;
+	});
+	return clients.size() == 0;
 }
 
-int TCPServer_Private::getIndexByAddrPort(const IPAddr & clientAddr, uint16 port){
-	clientMutex.lock();
-	for(auto i = clients.begin(); i != clients.end(); i++){
-		if(*i->second->addr == clientAddr && i->second->port == port){
-			clientMutex.unlock();
-			return i->first;
-		}
-	}
-	clientMutex.unlock();
-	return -1;
+void TCPServer_Private::closeClient(std::shared_ptr<TCP_Socket_Datas> client){
+	// 连接的其他操作都在它的strand上执行, 关闭也要在strand上进行, 以免与正在进行的读写冲突
+	// 反应器已停止时没有其他操作在进行, 直接关闭即可
+	// 仍未完成的读写回调持有连接的引用, 连接在最后一个回调结束后才会被释放
+	if(isListening)
+		boost::asio::post(*client->strand, [this, client](){
+#if defined AA_SOCKET_URING
+			cancelUringReceive(*client);
+#endif
+			client->closeSocket(true);
+		});
+	else
+		client->closeSocket(true);
+}
+
+int TCPServer_Private::getIndexByAddrPort(const IPAddr & clientAddr, uint16 port){
+	int ret = -1;
+	clients.forEach([&ret, &clientAddr, port](uint32 index, const std::shared_ptr<TCP_Socket_Datas>& client){
+		if(*client->addr == clientAddr && client->port == port){
+			ret = int(index);
+			return false;
+		}
+		return true;
+	});
+	return ret;
 }
 
 TCPClient_Private::~TCPClient_Private(){
@@ -1200,6 +1954,7 @@ bool TCPClient_Private::connectServer(bool async, bool needHandshake, TCPClient:
 			return false;
 		}
 		if(needHandshake){
+			setNoDelay(*getWebSocket());
 			getWebSocket()->handshake((String("ws://") + addr->getStr() + ":" + String(port)).c_str(), "/", err);
 			if(err){
 				auto code = err.value();
@@ -1217,6 +1972,11 @@ bool TCPClient_Private::connectServer(bool async, bool needHandshake, TCPClient:
 
 bool TCPClient_Private::disconnectServer(uint32 waitTime){
     // TODO: unused parameter waitTime
+	// 先停止运行线程并等待其退出, 此后接收回调不会再与这里同时操作套接字
+	localService.stop();
+	if(localServiceThread != nullptr && localServiceThread->joinable() && localServiceThread->get_id() != std::this_thread::get_id()){
+		localServiceThread->join();
+	}
 	if(getSocket() != nullptr){
 		boost::system::error_code err;
 		if(getSocket()->is_open()){
@@ -1229,16 +1989,34 @@ bool TCPClient_Private::disconnectServer(uint32 waitTime){
 		}
 		closeSocket(true);
 	}
-	localService.stop();
-	if(localServiceThread != nullptr && localServiceThread->joinable() && localServiceThread->get_id() != std::this_thread::get_id()){
-		localServiceThread->join();
-	}
 	isListening = false;
 	AA_SAFE_DEL(addr);
 	AA_SAFE_DEL(localAddr);
 	return true;
 }
 
+bool TCPClient_Private::checkSending(const SendingBuffer * buffers, uint32 count, uint64 & len, const char * functionName){
+	if(!isListening){
+		SocketException ex(SocketException::ErrorType::SocketStatueError, "Have not connected to the server");
+		reportError(ex, *addr, port, functionName);
+		return false;
+	}
+	len = 0;
+	for(uint32 i = 0; buffers != nullptr && i < count; ++i){
+		if(buffers[i].getData() == nullptr && buffers[i].getLength() > 0){
+			len = 0;
+			break;
+		}
+		len += buffers[i].getLength();
+	}
+	if(buffers == nullptr || len == 0){
+		SocketException ex(SocketException::ErrorType::InvalidArgument, "Buffer error");
+		reportError(ex, *addr, port, functionName);
+		return false;
+	}
+	return true;
+}
+
 void TCPClient_Private::onAsyncConnect(bool needHandshake, Socket::ClientConnectCall asyncConnectCallBack, void* asyncConnectCallData, boost::system::error_code err){
 	if(err){
 		asyncConnectCallBack(!!err, asyncConnectCallData);
@@ -1257,6 +2035,7 @@ void TCPClient_Private::onAsyncConnect(bool needHandshake, Socket::ClientConnect
 		}
 	} else{
 		if(needHandshake){
+			setNoDelay(*getWebSocket());
 			getWebSocket()->handshake((addr->getStr() + String(":") + String(port)).c_str(), "/", err);
 			if(err){
 				auto code = err.value();
@@ -1276,12 +2055,10 @@ void TCPClient_Private::onConnect(Socket::ClientConnectCall asyncConnectCallBack
 	localAddr = IPAddr::clone(toAAAddr(getSocket()->local_endpoint().address()));
 	localport = getSocket()->local_endpoint().port();
 	if(isShared()){
-		auto buffer = std::shared_ptr<uint8>(new uint8[maxBufferLen]);
-		memset(buffer.get(), 0, maxBufferLen);
-		getSocket()->async_read_some(boost::asio::buffer(buffer.get(), maxBufferLen), std::bind(&TCPClient_Private::onReceivedShared, this, asyncConnectCallBack, asyncConnectCallData, std::placeholders::_1, std::placeholders::_2, buffer));
+		framer.reset(framing.type != Socket::FramingType::None ? new SocketFramer(framing) : nullptr);
+		receiveShared(asyncConnectCallBack, asyncConnectCallData);
 	} else{
-		auto buffer = std::shared_ptr<boost::beast::multi_buffer>(new boost::beast::multi_buffer(maxBufferLen));
-		getWebSocket()->async_read_some(boost::asio::buffer(buffer.get(), maxBufferLen), boost::asio::bind_executor<boost::asio::executor>(*strand, std::bind(&TCPClient_Private::onReceivedUnshared, this, asyncConnectCallBack, asyncConnectCallData, std::placeholders::_1, std::placeholders::_2, buffer)));
+		receiveUnshared(asyncConnectCallBack, asyncConnectCallData);
 	}
 	localServiceThread = std::shared_ptr<std::thread>(new std::thread([this](){
 		boost::system::error_code err;
@@ -1314,10 +2091,26 @@ void TCPClient_Private::onConnect(Socket::ClientConnectCall asyncConnectCallBack
 	}));
 }
 
-void TCPClient_Private::onReceivedShared(Socket::ClientConnectCall asyncConnectCallBack, void* asyncConnectCallData, boost::system::error_code err, std::size_t size, std::shared_ptr<uint8> buffer){
+void TCPClient_Private::receiveShared(Socket::ClientConnectCall asyncConnectCallBack, void* asyncConnectCallData){
+	asyncReceivePooled(getSharedSocket(), maxBufferLen, framer.get(), localService.get_executor(), std::bind(&TCPClient_Private::onReceivedShared, this, asyncConnectCallBack, asyncConnectCallData, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+void TCPClient_Private::onReceivedShared(Socket::ClientConnectCall asyncConnectCallBack, void* asyncConnectCallData, boost::system::error_code err, const uint8* data, std::size_t size){
 	if(!err){
-		if(size > 0){
-			gettingCallBack(buffer.get(), size, gettingCallData);
+		if(size > 0 && gettingCallBack != nullptr){
+			if(framer == nullptr){
+				gettingCallBack(data, size, gettingCallData);
+			} else if(!framer->feed(data, uint32(size), [this](const uint8* message, uint32 len){ gettingCallBack(message, len, gettingCallData); })){
+				// 消息头非法或消息超长, 之后的数据已无法正确切分, 只能断开
+				reportError(SocketException(SocketException::ErrorType::InvalidArgument, "Invalid message frame"), *addr, port, "onReceived");
+				if(getSocket() != nullptr)
+					closeSocket(true);
+				localService.stop();
+				isListening = false;
+				if(lostCallBack != nullptr)
+					lostCallBack(lostCallData);
+				return;
+			}
 		}
 	} else{
 		auto v = err.value();
@@ -1345,45 +2138,47 @@ void TCPClient_Private::onReceivedShared(Socket::ClientConnectCall asyncConnectC
 				return;
 		}
 	}
-	memset(buffer.get(), 0, size);
-	getSocket()->async_read_some(boost::asio::buffer(buffer.get(), maxBufferLen), std::bind(&TCPClient_Private::onReceivedShared, this, asyncConnectCallBack, asyncConnectCallData, std::placeholders::_1, std::placeholders::_2, buffer));
+	receiveShared(asyncConnectCallBack, asyncConnectCallData);
 }
 
-void TCPClient_Private::onReceivedUnshared(Socket::ClientConnectCall asyncConnectCallBack, void * asyncConnectCallData, boost::system::error_code err, std::size_t size, std::shared_ptr<boost::beast::multi_buffer> buffer){
+void TCPClient_Private::receiveUnshared(Socket::ClientConnectCall asyncConnectCallBack, void * asyncConnectCallData){
+	consumeWebReceiving(webReceiving, maxBufferLen);
+	getWebSocket()->async_read(webReceiving, boost::asio::bind_executor(*strand, std::bind(&TCPClient_Private::onReceivedUnshared, this, asyncConnectCallBack, asyncConnectCallData, std::placeholders::_1, std::placeholders::_2)));
+}
+
+void TCPClient_Private::onReceivedUnshared(Socket::ClientConnectCall asyncConnectCallBack, void * asyncConnectCallData, boost::system::error_code err, std::size_t size){
 	if(!err){
-		if(size > 0){
-			std::stringstream strstr;
-			strstr << boost::beast::make_printable(buffer->data());
-			gettingCallBack(strstr.str().c_str(), size, gettingCallData);
+		if(size > 0 && gettingCallBack != nullptr){
+			auto data = webReceiving.data();
+			gettingCallBack(data.data(), data.size(), gettingCallData);
 		}
 	} else{
-		auto v = err.value();
-		auto m = err.message();
-		SocketException e(SocketException::ErrorType::SystemError, m.c_str(), v);
-		reportError(e, *addr, port, "onReceived");
-		switch(v){
-			case boost::asio::error::eof:
-			case boost::asio::error::connection_aborted:
-			case boost::asio::error::connection_reset:
-				if(getSocket() != nullptr){
-					if(getSocket()->is_open()){
-						getSocket()->shutdown(getSocket()->shutdown_both, err);
-					}
-					if(!err)
-						getSocket()->cancel(err);
-					if(!err){
-						getSocket()->close(err);
-					}
-				}
-				localService.stop();
-				isListening = false;
-				setSocket(nullptr);
-				lostCallBack(lostCallData);
-				return;
+		// 主动断开时关闭握手的结果, 不再报告
+		if(!isListening)
+			return;
+		if(err != boost::beast::websocket::error::closed){
+			SocketException e(SocketException::ErrorType::SystemError, err.message().c_str(), err.value());
+			reportError(e, *addr, port, "onReceived");
+		}
+		// websocket连接读取出错后就不能再继续读取, 任何错误都断开连接
+		if(getSocket() != nullptr){
+			if(getSocket()->is_open()){
+				getSocket()->shutdown(getSocket()->shutdown_both, err);
+			}
+			if(!err)
+				getSocket()->cancel(err);
+			if(!err){
+				getSocket()->close(err);
+			}
 		}
+		localService.stop();
+		isListening = false;
+		setSocket(nullptr);
+		if(lostCallBack != nullptr)
+			lostCallBack(lostCallData);
+		return;
 	}
-	buffer = std::shared_ptr<boost::beast::multi_buffer>(new boost::beast::multi_buffer(maxBufferLen));
-	getWebSocket()->async_read_some(boost::asio::buffer(buffer.get(), maxBufferLen), boost::asio::bind_executor < boost::asio::executor >(*strand, std::bind(&TCPClient_Private::onReceivedUnshared, this, asyncConnectCallBack, asyncConnectCallData, std::placeholders::_1, std::placeholders::_2, buffer)));
+	receiveUnshared(asyncConnectCallBack, asyncConnectCallData);
 }
 
 UDPSingle_Private::UDPSingle_Private()
@@ -1391,6 +2186,138 @@ UDPSingle_Private::UDPSingle_Private()
 
 }
 
+bool UDPSingle_Private::openSocket(bool isIPv4, const char* functionName){
+	if(s != nullptr && s->is_open())
+		return true;
+	AA_SAFE_DEL(s);
+	s = new boost::asio::ip::udp::socket(localService);
+	boost::system::error_code err;
+	s->open(isIPv4 ? boost::asio::ip::udp::v4() : boost::asio::ip::udp::v6(), err);
+	if(!err)
+		s->non_blocking(true, err);
+	if(err){
+		AA_SAFE_DEL(s);
+		SocketException ex(SocketException::ErrorType::SystemError, err.message().c_str(), err.value());
+		reportError(ex, isIPv4 ? static_cast<IPAddr&>(IPAddr_v4::localhost()) : static_cast<IPAddr&>(IPAddr_v6::localhost()), 0, functionName);
+		return false;
+	}
+	return true;
+}
+
+void UDPSingle_Private::closeSocket(){
+	if(s != nullptr){
+		boost::system::error_code err;
+		s->cancel(err);
+		s->close(err);
+		AA_SAFE_DEL(s);
+	}
+	AA_SAFE_DEL(localAddr);
+	localPort = 0;
+}
+
+void UDPSingle_Private::prepareReceiving(){
+	slotLen = maxBufferLen;
+	recvRing.reset(new uint8[std::size_t(batchSize) * slotLen]);
+	Socket::UDPDatagram empty = {nullptr, 0, nullptr, 0};
+	datagrams.assign(batchSize, empty);
+	senders4.assign(batchSize, IPAddr_v4(uint32(0)));
+	senders6.assign(batchSize, IPAddr_v6(nullptr));
+#if defined AA_SOCKET_MMSG
+	recvMsgs.assign(batchSize, mmsghdr());
+	recvIovs.assign(batchSize, iovec());
+	recvAddrs.assign(batchSize, sockaddr_storage());
+	for(uint32 i = 0; i < batchSize; ++i){
+		recvIovs[i].iov_base = recvRing.get() + std::size_t(i) * slotLen;
+		recvIovs[i].iov_len = slotLen;
+		memset(&recvMsgs[i], 0, sizeof(mmsghdr));
+		recvMsgs[i].msg_hdr.msg_name = &recvAddrs[i];
+		recvMsgs[i].msg_hdr.msg_iov = &recvIovs[i];
+		recvMsgs[i].msg_hdr.msg_iovlen = 1;
+	}
+#endif
+}
+
+void UDPSingle_Private::receive(){
+	s->async_wait(boost::asio::ip::udp::socket::wait_read, std::bind(&UDPSingle_Private::onReadable, this, std::placeholders::_1));
+}
+
+void UDPSingle_Private::onReadable(boost::system::error_code err){
+	if(err == boost::asio::error::operation_aborted || !isListening)
+		return;
+	// 一次可读最多连续收取若干批, 以免数据源源不断时其他回调得不到执行
+	for(int round = 0; !err && round < 8; ++round){
+		auto count = receiveBatch(err);
+		if(count == 0)
+			break;
+		if(batchGettingCallBack != nullptr){
+			batchGettingCallBack(datagrams.data(), count, batchGettingCallData);
+		} else if(gettingCallBack != nullptr){
+			for(uint32 i = 0; i < count; ++i)
+				gettingCallBack(*datagrams[i].addr, datagrams[i].port, static_cast<uint8*>(const_cast<void*>(datagrams[i].data)), datagrams[i].datalen, gettingCallData);
+		}
+		if(count < batchSize)
+			break;
+	}
+	if(err){
+		SocketException ex(SocketException::ErrorType::SystemError, err.message().c_str(), err.value());
+		reportError(ex, *localAddr, localPort, "UDPSilgle::onReadable");
+	}
+	if(isListening)
+		receive();
+}
+
+uint32 UDPSingle_Private::receiveBatch(boost::system::error_code& err){
+#if defined AA_SOCKET_MMSG
+	for(uint32 i = 0; i < batchSize; ++i)
+		recvMsgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+	int count;
+	do{
+		count = recvmmsg(s->native_handle(), recvMsgs.data(), batchSize, MSG_DONTWAIT, nullptr);
+	} while(count < 0 && errno == EINTR);
+	if(count < 0){
+		if(errno != EAGAIN && errno != EWOULDBLOCK)
+			err = boost::system::error_code(errno, boost::asio::error::get_system_category());
+		return 0;
+	}
+	boost::asio::ip::udp::endpoint sender;
+	for(int i = 0; i < count; ++i){
+		memcpy(sender.data(), &recvAddrs[i], recvMsgs[i].msg_hdr.msg_namelen);
+		setSender(i, sender);
+		datagrams[i].data = recvIovs[i].iov_base;
+		datagrams[i].datalen = recvMsgs[i].msg_len;
+	}
+	return uint32(count);
+#else
+	uint32 count = 0;
+	boost::asio::ip::udp::endpoint sender;
+	for(; count < batchSize; ++count){
+		auto slot = recvRing.get() + std::size_t(count) * slotLen;
+		auto size = s->receive_from(boost::asio::buffer(slot, slotLen), sender, 0, err);
+		if(err){
+			if(err == boost::asio::error::would_block)
+				err = boost::system::error_code();
+			break;
+		}
+		setSender(count, sender);
+		datagrams[count].data = slot;
+		datagrams[count].datalen = size;
+	}
+	return count;
+#endif
+}
+
+void UDPSingle_Private::setSender(uint32 index, const boost::asio::ip::udp::endpoint& sender){
+	auto address = sender.address();
+	if(address.is_v4()){
+		senders4[index] = IPAddr_v4(uint32(address.to_v4().to_ulong()));
+		datagrams[index].addr = &senders4[index];
+	} else{
+		senders6[index] = static_cast<IPAddr_v6&>(toAAAddr(address));
+		datagrams[index].addr = &senders6[index];
+	}
+	datagrams[index].port = sender.port();
+}
+
 /*********************** Source for class Socket **************************/
 
 
@@ -1413,6 +2340,18 @@ bool Socket::setSendingResponseCallBack(SendingResp sendingRespCB, void * pUser)
 	return true;
 }
 
+bool Socket::setSendingQueueLimit(uint64 highWaterBytes, SendingQueuePolicy policy){
+	AA_HANDLE_MANAGER[this]->sendingQueueHighWater = highWaterBytes;
+	AA_HANDLE_MANAGER[this]->sendingQueuePolicy = policy;
+	return true;
+}
+
+bool Socket::setSendingQueueCallBack(SendingQueueCall sendingQueueCB, void * pUser){
+	AA_HANDLE_MANAGER[this]->sendingQueueCall = sendingQueueCB;
+	AA_HANDLE_MANAGER[this]->sendingQueueCallData = pUser;
+	return true;
+}
+
 bool Socket::setErrorReportCallBack(ErrorInfoCall errorReportCB, void * pUser){
 	AA_HANDLE_MANAGER[this]->errorReportCallBack = errorReportCB;
 	AA_HANDLE_MANAGER[this]->errorReportUserData = pUser;
@@ -1472,11 +2411,81 @@ IPAddr_v6 Socket::getLocalIpv6Addr(int index){
 }
 
 
+Socket::Framing::Framing()
+	:type(FramingType::None), headerLen(0), lengthOffset(0), lengthBytes(0), isBigEndian(true), isLengthWithHeader(false), isKeepingHeader(false), delimiterLen(0), maxMessageLen(16 * 1024 * 1024){
+	memset(delimiter, 0, sizeof(delimiter));
+}
+
+Socket::Framing Socket::Framing::makeFixedHeader(uint32 headerLen, uint32 lengthOffset, uint8 lengthBytes, bool isBigEndian, bool isLengthWithHeader){
+	Framing ret;
+	ret.type = FramingType::FixedHeader;
+	ret.headerLen = headerLen;
+	ret.lengthOffset = lengthOffset;
+	ret.lengthBytes = lengthBytes;
+	ret.isBigEndian = isBigEndian;
+	ret.isLengthWithHeader = isLengthWithHeader;
+	return ret;
+}
+
+Socket::Framing Socket::Framing::makeVarint(){
+	Framing ret;
+	ret.type = FramingType::Varint;
+	return ret;
+}
+
+Socket::Framing Socket::Framing::makeDelimiter(const char * delimiter, uint8 delimiterLen){
+	Framing ret;
+	ret.type = FramingType::Delimiter;
+	if(delimiter != nullptr && delimiterLen <= sizeof(ret.delimiter)){
+		memcpy(ret.delimiter, delimiter, delimiterLen);
+		ret.delimiterLen = delimiterLen;
+	}
+	return ret;
+}
+
+bool Socket::Framing::isValid() const{
+	if(maxMessageLen == 0)
+		return false;
+	switch(type){
+		case FramingType::None:
+		case FramingType::Varint:
+			return true;
+		case FramingType::FixedHeader:
+			if(lengthBytes != 1 && lengthBytes != 2 && lengthBytes != 4 && lengthBytes != 8)
+				return false;
+			return uint64(lengthOffset) + lengthBytes <= headerLen;
+		case FramingType::Delimiter:
+			return delimiterLen > 0 && delimiterLen <= sizeof(delimiter);
+	}
+	return false;
+}
+
+Socket::WebSocketDeflate::WebSocketDeflate()
+	:isEnabled(false), serverMaxWindowBits(15), clientMaxWindowBits(15), isServerNoContextTakeover(false), isClientNoContextTakeover(false), compLevel(8), memLevel(4){
+}
+
+Socket::WebSocketDeflate Socket::WebSocketDeflate::makeEnabled(uint8 serverMaxWindowBits, uint8 clientMaxWindowBits, bool isNoContextTakeover){
+	WebSocketDeflate ret;
+	ret.isEnabled = true;
+	ret.serverMaxWindowBits = serverMaxWindowBits;
+	ret.clientMaxWindowBits = clientMaxWindowBits;
+	ret.isServerNoContextTakeover = isNoContextTakeover;
+	ret.isClientNoContextTakeover = isNoContextTakeover;
+	return ret;
+}
+
+bool Socket::WebSocketDeflate::isValid() const{
+	// zlib不能正确处理8位的窗口, 因此最小为9
+	if(serverMaxWindowBits < 9 || serverMaxWindowBits > 15 || clientMaxWindowBits < 9 || clientMaxWindowBits > 15)
+		return false;
+	return compLevel <= 9 && memLevel >= 1 && memLevel <= 9;
+}
+
 /******************* Source for class TCPServer ************************/
 
 
-TCPServer::TCPServer(int32 maxConnNum)
-	:Socket(new TCPServer_Private(maxConnNum)){
+TCPServer::TCPServer(int32 maxConnNum, uint32 threadNum)
+	:Socket(new TCPServer_Private(maxConnNum, threadNum)){
 	//auto hd = static_cast<TCPServer_Private*>(AA_HANDLE_MANAGER[this]);
 }
 
@@ -1516,6 +2525,42 @@ bool TCPServer::setMaxIOBufferLen(uint32 len){
 	return Socket::setMaxIOBufferLen(len);
 }
 
+bool TCPServer::setThreadNum(uint32 threadNum){
+	if(isStarting())
+		return false;
+	static_cast<TCPServer_Private*>(AA_HANDLE_MANAGER[this])->threadNum = threadNum;
+	return true;
+}
+
+bool TCPServer::setFraming(const Framing & framing){
+	if(isStarting() || !framing.isValid())
+		return false;
+	AA_HANDLE_MANAGER[this]->framing = framing;
+	return true;
+}
+
+bool TCPServer::setIOBackend(IOBackend backend){
+	if(isStarting())
+		return false;
+	static_cast<TCPServer_Private*>(AA_HANDLE_MANAGER[this])->ioBackend = backend;
+	return true;
+}
+
+Socket::IOBackend TCPServer::getIOBackend() const{
+	auto hd = static_cast<TCPServer_Private*>(AA_HANDLE_MANAGER[this]);
+	return hd->isListening ? hd->usingBackend : hd->ioBackend;
+}
+
+bool TCPServer::setIdleTimeout(uint32 readIdle, uint32 writeIdle, uint32 lifetime){
+	if(isStarting())
+		return false;
+	auto hd = static_cast<TCPServer_Private*>(AA_HANDLE_MANAGER[this]);
+	hd->readIdleTimeout = readIdle;
+	hd->writeIdleTimeout = writeIdle;
+	hd->lifetime = lifetime;
+	return true;
+}
+
 bool TCPServer::start(uint16 port, bool ipv6){
 	auto hd = static_cast<TCPServer_Private*>(AA_HANDLE_MANAGER[this]);
 	return hd->start(port, ipv6);
@@ -1542,36 +2587,37 @@ bool TCPServer::givenUpAllClients(){
 }
 
 mac_uint TCPServer::send(uint32 index, void * data, uint64 len, bool isAsync){
-	auto hd = static_cast<TCPServer_Private*>(AA_HANDLE_MANAGER[this]);
-	hd->clientMutex.lock();
-	auto cl = hd->clients.find(index);
-	if(cl == hd->clients.end()){
-		hd->clientMutex.unlock();
-		return 0;
-	}
-
-	auto buffer = std::shared_ptr<uint8>(new uint8[len]);
+	if(!isAsync)
+		return send(index, SendingBuffer(data, len), false);
+	// 异步发送时调用者的数据可能在写出前被释放, 需要复制一份
+	std::unique_ptr<uint8[]> buffer(new uint8[len]);
 	memcpy(buffer.get(), data, len);
-	if(!isAsync){
-		auto ret = cl->second->getSocket()->send(boost::asio::buffer(buffer.get(), len));
-		hd->clientMutex.unlock();
-		return ret;
-	} else{
-		hd->asyncRespTimes = 0;
-#ifdef OS_LINUX
-		cl->second->getSocket()->async_write_some(boost::asio::buffer(buffer.get(), len), std::bind(&Socket_Private::onTCPSendingResponse, AA_HANDLE_MANAGER[this], index, buffer, cl->second->getSocket(), std::placeholders::_1, std::placeholders::_2, len, nullptr));
-#else
-		cl->second->getSocket()->async_write_some(boost::asio::buffer(buffer.get(), len), std::bind(&Socket_Private::onTCPSendingResponse, AA_HANDLE_MANAGER[this], index, buffer, cl->second->getSocket(), std::placeholders::_1, std::placeholders::_2, len));
-#endif
-		hd->clientMutex.unlock();
+	return send(index, SendingBuffer(std::move(buffer), len), true);
+}
+
+mac_uint TCPServer::send(uint32 index, SendingBuffer && buffer, bool isAsync){
+	return send(index, &buffer, 1, isAsync);
+}
+
+mac_uint TCPServer::send(uint32 index, SendingBuffer * buffers, uint32 count, bool isAsync){
+	auto hd = static_cast<TCPServer_Private*>(AA_HANDLE_MANAGER[this]);
+	auto cl = hd->clients.get(index);
+	if(cl == nullptr || buffers == nullptr || count == 0)
 		return 0;
-	}
+	return hd->sendBuffers(cl, *cl, cl->getSharedSocket(), *cl->strand, index, buffers, count, isAsync, "TCPServer::send");
 }
 
 int TCPServer::getMaxConnNum() const{
 	return static_cast<TCPServer_Private*>(AA_HANDLE_MANAGER[this])->maxClientNum;
 }
 
+uint32 TCPServer::getThreadNum() const{
+	auto hd = static_cast<TCPServer_Private*>(AA_HANDLE_MANAGER[this]);
+	if(!hd->reactors.empty())
+		return uint32(hd->reactors.size());
+	return hd->threadNum;
+}
+
 int TCPServer::getNowConnNum() const{
 	// WARNING : If the number is larger than INT_MAX
 	return int(static_cast<TCPServer_Private*>(AA_HANDLE_MANAGER[this])->clients.size());
@@ -1579,26 +2625,18 @@ int TCPServer::getNowConnNum() const{
 
 TCPServer::IPAddrInfo TCPServer::getClientByIndex(int index) const{
 	auto hd = static_cast<TCPServer_Private*>(AA_HANDLE_MANAGER[this]);
-	auto hdcls = hd->clients;
-	hd->clientMutex.lock();
-	auto ret = hdcls.find(index);
-	if(ret != hdcls.end()){
-		TCPServer::IPAddrInfo result = {ret->second->addr,ret->second->port,ret->second->localAddr,ret->second->localport};
-		hd->clientMutex.unlock();
-		return result;
-	}
-	hd->clientMutex.unlock();
+	auto ret = hd->clients.get(uint32(index));
+	if(ret != nullptr)
+		return{ret->addr,ret->port,ret->localAddr,ret->localport};
 	return{nullptr,0,nullptr,0};
 }
 void TCPServer::getAllClients(TCPServer::IPAddrInfo* ref) const{
 	auto hd = static_cast<TCPServer_Private*>(AA_HANDLE_MANAGER[this]);
-	auto hdcls = hd->clients;
 	int index = 0;
-	hd->clientMutex.lock();
-	for(auto i = hdcls.begin(); i != hdcls.end(); ++i){
-		ref[index++] = {i->second->addr,i->second->port,i->second->localAddr,i->second->localport};
-	}
-	hd->clientMutex.unlock();
+	hd->clients.forEach([ref, &index](uint32, const std::shared_ptr<TCP_Socket_Datas>& client){
+		ref[index++] = {client->addr,client->port,client->localAddr,client->localport};
+		return true;
+	});
 }
 
 int TCPServer::getIndexByAddrPort(const IPAddr & clientAddr, uint16 port){
@@ -1606,6 +2644,15 @@ int TCPServer::getIndexByAddrPort(const IPAddr & clientAddr, uint16 port){
 	return hd->getIndexByAddrPort(clientAddr, port);
 }
 
+bool TCPServer::getSendingQueueDepth(uint32 index, uint32 & messageCount, uint64 & byteCount) const{
+	auto hd = static_cast<TCPServer_Private*>(AA_HANDLE_MANAGER[this]);
+	auto cl = hd->clients.get(index);
+	if(cl == nullptr)
+		return false;
+	cl->sendingQueue->getDepth(messageCount, byteCount);
+	return true;
+}
+
 bool TCPServer::isStarting()const{
 	return AA_HANDLE_MANAGER[this]->isListening;
 }
@@ -1655,6 +2702,14 @@ bool TCPClient::setGettingCallBack(Socket::ClientGettingCall recvCB, void*pUser)
 	return true;
 }
 
+bool TCPClient::setFraming(const Framing & framing){
+	auto hd = static_cast<TCPClient_Private*>(AA_HANDLE_MANAGER[this]);
+	if(hd->isListening || !framing.isValid())
+		return false;
+	hd->framing = framing;
+	return true;
+}
+
 bool TCPClient::connectServer(bool isAsync, ClientConnectCall asyncConnectCallBack, void* asyncConnectCallData){
     auto hd = static_cast<TCPClient_Private*>(AA_HANDLE_MANAGER[this]);
     auto protocol = hd->addr->getIPVer() == 6 ? boost::asio::ip::tcp::v6() : boost::asio::ip::tcp::v4();
@@ -1683,31 +2738,24 @@ bool TCPClient::disconnectServer(uint32 waitTime){
 }
 
 mac_uint TCPClient::send(const void * pBuffer, size_t len, bool isAsync){
-	auto hd = static_cast<TCPClient_Private*>(AA_HANDLE_MANAGER[this]);
-	if(!hd->isListening){
-		SocketException ex(SocketException::ErrorType::SocketStatueError, "Have not connected to the server");
-		hd->reportError(ex, *hd->addr, hd->port, "TCPClient::Send");
-		return false;
-	}
-	if(pBuffer == nullptr || len <= 0){
-		SocketException ex(SocketException::ErrorType::InvalidArgument, "Buffer error");
-		hd->reportError(ex, *hd->addr, hd->port, "TCPClient::Send");
-		return false;
-	}
-	auto buffer = std::shared_ptr<uint8>(new uint8[len]);
+	if(!isAsync || pBuffer == nullptr)
+		return send(SendingBuffer(pBuffer, len), isAsync);
+	// 异步发送时调用者的数据可能在写出前被释放, 需要复制一份
+	std::unique_ptr<uint8[]> buffer(new uint8[len]);
 	memcpy(buffer.get(), pBuffer, len);
-	if(!isAsync){
-		auto ret = hd->getSocket()->send(boost::asio::buffer(buffer.get(), len));
-		return ret;
-	} else{
-		hd->asyncRespTimes = 0;
-#ifdef OS_LINUX
-		hd->getSocket()->async_write_some(boost::asio::buffer(buffer.get(), len), std::bind(&Socket_Private::onTCPSendingResponse, AA_HANDLE_MANAGER[this], 0, buffer, hd->getSocket(), std::placeholders::_1, std::placeholders::_2, len, nullptr));
-#else
-		hd->getSocket()->async_write_some(boost::asio::buffer(buffer.get(), len), std::bind(&Socket_Private::onTCPSendingResponse, AA_HANDLE_MANAGER[this], 0, buffer, hd->getSocket(), std::placeholders::_1, std::placeholders::_2, len));
-#endif
-		return len;
-	}
+	return send(SendingBuffer(std::move(buffer), len), true);
+}
+
+mac_uint TCPClient::send(SendingBuffer && buffer, bool isAsync){
+	return send(&buffer, 1, isAsync);
+}
+
+mac_uint TCPClient::send(SendingBuffer * buffers, uint32 count, bool isAsync){
+	auto hd = static_cast<TCPClient_Private*>(AA_HANDLE_MANAGER[this]);
+	uint64 len = 0;
+	if(!hd->checkSending(buffers, count, len, "TCPClient::send"))
+		return 0;
+	return hd->sendBuffers(nullptr, *hd, hd->getSharedSocket(), hd->localService.get_executor(), 0, buffers, count, isAsync, "TCPClient::send");
 }
 
 const IPAddr & TCPClient::getServerAddr() const{
@@ -1730,6 +2778,15 @@ bool TCPClient::isConnection() const{
 	return static_cast<TCPClient_Private*>(AA_HANDLE_MANAGER[this])->isListening;
 }
 
+bool TCPClient::getSendingQueueDepth(uint32 & messageCount, uint64 & byteCount) const{
+	auto hd = static_cast<TCPClient_Private*>(AA_HANDLE_MANAGER[this]);
+	auto queue = hd->sendingQueue;
+	if(!hd->isListening || queue == nullptr)
+		return false;
+	queue->getDepth(messageCount, byteCount);
+	return true;
+}
+
 
 /******************* Source for class UDPSingle ************************/
 
@@ -1739,18 +2796,9 @@ UDPSilgle::UDPSilgle()
 
 UDPSilgle::~UDPSilgle(){
 	auto hd = static_cast<UDPSingle_Private*>(AA_HANDLE_MANAGER[this]);
-	if(hd->s->is_open()){
-		boost::system::error_code err;
-		if(hd->s->is_open()){
-			hd->s->shutdown(hd->s->shutdown_both, err);
-		}
-		if(!err)
-			hd->s->cancel(err);
-		if(!err){
-			hd->s->close(err);
-		}
-		AA_SAFE_DEL(hd->s);
-	}
+	if(hd->isListening)
+		stopListening(0);
+	hd->closeSocket();
 }
 
 bool UDPSilgle::setGettingCallBack(Socket::UDPGettingCall recvCB, void*pUser){
@@ -1760,7 +2808,22 @@ bool UDPSilgle::setGettingCallBack(Socket::UDPGettingCall recvCB, void*pUser){
 	return true;
 }
 
-bool UDPSilgle::startListening(bool isIPv4){
+bool UDPSilgle::setBatchGettingCallBack(Socket::UDPBatchGettingCall recvCB, void * pUser){
+	auto hd = static_cast<UDPSingle_Private*>(AA_HANDLE_MANAGER[this]);
+	hd->batchGettingCallBack = recvCB;
+	hd->batchGettingCallData = pUser;
+	return true;
+}
+
+bool UDPSilgle::setBatchSize(uint32 batchSize){
+	auto hd = static_cast<UDPSingle_Private*>(AA_HANDLE_MANAGER[this]);
+	if(hd->isListening || batchSize == 0)
+		return false;
+	hd->batchSize = batchSize;
+	return true;
+}
+
+bool UDPSilgle::startListening(bool isIPv4, uint16 port){
 	auto hd = static_cast<UDPSingle_Private*>(AA_HANDLE_MANAGER[this]);
 	if(hd->isListening){
 		SocketException ex(SocketException::ErrorType::SocketStatueError, "The listening has started");
@@ -1768,90 +2831,152 @@ bool UDPSilgle::startListening(bool isIPv4){
 		return false;
 	}
 	hd->isAsync = true;
-	AA_SAFE_DEL(hd->s);
-	hd->s = new boost::asio::ip::udp::socket(hd->localService);
-	try{
-		if(!hd->s->is_open())
-			hd->s->open(isIPv4 ? boost::asio::ip::udp::v4() : boost::asio::ip::udp::v6());
-		hd->localAddr = IPAddr::clone(toAAAddr(hd->s->local_endpoint().address()));
-		hd->localPort = hd->s->local_endpoint().port();
-	} catch(boost::system::system_error e){
-		auto code = e.code().value();
-		auto msg = e.code().message();
-		SocketException ex(SocketException::ErrorType::SystemError, msg.c_str(), code);
-		hd->reportError(ex, *hd->localAddr, hd->localPort, "UDPSilgle::StartListening");
+	// 发送时可能已经打开了未绑定端口的套接字, 监听需要重新打开并绑定
+	hd->closeSocket();
+	if(!hd->openSocket(isIPv4, "UDPSilgle::StartListening"))
+		return false;
+	boost::system::error_code err;
+	hd->s->bind(boost::asio::ip::udp::endpoint(isIPv4 ? boost::asio::ip::udp::v4() : boost::asio::ip::udp::v6(), port), err);
+	if(err){
+		SocketException ex(SocketException::ErrorType::SystemError, err.message().c_str(), err.value());
+		hd->closeSocket();
+		hd->reportError(ex, isIPv4 ? static_cast<IPAddr&>(IPAddr_v4::localhost()) : static_cast<IPAddr&>(IPAddr_v6::localhost()), port, "UDPSilgle::StartListening");
 		return false;
 	}
-	hd->s->async_receive_from(hd->recvbuffer, hd->recver, [hd](boost::system::error_code err, std::size_t){
-		auto senderAddr = IPAddr::clone(toAAAddr(hd->recver.address())); uint16 senderPort = hd->recver.port(); 			if(!err)
-			while(!hd->recvbuffer.empty()){
-				auto bfn = *hd->recvbuffer.begin();
-				auto bfnp = boost::asio::buffer_cast<uint8*>(bfn);
-				auto sz = boost::asio::buffer_size(bfn);
-				hd->gettingCallBack(*senderAddr, senderPort, bfnp, sz, hd->gettingCallData);
-				hd->recvbuffer.pop_front();
-			} else switch(err.value()){
-				default:
-					break;
-			}
-	});
-
+	auto local = hd->s->local_endpoint(err);
+	hd->localAddr = IPAddr::clone(toAAAddr(local.address()));
+	hd->localPort = local.port();
+	hd->prepareReceiving();
+	hd->isListening = true;
+	hd->receive();
+	hd->localService.restart();
+	hd->localServiceThread = std::shared_ptr<std::thread>(new std::thread([hd](){
+		boost::system::error_code err;
+		hd->localService.run(err);
+	}));
 	return true;
 }
 
 mac_uint UDPSilgle::send(const IPAddr & addr, uint16 port, void * data, size_t len, bool isAsync){
 	auto hd = static_cast<UDPSingle_Private*>(AA_HANDLE_MANAGER[this]);
-	if(!hd->isListening)
-		return 0;
-	try{
-		if(!hd->s->is_open())
-			hd->s->open(addr.getIPVer() == 4 ? boost::asio::ip::udp::v4() : boost::asio::ip::udp::v6());
-		hd->localAddr = IPAddr::clone(toAAAddr(hd->s->local_endpoint().address()));
-		hd->localPort = hd->s->local_endpoint().port();
-	} catch(boost::system::error_code){
+	if(!hd->openSocket(addr.getIPVer() == 4, "UDPSilgle::send"))
 		return 0;
+	boost::asio::ip::udp::endpoint target(toBoostAddr(addr), port);
+	if(!isAsync || !hd->isListening){
+		// 没有在监听时没有运行中的io_service, 异步发送也只能同步进行. UDP的发送很少需要等待
+		boost::system::error_code err;
+		auto ret = hd->s->send_to(boost::asio::buffer(data, len), target, 0, err);
+		if(err == boost::asio::error::would_block){
+			hd->s->wait(boost::asio::ip::udp::socket::wait_write, err);
+			if(!err)
+				ret = hd->s->send_to(boost::asio::buffer(data, len), target, 0, err);
+		}
+		if(isAsync && hd->asyncResp != nullptr)
+			hd->asyncResp(err ? 0 : ret, 0, 0, data, len, hd->asyncRespUserData);
+		if(err){
+			SocketException ex(SocketException::ErrorType::SystemError, err.message().c_str(), err.value());
+			hd->reportError(ex, const_cast<IPAddr&>(addr), port, "UDPSilgle::send");
+			return 0;
+		}
+		return ret;
 	}
+	// 异步发送时调用者的数据可能在发出前被释放, 需要复制一份
+	std::shared_ptr<uint8> buffer(new uint8[len], std::default_delete<uint8[]>());
+	memcpy(buffer.get(), data, len);
+	hd->s->async_send_to(boost::asio::buffer(buffer.get(), len), target, [hd, buffer, len](boost::system::error_code err, std::size_t size){
+		if(hd->asyncResp != nullptr)
+			hd->asyncResp(err ? 0 : size, 0, 0, buffer.get(), len, hd->asyncRespUserData);
+	});
+	return 0;
+}
 
-	if(!isAsync){
-		hd->sendBuffer.clear();
-		hd->sendBuffer.push_back(boost::asio::mutable_buffer(data, size_t(len)));
-		return hd->s->send_to(hd->sendBuffer, boost::asio::ip::udp::endpoint(toBoostAddr(addr), port));
+uint32 UDPSilgle::send(const UDPDatagram * datagrams, uint32 count){
+	auto hd = static_cast<UDPSingle_Private*>(AA_HANDLE_MANAGER[this]);
+	if(datagrams == nullptr || count == 0 || datagrams[0].addr == nullptr)
+		return 0;
+	if(!hd->openSocket(datagrams[0].addr->getIPVer() == 4, "UDPSilgle::send"))
+		return 0;
+	boost::system::error_code err;
+	uint32 sent = 0;
+#if defined AA_SOCKET_MMSG
+	// 每个线程复用各自的消息数组, 批量发送不需要分配内存
+	static thread_local std::vector<mmsghdr> msgs;
+	static thread_local std::vector<iovec> iovs;
+	static thread_local std::vector<boost::asio::ip::udp::endpoint> targets;
+	if(msgs.size() < count){
+		msgs.resize(count);
+		iovs.resize(count);
+		targets.resize(count);
+	}
+	for(uint32 i = 0; i < count; ++i){
+		targets[i] = boost::asio::ip::udp::endpoint(toBoostAddr(*datagrams[i].addr), datagrams[i].port);
+		iovs[i].iov_base = const_cast<void*>(datagrams[i].data);
+		iovs[i].iov_len = datagrams[i].datalen;
+		memset(&msgs[i], 0, sizeof(mmsghdr));
+		msgs[i].msg_hdr.msg_name = targets[i].data();
+		msgs[i].msg_hdr.msg_namelen = socklen_t(targets[i].size());
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	while(sent < count){
+		auto ret = sendmmsg(hd->s->native_handle(), msgs.data() + sent, count - sent, 0);
+		if(ret >= 0){
+			sent += uint32(ret);
+			continue;
+		}
+		if(errno == EINTR)
+			continue;
+		if(errno == EAGAIN || errno == EWOULDBLOCK){
+			// 发送缓冲区已满, 等待可写后继续
+			hd->s->wait(boost::asio::ip::udp::socket::wait_write, err);
+			if(!err)
+				continue;
+		} else{
+			err = boost::system::error_code(errno, boost::asio::error::get_system_category());
+		}
+		break;
 	}
-
-	std::shared_ptr<std::function<void(boost::system::error_code err, std::size_t sz)>> respF;
-	std::shared_ptr<std::function<void(boost::system::error_code err, std::size_t sz)>>&respF2 = respF;
-	std::shared_ptr<uint32> n(new uint32(0));
-	respF = std::shared_ptr<std::function<void(boost::system::error_code err, std::size_t sz)>>(new std::function<void(boost::system::error_code err, std::size_t sz)>([hd, &addr, port, &n, len, data, &respF2](boost::system::error_code err, std::size_t sz){
-		if(!err)
-			hd->sendBuffer.clear();
-		if(hd->asyncResp != nullptr && hd->asyncResp(sz, (*n)++, 0, data, len, hd->asyncRespUserData) && err)
-			hd->s->async_send_to(hd->sendBuffer, boost::asio::ip::udp::endpoint(toBoostAddr(addr), port), *respF2);
-	}));
-	hd->s->async_send_to(hd->sendBuffer, boost::asio::ip::udp::endpoint(toBoostAddr(addr), port), *respF);
-	return 0;
+#else
+	for(; sent < count; ++sent){
+		boost::asio::ip::udp::endpoint target(toBoostAddr(*datagrams[sent].addr), datagrams[sent].port);
+		hd->s->send_to(boost::asio::buffer(datagrams[sent].data, std::size_t(datagrams[sent].datalen)), target, 0, err);
+		if(err == boost::asio::error::would_block){
+			hd->s->wait(boost::asio::ip::udp::socket::wait_write, err);
+			if(!err)
+				hd->s->send_to(boost::asio::buffer(datagrams[sent].data, std::size_t(datagrams[sent].datalen)), target, 0, err);
+		}
+		if(err)
+			break;
+	}
+#endif
+	if(err){
+		SocketException ex(SocketException::ErrorType::SystemError, err.message().c_str(), err.value());
+		hd->reportError(ex, const_cast<IPAddr&>(*datagrams[sent < count ? sent : 0].addr), datagrams[sent < count ? sent : 0].port, "UDPSilgle::send");
+	}
+	return sent;
 }
 
 bool UDPSilgle::stopListening(uint32 waitTime){
     // TODO: unused parameter waitTime
 	auto hd = static_cast<UDPSingle_Private*>(AA_HANDLE_MANAGER[this]);
 	hd->isListening = false;
-	boost::system::error_code err;
-	if(hd->s->is_open()){
-		hd->s->shutdown(hd->s->shutdown_both, err);
-	}
-	if(!err)
-		hd->s->cancel(err);
-	if(!err){
-		hd->s->close(err);
-	}
-	AA_SAFE_DEL(hd->s);
-	return !err;
+	hd->localService.stop();
+	if(hd->localServiceThread != nullptr && hd->localServiceThread->joinable() && hd->localServiceThread->get_id() != std::this_thread::get_id())
+		hd->localServiceThread->join();
+	hd->localServiceThread = nullptr;
+	hd->closeSocket();
+	return true;
 }
 
 bool UDPSilgle::isListening() const{
 	return static_cast<UDPSingle_Private*>(AA_HANDLE_MANAGER[this])->isListening;
 }
-TCPWebSocketServer::TCPWebSocketServer(int32 maxConnNum):TCPServer(maxConnNum){
+
+uint16 UDPSilgle::getLocalPort() const{
+	return static_cast<UDPSingle_Private*>(AA_HANDLE_MANAGER[this])->localPort;
+}
+
+TCPWebSocketServer::TCPWebSocketServer(int32 maxConnNum, uint32 threadNum):TCPServer(maxConnNum, threadNum){
 }
 
 TCPWebSocketServer::~TCPWebSocketServer(){
@@ -1867,37 +2992,27 @@ bool TCPWebSocketServer::stop(uint32 waitTime){
 	return hd->stop(waitTime);
 }
 
+bool TCPWebSocketServer::setDeflate(const WebSocketDeflate & deflate){
+	if(isStarting() || !deflate.isValid())
+		return false;
+	AA_HANDLE_MANAGER[this]->deflate = deflate;
+	return true;
+}
+
 mac_uint TCPWebSocketServer::send(uint32 index, void * data, uint64 len, bool isAsync){
-	auto hd = static_cast<TCPServer_Private*>(AA_HANDLE_MANAGER[this]);
-	hd->clientMutex.lock();
-	auto cl = hd->clients.find(index);
-	if(cl == hd->clients.end()){
-		hd->clientMutex.unlock();
-		return 0;
-	}
+	return TCPServer::send(index, data, len, isAsync);
+}
 
-	auto buffer = std::shared_ptr<uint8>(new uint8[len]);
-	memcpy(buffer.get(), data, len);
-	if(!isAsync){
-		boost::beast::error_code err;
-		cl->second->getWebSocket()->binary(true);   // 必须设置为二进制, 才能传输二进制数据
-		auto ret = cl->second->getWebSocket()->write(boost::asio::buffer(buffer.get(), len), err);
-		hd->clientMutex.unlock();
-		if(err){
-			hd->reportError(SocketException(SocketException::ErrorType::SystemError, err.message().c_str(), err.value()), *cl->second->addr, cl->second->port, "TCPWebSocketServer::send");
-		}
-		return ret;
-	} else{
-		hd->asyncRespTimes = 0;
-#if defined OS_LINUX
-                cl->second->linuxWebsocketMutex.lock();
-		cl->second->getWebSocket()->async_write(boost::asio::buffer(buffer.get(), len), std::bind(&Socket_Private::onTCPSendingResponse, AA_HANDLE_MANAGER[this], index, buffer, cl->second->getSocket(), std::placeholders::_1, std::placeholders::_2, len, &cl->second->linuxWebsocketMutex));
-#else
-		cl->second->getWebSocket()->async_write(boost::asio::buffer(buffer.get(), len), std::bind(&Socket_Private::onTCPSendingResponse, AA_HANDLE_MANAGER[this], index, buffer, cl->second->getSocket(), std::placeholders::_1, std::placeholders::_2, len));
-#endif
-		hd->clientMutex.unlock();
+mac_uint TCPWebSocketServer::send(uint32 index, SendingBuffer && buffer, bool isAsync){
+	return send(index, &buffer, 1, isAsync);
+}
+
+mac_uint TCPWebSocketServer::send(uint32 index, SendingBuffer * buffers, uint32 count, bool isAsync){
+	auto hd = static_cast<TCPServer_Private*>(AA_HANDLE_MANAGER[this]);
+	auto cl = hd->clients.get(index);
+	if(cl == nullptr || buffers == nullptr || count == 0)
 		return 0;
-	}
+	return hd->sendBuffers(cl, *cl, cl->getWebSocket(), *cl->strand, index, buffers, count, isAsync, "TCPWebSocketServer::send");
 }
 
 TCPWebSocketClient::TCPWebSocketClient():TCPClient(){
@@ -1910,50 +3025,60 @@ TCPWebSocketClient::~TCPWebSocketClient(){
 bool TCPWebSocketClient::connectServer(uint16 port, bool isAsync, ClientConnectCall asyncConnectCallBack, void * asyncConnectCallData){
 	auto hd = static_cast<TCPClient_Private*>(AA_HANDLE_MANAGER[this]);
     auto websocket = std::shared_ptr <boost::beast::websocket::stream<boost::asio::ip::tcp::socket>>(new boost::beast::websocket::stream<boost::asio::ip::tcp::socket>{hd->localService});
-    hd->strand = new boost::asio::strand<boost::asio::executor>(*websocket->get_executor().target<boost::asio::executor>());
+	// strand属于客户端自己的io_service, 重连时沿用同一个, 上一次连接遗留的回调可能仍引用它, 由析构函数释放
+	if(hd->strand == nullptr)
+		hd->strand = new TCP_Socket_Datas::Strand(*websocket->get_executor().target<boost::asio::io_service::executor_type>());
+	setDeflateOption(*websocket, hd->deflate, false);
     auto protocol = hd->addr->getIPVer() == 6 ? boost::asio::ip::tcp::v6() : boost::asio::ip::tcp::v4();
 	return hd->connectServer(isAsync, asyncConnectCallBack, asyncConnectCallData, websocket);
 }
 
 bool TCPWebSocketClient::disconnectServer(uint32 waitTime){
 	auto hd = static_cast<TCPClient_Private*>(AA_HANDLE_MANAGER[this]);
-	boost::beast::error_code err;
-	boost::beast::websocket::teardown(boost::beast::role_type::client, hd->getWebSocket()->next_layer(), err);
-	if(hd->getWebSocket()->is_open()){
-        hd->getWebSocket()->close(boost::beast::websocket::close_reason("Disconnect"));
+	auto websocket = hd->getWebSocket();
+	if(hd->isListening && websocket != nullptr && websocket->is_open()){
+		// 关闭握手需要与进行中的异步读取串行, 因此在连接的strand上发起, 最多等待waitTime毫秒
+		hd->isListening = false;
+		auto closed = std::make_shared<std::promise<void>>();
+		auto future = closed->get_future();
+		boost::asio::post(*hd->strand, [websocket, closed](){
+			websocket->async_close(boost::beast::websocket::close_reason("Disconnect"), [closed](boost::beast::error_code){
+				closed->set_value();
+			});
+		});
+		if(!isInExecutorThread(*hd->strand))
+			future.wait_for(std::chrono::milliseconds(waitTime));
 	}
 	return hd->disconnectServer(waitTime);
 }
 
-mac_uint TCPWebSocketClient::send(const void * pBuffer, size_t len, bool isAsync){
+bool TCPWebSocketClient::setDeflate(const WebSocketDeflate & deflate){
 	auto hd = static_cast<TCPClient_Private*>(AA_HANDLE_MANAGER[this]);
-	if(!hd->isListening){
-		SocketException ex(SocketException::ErrorType::SocketStatueError, "Have not connected to the server");
-		hd->reportError(ex, *hd->addr, hd->port, "TCPClient::Send");
+	if(hd->isListening || !deflate.isValid())
 		return false;
-	}
-	if(pBuffer == nullptr || len <= 0){
-		SocketException ex(SocketException::ErrorType::InvalidArgument, "Buffer error");
-		hd->reportError(ex, *hd->addr, hd->port, "TCPClient::Send");
-		return false;
-	}
-	auto buffer = std::shared_ptr<uint8>(new uint8[len]);
-	memcpy(buffer.get(), pBuffer, len);
-	if(!isAsync){
-		auto ret = hd->getWebSocket()->write(boost::asio::buffer(buffer.get(), len));
-		return ret;
-	} else{
-		hd->asyncRespTimes = 0;
-#if defined OS_LINUX
-                hd->linuxWebsocketMutex.lock();
-		hd->getWebSocket()->async_write(boost::asio::buffer(buffer.get(), len), std::bind(&Socket_Private::onTCPSendingResponse, AA_HANDLE_MANAGER[this], 0, buffer, hd->getSocket(), std::placeholders::_1, std::placeholders::_2, len, &hd->linuxWebsocketMutex));
-#else
-		hd->getWebSocket()->async_write(boost::asio::buffer(buffer.get(), len), std::bind(&Socket_Private::onTCPSendingResponse, AA_HANDLE_MANAGER[this], 0, buffer, hd->getSocket(), std::placeholders::_1, std::placeholders::_2, len));
-#endif
-		return len;
-	}
+	hd->deflate = deflate;
+	return true;
+}
+
+mac_uint TCPWebSocketClient::send(const void * pBuffer, size_t len, bool isAsync){
+	return TCPClient::send(pBuffer, len, isAsync);
+}
+
+mac_uint TCPWebSocketClient::send(SendingBuffer && buffer, bool isAsync){
+	return send(&buffer, 1, isAsync);
+}
+
+mac_uint TCPWebSocketClient::send(SendingBuffer * buffers, uint32 count, bool isAsync){
+	auto hd = static_cast<TCPClient_Private*>(AA_HANDLE_MANAGER[this]);
+	uint64 len = 0;
+	if(!hd->checkSending(buffers, count, len, "TCPWebSocketClient::send"))
+		return 0;
+	return hd->sendBuffers(nullptr, *hd, hd->getWebSocket(), hd->localService.get_executor(), 0, buffers, count, isAsync, "TCPWebSocketClient::send");
 }
 
 }
 
+#undef AA_SOCKET_REUSE_PORT
+#undef AA_SOCKET_MMSG
+#undef AA_SOCKET_URING
 #undef AA_HANDLE_MANAGER
@@ -0,0 +1,124 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+#ifndef AA_SOCKET_BUFFER_POOL_PRIVATE_HEADER_2026_10_17
+#define AA_SOCKET_BUFFER_POOL_PRIVATE_HEADER_2026_10_17
+
+#include "../../inc/AADefine.h"
+
+#include <vector>
+
+namespace ArmyAnt{
+
+// 接收缓冲区池, 所有连接共用, 按大小分级, 每一级的容量是上一级的4倍
+// 每个线程各自缓存归还的缓冲区, 借出和归还都不需要加锁. 接收在连接所属的反应器线程中进行, 缓冲区借出后总在同一线程中归还
+class SocketBufferPool{
+public:
+	static const uint32 minSize = 256;		// 最小一级的容量
+	static const uint32 classNum = 7;		// 分级数量, 最大一级为1MB, 更大的缓冲区不缓存
+	static const uint32 cacheBytes = 1024 * 1024;	// 每个线程每一级最多缓存的字节数
+
+public:
+	// 借出至少能容纳size字节的缓冲区, 实际容量由capacity返回
+	static uint8* acquire(uint32 size, uint32& capacity);
+	// 归还缓冲区, capacity为借出时返回的容量
+	static void release(uint8* buffer, uint32 capacity);
+
+private:
+	struct Cache{
+		~Cache();
+		std::vector<uint8*> buffers[classNum];
+	};
+	static Cache& getCache();
+	static uint32 getClass(uint32 size);
+};
+
+// 从缓冲池借出的缓冲区, 析构时归还
+class SocketBuffer{
+public:
+	SocketBuffer(uint32 size) :len(size), capacity(0), buffer(SocketBufferPool::acquire(size, capacity)){}
+	~SocketBuffer(){ SocketBufferPool::release(buffer, capacity); }
+
+public:
+	uint8* data()const{ return buffer; }
+	uint32 size()const{ return len; }
+
+private:
+	uint32 len;
+	uint32 capacity;
+	uint8* buffer;
+
+	AA_FORBID_COPY_CTOR(SocketBuffer);
+	AA_FORBID_ASSGN_OPR(SocketBuffer);
+};
+
+inline uint8* SocketBufferPool::acquire(uint32 size, uint32 & capacity){
+	auto level = getClass(size);
+	if(level >= classNum){
+		capacity = size;
+		return new uint8[size];
+	}
+	capacity = minSize << (level * 2);
+	auto& buffers = getCache().buffers[level];
+	if(buffers.empty())
+		return new uint8[capacity];
+	auto ret = buffers.back();
+	buffers.pop_back();
+	return ret;
+}
+
+inline void SocketBufferPool::release(uint8 * buffer, uint32 capacity){
+	auto level = getClass(capacity);
+	if(level >= classNum){
+		delete[] buffer;
+		return;
+	}
+	auto& buffers = getCache().buffers[level];
+	if(buffers.size() * capacity >= cacheBytes && !buffers.empty()){
+		delete[] buffer;
+		return;
+	}
+	buffers.push_back(buffer);
+}
+
+inline SocketBufferPool::Cache::~Cache(){
+	for(uint32 i = 0; i < classNum; ++i)
+		for(auto j = buffers[i].begin(); j != buffers[i].end(); ++j)
+			delete[] *j;
+}
+
+inline SocketBufferPool::Cache & SocketBufferPool::getCache(){
+	static thread_local Cache cache;
+	return cache;
+}
+
+inline uint32 SocketBufferPool::getClass(uint32 size){
+	uint32 ret = 0;
+	for(uint32 capacity = minSize; capacity < size && ret < classNum; capacity <<= 2)
+		++ret;
+	return ret;
+}
+
+} // namespace ArmyAnt
+
+#endif // AA_SOCKET_BUFFER_POOL_PRIVATE_HEADER_2026_10_17
@@ -0,0 +1,132 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+#ifndef AA_SOCKET_ERROR_DISPATCHER_PRIVATE_HEADER_2026_10_17
+#define AA_SOCKET_ERROR_DISPATCHER_PRIVATE_HEADER_2026_10_17
+
+#include "../../inc/AADefine.h"
+
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace ArmyAnt{
+
+// 所有Socket共用的错误报告分发器, 错误报告在一个共用的线程中按报告的顺序回调, 不占用反应器线程
+// 线程在第一次报告错误时才启动, 队列为空时在条件变量上等待, 没有错误时不会被唤醒
+class SocketErrorDispatcher{
+public:
+	typedef std::function<void()> Task;
+
+	// Socket在构造时就应获取一次, 使分发器先于Socket构造, 从而晚于Socket析构
+	static SocketErrorDispatcher& get();
+
+public:
+	// 将owner的一个回调任务加入队列
+	void post(const void* owner, Task task);
+	// 丢弃owner尚未执行的任务, 并等待owner正在执行的任务结束. 在回调中调用时不等待
+	void cancel(const void* owner);
+
+private:
+	SocketErrorDispatcher() :running(true), current(nullptr){}
+	~SocketErrorDispatcher();
+	void run();
+
+private:
+	struct Item{
+		const void* owner;
+		Task task;
+	};
+	std::mutex mutex;
+	std::condition_variable cond;		// 有新任务或需要退出
+	std::condition_variable finished;	// 一个任务执行完毕
+	std::deque<Item> items;
+	std::thread thread;
+	bool running;
+	const void* current;				// 正在执行的任务所属的owner
+
+	AA_FORBID_COPY_CTOR(SocketErrorDispatcher);
+	AA_FORBID_ASSGN_OPR(SocketErrorDispatcher);
+};
+
+inline SocketErrorDispatcher & SocketErrorDispatcher::get(){
+	static SocketErrorDispatcher instance;
+	return instance;
+}
+
+inline void SocketErrorDispatcher::post(const void * owner, Task task){
+	std::lock_guard<std::mutex> lock(mutex);
+	if(!running)
+		return;
+	if(!thread.joinable())
+		thread = std::thread(std::bind(&SocketErrorDispatcher::run, this));
+	Item item = {owner, std::move(task)};
+	items.push_back(std::move(item));
+	cond.notify_one();
+}
+
+inline void SocketErrorDispatcher::cancel(const void * owner){
+	std::deque<Item> kept;
+	std::unique_lock<std::mutex> lock(mutex);
+	// 被丢弃的任务留在kept交换出来的旧队列中, 在锁外释放其持有的数据
+	for(auto i = items.begin(); i != items.end(); ++i)
+		if(i->owner != owner)
+			kept.push_back(std::move(*i));
+	items.swap(kept);
+	if(thread.get_id() != std::this_thread::get_id())
+		finished.wait(lock, [this, owner](){ return current != owner; });
+}
+
+inline SocketErrorDispatcher::~SocketErrorDispatcher(){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+		cond.notify_one();
+	}
+	if(thread.joinable())
+		thread.join();
+}
+
+inline void SocketErrorDispatcher::run(){
+	std::unique_lock<std::mutex> lock(mutex);
+	while(true){
+		cond.wait(lock, [this](){ return !running || !items.empty(); });
+		if(!running)
+			return;
+		auto item = std::move(items.front());
+		items.pop_front();
+		current = item.owner;
+		lock.unlock();
+		item.task();
+		item.task = nullptr;
+		lock.lock();
+		current = nullptr;
+		finished.notify_all();
+	}
+}
+
+} // namespace ArmyAnt
+
+#endif // AA_SOCKET_ERROR_DISPATCHER_PRIVATE_HEADER_2026_10_17
@@ -0,0 +1,242 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+#ifndef AA_SOCKET_FRAMER_PRIVATE_HEADER_2026_10_17
+#define AA_SOCKET_FRAMER_PRIVATE_HEADER_2026_10_17
+
+#include "../../inc/AADefine.h"
+#include "../../inc/AASocket.h"
+#include "../tool/AAStringScan.hxx"
+#include "AASocketBufferPool.hxx"
+
+#include <cstring>
+#include <algorithm>
+
+namespace ArmyAnt{
+
+// 单个TCP连接的接收分帧器, 将读取到的字节流切分为完整的消息, 只在连接所属的反应器线程中使用
+// 读取到的数据中完整的消息直接在原缓冲区中回调, 不复制. 只有跨越两次读取的不完整消息才暂存,
+// 暂存期间的下一次读取直接写入暂存区, 接在不完整的消息之后, 因此每个字节最多复制一次
+class SocketFramer{
+public:
+	SocketFramer(const Socket::Framing& framing)
+		:framing(framing), buffer(nullptr), capacity(0), length(0), scanned(0), needed(0){}
+	~SocketFramer(){ releaseBuffer(); }
+
+public:
+	// 有暂存的不完整消息时, 返回暂存区中可以写入size字节的位置; 否则返回nullptr, 由调用者自行借出缓冲区
+	uint8* prepare(uint32 size);
+	// 处理读取到的size字节数据, 每得到一条完整的消息调用一次func(const uint8* data, uint32 len)
+	// data可以是prepare返回的位置, 也可以是调用者自己的缓冲区, 回调中的数据只在回调期间有效
+	// 消息超长或消息头非法时返回false, 此后该连接的数据已无法正确切分, 应断开连接
+	template<class Func>
+	bool feed(const uint8* data, uint32 size, Func func);
+
+private:
+	enum class ParseResult : uint8{
+		Complete,
+		Incomplete,
+		Invalid
+	};
+	// 从data开头解析一条消息, 完整时给出消息的总长度, 以及去掉消息头(或分隔符)后的消息体偏移和长度
+	// from为分隔符查找的起始位置, 之前的部分已确认不含分隔符
+	ParseResult parse(const uint8* data, uint32 size, uint32 from, uint32& frameLen, uint32& bodyOffset, uint32& bodyLen);
+	// 依次回调data中所有完整的消息, 返回处理掉的字节数, 出错时isValid返回false
+	template<class Func>
+	uint32 consume(const uint8* data, uint32 size, Func& func, bool& isValid);
+	void reserve(uint32 size);
+	void releaseBuffer();
+
+private:
+	const Socket::Framing framing;
+	uint8* buffer;		// 暂存区, 从缓冲池借出, 没有暂存的数据时归还
+	uint32 capacity;
+	uint32 length;		// 暂存的字节数
+	uint32 scanned;		// 分隔符分帧时, 暂存的数据中已确认不含分隔符的长度, 避免重复查找
+	uint32 needed;		// 已从消息头得知的当前消息总长度, 用于一次扩容到位
+
+	AA_FORBID_COPY_CTOR(SocketFramer);
+	AA_FORBID_ASSGN_OPR(SocketFramer);
+};
+
+inline uint8* SocketFramer::prepare(uint32 size){
+	if(length == 0)
+		return nullptr;
+	reserve(std::max(length + size, needed));
+	return buffer + length;
+}
+
+template<class Func>
+inline bool SocketFramer::feed(const uint8 * data, uint32 size, Func func){
+	bool isValid = true;
+	if(length == 0){
+		// 没有暂存的数据, 直接在调用者的缓冲区中切分, 只暂存末尾不完整的部分
+		auto used = consume(data, size, func, isValid);
+		if(!isValid)
+			return false;
+		if(used < size){
+			reserve(std::max(size - used, needed));
+			memcpy(buffer, data + used, size - used);
+			length = size - used;
+		}
+		return true;
+	}
+	if(data != buffer + length){
+		// 数据不是读入暂存区的, 先拼接到暂存的数据之后
+		reserve(length + size);
+		memmove(buffer + length, data, size);
+	}
+	length += size;
+	auto used = consume(buffer, length, func, isValid);
+	if(!isValid)
+		return false;
+	if(used == length){
+		length = 0;
+		releaseBuffer();
+	} else if(used > 0){
+		memmove(buffer, buffer + used, length - used);
+		length -= used;
+	}
+	return true;
+}
+
+template<class Func>
+inline uint32 SocketFramer::consume(const uint8 * data, uint32 size, Func & func, bool & isValid){
+	uint32 used = 0;
+	uint32 from = scanned;
+	while(used < size){
+		uint32 frameLen = 0, bodyOffset = 0, bodyLen = 0;
+		auto result = parse(data + used, size - used, from, frameLen, bodyOffset, bodyLen);
+		if(result == ParseResult::Invalid){
+			isValid = false;
+			return used;
+		}
+		if(result == ParseResult::Incomplete){
+			scanned = size - used;
+			return used;
+		}
+		if(framing.isKeepingHeader)
+			func(data + used, frameLen);
+		else
+			func(data + used + bodyOffset, bodyLen);
+		used += frameLen;
+		from = 0;
+		needed = 0;
+	}
+	scanned = 0;
+	return used;
+}
+
+inline SocketFramer::ParseResult SocketFramer::parse(const uint8 * data, uint32 size, uint32 from, uint32 & frameLen, uint32 & bodyOffset, uint32 & bodyLen){
+	uint64 body = 0;
+	uint32 header = 0;
+	switch(framing.type){
+		case Socket::FramingType::FixedHeader:
+		{
+			header = framing.headerLen;
+			if(size < header)
+				return ParseResult::Incomplete;
+			auto field = data + framing.lengthOffset;
+			for(uint8 i = 0; i < framing.lengthBytes; ++i)
+				body |= uint64(field[framing.isBigEndian ? i : framing.lengthBytes - 1 - i]) << (8 * (framing.lengthBytes - 1 - i));
+			if(framing.isLengthWithHeader){
+				if(body < header)
+					return ParseResult::Invalid;
+				body -= header;
+			}
+			break;
+		}
+		case Socket::FramingType::Varint:
+		{
+			// 最长10字节, 可以表示全部64位
+			for(uint32 i = 0; ; ++i){
+				if(i >= 10)
+					return ParseResult::Invalid;
+				if(i >= size)
+					return ParseResult::Incomplete;
+				body |= uint64(data[i] & 0x7f) << (7 * i);
+				if((data[i] & 0x80) == 0){
+					header = i + 1;
+					break;
+				}
+			}
+			break;
+		}
+		case Socket::FramingType::Delimiter:
+		{
+			// 从上次查找结束的位置往前退回分隔符长度减1, 以免漏掉跨越两次读取的分隔符
+			auto delimiterLen = uint32(framing.delimiterLen);
+			auto start = from >= delimiterLen ? from - delimiterLen + 1 : 0;
+			auto begin = reinterpret_cast<const char*>(data);
+			auto end = begin + size;
+			auto found = StringScan::get().findString(begin + start, end, framing.delimiter, delimiterLen);
+			if(found == end){
+				if(size > uint64(framing.maxMessageLen) + delimiterLen)
+					return ParseResult::Invalid;
+				return ParseResult::Incomplete;
+			}
+			bodyLen = uint32(found - begin);
+			if(bodyLen > framing.maxMessageLen)
+				return ParseResult::Invalid;
+			bodyOffset = 0;
+			frameLen = bodyLen + delimiterLen;
+			return ParseResult::Complete;
+		}
+		default:
+			// 不分帧时不会创建分帧器
+			return ParseResult::Invalid;
+	}
+	if(body > framing.maxMessageLen)
+		return ParseResult::Invalid;
+	bodyOffset = header;
+	bodyLen = uint32(body);
+	frameLen = header + bodyLen;
+	if(size < frameLen){
+		needed = frameLen;
+		return ParseResult::Incomplete;
+	}
+	return ParseResult::Complete;
+}
+
+inline void SocketFramer::reserve(uint32 size){
+	if(size <= capacity)
+		return;
+	uint32 newCapacity = 0;
+	auto newBuffer = SocketBufferPool::acquire(size, newCapacity);
+	if(length > 0)
+		memcpy(newBuffer, buffer, length);
+	releaseBuffer();
+	buffer = newBuffer;
+	capacity = newCapacity;
+}
+
+inline void SocketFramer::releaseBuffer(){
+	if(buffer != nullptr)
+		SocketBufferPool::release(buffer, capacity);
+	buffer = nullptr;
+	capacity = 0;
+}
+
+} // namespace ArmyAnt
+
+#endif // AA_SOCKET_FRAMER_PRIVATE_HEADER_2026_10_17
@@ -0,0 +1,235 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+#ifndef AA_SOCKET_SENDING_QUEUE_PRIVATE_HEADER_2026_10_17
+#define AA_SOCKET_SENDING_QUEUE_PRIVATE_HEADER_2026_10_17
+
+#include "../../inc/AADefine.h"
+#include "../../inc/AASocket.h"
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+namespace ArmyAnt{
+
+// 单个连接的发送队列, 保证消息按发送顺序写出, 同一时刻只有一次写出在进行
+// 写出进行时新的消息排队, 上一次写出完成后, 排队的消息一起作为一次聚合写出(websocket每次只写出一条消息, 以保留消息边界)
+// 队列只负责排队和计数, 实际的写出由持有"写出权"(push或beginDirect返回Start)的一方在连接的执行器上进行
+class SendingQueue{
+public:
+	static const uint32 maxBuffersPerWrite = 64;	// 一次聚合写出最多包含的数据块数, 与boost在Linux上单次writev的上限一致
+
+	enum class Result : uint8{
+		Start,		// 调用者获得写出权, 需要发起写出
+		Queued,		// 已排在正在进行的写出之后
+		Full,		// 超过高水位, 未入队
+		Closed		// 连接已关闭, 未入队
+	};
+
+public:
+	SendingQueue(bool oneMessagePerWrite)
+		:oneMessagePerWrite(oneMessagePerWrite), closed(false), busy(false), overHighWater(false), highWater(0), messages(0), bytes(0), writingBytes(0){}
+	~SendingQueue(){ close(); }
+
+public:
+	// 入队一条由count个数据块组成的消息, 成功时数据块的所有权转交给队列, buffers中的数据块被清空
+	// highWater为0表示不限制. 入队后会超过高水位时按policy处理, 只有canWait为true时才会以Block方式等待, 否则视为Drop
+	// 队列首次触及高水位时reachedHighWater返回true, queuedBytes返回此时队列中的字节数
+	Result push(SendingBuffer* buffers, uint32 count, uint64 highWater, Socket::SendingQueuePolicy policy, bool canWait, uint64& queuedBytes, bool& reachedHighWater);
+	// 以同步方式独占写出, 返回Start时调用者直接写出, 完成后必须调用endDirect
+	// 队列忙时, canWait为true则等待之前的消息全部写出, 否则返回Queued, 调用者应改为入队
+	Result beginDirect(bool canWait);
+	// 同步写出结束, 返回true表示期间有消息入队, 调用者继续持有写出权, 需要发起异步写出
+	bool endDirect();
+	// 当前写出中的数据块, 只有持有写出权的一方可以访问
+	const SendingBuffer* getWriting()const{ return writing.data(); }
+	std::size_t getWritingCount()const{ return writing.size(); }
+	// 依次访问写出中的每个数据块, 参数为数据块的地址和长度. 聚合消息的各个数据块不连续, 不能合并为一段访问
+	template<class Func>
+	void forEachWriting(Func func)const;
+	// 写出完成, 释放写出中的数据块. 返回true表示还有排队的消息, 已取出作为下一次写出, 否则交还写出权
+	// 队列从高水位回落到一半以下时fellToLowWater返回true
+	bool finish(uint64& queuedBytes, bool& fellToLowWater);
+	// 关闭队列, 丢弃排队的消息, 唤醒所有等待中的发送者, 之后的入队都返回Closed
+	void close();
+	// 队列深度, 包括正在写出的消息
+	void getDepth(uint32& messageCount, uint64& byteCount);
+
+private:
+	// 在加锁状态下将排队的消息取出作为下一次写出
+	void takeBatch();
+	// 在不加锁的状态下释放数据块, 释放函数可能再次调用发送
+	static void releaseBuffers(std::vector<SendingBuffer>& buffers);
+
+private:
+	const bool oneMessagePerWrite;
+	bool closed;
+	bool busy;				// 写出权是否已被持有
+	bool overHighWater;		// 是否已通知过触及高水位, 回落到一半以下后复位
+	uint64 highWater;		// 最近一次入队时的高水位
+	uint32 messages;		// 队列中的消息数, 包括正在写出的
+	uint64 bytes;			// 队列中的字节数, 包括正在写出的
+	std::deque<SendingBuffer> pending;
+	std::deque<uint32> pendingCounts;	// 排队中每条消息包含的数据块数
+	std::vector<SendingBuffer> writing;	// 写出中的数据块, 容量在多次写出间复用
+	std::vector<uint32> writingCounts;
+	uint64 writingBytes;
+	std::mutex mutex;
+	std::condition_variable cond;
+
+	AA_FORBID_COPY_CTOR(SendingQueue);
+	AA_FORBID_ASSGN_OPR(SendingQueue);
+};
+
+inline SendingQueue::Result SendingQueue::push(SendingBuffer * buffers, uint32 count, uint64 highWater, Socket::SendingQueuePolicy policy, bool canWait, uint64 & queuedBytes, bool & reachedHighWater){
+	uint64 len = 0;
+	for(uint32 i = 0; i < count; ++i)
+		len += buffers[i].getLength();
+	reachedHighWater = false;
+	std::unique_lock<std::mutex> lock(mutex);
+	this->highWater = highWater;
+	if(!closed && highWater > 0 && bytes > 0 && bytes + len > highWater){
+		// 队列为空时总是允许入队, 否则超过高水位的单条消息永远无法发出
+		if(!overHighWater){
+			overHighWater = true;
+			reachedHighWater = true;
+		}
+		if(policy == Socket::SendingQueuePolicy::Block && canWait){
+			cond.wait(lock, [this, len, highWater](){ return closed || bytes == 0 || bytes + len <= highWater; });
+		} else if(policy != Socket::SendingQueuePolicy::Signal){
+			queuedBytes = bytes;
+			return Result::Full;
+		}
+	}
+	queuedBytes = bytes;
+	if(closed)
+		return Result::Closed;
+	for(uint32 i = 0; i < count; ++i)
+		pending.push_back(std::move(buffers[i]));
+	pendingCounts.push_back(count);
+	++messages;
+	bytes += len;
+	queuedBytes = bytes;
+	if(busy)
+		return Result::Queued;
+	busy = true;
+	takeBatch();
+	return Result::Start;
+}
+
+inline SendingQueue::Result SendingQueue::beginDirect(bool canWait){
+	std::unique_lock<std::mutex> lock(mutex);
+	if(busy && canWait)
+		cond.wait(lock, [this](){ return closed || !busy; });
+	if(closed)
+		return Result::Closed;
+	if(busy)
+		return Result::Queued;
+	busy = true;
+	return Result::Start;
+}
+
+inline bool SendingQueue::endDirect(){
+	std::lock_guard<std::mutex> lock(mutex);
+	if(!closed && !pending.empty()){
+		takeBatch();
+		return true;
+	}
+	busy = false;
+	cond.notify_all();
+	return false;
+}
+
+template<class Func>
+inline void SendingQueue::forEachWriting(Func func)const{
+	for(auto i = writing.begin(); i != writing.end(); ++i)
+		func(i->getData(), i->getLength());
+}
+
+inline bool SendingQueue::finish(uint64 & queuedBytes, bool & fellToLowWater){
+	releaseBuffers(writing);
+	std::lock_guard<std::mutex> lock(mutex);
+	writing.clear();
+	messages -= uint32(writingCounts.size());
+	bytes -= writingBytes;
+	writingCounts.clear();
+	writingBytes = 0;
+	queuedBytes = bytes;
+	fellToLowWater = overHighWater && bytes <= highWater / 2;
+	if(fellToLowWater)
+		overHighWater = false;
+	cond.notify_all();
+	if(!closed && !pending.empty()){
+		takeBatch();
+		return true;
+	}
+	busy = false;
+	return false;
+}
+
+inline void SendingQueue::close(){
+	std::deque<SendingBuffer> dropped;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		dropped.swap(pending);
+		pendingCounts.clear();
+		messages = uint32(writingCounts.size());
+		bytes = writingBytes;
+		overHighWater = false;
+		cond.notify_all();
+	}
+	// dropped析构时释放数据块
+}
+
+inline void SendingQueue::getDepth(uint32 & messageCount, uint64 & byteCount){
+	std::lock_guard<std::mutex> lock(mutex);
+	messageCount = messages;
+	byteCount = bytes;
+}
+
+inline void SendingQueue::takeBatch(){
+	while(!pendingCounts.empty()){
+		auto count = pendingCounts.front();
+		if(!writingCounts.empty() && (oneMessagePerWrite || writing.size() + count > maxBuffersPerWrite))
+			break;
+		pendingCounts.pop_front();
+		for(uint32 i = 0; i < count; ++i){
+			writingBytes += pending.front().getLength();
+			writing.push_back(std::move(pending.front()));
+			pending.pop_front();
+		}
+		writingCounts.push_back(count);
+	}
+}
+
+inline void SendingQueue::releaseBuffers(std::vector<SendingBuffer>& buffers){
+	for(auto i = buffers.begin(); i != buffers.end(); ++i)
+		i->reset();
+}
+
+} // namespace ArmyAnt
+
+#endif // AA_SOCKET_SENDING_QUEUE_PRIVATE_HEADER_2026_10_17
@@ -0,0 +1,240 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+#ifndef AA_SOCKET_SLOT_TABLE_PRIVATE_HEADER_2026_10_17
+#define AA_SOCKET_SLOT_TABLE_PRIVATE_HEADER_2026_10_17
+
+#include "../../inc/AADefine.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace ArmyAnt{
+
+// 带代数标记的槽位表, 用于以索引保存连接等对象
+// 索引的低位是槽位号, 高位是槽位的代数. 槽位每释放一次代数加一, 因此已释放的旧索引不会误指向后来放入的对象
+// 分配和释放通过无锁的空闲链表完成, 查找只读取对应槽位, 都是O(1)
+// 槽位按块分配, 块一旦分配便不再释放, 因此任何时候都可以无锁地读取槽位
+template<class T>
+class SlotTable{
+public:
+	static const uint32 slotBits = 20;			// 最多可容纳 2^20 个对象
+	static const uint32 generationBits = 11;	// 索引总长31位, 保持在int范围内, 兼容使用int索引的接口
+	static const uint32 invalidIndex = 0xffffffff;
+
+public:
+	SlotTable();
+	~SlotTable();
+
+public:
+	// 放入对象, 返回索引, 表已满时返回invalidIndex
+	uint32 add(std::shared_ptr<T> value);
+	// 获取索引对应的对象, 索引已失效时返回空
+	std::shared_ptr<T> get(uint32 index)const;
+	// 移除索引对应的对象并将其返回, 索引已失效时返回空. 同一索引并发移除时只有一个调用者能得到对象
+	std::shared_ptr<T> remove(uint32 index);
+	// 当前对象数量
+	uint32 size()const;
+	// 遍历所有对象, 回调参数为索引和对象, 回调返回false时停止遍历
+	// 遍历期间其他线程仍可增删, 遍历开始后新放入的对象不一定会被遍历到
+	template<class Func> void forEach(Func func)const;
+
+private:
+	static const uint32 chunkBits = 10;
+	static const uint32 chunkSize = 1u << chunkBits;
+	static const uint32 maxChunks = 1u << (slotBits - chunkBits);
+	static const uint32 slotMask = (1u << slotBits) - 1;
+	static const uint32 generationMask = (1u << generationBits) - 1;
+	static const uint32 occupiedFlag = 0x80000000;
+	static const uint32 noneSlot = 0xffffffff;
+
+	struct Slot{
+		std::atomic<uint32> state;		// 最高位表示是否被占用, 低位为当前代数
+		std::atomic<uint32> next;		// 空闲链表中的下一个槽位
+		std::shared_ptr<T> value;		// 只通过std::atomic_load/atomic_exchange访问
+	};
+
+	Slot* getSlot(uint32 slot)const;
+	uint32 popFree();
+	void pushFree(uint32 first, uint32 last);
+	bool grow();
+
+	// 空闲链表头, 高32位是每次修改都递增的计数, 用于避免ABA问题, 低32位是槽位号
+	std::atomic<uint64> freeHead;
+	std::atomic<Slot*> chunks[maxChunks];
+	std::atomic<uint32> chunkCount;
+	std::atomic<uint32> count;
+	std::mutex growMutex;
+
+	AA_FORBID_COPY_CTOR(SlotTable);
+	AA_FORBID_ASSGN_OPR(SlotTable);
+};
+
+template<class T> const uint32 SlotTable<T>::slotBits;
+template<class T> const uint32 SlotTable<T>::generationBits;
+template<class T> const uint32 SlotTable<T>::invalidIndex;
+
+template<class T>
+SlotTable<T>::SlotTable() :freeHead(noneSlot), chunkCount(0), count(0){
+	for(uint32 i = 0; i < maxChunks; ++i)
+		chunks[i].store(nullptr, std::memory_order_relaxed);
+}
+
+template<class T>
+SlotTable<T>::~SlotTable(){
+	for(uint32 i = 0; i < maxChunks; ++i)
+		delete[] chunks[i].load(std::memory_order_relaxed);
+}
+
+template<class T>
+uint32 SlotTable<T>::add(std::shared_ptr<T> value){
+	auto slot = popFree();
+	if(slot == noneSlot)
+		return invalidIndex;
+	auto s = getSlot(slot);
+	std::atomic_store(&s->value, value);
+	uint32 generation = s->state.load(std::memory_order_relaxed) & generationMask;
+	s->state.store(occupiedFlag | generation, std::memory_order_release);
+	count.fetch_add(1, std::memory_order_relaxed);
+	return (generation << slotBits) | slot;
+}
+
+template<class T>
+std::shared_ptr<T> SlotTable<T>::get(uint32 index)const{
+	if(index >> (slotBits + generationBits) != 0)
+		return nullptr;
+	auto s = getSlot(index & slotMask);
+	if(s == nullptr)
+		return nullptr;
+	uint32 expected = occupiedFlag | (index >> slotBits);
+	if(s->state.load(std::memory_order_acquire) != expected)
+		return nullptr;
+	auto ret = std::atomic_load(&s->value);
+	// 读取期间槽位可能被释放并重新使用, 需要再次确认
+	if(s->state.load(std::memory_order_acquire) != expected)
+		return nullptr;
+	return ret;
+}
+
+template<class T>
+std::shared_ptr<T> SlotTable<T>::remove(uint32 index){
+	if(index >> (slotBits + generationBits) != 0)
+		return nullptr;
+	uint32 slot = index & slotMask;
+	auto s = getSlot(slot);
+	if(s == nullptr)
+		return nullptr;
+	uint32 generation = index >> slotBits;
+	uint32 expected = occupiedFlag | generation;
+	// 清除占用标记并递增代数, 只有一个线程能够成功
+	if(!s->state.compare_exchange_strong(expected, (generation + 1) & generationMask, std::memory_order_acq_rel))
+		return nullptr;
+	auto ret = std::atomic_exchange(&s->value, std::shared_ptr<T>());
+	count.fetch_sub(1, std::memory_order_relaxed);
+	pushFree(slot, slot);
+	return ret;
+}
+
+template<class T>
+uint32 SlotTable<T>::size()const{
+	return count.load(std::memory_order_relaxed);
+}
+
+template<class T>
+template<class Func>
+void SlotTable<T>::forEach(Func func)const{
+	uint32 slots = chunkCount.load(std::memory_order_acquire) * chunkSize;
+	for(uint32 i = 0; i < slots; ++i){
+		uint32 state = getSlot(i)->state.load(std::memory_order_acquire);
+		if((state & occupiedFlag) == 0)
+			continue;
+		uint32 index = ((state & generationMask) << slotBits) | i;
+		auto value = get(index);
+		if(value != nullptr && !func(index, value))
+			return;
+	}
+}
+
+template<class T>
+typename SlotTable<T>::Slot* SlotTable<T>::getSlot(uint32 slot)const{
+	auto chunk = chunks[slot >> chunkBits].load(std::memory_order_acquire);
+	if(chunk == nullptr)
+		return nullptr;
+	return chunk + (slot & (chunkSize - 1));
+}
+
+template<class T>
+uint32 SlotTable<T>::popFree(){
+	uint64 head = freeHead.load(std::memory_order_acquire);
+	while(true){
+		uint32 slot = uint32(head);
+		if(slot == noneSlot){
+			if(!grow())
+				return noneSlot;
+			head = freeHead.load(std::memory_order_acquire);
+			continue;
+		}
+		// 槽位内存不会释放, 即使此槽位已被其他线程取走, 读取next也是安全的, 此时下面的CAS会失败
+		uint32 next = getSlot(slot)->next.load(std::memory_order_relaxed);
+		uint64 newHead = (((head >> 32) + 1) << 32) | next;
+		if(freeHead.compare_exchange_weak(head, newHead, std::memory_order_acq_rel, std::memory_order_acquire))
+			return slot;
+	}
+}
+
+template<class T>
+void SlotTable<T>::pushFree(uint32 first, uint32 last){
+	auto tail = getSlot(last);
+	uint64 head = freeHead.load(std::memory_order_relaxed);
+	uint64 newHead;
+	do{
+		tail->next.store(uint32(head), std::memory_order_relaxed);
+		newHead = (((head >> 32) + 1) << 32) | first;
+	} while(!freeHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+}
+
+template<class T>
+bool SlotTable<T>::grow(){
+	std::lock_guard<std::mutex> lock(growMutex);
+	// 等待锁期间可能已有其他线程扩充过, 或有槽位被释放
+	if(uint32(freeHead.load(std::memory_order_acquire)) != noneSlot)
+		return true;
+	uint32 chunkIndex = chunkCount.load(std::memory_order_relaxed);
+	if(chunkIndex >= maxChunks)
+		return false;
+	auto chunk = new Slot[chunkSize];
+	uint32 first = chunkIndex << chunkBits;
+	for(uint32 i = 0; i < chunkSize; ++i){
+		chunk[i].state.store(0, std::memory_order_relaxed);
+		chunk[i].next.store(first + i + 1, std::memory_order_relaxed);
+	}
+	chunks[chunkIndex].store(chunk, std::memory_order_release);
+	chunkCount.store(chunkIndex + 1, std::memory_order_release);
+	pushFree(first, first + chunkSize - 1);
+	return true;
+}
+
+} // namespace ArmyAnt
+
+#endif // AA_SOCKET_SLOT_TABLE_PRIVATE_HEADER_2026_10_17
@@ -0,0 +1,207 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+#ifndef AA_SOCKET_TIMER_WHEEL_PRIVATE_HEADER_2026_10_17
+#define AA_SOCKET_TIMER_WHEEL_PRIVATE_HEADER_2026_10_17
+
+#include "../../inc/AADefine.h"
+
+namespace ArmyAnt{
+
+// 分层时间轮, 时间以tick为单位. 第0层256个槽, 每个tick前进一个槽; 其上3层各64个槽, 下一层转完一圈时, 上一层当前槽中的定时器重新分配到下层
+// 添加和删除都是O(1), 定时器节点由调用者分配, 以侵入式链表挂在槽上, 不需要额外分配内存
+// 超出范围(2^26个tick)的定时器按最远的时间处理, 因此到期时调用者应自行检查是否真正到期
+// 时间轮不加锁, 只能在同一个线程中使用
+class TimerWheel{
+public:
+	struct Node{
+		Node() :prev(nullptr), next(nullptr), expire(0){}
+		virtual ~Node(){}
+
+		Node* prev;
+		Node* next;
+		uint64 expire;	// 到期的tick
+	};
+
+public:
+	// now为开始时的tick
+	TimerWheel(uint64 now = 0);
+	// 删除所有仍在时间轮中的节点
+	~TimerWheel();
+
+public:
+	// 添加定时器, 节点不能已在时间轮中. 已经过期的时间按下一个tick处理
+	void add(Node* node, uint64 expire);
+	// 将定时器从时间轮中取出, 但不删除节点
+	static void remove(Node* node);
+	static bool isLinked(const Node* node);
+	// 推进到第to个tick(含), 依次回调到期的定时器, 回调时节点已取出, 回调中可以重新添加或删除节点
+	template<class Func>
+	void advance(uint64 to, Func&& onExpired);
+	// 下一个要处理的tick
+	uint64 getNow()const;
+
+private:
+	static const uint32 rootBits = 8;
+	static const uint32 levelBits = 6;
+	static const uint32 levelNum = 3;
+	static const uint64 maxDelta = (uint64(1) << (rootBits + levelBits * levelNum)) - 1;
+
+	static void initSlot(Node& slot);
+	static void link(Node& slot, Node* node);
+	Node& getSlot(uint64 expire);
+	// 将第level层(1开始)当前槽中的定时器重新分配, 返回该槽的序号
+	uint32 cascade(uint32 level);
+
+private:
+	uint64 now;
+	Node root[1 << rootBits];
+	Node levels[levelNum][1 << levelBits];
+
+	AA_FORBID_COPY_CTOR(TimerWheel);
+	AA_FORBID_ASSGN_OPR(TimerWheel);
+};
+
+inline TimerWheel::TimerWheel(uint64 now) :now(now){
+	for(auto& slot : root)
+		initSlot(slot);
+	for(auto& level : levels)
+		for(auto& slot : level)
+			initSlot(slot);
+}
+
+inline TimerWheel::~TimerWheel(){
+	auto clear = [](Node& slot){
+		while(slot.next != &slot){
+			auto node = slot.next;
+			remove(node);
+			delete node;
+		}
+	};
+	for(auto& slot : root)
+		clear(slot);
+	for(auto& level : levels)
+		for(auto& slot : level)
+			clear(slot);
+}
+
+inline void TimerWheel::add(Node * node, uint64 expire){
+	if(expire < now)
+		expire = now;
+	if(expire - now > maxDelta)
+		expire = now + maxDelta;
+	node->expire = expire;
+	link(getSlot(expire), node);
+}
+
+inline void TimerWheel::remove(Node * node){
+	if(!isLinked(node))
+		return;
+	node->prev->next = node->next;
+	node->next->prev = node->prev;
+	node->prev = nullptr;
+	node->next = nullptr;
+}
+
+inline bool TimerWheel::isLinked(const Node * node){
+	return node->next != nullptr;
+}
+
+template<class Func>
+inline void TimerWheel::advance(uint64 to, Func && onExpired){
+	Node expired;
+	while(now <= to){
+		auto index = uint32(now & ((1 << rootBits) - 1));
+		// 第0层转完一圈, 依次从上层取下一批定时器, 上层也转完一圈时继续向上
+		if(index == 0){
+			for(uint32 level = 1; level <= levelNum && cascade(level) == 0; ++level);
+		}
+		// 先把整个槽取出再回调, 回调中添加的定时器不会在本轮被处理
+		auto& slot = root[index];
+		initSlot(expired);
+		if(slot.next != &slot){
+			expired.next = slot.next;
+			expired.prev = slot.prev;
+			expired.next->prev = &expired;
+			expired.prev->next = &expired;
+			initSlot(slot);
+		}
+		++now;
+		while(expired.next != &expired){
+			auto node = expired.next;
+			remove(node);
+			onExpired(node);
+		}
+	}
+}
+
+inline uint64 TimerWheel::getNow() const{
+	return now;
+}
+
+inline void TimerWheel::initSlot(Node & slot){
+	slot.prev = &slot;
+	slot.next = &slot;
+}
+
+inline void TimerWheel::link(Node & slot, Node * node){
+	node->prev = slot.prev;
+	node->next = &slot;
+	slot.prev->next = node;
+	slot.prev = node;
+}
+
+inline TimerWheel::Node & TimerWheel::getSlot(uint64 expire){
+	auto delta = expire - now;
+	if(delta < (uint64(1) << rootBits))
+		return root[expire & ((1 << rootBits) - 1)];
+	for(uint32 level = 0; level < levelNum - 1; ++level){
+		if(delta < (uint64(1) << (rootBits + levelBits * (level + 1))))
+			return levels[level][(expire >> (rootBits + levelBits * level)) & ((1 << levelBits) - 1)];
+	}
+	return levels[levelNum - 1][(expire >> (rootBits + levelBits * (levelNum - 1))) & ((1 << levelBits) - 1)];
+}
+
+inline uint32 TimerWheel::cascade(uint32 level){
+	auto index = uint32((now >> (rootBits + levelBits * (level - 1))) & ((1 << levelBits) - 1));
+	auto& slot = levels[level - 1][index];
+	Node pending;
+	initSlot(pending);
+	if(slot.next != &slot){
+		pending.next = slot.next;
+		pending.prev = slot.prev;
+		pending.next->prev = &pending;
+		pending.prev->next = &pending;
+		initSlot(slot);
+	}
+	while(pending.next != &pending){
+		auto node = pending.next;
+		remove(node);
+		add(node, node->expire);
+	}
+	return index;
+}
+
+} // namespace ArmyAnt
+
+#endif // AA_SOCKET_TIMER_WHEEL_PRIVATE_HEADER_2026_10_17
@@ -0,0 +1,336 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+#ifndef AA_SOCKET_URING_PRIVATE_HEADER_2026_10_17
+#define AA_SOCKET_URING_PRIVATE_HEADER_2026_10_17
+
+#include "../../inc/AADefine.h"
+
+// 内核头文件提供多次触发的accept和recv时, 才编译io_uring后端, 否则只能使用boost::asio的epoll反应器
+#if defined OS_LINUX && defined __has_include
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined IORING_ACCEPT_MULTISHOT && defined IORING_RECV_MULTISHOT && defined IORING_ASYNC_CANCEL_ANY
+#define AA_SOCKET_URING
+#endif
+#endif
+#endif
+
+#if defined AA_SOCKET_URING
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace ArmyAnt{
+
+// 不依赖liburing的最小io_uring封装, 每个反应器一个, 只在反应器线程中使用, 不加锁
+// 接收使用注册到内核的一组缓冲区(provided buffer ring), 多次触发的recv每收到一次数据就从中取一个缓冲区填充, 回调后立即归还
+// 完成事件通过eventfd通知, 因此可以挂在boost::asio的io_service上等待, 与其他异步操作在同一线程中执行
+class SocketUring{
+public:
+	// 创建失败(内核不支持, 或被seccomp等禁止)时返回nullptr, 调用者应退回到epoll
+	static SocketUring* create(uint32 entries, uint32 bufferCount, uint32 bufferLen);
+	~SocketUring();
+
+public:
+	int getEventFd()const;
+	uint32 getBufferLen()const;
+	// 准备各种提交项, 提交队列已满时先提交已有的项
+	void prepareMultishotAccept(int fd, uint64 userData);
+	void prepareMultishotReceive(int fd, uint64 userData);
+	void prepareCancel(uint64 target);
+	// 提交所有准备好的项, 返回提交的数量, 出错时返回负的错误码
+	int submit();
+	// 依次回调所有已完成的项, func(uint64 userData, int32 result, uint32 flags, const uint8* data)
+	// 带有缓冲区的完成项, data指向其数据, 回调结束后缓冲区即归还给内核; 返回处理的数量
+	template<class Func>
+	uint32 forEachCompletion(Func&& func);
+	// 读取并清除eventfd的通知
+	void clearEvent();
+
+private:
+	SocketUring();
+	io_uring_sqe* getSqe();
+	void recycleBuffer(uint16 bid);
+
+private:
+	int ringFd = -1;
+	int eventFd = -1;
+	io_uring_params params;
+
+	void* sqRing = nullptr;
+	std::size_t sqRingSize = 0;
+	void* cqRing = nullptr;
+	std::size_t cqRingSize = 0;
+	io_uring_sqe* sqes = nullptr;
+	std::size_t sqesSize = 0;
+
+	unsigned* sqHead = nullptr;
+	unsigned* sqTail = nullptr;
+	unsigned* sqFlags = nullptr;
+	unsigned sqMask = 0;
+	unsigned* sqArray = nullptr;
+	unsigned sqPending = 0;			// 已准备但未提交的项数
+	unsigned* cqHead = nullptr;
+	unsigned* cqTail = nullptr;
+	unsigned cqMask = 0;
+	io_uring_cqe* cqes = nullptr;
+
+	static const uint16 bufferGroup = 0;
+	io_uring_buf_ring* bufferRing = nullptr;	// 缓冲区环, 需要页对齐, 用mmap分配
+	std::size_t bufferRingSize = 0;
+	uint8* buffers = nullptr;					// 所有接收缓冲区, 连续分配
+	std::size_t buffersSize = 0;
+	uint32 bufferCount = 0;
+	uint32 bufferLen = 0;
+
+	AA_FORBID_COPY_CTOR(SocketUring);
+	AA_FORBID_ASSGN_OPR(SocketUring);
+};
+
+inline SocketUring * SocketUring::create(uint32 entries, uint32 bufferCount, uint32 bufferLen){
+	// 缓冲区环的项数必须是2的幂
+	if(bufferCount == 0 || (bufferCount & (bufferCount - 1)) != 0 || bufferCount > 32768)
+		return nullptr;
+	std::unique_ptr<SocketUring> ret(new SocketUring());
+	auto& p = ret->params;
+	memset(&p, 0, sizeof(p));
+	// 多次触发的操作会产生大量完成项, 完成队列设为提交队列的8倍
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = entries * 8;
+	ret->ringFd = int(syscall(__NR_io_uring_setup, entries, &p));
+	if(ret->ringFd < 0)
+		return nullptr;
+	// 映射提交队列, 完成队列和提交项数组
+	ret->sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ret->cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+	if(p.features & IORING_FEAT_SINGLE_MMAP){
+		if(ret->cqRingSize > ret->sqRingSize)
+			ret->sqRingSize = ret->cqRingSize;
+		ret->cqRingSize = ret->sqRingSize;
+	}
+	ret->sqRing = mmap(nullptr, ret->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ret->ringFd, IORING_OFF_SQ_RING);
+	if(ret->sqRing == MAP_FAILED){
+		ret->sqRing = nullptr;
+		return nullptr;
+	}
+	if(p.features & IORING_FEAT_SINGLE_MMAP){
+		ret->cqRing = ret->sqRing;
+	} else{
+		ret->cqRing = mmap(nullptr, ret->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ret->ringFd, IORING_OFF_CQ_RING);
+		if(ret->cqRing == MAP_FAILED){
+			ret->cqRing = nullptr;
+			return nullptr;
+		}
+	}
+	ret->sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+	auto sqes = mmap(nullptr, ret->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ret->ringFd, IORING_OFF_SQES);
+	if(sqes == MAP_FAILED)
+		return nullptr;
+	ret->sqes = static_cast<io_uring_sqe*>(sqes);
+	auto sq = static_cast<uint8*>(ret->sqRing);
+	ret->sqHead = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+	ret->sqTail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+	ret->sqFlags = reinterpret_cast<unsigned*>(sq + p.sq_off.flags);
+	ret->sqMask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+	ret->sqArray = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+	auto cq = static_cast<uint8*>(ret->cqRing);
+	ret->cqHead = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+	ret->cqTail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+	ret->cqMask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+	ret->cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+
+	// 完成通知
+	ret->eventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if(ret->eventFd < 0)
+		return nullptr;
+	if(syscall(__NR_io_uring_register, ret->ringFd, IORING_REGISTER_EVENTFD, &ret->eventFd, 1) < 0)
+		return nullptr;
+
+	// 注册接收缓冲区
+	ret->bufferCount = bufferCount;
+	ret->bufferLen = bufferLen;
+	ret->bufferRingSize = bufferCount * sizeof(io_uring_buf);
+	auto ring = mmap(nullptr, ret->bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(ring == MAP_FAILED)
+		return nullptr;
+	ret->bufferRing = static_cast<io_uring_buf_ring*>(ring);
+	ret->buffersSize = std::size_t(bufferCount) * bufferLen;
+	auto buffers = mmap(nullptr, ret->buffersSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(buffers == MAP_FAILED)
+		return nullptr;
+	ret->buffers = static_cast<uint8*>(buffers);
+	io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = reinterpret_cast<uint64>(ret->bufferRing);
+	reg.ring_entries = bufferCount;
+	reg.bgid = bufferGroup;
+	if(syscall(__NR_io_uring_register, ret->ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+		return nullptr;
+	for(uint32 i = 0; i < bufferCount; ++i)
+		ret->recycleBuffer(uint16(i));
+	return ret.release();
+}
+
+inline SocketUring::SocketUring(){}
+
+inline SocketUring::~SocketUring(){
+	// 先关闭io_uring, 内核取消所有未完成的操作后, 才能释放其使用的内存
+	if(ringFd >= 0)
+		close(ringFd);
+	if(eventFd >= 0)
+		close(eventFd);
+	if(sqes != nullptr)
+		munmap(sqes, sqesSize);
+	if(cqRing != nullptr && cqRing != sqRing)
+		munmap(cqRing, cqRingSize);
+	if(sqRing != nullptr)
+		munmap(sqRing, sqRingSize);
+	if(buffers != nullptr)
+		munmap(buffers, buffersSize);
+	if(bufferRing != nullptr)
+		munmap(bufferRing, bufferRingSize);
+}
+
+inline int SocketUring::getEventFd() const{
+	return eventFd;
+}
+
+inline uint32 SocketUring::getBufferLen() const{
+	return bufferLen;
+}
+
+inline void SocketUring::prepareMultishotAccept(int fd, uint64 userData){
+	auto sqe = getSqe();
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = fd;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->accept_flags = SOCK_CLOEXEC;
+	sqe->user_data = userData;
+}
+
+inline void SocketUring::prepareMultishotReceive(int fd, uint64 userData){
+	auto sqe = getSqe();
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = fd;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = bufferGroup;
+	sqe->user_data = userData;
+}
+
+inline void SocketUring::prepareCancel(uint64 target){
+	auto sqe = getSqe();
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = target;
+	sqe->user_data = 0;
+}
+
+inline int SocketUring::submit(){
+	if(sqPending == 0)
+		return 0;
+	int ret;
+	do{
+		ret = int(syscall(__NR_io_uring_enter, ringFd, sqPending, 0, 0, nullptr, 0));
+	} while(ret < 0 && errno == EINTR);
+	if(ret < 0)
+		return -errno;
+	sqPending -= unsigned(ret) < sqPending ? unsigned(ret) : sqPending;
+	return ret;
+}
+
+template<class Func>
+inline uint32 SocketUring::forEachCompletion(Func && func){
+	uint32 ret = 0;
+	while(true){
+		auto head = *cqHead;
+		auto tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+		if(head == tail)
+			break;
+		for(; head != tail; ++head, ++ret){
+			auto& cqe = cqes[head & cqMask];
+			auto userData = uint64(cqe.user_data);
+			auto result = int32(cqe.res);
+			auto flags = uint32(cqe.flags);
+			if(flags & IORING_CQE_F_BUFFER){
+				auto bid = uint16(flags >> IORING_CQE_BUFFER_SHIFT);
+				func(userData, result, flags, buffers + std::size_t(bid) * bufferLen);
+				recycleBuffer(bid);
+			} else{
+				func(userData, result, flags, static_cast<const uint8*>(nullptr));
+			}
+		}
+		__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+	}
+	// 完成队列溢出时, 内核暂存的完成项需要再进入内核一次才会写入队列
+	if(__atomic_load_n(sqFlags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW){
+		syscall(__NR_io_uring_enter, ringFd, 0, 0, IORING_ENTER_GETEVENTS, nullptr, 0);
+		ret += forEachCompletion(std::forward<Func>(func));
+	}
+	return ret;
+}
+
+inline void SocketUring::clearEvent(){
+	uint64 value;
+	auto ret = read(eventFd, &value, sizeof(value));
+	(void)ret;
+}
+
+inline io_uring_sqe * SocketUring::getSqe(){
+	auto head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+	auto tail = *sqTail;
+	if(tail - head >= params.sq_entries){
+		submit();
+		head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+	}
+	auto index = tail & sqMask;
+	auto sqe = &sqes[index];
+	memset(sqe, 0, sizeof(io_uring_sqe));
+	sqArray[index] = index;
+	__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+	++sqPending;
+	return sqe;
+}
+
+inline void SocketUring::recycleBuffer(uint16 bid){
+	auto tail = bufferRing->tail;
+	// 内核头文件用空结构体包装柔性数组, 在C++中空结构体占1字节, 因此bufs的偏移不对, 直接从环的起始地址取缓冲区项
+	auto& buf = reinterpret_cast<io_uring_buf*>(bufferRing)[tail & (bufferCount - 1)];
+	buf.addr = reinterpret_cast<uint64>(buffers + std::size_t(bid) * bufferLen);
+	buf.len = bufferLen;
+	buf.bid = bid;
+	__atomic_store_n(&bufferRing->tail, uint16(tail + 1), __ATOMIC_RELEASE);
+}
+
+} // namespace ArmyAnt
+
+#endif // defined AA_SOCKET_URING
+
+#endif // AA_SOCKET_URING_PRIVATE_HEADER_2026_10_17
@@ -23,52 +23,74 @@
  */
 
 #include "../../inc/AASqlClient.h"
+#include <initializer_list>
 
 namespace ArmyAnt {
 
+    // 先计算总长度并一次性预留, 再依次拼接各段, 避免 operator+ 逐段生成临时字符串
+    static String joinSql(std::initializer_list<StringView> parts) {
+        uint64 length = 0;
+        for (auto &part : parts)
+            length += part.size();
+        String ret;
+        ret.reserve(length);
+        for (auto &part : parts)
+            ret += part;
+        return ret;
+    }
+
     ISqlClient::ISqlClient() {
     }
 
     ISqlClient::~ISqlClient() {
     }
 
-    SqlTable ISqlClient::getWholeTable(const String &tableName) {
+    SqlTable ISqlClient::getWholeTable(StringView tableName) {
         return select( tableName);
     }
 
-    SqlTable ISqlClient::getWholeView(const String &tableName) {
+    SqlTable ISqlClient::getWholeView(StringView tableName) {
         return select( tableName);
     }
 
     SqlTable
-    ISqlClient::select(const String &tableName, const SqlClause *clauses, int clausesNum) {
-        return query("select * from " + tableName + organizeSqlClause(clauses, clausesNum));
+    ISqlClient::select(StringView tableName, const SqlClause *clauses, int clausesNum) {
+        return query(joinSql({"select * from ", tableName, organizeSqlClause(clauses, clausesNum)}));
     }
 
-    SqlTable ISqlClient::select(const String &tableName, const String *columnNames, int columnNum,
+    SqlTable ISqlClient::select(StringView tableName, const String *columnNames, int columnNum,
                                 const SqlClause *clauses, int clausesNum) {
         String sql = "select ";
         if (columnNames != nullptr)
             for (int i = 0; i < columnNum; ++i) {
-                sql += columnNames[i] + " , ";
+                if (i != 0)
+                    sql += " , ";
+                sql += columnNames[i];
             }
-        return query(sql + "from " + tableName + organizeSqlClause(clauses, clausesNum));
+        sql += " from ";
+        sql += tableName;
+        sql += organizeSqlClause(clauses, clausesNum);
+        return query(sql);
     }
 
-	int64 ISqlClient::update(const String &tableName, const SqlRow &updatedData,
+	int64 ISqlClient::update(StringView tableName, const SqlRow &updatedData,
                             const SqlClause *clauses, int clausesNum) {
         if (updatedData.size() <= 0)
             return -1;
-        String sql = "update " + tableName + " set ";
+        String sql = joinSql({"update ", tableName, " set "});
         for (uint32 i = 0; i < updatedData.size(); ++i) {
-            sql += updatedData[i].getHead()->columnName + " = \"" + updatedData[i].getValue() + "\" ";
+            sql += updatedData[i].getHead()->columnName;
+            sql += " = \"";
+            sql += updatedData[i].getValue();
+            sql += "\" ";
             if (i != updatedData.size() - 1)
                 sql += ", ";
         }
-        return update(sql + organizeSqlClause(clauses, clausesNum));
+        sql += organizeSqlClause(clauses, clausesNum);
+        return update(sql);
     }
 
-	int64 ISqlClient::insertRow(const String &tableName, const SqlRow &insertedData) {
+	int64 ISqlClient::insertRow(StringView tableName, const SqlRow &insertedData) {
         if (insertedData.size() <= 0)
             return -1;
         String keys = "";
@@ -82,14 +104,14 @@ namespace ArmyAnt {
             }
         }
 
-        return update("insert into " + tableName + " ( " + keys + " ) values ( " + values + " )");
+        return update(joinSql({"insert into ", tableName, " ( ", keys, " ) values ( ", values, " )"}));
     }
 
-	int64 ISqlClient::insertColumn(const String &tableName, const SqlFieldHead &columnHead) {
-        return update("alter table " + tableName + " add " + organizeColumnInfo(columnHead));
+	int64 ISqlClient::insertColumn(StringView tableName, const SqlFieldHead &columnHead) {
+        return update(joinSql({"alter table ", tableName, " add ", organizeColumnInfo(columnHead)}));
     }
 
-	int64 ISqlClient::insertColumn(const String &tableName, const SqlColumn &column) {
+	int64 ISqlClient::insertColumn(StringView tableName, const SqlColumn &column) {
         for (uint32 i = 0; i < column.size(); ++i) {
             if (!insertColumn(tableName, *(column.getHead(i))))
                 return -1;
@@ -97,43 +119,44 @@ namespace ArmyAnt {
         return column.size() > 0;
     }
 
-	int64 ISqlClient::deleteRow(const String &tableName, const SqlClause *where) {
+	int64 ISqlClient::deleteRow(StringView tableName, const SqlClause *where) {
         if (where != nullptr && where->type != SqlClauseType::Where)
             return -1;
-        return update("delete from " + tableName + ' ' + organizeSqlClause(where, 1));
+        return update(joinSql({"delete from ", tableName, " ", organizeSqlClause(where, 1)}));
     }
 
-	int64 ISqlClient::deleteColumn(const String &tableName, const String &columnName) {
-        return update("alter table " + tableName + " drop column " + columnName);
+	int64 ISqlClient::deleteColumn(StringView tableName, StringView columnName) {
+        return update(joinSql({"alter table ", tableName, " drop column ", columnName}));
     }
 
-	int64 ISqlClient::createDatabase(const String &dbName) {
-        return update("create database "+dbName);
+	int64 ISqlClient::createDatabase(StringView dbName) {
+        return update(joinSql({"create database ", dbName}));
     }
 
-	int64 ISqlClient::deleteDatabase(const String &dbName) {
-        return update("drop database "+dbName);
+	int64 ISqlClient::deleteDatabase(StringView dbName) {
+        return update(joinSql({"drop database ", dbName}));
     }
 
-	int64 ISqlClient::createTable(const String &tableName, const SqlColumn&column, const SqlTableInfo*tableInfo) {
+	int64 ISqlClient::createTable(StringView tableName, const SqlColumn&column, const SqlTableInfo*tableInfo) {
         if(column.size()<=0)
             return -1;
-        String sql = "create table " + tableName+" ( ";
+        String sql = joinSql({"create table ", tableName, " ( "});
         for(uint32 i=0;i<column.size();++i){
             sql += organizeColumnInfo(*(column[i].getHead()));
             if(i< column.size()-1)
                 sql+=" , ";
         }
-        return update(sql + " )");
+        sql += " )";
+        return update(sql);
     }
 
-	int64 ISqlClient::deleteTable(const String &tableName) {
-        return update("drop table "+tableName);
+	int64 ISqlClient::deleteTable(StringView tableName) {
+        return update(joinSql({"drop table ", tableName}));
     }
 
     String ISqlClient::organizeColumnInfo(const SqlFieldHead &column) {
         // TODO: 应当扩展支持的更多属性
-        return column.columnName + ' ' + SqlStructHelper::getDataTypeName(column.type) + (column.allowNull ? "" : " not null");
+        return joinSql({column.columnName, " ", SqlStructHelper::getDataTypeName(column.type), column.allowNull ? "" : " not null"});
     }
 
     String ISqlClient::organizeSqlClause(const SqlClause *clauses, int clausesNum) {
@@ -22,87 +22,523 @@
  */
 
 #include "../../inc/AALog.h"
-#include "../../inc/AATimeUtilities.h"
 
-#include <queue>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <thread>
+#include <utility>
+#include <vector>
 
 #include "../../inc/AAClassPrivateHandle.hpp"
 #include "../../inc/AAString.h"
-#include "../../inc/AAIStream_File.h"
+#include "../../inc/AATimeUtilities.h"
+#include "AALogArchiver.hxx"
+#include "AALogBinary.hxx"
+#include "AALogFileSink.hxx"
+#include "AALogRing.hxx"
 
 
 #define AA_HANDLE_MANAGER ArmyAnt::ClassPrivateHandleManager<Logger, Logger_Private>::getInstance()
 
 namespace ArmyAnt{
 
+namespace{
+
+// 一个线程在一个日志对象上的环, 线程退出时标记为已放弃, 由写线程读空后释放
+struct LoggerThreadRing{
+	uint64 loggerId;
+	std::shared_ptr<LogRing> ring;
+};
+
+struct LoggerThreadRings{
+	std::vector<LoggerThreadRing> rings;
+	~LoggerThreadRings();
+};
+
+thread_local LoggerThreadRings t_loggerRings;
+// 线程退出, t_loggerRings析构之后仍写日志时(如静态对象的析构函数中), 改走加锁的队列
+thread_local bool t_isLoggerRingsDestroyed = false;
+std::atomic<uint64> g_loggerId(0);
+
+LoggerThreadRings::~LoggerThreadRings(){
+	for(auto i = rings.begin(); i != rings.end(); ++i)
+		i->ring->isAbandoned = true;
+	t_isLoggerRingsDestroyed = true;
+}
+
+}
+
 class Logger_Private{
 public:
-	Logger_Private() :mutex(), logFileWriteQueue(), threadEnd(false), logFileWriteThread(&Logger_Private::update, this){}
+	Logger_Private() :id(++g_loggerId), logFileWriteThread(&Logger_Private::update, this){}
 	~Logger_Private(){
-		threadEnd = true;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			threadEnd = true;
+		}
+		logFileWriteCondition.notify_one();
+		// 写线程退出前会写完所有环和队列中剩余的日志
 		logFileWriteThread.join();
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		for(auto i = rings.begin(); i != rings.end(); ++i)
+			(*i)->isClosed = true;
 	}
 
+	// 记录的输出目标
+	static const uint8 toConsole = 1;
+	static const uint8 toFile = 2;
+	// 记录内容是uint32格式id, int64时间和编码后的参数, 由写线程格式化
+	static const uint8 isDeferred = 4;
+	// 每个线程的环的大小, 超过其1/4的记录改走加锁的队列
+	static const uint32 ringCapacity = 256 * 1024;
+
+	// 按"[ 时间 ] [ 标签 ] [ 级别 ] 内容"格式化, 直接写入当前线程的环, 不加锁也不分配内存
+	bool pushRecord(const char* content, Logger::AlertLevel level, const char* tag, uint8 targets);
+	// 写入已格式化好的整条内容
+	bool pushWholeRecord(const char* wholeContent, uint8 targets);
+	// 只复制参数的原始字节
+	bool pushDeferredRecord(uint32 formatId, int64 timeNs, const char* arguments, uint32 length, uint8 targets);
+	// 日志写线程: 所有环都为空时在条件变量上等待, 有日志时整批读出, 合并为一次writev写出
 	void update();
 
 	static ArmyAnt::String getWholeContent(const char * content, Logger::AlertLevel level, const char * tag);
 
+private:
+	bool pushParts(const char* const* parts, const uint32* lens, uint32 count, uint64 total, uint8 targets);
+	LogRing* getThreadRing();
+	void wakeWriter();
+	// 读出并写出所有日志, 没有日志时返回false
+	bool drain();
+	bool hasRingRecords();
+	void refreshRings();
+	// 只在写线程中调用, 缓存已查到的格式
+	const LogFormatInfo* getFormat(uint32 formatId);
+	// 需要持有fileMutex. 关闭并改名当前文件, 再打开新文件, 改名后的文件交给后台压缩
+	void rotateFile();
+
+public:
+	// 需要持有fileMutex
+	void resetRotationTime(time_t now);
+
+public:
 	Logger::AlertLevel consoleLevel = Logger::AlertLevel::Import;
-	ArmyAnt::File logFile;
+	LogFileSink logFile;
 	Logger::AlertLevel fileLevel = Logger::AlertLevel::Verbose;
 	std::ostream* userStream = nullptr;
 	Logger::AlertLevel userStreamLevel = Logger::AlertLevel::Debug;
 
+	const uint64 id;			// 区分先后分配在同一地址上的日志对象
 	ArmyAnt::String logFileName;
-	std::mutex mutex;
-	std::queue<ArmyAnt::String> logFileWriteQueue;
+	Logger::FileFormat fileFormat = Logger::FileFormat::Text;
+	uint32 fileGeneration = 0;	// 每次更换文件时加一, 写线程据此在新文件中重新写出文件头和格式
+	Logger::Rotation rotation;
+	uint64 fileSize = 0;		// 当前文件的长度, 包括已交给logFile但尚未flush的部分
+	time_t nextRotationTime = 0;
+	std::mutex fileMutex;		// 保护logFile, logFileName, fileFormat和fileGeneration, 写线程写出一批日志期间持有
+
+private:
+	std::mutex ringsMutex;		// 保护rings, 只在线程第一次写日志和写线程丢弃环时加锁
+	std::vector<std::shared_ptr<LogRing>> rings;
+	std::atomic<uint32> ringsVersion{0};
+	std::vector<std::shared_ptr<LogRing>> drainingRings;	// 写线程持有的rings副本, 版本变化时更新
+	uint32 drainingVersion = 0;
+
+	struct Record{
+		uint8 targets;
+		const char* data;
+		uint32 len;
+		// 写线程生成的文本或二进制记录在formattingBuffer中的位置, 整批生成完之后才能换算为指针
+		std::size_t textOffset;
+		std::size_t textLen;
+		std::size_t binaryOffset;
+		std::size_t binaryLen;
+		bool isRotatingBefore;	// 写入这条记录之前轮换文件
+	};
+	// 需要持有fileMutex. 生成record写入文件和控制台所需的二进制或文本内容, 二进制内容在前. 返回写入文件的长度
+	std::size_t formatRecord(Record& record, bool isToFile, bool isBinary);
+	std::vector<Record> drainingRecords;
+	std::vector<uint64> drainingPositions;
+	std::vector<std::pair<uint8, ArmyAnt::String>> drainingQueue;
+	std::string formattingBuffer;
+	std::string consoleBuffer;
+	std::vector<const LogFormatInfo*> formatCache;
+	std::vector<bool> writtenFormats;	// 当前二进制文件中已写出的格式
+	uint32 writtenGeneration = 0;
+	std::unique_ptr<LogArchiver> archiver;	// 第一次轮换时创建, 析构时等待进行中的压缩完成
+
+	std::atomic<bool> isWriterSleeping{false};
+	std::mutex mutex;			// 保护logFileWriteQueue, isWakeRequested和threadEnd
+	std::condition_variable logFileWriteCondition;
+	std::vector<std::pair<uint8, ArmyAnt::String>> logFileWriteQueue;	// 过长的记录, 每条已带有换行符
+	bool isWakeRequested = false;
 	bool threadEnd = false;
 	std::thread logFileWriteThread;
 };
 
+const uint8 Logger_Private::toConsole;
+const uint8 Logger_Private::toFile;
+const uint32 Logger_Private::ringCapacity;
+
 ArmyAnt::String Logger_Private::getWholeContent(const char * content, Logger::AlertLevel level, const char * tag){
-	ArmyAnt::String timeString = "[ " + TimeUtilities::getTimeStamp() + " ] ";
+	char timeStamp[32];
+	TimeUtilities::formatCoarseTimeStamp(timeStamp);
+	ArmyAnt::String timeString = ArmyAnt::String("[ ") + timeStamp + " ] ";
 	ArmyAnt::String tagString = "[ " + ArmyAnt::String(tag) + " ] ";
 	ArmyAnt::String wholeContent = timeString + tagString + "[ " + Logger::convertLevelToString(level) + " ] " + content;
 	return wholeContent;
 }
 
+bool Logger_Private::pushRecord(const char * content, Logger::AlertLevel level, const char * tag, uint8 targets){
+	char timeStamp[32];
+	auto timeLen = TimeUtilities::formatCoarseTimeStamp(timeStamp);
+	const char* parts[] = {"[ ", timeStamp, " ] [ ", tag == nullptr ? "" : tag, " ] [ ", Logger::convertLevelToString(level), " ] ", content == nullptr ? "" : content, "\n"};
+	uint32 lens[9];
+	uint64 total = 0;
+	for(uint32 i = 0; i < 9; ++i){
+		lens[i] = i == 1 ? timeLen : uint32(strlen(parts[i]));
+		total += lens[i];
+	}
+	return pushParts(parts, lens, 9, total, targets);
+}
+
+bool Logger_Private::pushWholeRecord(const char * wholeContent, uint8 targets){
+	const char* parts[] = {wholeContent == nullptr ? "" : wholeContent, "\n"};
+	uint32 lens[] = {uint32(strlen(parts[0])), 1};
+	return pushParts(parts, lens, 2, uint64(lens[0]) + 1, targets);
+}
+
+bool Logger_Private::pushDeferredRecord(uint32 formatId, int64 timeNs, const char * arguments, uint32 length, uint8 targets){
+	char header[12];
+	memcpy(header, &formatId, 4);
+	memcpy(header + 4, &timeNs, 8);
+	const char* parts[] = {header, arguments};
+	uint32 lens[] = {12, length};
+	return pushParts(parts, lens, 2, uint64(length) + 12, targets | isDeferred);
+}
+
+bool Logger_Private::pushParts(const char * const * parts, const uint32 * lens, uint32 count, uint64 total, uint8 targets){
+	auto ring = getThreadRing();
+	if(ring != nullptr && total <= ring->getMaxRecordLen()){
+		char* target;
+		while((target = ring->reserve(uint32(total), targets)) == nullptr){
+			// 环已满, 等待写线程读出
+			wakeWriter();
+			std::this_thread::yield();
+		}
+		for(uint32 i = 0; i < count; ++i){
+			memcpy(target, parts[i], lens[i]);
+			target += lens[i];
+		}
+		ring->commit();
+		wakeWriter();
+		return true;
+	}
+	// 过长的记录加锁入队. 写线程先写出队列再写出各个环, 因此要等本线程之前的记录都已读出, 才能保持本线程的顺序
+	if(ring != nullptr){
+		while(!ring->isEmpty()){
+			wakeWriter();
+			std::this_thread::yield();
+		}
+	}
+	ArmyAnt::String record;
+	record.reserve(total);
+	for(uint32 i = 0; i < count; ++i)
+		record.append(parts[i], lens[i]);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		logFileWriteQueue.emplace_back(targets, std::move(record));
+		isWakeRequested = true;
+	}
+	logFileWriteCondition.notify_one();
+	return true;
+}
+
+LogRing * Logger_Private::getThreadRing(){
+	if(t_isLoggerRingsDestroyed)
+		return nullptr;
+	auto& threadRings = t_loggerRings.rings;
+	for(auto i = threadRings.begin(); i != threadRings.end(); ++i)
+		if(i->loggerId == id)
+			return i->ring.get();
+	// 本线程第一次写这个日志对象, 顺便释放已销毁的日志对象留下的环
+	for(auto i = threadRings.begin(); i != threadRings.end();){
+		if(i->ring->isClosed)
+			i = threadRings.erase(i);
+		else
+			++i;
+	}
+	std::shared_ptr<LogRing> ring(new LogRing(ringCapacity));
+	{
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		rings.push_back(ring);
+		++ringsVersion;
+	}
+	LoggerThreadRing threadRing = {id, ring};
+	threadRings.push_back(threadRing);
+	return ring.get();
+}
+
+void Logger_Private::wakeWriter(){
+	// 与写线程中声明休眠后再检查一次环的顺序相对: 要么写线程看到刚发布的记录, 要么这里看到写线程已休眠
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(!isWriterSleeping.load(std::memory_order_relaxed))
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		isWakeRequested = true;
+	}
+	logFileWriteCondition.notify_one();
+}
+
 void Logger_Private::update(){
 	while(true){
-		mutex.lock();
-		bool isEmpty = logFileWriteQueue.empty();
-		if(!isEmpty){
-			if(logFile.IsOpened())
-				logFile.Close();
-			if(!logFile.Open(logFileName)){
-				std::this_thread::sleep_for(std::chrono::microseconds(1));
+		if(drain())
+			continue;
+		isWriterSleeping.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(hasRingRecords()){
+			isWriterSleeping.store(false, std::memory_order_relaxed);
+			continue;
+		}
+		bool isEnd;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			logFileWriteCondition.wait(lock, [this](){ return isWakeRequested || threadEnd; });
+			isWakeRequested = false;
+			isEnd = threadEnd;
+		}
+		isWriterSleeping.store(false, std::memory_order_relaxed);
+		if(isEnd){
+			while(drain());
+			break;
+		}
+	}
+}
+
+bool Logger_Private::drain(){
+	refreshRings();
+	// 先读出各个环, 再取出队列: 一个线程的过长记录入队时它的环已读空, 因此先写队列再写环不会打乱同一线程的顺序
+	drainingRecords.clear();
+	drainingPositions.clear();
+	for(auto i = drainingRings.begin(); i != drainingRings.end(); ++i){
+		drainingPositions.push_back((*i)->peek([this](uint8 targets, const char* data, uint32 len){
+			Record record = {targets, data, len, 0, 0, 0, 0, false};
+			drainingRecords.push_back(record);
+		}));
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		drainingQueue.swap(logFileWriteQueue);
+	}
+	if(!drainingQueue.empty()){
+		std::vector<Record> queued;
+		for(auto i = drainingQueue.begin(); i != drainingQueue.end(); ++i){
+			Record record = {i->first, i->second.c_str(), uint32(i->second.size()), 0, 0, 0, 0, false};
+			queued.push_back(record);
+		}
+		drainingRecords.insert(drainingRecords.begin(), queued.begin(), queued.end());
+	}
+	if(drainingRecords.empty())
+		return false;
+
+	{
+		std::lock_guard<std::mutex> lock(fileMutex);
+		// 没有设定日志文件时丢弃
+		auto isFileOpened = logFile.isOpened();
+		auto isBinary = isFileOpened && fileFormat == Logger::FileFormat::Binary;
+		formattingBuffer.clear();
+		if(writtenGeneration != fileGeneration){
+			writtenGeneration = fileGeneration;
+			writtenFormats.clear();
+			if(isBinary && logFile.getSize() == 0)
+				appendLogFileHeader(formattingBuffer);
+		}
+		auto headerLen = formattingBuffer.size();
+		uint64 projectedSize = fileSize + headerLen;
+		auto isTimeDue = isFileOpened && rotation.intervalSeconds > 0 && time(nullptr) >= nextRotationTime;
+		// 先生成所有需要的文本和二进制记录, formattingBuffer不再增长之后再交给文件和控制台
+		// 同时决定在哪条记录之前轮换, 轮换只发生在两条记录之间
+		for(auto i = drainingRecords.begin(); i != drainingRecords.end(); ++i){
+			auto isToFile = (i->targets & toFile) && isFileOpened;
+			auto fileLen = formatRecord(*i, isToFile, isBinary);
+			if(!isToFile)
 				continue;
+			if(isTimeDue || (rotation.maxFileSize > 0 && projectedSize > 0 && projectedSize + fileLen > rotation.maxFileSize)){
+				i->isRotatingBefore = true;
+				isTimeDue = false;
+				projectedSize = 0;
+				if(isBinary){
+					// 新文件需要重新写出文件头和用到的格式
+					auto offset = i->binaryOffset;
+					formattingBuffer.resize(offset);
+					writtenFormats.clear();
+					appendLogFileHeader(formattingBuffer);
+					formatRecord(*i, isToFile, isBinary);
+					fileLen = i->binaryOffset + i->binaryLen - offset;
+					i->binaryOffset = offset;
+					i->binaryLen = fileLen;
+				}
 			}
-			while(!logFileWriteQueue.empty()){
-				auto msg = logFileWriteQueue.front();
-
-				logFile.MoveTo(-1);
-				bool ret = logFile.Write(msg);
-				if(ret != 0){
-					ret = logFile.Write("\n");
+			projectedSize += fileLen;
+		}
+		auto formatted = formattingBuffer.data();
+		if(headerLen > 0){
+			logFile.append(formatted, headerLen);
+			fileSize += headerLen;
+		}
+		for(auto i = drainingRecords.begin(); i != drainingRecords.end(); ++i){
+			auto isDeferredRecord = (i->targets & isDeferred) != 0;
+			if(i->isRotatingBefore){
+				rotateFile();
+				isFileOpened = logFile.isOpened();
+			}
+			if((i->targets & toFile) && isFileOpened){
+				if(isBinary){
+					logFile.append(formatted + i->binaryOffset, i->binaryLen);
+					fileSize += i->binaryLen;
+				} else if(isDeferredRecord){
+					logFile.append(formatted + i->textOffset, i->textLen);
+					fileSize += i->textLen;
 				} else{
-
+					logFile.append(i->data, i->len);
+					fileSize += i->len;
 				}
-
-				logFileWriteQueue.pop();
 			}
-			logFile.Close();
-			mutex.unlock();
-		} else{
-			mutex.unlock();
-			if(threadEnd){
-				break;
-			} else{
-				std::this_thread::sleep_for(std::chrono::microseconds(1));
+			if(i->targets & toConsole){
+				if(isDeferredRecord)
+					consoleBuffer.append(formatted + i->textOffset, i->textLen);
+				else
+					consoleBuffer.append(i->data, i->len);
 			}
 		}
+		logFile.flush();
+	}
+	if(!consoleBuffer.empty()){
+		std::cout.write(consoleBuffer.data(), consoleBuffer.size());
+		std::cout.flush();
+		consoleBuffer.clear();
+	}
+	// 写出之后才能归还环中的空间
+	for(std::size_t i = 0; i < drainingRings.size(); ++i)
+		drainingRings[i]->release(drainingPositions[i]);
+	drainingQueue.clear();
+
+	// 丢弃所属线程已退出且已读空的环
+	bool hasAbandoned = false;
+	for(auto i = drainingRings.begin(); i != drainingRings.end(); ++i)
+		if((*i)->isAbandoned && (*i)->isEmpty())
+			hasAbandoned = true;
+	if(hasAbandoned){
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		for(auto i = rings.begin(); i != rings.end();){
+			if((*i)->isAbandoned && (*i)->isEmpty())
+				i = rings.erase(i);
+			else
+				++i;
+		}
+		++ringsVersion;
 	}
+	return true;
+}
+
+bool Logger_Private::hasRingRecords(){
+	refreshRings();
+	for(auto i = drainingRings.begin(); i != drainingRings.end(); ++i)
+		if(!(*i)->isEmpty())
+			return true;
+	return false;
+}
+
+void Logger_Private::refreshRings(){
+	auto version = ringsVersion.load(std::memory_order_acquire);
+	if(version == drainingVersion)
+		return;
+	std::lock_guard<std::mutex> lock(ringsMutex);
+	drainingRings = rings;
+	drainingVersion = ringsVersion.load(std::memory_order_relaxed);
+}
+
+std::size_t Logger_Private::formatRecord(Record & record, bool isToFile, bool isBinary){
+	if(!(record.targets & isDeferred)){
+		if(!isToFile)
+			return 0;
+		if(!isBinary)
+			return record.len;
+		record.binaryOffset = formattingBuffer.size();
+		appendLogTextRecord(formattingBuffer, record.data, record.len);
+		record.binaryLen = formattingBuffer.size() - record.binaryOffset;
+		return record.binaryLen;
+	}
+	uint32 formatId;
+	int64 timeNs;
+	memcpy(&formatId, record.data, 4);
+	memcpy(&timeNs, record.data + 4, 8);
+	auto arguments = record.data + 12;
+	auto argumentsLen = record.len - 12;
+	auto format = getFormat(formatId);
+	if(format == nullptr)
+		return 0;
+	if(isToFile && isBinary){
+		record.binaryOffset = formattingBuffer.size();
+		if(formatId >= writtenFormats.size())
+			writtenFormats.resize(formatId + 1, false);
+		if(!writtenFormats[formatId]){
+			appendLogFormatRecord(formattingBuffer, formatId, *format);
+			writtenFormats[formatId] = true;
+		}
+		appendLogEntryRecord(formattingBuffer, formatId, timeNs, arguments, argumentsLen);
+		record.binaryLen = formattingBuffer.size() - record.binaryOffset;
+	}
+	if((record.targets & toConsole) || (isToFile && !isBinary)){
+		record.textOffset = formattingBuffer.size();
+		appendLogLine(formattingBuffer, *format, timeNs, arguments, argumentsLen);
+		record.textLen = formattingBuffer.size() - record.textOffset;
+	}
+	if(!isToFile)
+		return 0;
+	return isBinary ? record.binaryLen : record.textLen;
+}
+
+void Logger_Private::rotateFile(){
+	// close会先写出已交给logFile的数据
+	logFile.close();
+	auto now = time(nullptr);
+	resetRotationTime(now);
+	std::string activePath(logFileName.c_str());
+	auto rotatedPath = makeRotatedLogPath(activePath, now);
+	auto isRenamed = std::rename(activePath.c_str(), rotatedPath.c_str()) == 0;
+	logFile.open(activePath.c_str());
+	// 改名失败时(如Windows上文件被其他进程占用)继续写原文件, 再写满一个文件后重试
+	fileSize = isRenamed ? logFile.getSize() : 0;
+	if(!isRenamed)
+		return;
+	if(archiver == nullptr)
+		archiver.reset(new LogArchiver());
+	archiver->push(rotatedPath, activePath, rotation.compression, rotation.maxRetainedFiles);
+}
+
+void Logger_Private::resetRotationTime(time_t now){
+	auto interval = time_t(rotation.intervalSeconds);
+	nextRotationTime = interval > 0 ? (now / interval + 1) * interval : 0;
+}
+
+const LogFormatInfo * Logger_Private::getFormat(uint32 formatId){
+	if(formatId < formatCache.size() && formatCache[formatId] != nullptr)
+		return formatCache[formatId];
+	auto format = LogFormatRegistry::getInstance().get(formatId);
+	if(format != nullptr){
+		if(formatId >= formatCache.size())
+			formatCache.resize(formatId + 1, nullptr);
+		formatCache[formatId] = format;
+	}
+	return format;
 }
 
 const char * Logger::convertLevelToString(AlertLevel level){
@@ -125,13 +561,43 @@ const char * Logger::convertLevelToString(AlertLevel level){
 	return "Unknown";
 }
 
+Logger::Rotation::Rotation()
+	:maxFileSize(0), intervalSeconds(0), maxRetainedFiles(0), compression(Compression::None){}
+
+Logger::Rotation Logger::Rotation::make(uint64 maxFileSize, uint32 intervalSeconds, uint32 maxRetainedFiles, Compression compression){
+	Rotation ret;
+	ret.maxFileSize = maxFileSize;
+	ret.intervalSeconds = intervalSeconds;
+	ret.maxRetainedFiles = maxRetainedFiles;
+	ret.compression = compression;
+	return ret;
+}
+
+bool Logger::Rotation::isValid() const{
+	switch(compression){
+		case Compression::None:
+		case Compression::Gzip:
+			return true;
+		case Compression::Zstd:
+#if defined AA_LOG_ZSTD
+			return true;
+#else
+			return false;
+#endif
+	}
+	return false;
+}
+
+Logger::Format::Format(const char * format, AlertLevel level, const char * tag)
+	:level(level), id(LogFormatRegistry::getInstance().add(format, tag, level)){}
+
 Logger::Logger(const char* logFilePath){
 	AA_HANDLE_MANAGER.GetHandle(this);
 	setLogFile(logFilePath);
 }
 
 Logger::~Logger(){
-	AA_HANDLE_MANAGER.ReleaseHandle(this);
+	delete AA_HANDLE_MANAGER.ReleaseHandle(this);
 }
 
 void Logger::setConsoleLevel(Logger::AlertLevel level){
@@ -142,20 +608,46 @@ Logger::AlertLevel Logger::getConsoleLevel()const{
 	return AA_HANDLE_MANAGER[this]->consoleLevel;
 }
 
-bool Logger::setLogFile(const char* path){
+bool Logger::setLogFile(const char* path, FileFormat format){
 	if(path == nullptr)
 		return false;
 	auto hd = AA_HANDLE_MANAGER[this];
-	hd->logFileName = path;
-	hd->mutex.lock();
-	hd->logFile.SetStreamMode(false, false);
-	auto ret = hd->logFile.Open(path);
-	hd->logFile.Close();
-	hd->mutex.unlock();
+	// 文件一直保持打开, 更换文件时才关闭旧的. 已入队但未写出的日志写入新文件
+	std::lock_guard<std::mutex> lock(hd->fileMutex);
+	auto ret = hd->logFile.open(path);
+	hd->logFileName = ret ? path : "";
+	hd->fileFormat = format;
+	++hd->fileGeneration;
+	hd->fileSize = hd->logFile.getSize();
+	hd->resetRotationTime(time(nullptr));
 	return ret;
 }
+
+Logger::FileFormat Logger::getFileFormat()const{
+	auto hd = AA_HANDLE_MANAGER[this];
+	std::lock_guard<std::mutex> lock(hd->fileMutex);
+	return hd->fileFormat;
+}
+
+bool Logger::setRotation(const Rotation & rotation){
+	if(!rotation.isValid())
+		return false;
+	auto hd = AA_HANDLE_MANAGER[this];
+	std::lock_guard<std::mutex> lock(hd->fileMutex);
+	hd->rotation = rotation;
+	hd->resetRotationTime(time(nullptr));
+	return true;
+}
+
+Logger::Rotation Logger::getRotation()const{
+	auto hd = AA_HANDLE_MANAGER[this];
+	std::lock_guard<std::mutex> lock(hd->fileMutex);
+	return hd->rotation;
+}
 const char*Logger::getLogFilePath()const{
-	return AA_HANDLE_MANAGER[this]->logFile.GetSourceName();
+	auto hd = AA_HANDLE_MANAGER[this];
+	std::lock_guard<std::mutex> lock(hd->fileMutex);
+	return hd->logFile.isOpened() ? hd->logFileName.c_str() : nullptr;
 }
 
 void Logger::setFileLevel(Logger::AlertLevel level){
@@ -183,49 +675,154 @@ Logger::AlertLevel Logger::getUserStreamLevel()const{
 }
 
 bool Logger::pushLog(const char * content, Logger::AlertLevel level, const char * tag){
-	ArmyAnt::String wholeContent = Logger_Private::getWholeContent(content, level, tag);
+	auto hd = AA_HANDLE_MANAGER[this];
+	uint8 targets = 0;
+	if(level >= hd->consoleLevel)
+		targets |= Logger_Private::toConsole;
+	if(level >= hd->fileLevel)
+		targets |= Logger_Private::toFile;
 	bool ret = true;
-	if(level >= AA_HANDLE_MANAGER[this]->consoleLevel){
-		ret = pushLogToConsole(wholeContent.c_str());
+	if(targets != 0){
+		ret = hd->pushRecord(content, level, tag, targets);
 	}
-	if(level >= AA_HANDLE_MANAGER[this]->fileLevel){
-		ret = ret && pushLogToFile(wholeContent.c_str());
-	}
-	if(level >= AA_HANDLE_MANAGER[this]->userStreamLevel){
-		ret = ret && pushLogToUserStream(wholeContent.c_str());
+	// 用户流仍在调用线程中同步写出
+	if(level >= hd->userStreamLevel && hd->userStream != nullptr){
+		ret = ret && pushLogToUserStream(Logger_Private::getWholeContent(content, level, tag).c_str());
 	}
 	return ret;
 }
 
 bool Logger::pushLogOnlyInConsole(const char * content, AlertLevel level, const char * tag){
-	ArmyAnt::String wholeContent = Logger_Private::getWholeContent(content, level, tag);
+	auto hd = AA_HANDLE_MANAGER[this];
 	bool ret = true;
-	if(level >= AA_HANDLE_MANAGER[this]->consoleLevel){
-		ret = pushLogToConsole(wholeContent.c_str());
+	if(level >= hd->consoleLevel){
+		ret = hd->pushRecord(content, level, tag, Logger_Private::toConsole);
 	}
 	return ret;
 }
 
 bool Logger::pushLogOnlyInFile(const char * content, AlertLevel level, const char * tag){
-	ArmyAnt::String wholeContent = Logger_Private::getWholeContent(content, level, tag);
+	auto hd = AA_HANDLE_MANAGER[this];
+	bool ret = true;
+	if(level >= hd->fileLevel){
+		ret = hd->pushRecord(content, level, tag, Logger_Private::toFile);
+	}
+	return ret;
+}
+
+bool Logger::isLevelEnabled(AlertLevel level)const{
+	auto hd = AA_HANDLE_MANAGER[this];
+	return level >= hd->consoleLevel || level >= hd->fileLevel || (level >= hd->userStreamLevel && hd->userStream != nullptr);
+}
+
+bool Logger::decodeBinaryLog(const char * binaryPath, std::ostream & output){
+	std::ifstream file(binaryPath, std::ios::in | std::ios::binary);
+	if(!file)
+		return false;
+	std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if(data.size() < LogBinary::fileHeaderLen || memcmp(data.data(), LogBinary::fileMagic, sizeof(LogBinary::fileMagic)) != 0)
+		return false;
+	uint32 version;
+	memcpy(&version, data.data() + sizeof(LogBinary::fileMagic), 4);
+	if(version != LogBinary::fileVersion)
+		return false;
+
+	std::map<uint32, LogFormatInfo> formats;
+	std::string line;
+	std::size_t position = LogBinary::fileHeaderLen;
+	// 从position处读取, 数据不足时返回false
+	auto read = [&data, &position](void* out, std::size_t len){
+		if(data.size() - position < len)
+			return false;
+		memcpy(out, data.data() + position, len);
+		position += len;
+		return true;
+	};
+	auto readString = [&data, &position, &read](std::string& out){
+		uint32 len;
+		if(!read(&len, 4) || data.size() - position < len)
+			return false;
+		out.assign(data.data() + position, len);
+		position += len;
+		return true;
+	};
+	while(position < data.size()){
+		// 追加写入的文件中间可能再次出现文件头
+		if(data.size() - position >= LogBinary::fileHeaderLen && memcmp(data.data() + position, LogBinary::fileMagic, sizeof(LogBinary::fileMagic)) == 0){
+			position += LogBinary::fileHeaderLen;
+			continue;
+		}
+		uint8 kind;
+		read(&kind, 1);
+		switch(LogBinary::RecordKind(kind)){
+			case LogBinary::RecordKind::Format:{
+				uint32 id;
+				uint8 level;
+				LogFormatInfo format;
+				if(!read(&id, 4) || !read(&level, 1) || !readString(format.tag) || !readString(format.format))
+					return false;
+				format.level = AlertLevel(level);
+				formats[id] = format;
+				break;
+			}
+			case LogBinary::RecordKind::Entry:{
+				uint32 id;
+				int64 timeNs;
+				std::string arguments;
+				if(!read(&id, 4) || !read(&timeNs, 8) || !readString(arguments))
+					return false;
+				auto format = formats.find(id);
+				if(format == formats.end())
+					return false;
+				line.clear();
+				appendLogLine(line, format->second, timeNs, arguments.data(), uint32(arguments.size()));
+				output.write(line.data(), line.size());
+				break;
+			}
+			case LogBinary::RecordKind::Text:{
+				if(!readString(line))
+					return false;
+				output.write(line.data(), line.size());
+				break;
+			}
+			default:
+				return false;
+		}
+	}
+	return bool(output);
+}
+
+bool Logger::pushDeferredLogArguments(const Format & format, const char * arguments, uint32 length){
+	auto hd = AA_HANDLE_MANAGER[this];
+	uint8 targets = 0;
+	if(format.level >= hd->consoleLevel)
+		targets |= Logger_Private::toConsole;
+	if(format.level >= hd->fileLevel)
+		targets |= Logger_Private::toFile;
+	auto timeNs = TimeUtilities::getWallNanoseconds();
 	bool ret = true;
-	if(level >= AA_HANDLE_MANAGER[this]->fileLevel){
-		ret = ret && pushLogToFile(wholeContent.c_str());
+	if(targets != 0){
+		ret = hd->pushDeferredRecord(format.id, timeNs, arguments, length, targets);
+	}
+	// 用户流需要在调用线程中同步格式化
+	if(format.level >= hd->userStreamLevel && hd->userStream != nullptr){
+		auto info = LogFormatRegistry::getInstance().get(format.id);
+		if(info != nullptr){
+			std::string line;
+			appendLogLine(line, *info, timeNs, arguments, length);
+			line.pop_back();
+			ret = ret && pushLogToUserStream(line.c_str());
+		}
 	}
 	return ret;
 }
 
 bool Logger::pushLogToConsole(const char * wholeContent){
-	std::cout << wholeContent << std::endl;
-	return true;
+	return AA_HANDLE_MANAGER[this]->pushWholeRecord(wholeContent, Logger_Private::toConsole);
 }
 
 bool Logger::pushLogToFile(const char * wholeContent){
-	auto hd = AA_HANDLE_MANAGER[this];
-	hd->mutex.lock();
-	hd->logFileWriteQueue.push(wholeContent);
-	hd->mutex.unlock();
-	return true;
+	return AA_HANDLE_MANAGER[this]->pushWholeRecord(wholeContent, Logger_Private::toFile);
 }
 
 bool Logger::pushLogToUserStream(const char * wholeContent){
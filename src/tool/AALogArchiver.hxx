@@ -0,0 +1,356 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+#ifndef AA_LOG_ARCHIVER_PRIVATE_HEADER_2026_10_17
+#define AA_LOG_ARCHIVER_PRIVATE_HEADER_2026_10_17
+
+#include "../../inc/AALog.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/beast/zlib/deflate_stream.hpp>
+#include <boost/crc.hpp>
+
+#if defined AA_LOG_ZSTD
+#include <zstd.h>
+#endif
+
+#if defined OS_WINDOWS
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace ArmyAnt{
+
+// 轮换出的日志文件名为"<活动文件名>.<yyyyMMdd-HHmmss>[.序号]", 压缩后再加上".gz"或".zst"
+// 时间戳在前, 序号只在同一秒内轮换多次时出现, 因此按(时间戳, 序号)排序即为轮换的先后顺序
+struct RotatedLogFile{
+	std::string path;
+	std::string stamp;
+	uint32 sequence;
+
+	bool operator<(const RotatedLogFile& other)const{
+		return stamp != other.stamp ? stamp < other.stamp : sequence < other.sequence;
+	}
+};
+
+inline bool isLogFileExisting(const std::string& path){
+#if defined OS_WINDOWS
+	return GetFileAttributesA(path.c_str()) != INVALID_FILE_ATTRIBUTES;
+#else
+	struct stat info;
+	return stat(path.c_str(), &info) == 0;
+#endif
+}
+
+inline std::string makeRotatedLogPath(const std::string& activePath, time_t time){
+	tm local;
+#if defined OS_WINDOWS
+	localtime_s(&local, &time);
+#else
+	localtime_r(&time, &local);
+#endif
+	char stamp[32];
+	strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+	auto base = activePath + "." + stamp;
+	auto path = base;
+	for(uint32 sequence = 1; isLogFileExisting(path) || isLogFileExisting(path + ".gz") || isLogFileExisting(path + ".zst"); ++sequence)
+		path = base + "." + std::to_string(sequence);
+	return path;
+}
+
+// 检查name是否是fileName轮换出的文件名, 是则取出时间戳和序号
+inline bool parseRotatedLogName(const std::string& name, const std::string& fileName, RotatedLogFile& out){
+	if(name.size() < fileName.size() + 16 || name.compare(0, fileName.size(), fileName) != 0 || name[fileName.size()] != '.')
+		return false;
+	auto stamp = name.substr(fileName.size() + 1, 15);
+	for(std::size_t i = 0; i < stamp.size(); ++i){
+		if(i == 8 ? stamp[i] != '-' : (stamp[i] < '0' || stamp[i] > '9'))
+			return false;
+	}
+	auto rest = name.substr(fileName.size() + 16);
+	if(rest.size() >= 3 && rest.compare(rest.size() - 3, 3, ".gz") == 0)
+		rest.resize(rest.size() - 3);
+	else if(rest.size() >= 4 && rest.compare(rest.size() - 4, 4, ".zst") == 0)
+		rest.resize(rest.size() - 4);
+	uint32 sequence = 0;
+	if(!rest.empty()){
+		if(rest[0] != '.' || rest.size() < 2 || rest.size() > 10)
+			return false;
+		for(std::size_t i = 1; i < rest.size(); ++i){
+			if(rest[i] < '0' || rest[i] > '9')
+				return false;
+			sequence = sequence * 10 + uint32(rest[i] - '0');
+		}
+	}
+	out.stamp = stamp;
+	out.sequence = sequence;
+	return true;
+}
+
+// 列出activePath轮换出的所有文件, 从旧到新排列
+inline std::vector<RotatedLogFile> listRotatedLogFiles(const std::string& activePath){
+	std::vector<RotatedLogFile> ret;
+#if defined OS_WINDOWS
+	auto slash = activePath.find_last_of("/\\");
+#else
+	auto slash = activePath.find_last_of('/');
+#endif
+	auto directory = slash == std::string::npos ? std::string(".") : activePath.substr(0, slash == 0 ? 1 : slash);
+	auto prefix = slash == std::string::npos ? std::string() : activePath.substr(0, slash + 1);
+	auto fileName = slash == std::string::npos ? activePath : activePath.substr(slash + 1);
+	RotatedLogFile file;
+#if defined OS_WINDOWS
+	WIN32_FIND_DATAA data;
+	auto finding = FindFirstFileA((directory + "\\*").c_str(), &data);
+	if(finding == INVALID_HANDLE_VALUE)
+		return ret;
+	do{
+		if(!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && parseRotatedLogName(data.cFileName, fileName, file)){
+			file.path = prefix + data.cFileName;
+			ret.push_back(file);
+		}
+	} while(FindNextFileA(finding, &data));
+	FindClose(finding);
+#else
+	auto dir = opendir(directory.c_str());
+	if(dir == nullptr)
+		return ret;
+	while(auto entry = readdir(dir)){
+		if(parseRotatedLogName(entry->d_name, fileName, file)){
+			file.path = prefix + entry->d_name;
+			ret.push_back(file);
+		}
+	}
+	closedir(dir);
+#endif
+	std::sort(ret.begin(), ret.end());
+	return ret;
+}
+
+// 以gzip格式压缩, 使用boost::beast自带的deflate实现, 不依赖zlib
+inline bool compressLogFileGzip(FILE* input, FILE* output){
+	static const unsigned char header[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff};
+	if(fwrite(header, 1, sizeof(header), output) != sizeof(header))
+		return false;
+	boost::beast::zlib::deflate_stream stream;
+	stream.reset(6, 15, 8, boost::beast::zlib::Strategy::normal);
+	boost::crc_32_type crc;
+	uint64 inputLen = 0;
+	std::vector<char> inputBuffer(65536);
+	std::vector<char> outputBuffer(65536);
+	bool isFinished = false;
+	while(!isFinished){
+		auto len = fread(inputBuffer.data(), 1, inputBuffer.size(), input);
+		if(ferror(input))
+			return false;
+		auto isEnd = len < inputBuffer.size();
+		crc.process_bytes(inputBuffer.data(), len);
+		inputLen += len;
+		boost::beast::zlib::z_params params;
+		params.next_in = inputBuffer.data();
+		params.avail_in = len;
+		while(true){
+			params.next_out = outputBuffer.data();
+			params.avail_out = outputBuffer.size();
+			boost::beast::error_code ec;
+			stream.write(params, isEnd ? boost::beast::zlib::Flush::finish : boost::beast::zlib::Flush::none, ec);
+			auto produced = outputBuffer.size() - params.avail_out;
+			if(produced > 0 && fwrite(outputBuffer.data(), 1, produced, output) != produced)
+				return false;
+			if(ec == boost::beast::zlib::error::end_of_stream){
+				isFinished = true;
+				break;
+			}
+			if(ec && ec != boost::beast::zlib::error::need_buffers)
+				return false;
+			// 输出缓冲区未写满说明已读完输入, 结束时则要一直压缩到end_of_stream
+			if(!isEnd && params.avail_in == 0 && params.avail_out > 0)
+				break;
+			// 没有任何进展: 未结束时等待更多输入, 结束时则是出错
+			if(ec == boost::beast::zlib::error::need_buffers && produced == 0){
+				if(isEnd)
+					return false;
+				break;
+			}
+		}
+	}
+	unsigned char trailer[8];
+	auto checksum = uint32(crc.checksum());
+	auto size = uint32(inputLen);
+	for(int i = 0; i < 4; ++i){
+		trailer[i] = uint8(checksum >> (i * 8));
+		trailer[4 + i] = uint8(size >> (i * 8));
+	}
+	return fwrite(trailer, 1, sizeof(trailer), output) == sizeof(trailer);
+}
+
+#if defined AA_LOG_ZSTD
+inline bool compressLogFileZstd(FILE* input, FILE* output){
+	auto context = ZSTD_createCCtx();
+	if(context == nullptr)
+		return false;
+	ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, 3);
+	std::vector<char> inputBuffer(ZSTD_CStreamInSize());
+	std::vector<char> outputBuffer(ZSTD_CStreamOutSize());
+	bool ret = true;
+	bool isEnd = false;
+	while(ret && !isEnd){
+		auto len = fread(inputBuffer.data(), 1, inputBuffer.size(), input);
+		if(ferror(input)){
+			ret = false;
+			break;
+		}
+		isEnd = len < inputBuffer.size();
+		ZSTD_inBuffer in = {inputBuffer.data(), len, 0};
+		bool isFinished = false;
+		while(!isFinished){
+			ZSTD_outBuffer out = {outputBuffer.data(), outputBuffer.size(), 0};
+			auto remaining = ZSTD_compressStream2(context, &out, &in, isEnd ? ZSTD_e_end : ZSTD_e_continue);
+			if(ZSTD_isError(remaining) || (out.pos > 0 && fwrite(outputBuffer.data(), 1, out.pos, output) != out.pos)){
+				ret = false;
+				break;
+			}
+			isFinished = isEnd ? remaining == 0 : in.pos == in.size;
+		}
+	}
+	ZSTD_freeCCtx(context);
+	return ret;
+}
+#endif
+
+// 轮换出的文件的后台处理: 压缩, 并删除超出保留数量的旧文件
+// 在一个低优先级的线程中依次处理, 不影响写日志的线程
+class LogArchiver{
+public:
+	LogArchiver() :thread(&LogArchiver::update, this){}
+	// 完成已排队的任务后才返回, 不留下压缩了一半的文件
+	~LogArchiver(){
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			isEnd = true;
+		}
+		condition.notify_one();
+		thread.join();
+	}
+
+	void push(const std::string& rotatedPath, const std::string& activePath, Logger::Compression compression, uint32 maxRetainedFiles){
+		Job job = {rotatedPath, activePath, compression, maxRetainedFiles};
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push_back(job);
+		}
+		condition.notify_one();
+	}
+
+private:
+	struct Job{
+		std::string rotatedPath;
+		std::string activePath;
+		Logger::Compression compression;
+		uint32 maxRetainedFiles;
+	};
+
+	void update(){
+#if defined OS_WINDOWS
+		SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif defined OS_LINUX
+		// Linux的nice值对单个线程生效
+		setpriority(PRIO_PROCESS, id_t(syscall(SYS_gettid)), 19);
+#endif
+		while(true){
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [this](){ return isEnd || !jobs.empty(); });
+				if(jobs.empty())
+					return;
+				job = jobs.front();
+				jobs.pop_front();
+			}
+			compress(job);
+			removeOldFiles(job);
+		}
+	}
+
+	static void compress(const Job& job){
+		if(job.compression == Logger::Compression::None)
+			return;
+		auto input = fopen(job.rotatedPath.c_str(), "rb");
+		if(input == nullptr)
+			return;
+		auto outputPath = job.rotatedPath + (job.compression == Logger::Compression::Gzip ? ".gz" : ".zst");
+		auto output = fopen(outputPath.c_str(), "wb");
+		if(output == nullptr){
+			fclose(input);
+			return;
+		}
+		bool ret = false;
+		if(job.compression == Logger::Compression::Gzip)
+			ret = compressLogFileGzip(input, output);
+#if defined AA_LOG_ZSTD
+		else if(job.compression == Logger::Compression::Zstd)
+			ret = compressLogFileZstd(input, output);
+#endif
+		fclose(input);
+		ret = fclose(output) == 0 && ret;
+		// 压缩失败时保留原文件
+		std::remove(ret ? job.rotatedPath.c_str() : outputPath.c_str());
+	}
+
+	static void removeOldFiles(const Job& job){
+		if(job.maxRetainedFiles == 0)
+			return;
+		auto files = listRotatedLogFiles(job.activePath);
+		for(std::size_t i = 0; i + job.maxRetainedFiles < files.size(); ++i)
+			std::remove(files[i].path.c_str());
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::deque<Job> jobs;
+	bool isEnd = false;
+	std::thread thread;
+
+	AA_FORBID_COPY_CTOR(LogArchiver);
+	AA_FORBID_ASSGN_OPR(LogArchiver);
+};
+
+} // namespace ArmyAnt
+
+#endif // AA_LOG_ARCHIVER_PRIVATE_HEADER_2026_10_17
@@ -0,0 +1,239 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+#ifndef AA_LOG_BINARY_PRIVATE_HEADER_2026_10_17
+#define AA_LOG_BINARY_PRIVATE_HEADER_2026_10_17
+
+#include "../../inc/AALog.h"
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <string>
+
+namespace ArmyAnt{
+
+// 二进制日志文件: 文件头(8字节标识 + uint32版本), 之后是连续的记录, 每条记录以1字节种类开头, 整数均为本机字节序
+//   Format: uint32 id, uint8 级别, uint32 长度 + 标签, uint32 长度 + 格式串. 每个文件中在第一次用到某个id之前写出, 同一id可以重复出现, 以最后一次为准
+//   Entry:  uint32 格式id, int64 时间(自1970年起的纳秒数), uint32 长度 + 参数(见LogArgument)
+//   Text:   uint32 长度 + 已格式化的一行文本(含换行符), 来自pushLog等普通日志
+namespace LogBinary{
+
+static const char fileMagic[8] = {'A', 'A', 'L', 'O', 'G', 'B', 'I', 'N'};
+static const uint32 fileVersion = 1;
+static const uint32 fileHeaderLen = 12;
+
+enum class RecordKind : uint8{
+	Format = 1,
+	Entry = 2,
+	Text = 3,
+};
+
+}
+
+// 一个调用处登记的格式, 登记后不再改变
+struct LogFormatInfo{
+	std::string format;
+	std::string tag;
+	Logger::AlertLevel level;
+};
+
+// 进程内所有延迟格式化日志的格式, id从1开始按登记顺序分配
+class LogFormatRegistry{
+public:
+	// 不析构, 静态的日志对象的写线程在进程退出时可能仍在查询
+	static LogFormatRegistry& getInstance(){
+		static auto instance = new LogFormatRegistry();
+		return *instance;
+	}
+
+	uint32 add(const char* format, const char* tag, Logger::AlertLevel level){
+		std::lock_guard<std::mutex> lock(mutex);
+		LogFormatInfo info = {format == nullptr ? "" : format, tag == nullptr ? "" : tag, level};
+		formats.push_back(info);
+		return uint32(formats.size());
+	}
+
+	// id不存在时返回nullptr. 返回的指针一直有效, 可以缓存
+	const LogFormatInfo* get(uint32 id){
+		std::lock_guard<std::mutex> lock(mutex);
+		if(id == 0 || id > formats.size())
+			return nullptr;
+		return &formats[id - 1];
+	}
+
+private:
+	LogFormatRegistry(){}
+
+	std::mutex mutex;
+	std::deque<LogFormatInfo> formats;		// deque追加元素时不会移动已有的元素
+
+	AA_FORBID_COPY_CTOR(LogFormatRegistry);
+	AA_FORBID_ASSGN_OPR(LogFormatRegistry);
+};
+
+// 格式化为"Sat Oct 17 13:32:52 2026", out至少32字节, 返回长度
+// localtime需要读取时区设定, glibc中会加锁, 因此每个线程每秒只转换一次
+inline uint32 formatLogTime(time_t time, char* out){
+	static thread_local time_t cachedTime = 0;
+	static thread_local char cachedText[32] = "";
+	static thread_local uint32 cachedLen = 0;
+	if(time != cachedTime || cachedLen == 0){
+		tm local;
+#if defined OS_WINDOWS
+		localtime_s(&local, &time);
+#else
+		localtime_r(&time, &local);
+#endif
+		cachedLen = uint32(strftime(cachedText, sizeof(cachedText), "%a %b %e %H:%M:%S %Y", &local));
+		cachedTime = time;
+	}
+	memcpy(out, cachedText, cachedLen + 1);
+	return cachedLen;
+}
+
+// 解码并输出position处的一个参数, 数据不完整时返回false
+inline bool appendLogArgument(std::string& out, const char* arguments, uint32 length, uint32& position){
+	if(position >= length)
+		return false;
+	auto type = LogArgument::Type(uint8(arguments[position++]));
+	auto left = length - position;
+	auto data = arguments + position;
+	char text[32];
+	switch(type){
+		case LogArgument::Type::Int:
+		case LogArgument::Type::UInt:
+		case LogArgument::Type::Double:
+			if(left < 8)
+				return false;
+			if(type == LogArgument::Type::Int){
+				int64 value;
+				memcpy(&value, data, 8);
+				snprintf(text, sizeof(text), "%lld", (long long)value);
+			} else if(type == LogArgument::Type::UInt){
+				uint64 value;
+				memcpy(&value, data, 8);
+				snprintf(text, sizeof(text), "%llu", (unsigned long long)value);
+			} else{
+				double value;
+				memcpy(&value, data, 8);
+				snprintf(text, sizeof(text), "%.15g", value);
+			}
+			out += text;
+			position += 8;
+			return true;
+		case LogArgument::Type::String:{
+			uint32 stringLen;
+			if(left < 4)
+				return false;
+			memcpy(&stringLen, data, 4);
+			if(left - 4 < stringLen)
+				return false;
+			out.append(data + 4, stringLen);
+			position += 4 + stringLen;
+			return true;
+		}
+		case LogArgument::Type::Char:
+		case LogArgument::Type::Bool:
+			if(left < 1)
+				return false;
+			if(type == LogArgument::Type::Char)
+				out.push_back(*data);
+			else
+				out += *data != 0 ? "true" : "false";
+			position += 1;
+			return true;
+	}
+	return false;
+}
+
+// 把格式串中的"{}"依次替换为参数. 参数不足时多出的"{}"原样保留, 多余的参数忽略
+inline bool appendLogMessage(std::string& out, const char* format, const char* arguments, uint32 length){
+	uint32 position = 0;
+	for(auto i = format; *i != '\0'; ++i){
+		if(i[0] == '{' && i[1] == '}' && position < length){
+			if(!appendLogArgument(out, arguments, length, position))
+				return false;
+			++i;
+			continue;
+		}
+		out.push_back(*i);
+	}
+	return true;
+}
+
+// 输出与Logger::pushLog相同格式的一行
+inline void appendLogLine(std::string& out, const LogFormatInfo& format, int64 timeNs, const char* arguments, uint32 length){
+	char timeText[32];
+	auto timeLen = formatLogTime(time_t(timeNs / 1000000000), timeText);
+	out += "[ ";
+	out.append(timeText, timeLen);
+	out += " ] [ ";
+	out += format.tag;
+	out += " ] [ ";
+	out += Logger::convertLevelToString(format.level);
+	out += " ] ";
+	if(!appendLogMessage(out, format.format.c_str(), arguments, length))
+		out += " <bad arguments>";
+	out += '\n';
+}
+
+template<class T>
+inline void appendLogRaw(std::string& out, const T& value){
+	out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+inline void appendLogFileHeader(std::string& out){
+	out.append(LogBinary::fileMagic, sizeof(LogBinary::fileMagic));
+	appendLogRaw(out, LogBinary::fileVersion);
+}
+
+inline void appendLogFormatRecord(std::string& out, uint32 id, const LogFormatInfo& format){
+	appendLogRaw(out, uint8(LogBinary::RecordKind::Format));
+	appendLogRaw(out, id);
+	appendLogRaw(out, uint8(format.level));
+	appendLogRaw(out, uint32(format.tag.size()));
+	out += format.tag;
+	appendLogRaw(out, uint32(format.format.size()));
+	out += format.format;
+}
+
+inline void appendLogEntryRecord(std::string& out, uint32 id, int64 timeNs, const char* arguments, uint32 length){
+	appendLogRaw(out, uint8(LogBinary::RecordKind::Entry));
+	appendLogRaw(out, id);
+	appendLogRaw(out, timeNs);
+	appendLogRaw(out, length);
+	out.append(arguments, length);
+}
+
+inline void appendLogTextRecord(std::string& out, const char* text, uint32 length){
+	appendLogRaw(out, uint8(LogBinary::RecordKind::Text));
+	appendLogRaw(out, length);
+	out.append(text, length);
+}
+
+} // namespace ArmyAnt
+
+#endif // AA_LOG_BINARY_PRIVATE_HEADER_2026_10_17
@@ -0,0 +1,218 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+#ifndef AA_LOG_FILE_SINK_PRIVATE_HEADER_2026_10_17
+#define AA_LOG_FILE_SINK_PRIVATE_HEADER_2026_10_17
+
+#include "../../inc/AADefine.h"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined OS_WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace ArmyAnt{
+
+// 日志文件的写入端, 只在日志写线程中使用
+// 打开后一直持有文件句柄, 以追加方式写入, 多个进程同时写同一个文件也不会互相覆盖
+// append只记录数据的位置, 不复制, flush时合并为尽量少的系统调用(writev)写出, 因此数据在flush之前必须保持有效
+class LogFileSink{
+public:
+	LogFileSink(){}
+	~LogFileSink(){ close(); }
+
+public:
+	bool open(const char* path);
+	void close();
+	bool isOpened()const;
+	// 文件当前的长度, 不含尚未flush的数据
+	uint64 getSize()const;
+	void append(const char* data, uint64 len);
+	// 写出所有append的数据, 出错时放弃剩余的数据并返回false
+	bool flush();
+
+private:
+#if defined OS_WINDOWS
+	HANDLE file = INVALID_HANDLE_VALUE;
+	std::string staging;		// Windows没有writev, 先拼接再一次写出
+#else
+	int fd = -1;
+	std::vector<iovec> pending;
+#endif
+
+	AA_FORBID_COPY_CTOR(LogFileSink);
+	AA_FORBID_ASSGN_OPR(LogFileSink);
+};
+
+#if defined OS_WINDOWS
+
+inline bool LogFileSink::open(const char * path){
+	close();
+	// FILE_APPEND_DATA使每次写入都追加到文件末尾, 不需要移动文件指针
+	file = CreateFileA(path, FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	return file != INVALID_HANDLE_VALUE;
+}
+
+inline void LogFileSink::close(){
+	if(file != INVALID_HANDLE_VALUE){
+		flush();
+		CloseHandle(file);
+	}
+	file = INVALID_HANDLE_VALUE;
+	staging.clear();
+}
+
+inline bool LogFileSink::isOpened() const{
+	return file != INVALID_HANDLE_VALUE;
+}
+
+inline uint64 LogFileSink::getSize() const{
+	LARGE_INTEGER size;
+	if(file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size))
+		return 0;
+	return uint64(size.QuadPart);
+}
+
+inline void LogFileSink::append(const char * data, uint64 len){
+	staging.append(data, std::size_t(len));
+}
+
+inline bool LogFileSink::flush(){
+	auto data = staging.data();
+	auto left = staging.size();
+	bool ret = true;
+	while(left > 0 && file != INVALID_HANDLE_VALUE){
+		DWORD written = 0;
+		auto len = DWORD(left > 0x40000000 ? 0x40000000 : left);
+		if(!WriteFile(file, data, len, &written, nullptr)){
+			ret = false;
+			break;
+		}
+		data += written;
+		left -= written;
+	}
+	staging.clear();
+	return ret;
+}
+
+#else
+
+inline bool LogFileSink::open(const char * path){
+	close();
+	int ret;
+	do{
+		ret = ::open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	} while(ret < 0 && errno == EINTR);
+	fd = ret;
+	return fd >= 0;
+}
+
+inline void LogFileSink::close(){
+	if(fd >= 0){
+		flush();
+		::close(fd);
+	}
+	fd = -1;
+	pending.clear();
+}
+
+inline bool LogFileSink::isOpened() const{
+	return fd >= 0;
+}
+
+inline uint64 LogFileSink::getSize() const{
+	struct stat info;
+	if(fd < 0 || fstat(fd, &info) != 0)
+		return 0;
+	return uint64(info.st_size);
+}
+
+inline void LogFileSink::append(const char * data, uint64 len){
+	if(len == 0)
+		return;
+	// 与上一段首尾相接时合并, 减少iovec的数量
+	if(!pending.empty()){
+		auto& last = pending.back();
+		if(static_cast<const char*>(last.iov_base) + last.iov_len == data){
+			last.iov_len += std::size_t(len);
+			return;
+		}
+	}
+	iovec vec;
+	vec.iov_base = const_cast<char*>(data);
+	vec.iov_len = std::size_t(len);
+	pending.push_back(vec);
+}
+
+inline bool LogFileSink::flush(){
+#if defined IOV_MAX
+	const std::size_t maxCount = IOV_MAX;
+#else
+	const std::size_t maxCount = 1024;
+#endif
+	bool ret = true;
+	std::size_t index = 0;
+	while(index < pending.size() && fd >= 0){
+		auto count = pending.size() - index;
+		if(count > maxCount)
+			count = maxCount;
+		auto written = ::writev(fd, &pending[index], int(count));
+		if(written < 0){
+			if(errno == EINTR)
+				continue;
+			ret = false;
+			break;
+		}
+		// 部分写出时跳过已写出的段, 剩余部分下一轮继续
+		auto left = std::size_t(written);
+		while(left > 0 && index < pending.size()){
+			auto& vec = pending[index];
+			if(left >= vec.iov_len){
+				left -= vec.iov_len;
+				++index;
+			} else{
+				vec.iov_base = static_cast<char*>(vec.iov_base) + left;
+				vec.iov_len -= left;
+				left = 0;
+			}
+		}
+	}
+	pending.clear();
+	return ret;
+}
+
+#endif
+
+} // namespace ArmyAnt
+
+#endif // AA_LOG_FILE_SINK_PRIVATE_HEADER_2026_10_17
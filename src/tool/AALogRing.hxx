@@ -0,0 +1,143 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+#ifndef AA_LOG_RING_PRIVATE_HEADER_2026_10_17
+#define AA_LOG_RING_PRIVATE_HEADER_2026_10_17
+
+#include "../../inc/AADefine.h"
+
+#include <atomic>
+#include <cstring>
+
+namespace ArmyAnt{
+
+// 单生产者单消费者的日志记录环形缓冲区, 每个写日志的线程一个, 由日志写线程读出
+// 记录在环中连续存放, 记录头8字节(长度和标志), 数据按8字节对齐. 环尾放不下一条记录时, 用一条填充记录跳到环首, 因此每条记录的数据都是连续的, 可以直接交给writev
+// 位置是单调递增的64位计数, 不会回绕; 生产者只写tail, 消费者只写head, 二者分属不同的缓存行
+class LogRing{
+public:
+	// capacity必须是2的幂, 且不小于64
+	explicit LogRing(uint32 capacity)
+		:isAbandoned(false), isClosed(false), buffer(new char[capacity]), capacity(capacity), mask(capacity - 1), tail(0), reservingTail(0), cachedHead(0), head(0){}
+	~LogRing(){ delete[] buffer; }
+
+public:
+	// 单条记录的最大长度, 更长的记录应改用其他途径
+	uint32 getMaxRecordLen()const{ return capacity / 4; }
+
+	// 生产者: 预留len字节, 空间不足时返回nullptr. 写入数据后调用commit发布
+	char* reserve(uint32 len, uint8 flags);
+	void commit();
+
+	// 消费者: 依次回调[head, tail)中的记录, func(uint8 flags, const char* data, uint32 len), 返回读到的位置
+	// 回调的数据在release之前一直有效, 生产者不会覆盖
+	template<class Func>
+	uint64 peek(Func&& func)const;
+	void release(uint64 position);
+	bool isEmpty()const;
+
+public:
+	std::atomic<bool> isAbandoned;	// 所属线程已退出, 读空后即可丢弃
+	std::atomic<bool> isClosed;		// 所属的日志对象已销毁, 生产者不应再写入
+
+private:
+	static const uint8 paddingFlag = 0xff;
+	static const uint32 headerLen = 8;
+	static uint32 getTotalLen(uint32 len){ return (headerLen + len + 7) & ~uint32(7); }
+	void writeHeader(uint64 position, uint32 len, uint8 flags);
+
+private:
+	char* const buffer;
+	const uint32 capacity;
+	const uint32 mask;
+
+	char producerLine[64];
+	std::atomic<uint64> tail;
+	uint64 reservingTail;		// 只在生产者线程中访问
+	uint64 cachedHead;			// 生产者最近读到的head, 空间足够时不必每次读取消费者的缓存行
+	char consumerLine[64];
+	std::atomic<uint64> head;
+
+	AA_FORBID_COPY_CTOR(LogRing);
+	AA_FORBID_ASSGN_OPR(LogRing);
+};
+
+inline char * LogRing::reserve(uint32 len, uint8 flags){
+	if(len > getMaxRecordLen())
+		return nullptr;
+	auto position = tail.load(std::memory_order_relaxed);
+	auto total = getTotalLen(len);
+	auto index = uint32(position & mask);
+	// 环尾剩余空间放不下时, 剩余部分全部作为填充
+	uint32 padding = capacity - index < total ? capacity - index : 0;
+	if(position + padding + total - cachedHead > capacity){
+		cachedHead = head.load(std::memory_order_acquire);
+		if(position + padding + total - cachedHead > capacity)
+			return nullptr;
+	}
+	if(padding > 0){
+		writeHeader(position, padding - headerLen, paddingFlag);
+		position += padding;
+	}
+	writeHeader(position, len, flags);
+	reservingTail = position + total;
+	return buffer + (position & mask) + headerLen;
+}
+
+inline void LogRing::commit(){
+	tail.store(reservingTail, std::memory_order_release);
+}
+
+template<class Func>
+inline uint64 LogRing::peek(Func && func) const{
+	auto position = head.load(std::memory_order_relaxed);
+	auto end = tail.load(std::memory_order_acquire);
+	while(position < end){
+		auto record = buffer + (position & mask);
+		uint32 len;
+		memcpy(&len, record, sizeof(len));
+		auto flags = uint8(record[4]);
+		if(flags != paddingFlag)
+			func(flags, record + headerLen, len);
+		position += getTotalLen(len);
+	}
+	return end;
+}
+
+inline void LogRing::release(uint64 position){
+	head.store(position, std::memory_order_release);
+}
+
+inline bool LogRing::isEmpty() const{
+	return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+}
+
+inline void LogRing::writeHeader(uint64 position, uint32 len, uint8 flags){
+	auto record = buffer + (position & mask);
+	memcpy(record, &len, sizeof(len));
+	record[4] = char(flags);
+}
+
+} // namespace ArmyAnt
+
+#endif // AA_LOG_RING_PRIVATE_HEADER_2026_10_17
@@ -24,44 +24,147 @@
 
 #include <cmath>
 #include "../../inc/AAString.h"
-#include "../../inc/AAClassPrivateHandle.hpp"
-#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
 #include <vector>
+#include <utility>
 
 #ifdef OS_BSD
 #include <cmath>
 #endif
 
 
-#define AA_HANDLE_MANAGER ClassPrivateHandleManager<String, std::string>::getInstance()
-
 namespace ArmyAnt{
 
+const uint64 String::c_shortCapacity;
+
+/*************************** Storage ***************************/
+
+bool String::isLong() const{
+	static_assert(sizeof(LongStorage) == sizeof(ShortStorage), "The two storage layouts must share the same flag byte");
+	return local.length == c_longFlag;
+}
+
+char * String::buffer(){
+	return isLong() ? heap.data : local.data;
+}
+
+const char * String::buffer() const{
+	return isLong() ? heap.data : local.data;
+}
+
+void String::setLength(uint64 length){
+	if(isLong())
+		heap.length = length;
+	else
+		local.length = uint8(length);
+	buffer()[length] = '\0';
+}
+
+void String::setLongCapacity(uint64 newCapacity){
+	heap.capacityLow = uint32(newCapacity);
+	heap.capacityHigh = uint16(newCapacity >> 32);
+	heap.reserved = 0;
+	heap.flag = c_longFlag;
+}
+
+void String::grow(uint64 minCapacity){
+	// 按容量几何增长, 使连续的 += 操作均摊为常数时间
+	auto oldCapacity = capacity();
+	if(minCapacity <= oldCapacity)
+		return;
+	auto newCapacity = oldCapacity * 2;
+	if(newCapacity < minCapacity)
+		newCapacity = minCapacity;
+	reserve(newCapacity);
+}
+
+void String::assign(const char * value, uint64 length){
+	if(length > capacity()){
+		// 新内容不可能位于当前缓冲区内部, 可以先释放
+		releaseStorage();
+		reserve(length);
+	}
+	memmove(buffer(), value, length);
+	setLength(length);
+	resetValue();
+}
+
+void String::releaseStorage(){
+	if(isLong())
+		delete[] heap.data;
+	local.length = 0;
+	local.data[0] = '\0';
+}
+
+void String::reserve(uint64 newCapacity){
+	if(newCapacity <= capacity())
+		return;
+	auto length = size();
+	auto newData = new char[newCapacity + 1];
+	memcpy(newData, buffer(), length + 1);
+	if(isLong())
+		delete[] heap.data;
+	heap.data = newData;
+	heap.length = length;
+	setLongCapacity(newCapacity);
+	resetValue();
+}
+
+uint64 String::capacity() const{
+	if(isLong())
+		return uint64(heap.capacityLow) | (uint64(heap.capacityHigh) << 32);
+	return c_shortCapacity;
+}
+
+String & String::append(const char * value, uint64 length){
+	if(value == nullptr || length == 0)
+		return *this;
+	auto oldLength = size();
+	if(oldLength + length > capacity()){
+		// value 可能指向自身的缓冲区, 因此不能在复制前释放旧缓冲区
+		auto oldCapacity = capacity();
+		auto newCapacity = oldCapacity * 2 < oldLength + length ? oldLength + length : oldCapacity * 2;
+		auto newData = new char[newCapacity + 1];
+		memcpy(newData, buffer(), oldLength);
+		memcpy(newData + oldLength, value, length);
+		if(isLong())
+			delete[] heap.data;
+		heap.data = newData;
+		setLongCapacity(newCapacity);
+	} else{
+		memmove(buffer() + oldLength, value, length);
+	}
+	setLength(oldLength + length);
+	resetValue();
+	return *this;
+}
+
+/*************************** Constructors ***************************/
 
 String::String(const char * value){
-	if(value == nullptr)
-		value = "";
-	auto newStr = new std::string(value);
-	AA_HANDLE_MANAGER.GetHandle(this, newStr);
+	local.length = 0;
+	local.data[0] = '\0';
+	if(value != nullptr)
+		assign(value, strlen(value));
 	resetValue();
 }
 
 String::String(char c){
-	AA_HANDLE_MANAGER.GetHandle(this, new std::string(c + std::string()));
+	local.length = 1;
+	local.data[0] = c;
+	local.data[1] = '\0';
 	resetValue();
 }
 
 String::String(int32 num){
-	std::ostringstream tmp;
-	tmp << num;
-	AA_HANDLE_MANAGER.GetHandle(this, new std::string(tmp.str()));
+	local.length = uint8(snprintf(local.data, c_shortCapacity + 1, "%d", num));
 	resetValue();
 }
 
 String::String(const int64 & num){
-	std::ostringstream tmp;
-	tmp << num;
-	AA_HANDLE_MANAGER.GetHandle(this, new std::string(tmp.str()));
+	local.length = uint8(snprintf(local.data, c_shortCapacity + 1, "%lld", static_cast<long long>(num)));
 	resetValue();
 }
 
@@ -70,47 +173,68 @@ String::String(double num, int32 behindFloat){
 		int64 powed = int64(pow(10, behindFloat));
 		num -= num - double(int64(num*powed)) / powed;
 	}
-	std::ostringstream tmp;
-	tmp << num;
-	AA_HANDLE_MANAGER.GetHandle(this, new std::string(tmp.str()));
+	// %g 与 std::ostream 的默认输出格式一致, 结果不会超过短字符串容量
+	local.length = uint8(snprintf(local.data, c_shortCapacity + 1, "%g", num));
 	resetValue();
 }
 
 String::String(const String & value){
-	AA_HANDLE_MANAGER.GetHandle(this, new std::string(*(AA_HANDLE_MANAGER[&value])));
+	local.length = 0;
+	local.data[0] = '\0';
+	if(value.isLong()){
+		auto length = value.size();
+		if(length > c_shortCapacity){
+			heap.data = new char[length + 1];
+			heap.length = length;
+			setLongCapacity(length);
+		}
+		memcpy(buffer(), value.c_str(), length + 1);
+		setLength(length);
+	} else{
+		local = value.local;
+	}
 	resetValue();
 }
 
-String::String(String && _moved){
-	AA_HANDLE_MANAGER.MoveTo(&_moved, this);
+String::String(const StringView & value){
+	local.length = 0;
+	local.data[0] = '\0';
+	assign(value.data(), value.size());
+}
+
+String::String(String && _moved) noexcept{
+	memcpy(&heap, &_moved.heap, sizeof(heap));
+	_moved.local.length = 0;
+	_moved.local.data[0] = '\0';
+	_moved.resetValue();
 	resetValue();
 }
 
 String::~String(){
-	if(AA_HANDLE_MANAGER.GetDataByHandle(this, true) != nullptr){
-
-		auto hd = AA_HANDLE_MANAGER.ReleaseHandle(this);
-		delete hd;
-	}
+	if(isLong())
+		delete[] heap.data;
 }
 
+/*************************** Properties ***************************/
+
 bool String::empty() const{
-	return AA_HANDLE_MANAGER[this]->empty();
+	return size() == 0;
 }
 
 const char * String::c_str() const{
-	return AA_HANDLE_MANAGER[this]->c_str();
+	return buffer();
 }
 
 uint64 String::size() const{
-	return AA_HANDLE_MANAGER[this]->size();
+	return isLong() ? heap.length : local.length;
 }
 
 bool String::isNumeric() const{
-	auto ret = (*AA_HANDLE_MANAGER[this]);
-	if(atof(ret.c_str()) == 0.0)
-		for(size_t i = 0; i < ret.size(); ++i){
-			if(ret[i] != ' ' && ret[i] != '0' && ret[i] != '.')
+	auto str = c_str();
+	auto length = size();
+	if(atof(str) == 0.0)
+		for(uint64 i = 0; i < length; ++i){
+			if(str[i] != ' ' && str[i] != '0' && str[i] != '.')
 				return false;
 		}
 	return true;
@@ -125,65 +249,81 @@ bool String::isFloat() const{
 }
 
 int32 String::toInteger() const{
-	return atoi(AA_HANDLE_MANAGER[this]->c_str());
+	return atoi(c_str());
 }
 
 int64 String::toLong() const{
-	return atoll(AA_HANDLE_MANAGER[this]->c_str());
+	return atoll(c_str());
 }
 
 double String::toDemical() const{
-	return atof(AA_HANDLE_MANAGER[this]->c_str());
+	return atof(c_str());
 }
 
 char String::getChar(int32 index) const{
 	if(index < 0)
-		index += AA_HANDLE_MANAGER[this]->size();
-	return (*(AA_HANDLE_MANAGER[this]))[index];
+		index += int32(size());
+	return c_str()[index];
 }
 
-String & String::operator=(const String & value){
-	*(AA_HANDLE_MANAGER[this]) = value.c_str();
+void String::clear(){
+	setLength(0);
 	resetValue();
+}
+
+/*************************** Operators ***************************/
+
+String & String::operator=(const String & value){
+	if(&value != this)
+		assign(value.c_str(), value.size());
+	return *this;
+}
+
+String & String::operator=(String && _moved) noexcept{
+	if(&_moved != this){
+		if(isLong())
+			delete[] heap.data;
+		memcpy(&heap, &_moved.heap, sizeof(heap));
+		_moved.local.length = 0;
+		_moved.local.data[0] = '\0';
+		_moved.resetValue();
+		resetValue();
+	}
 	return *this;
 }
 
 String & String::operator=(const char * value){
-	*(AA_HANDLE_MANAGER[this]) = value;
-	resetValue();
+	if(value == nullptr)
+		value = "";
+	assign(value, strlen(value));
 	return *this;
 }
 
 String & String::operator=(char c){
-	*(AA_HANDLE_MANAGER[this]) = String() + c;
-	resetValue();
+	assign(&c, 1);
 	return *this;
 }
 
 String & String::operator=(int64 value){
-	std::ostringstream ss;
-	ss << value;
-	*(AA_HANDLE_MANAGER[this]) += ss.str();
-	resetValue();
-	return *this;
+	return operator=(String(value));
 }
 
 String & String::operator=(double value){
-	std::ostringstream ss;
-	ss << value;
-	*(AA_HANDLE_MANAGER[this]) += ss.str();
-	resetValue();
-	return *this;
+	return operator=(String(value));
 }
 
 bool String::operator<(const String & value) const{
-	auto hdThis = AA_HANDLE_MANAGER[this];
-	auto hdValue = AA_HANDLE_MANAGER[&value];
-	return *hdThis < *hdValue;
+	auto lengthThis = size();
+	auto lengthValue = value.size();
+	auto ret = memcmp(c_str(), value.c_str(), lengthThis < lengthValue ? lengthThis : lengthValue);
+	if(ret != 0)
+		return ret < 0;
+	return lengthThis < lengthValue;
 }
 
 bool String::operator==(const String & value) const{
-	return *(AA_HANDLE_MANAGER[this]) == *(AA_HANDLE_MANAGER[&value]);
+	auto length = size();
+	return length == value.size() && memcmp(c_str(), value.c_str(), length) == 0;
 }
 
 bool String::operator!=(const String & value) const{
@@ -191,13 +331,23 @@ bool String::operator!=(const String & value) const{
 }
 
 bool String::operator==(const char * value) const{
-	return *(AA_HANDLE_MANAGER[this]) == value;
+	if(value == nullptr)
+		return empty();
+	return strcmp(c_str(), value) == 0;
 }
 
 bool String::operator!=(const char * value) const{
 	return !operator==(value);
 }
 
+bool String::operator==(const StringView & value) const{
+	return StringView(*this) == value;
+}
+
+bool String::operator!=(const StringView & value) const{
+	return !operator==(value);
+}
+
 String::operator const char*()const{
 	return c_str();
 }
@@ -207,76 +357,93 @@ bool String::operator!() const{
 }
 
 String String::operator+(const String & value) const{
-	return String((*(AA_HANDLE_MANAGER[this]) + *(AA_HANDLE_MANAGER[&value])).c_str());
+	String ret;
+	ret.reserve(size() + value.size());
+	ret.append(c_str(), size());
+	ret.append(value.c_str(), value.size());
+	return ret;
 }
 
 String String::operator+(const char * value) const{
-	return String((*(AA_HANDLE_MANAGER[this]) + value).c_str());
+	if(value == nullptr)
+		return *this;
+	auto length = strlen(value);
+	String ret;
+	ret.reserve(size() + length);
+	ret.append(c_str(), size());
+	ret.append(value, length);
+	return ret;
+}
+
+String String::operator+(const StringView & value) const{
+	String ret;
+	ret.reserve(size() + value.size());
+	ret.append(c_str(), size());
+	ret.append(value.data(), value.size());
+	return ret;
 }
 
 String String::operator+(char c) const{
-	return String((*(AA_HANDLE_MANAGER[this]) + c).c_str());
+	String ret;
+	ret.reserve(size() + 1);
+	ret.append(c_str(), size());
+	ret.append(&c, 1);
+	return ret;
 }
 
 String String::operator+(int64 value) const{
-	std::ostringstream ss;
-	ss << *AA_HANDLE_MANAGER[this];
-	ss << value;
-	return String(ss.str().c_str());
+	return operator+(String(value));
 }
 
 String String::operator+(double value) const{
-	std::ostringstream ss;
-	ss << *AA_HANDLE_MANAGER[this];
-	ss << value;
-	return String(ss.str().c_str());
+	return operator+(String(value));
 }
 
 String & String::operator+=(const String & value){
-	*(AA_HANDLE_MANAGER[this]) += *(AA_HANDLE_MANAGER[&value]);
-	resetValue();
-	return *this;
+	return append(value.c_str(), value.size());
 }
 
 String & String::operator+=(const char * value){
-	*(AA_HANDLE_MANAGER[this]) += value;
-	resetValue();
-	return *this;
+	if(value == nullptr)
+		return *this;
+	return append(value, strlen(value));
+}
+
+String & String::operator+=(const StringView & value){
+	return append(value.data(), value.size());
 }
 
 String & String::operator+=(char c){
-	*(AA_HANDLE_MANAGER[this]) += c;
+	auto length = size();
+	if(length + 1 > capacity())
+		grow(length + 1);
+	buffer()[length] = c;
+	setLength(length + 1);
 	resetValue();
 	return *this;
 }
 
 String & String::operator+=(int64 value){
-	std::ostringstream ss;
-	ss << value;
-	*(AA_HANDLE_MANAGER[this]) += ss.str();
-	resetValue();
-	return *this;
+	return operator+=(String(value));
 }
 
 String & String::operator+=(double value){
-	std::ostringstream ss;
-	ss << value;
-	*(AA_HANDLE_MANAGER[this]) += ss.str();
-	resetValue();
-	return *this;
+	return operator+=(String(value));
 }
 
 String operator+(char c, const String & str){
-	return str + c;
+	return String(c) + str;
 }
 
+/*************************** Editing ***************************/
+
 bool String::clearFront(const char ** value, uint32 length){
-	auto hddd = AA_HANDLE_MANAGER[this];
-	auto& str = *(hddd);
-	if(value == nullptr || length == 0 || str.empty())
+	auto str = c_str();
+	auto strSize = size();
+	if(value == nullptr || length == 0 || strSize == 0)
 		return false;
-	int first = 0;
-	while(first < str.size()){
+	uint64 first = 0;
+	while(first < strSize){
 		bool isSame = false;
 		for(uint32 i = 0; i < length; ++i){
 			if(value[i] != nullptr){
@@ -285,7 +452,7 @@ bool String::clearFront(const char ** value, uint32 length){
 					strLen--;
 				bool isThisSame = true;
 				for(size_t k = 0; k < strLen; ++k){
-					if(*(str.c_str() + first + k) != value[i][k]){
+					if(*(str + first + k) != value[i][k]){
 						isThisSame = false;
 						break;
 					}
@@ -300,14 +467,14 @@ bool String::clearFront(const char ** value, uint32 length){
 			break;
 		++first;
 	}
-	return subString(first);
+	return subString(int64(first));
 }
 
 bool String::clearBack(const char ** value, uint32 length){
-	auto& str = *(AA_HANDLE_MANAGER[this]);
-	if(value == nullptr || length == 0 || str.empty())
+	auto str = c_str();
+	if(value == nullptr || length == 0 || empty())
 		return false;
-	int last = str.size();
+	int64 last = int64(size());
 	std::vector<size_t> strlens;
 	for(uint32 i = 0; i < length; ++i){
 		strlens.push_back(strlen(value[i]));
@@ -321,7 +488,7 @@ bool String::clearBack(const char ** value, uint32 length){
 					strLen--;
 				bool isThisSame = true;
 				for(size_t k = 0; k < strLen; ++k){
-					if(*(str.c_str() + last - strlens[i] + k) != value[i][k]){
+					if(*(str + last - strlens[i] + k) != value[i][k]){
 						isThisSame = false;
 						break;
 					}
@@ -348,28 +515,44 @@ bool String::subString(int64 start){
 }
 
 bool String::subString(int64 start, int64 end){
-	auto& str = *(AA_HANDLE_MANAGER[this]);
-	auto size = str.size();
+	auto size = int64(this->size());
 	if(start < 0)
 		start += size;
 	if(end <= 0)
 		end += size;
-	if(start < 0 && end < 0 && start > end)
+	if(end > size)
+		end = size;
+	if(start < 0 || end < 0 || start > end)
 		return false;
-	if(end < size)
-		str[end] = '\0';
-	std::string tmp = str.c_str() + start;
-	str = tmp.c_str();
+	// 原地截取, 不产生新的分配
+	memmove(buffer(), buffer() + start, uint64(end - start));
+	setLength(uint64(end - start));
 	resetValue();
 	return true;
 }
 
+StringView String::getSubView(int64 start, int64 end) const{
+	return StringView(*this).subView(start, end);
+}
+
+String String::getSubString(int64 start) const{
+	return getSubView(start);
+}
+
+String String::getSubString(int64 start, int64 end) const{
+	return getSubView(start, end);
+}
+
 int32 String::find(char c) const{
-	auto& str = *(AA_HANDLE_MANAGER[this]);
-	auto ret = str.find(c);
-	if(ret == str.npos)
+	auto str = c_str();
+	auto ret = static_cast<const char*>(memchr(str, c, size()));
+	if(ret == nullptr)
 		return c_npos;
-	return int32(ret);
+	return int32(ret - str);
+}
+
+int32 String::find(const char * str) const{
+	return int32(StringView(*this).find(StringView(str)));
 }
 
 String operator+(const char*value, const String&str){
@@ -381,27 +564,98 @@ bool operator==(const char*cstr, const String&str){
 }
 
 
+bool String::clearAnywhere(char c){
+	return replaceAll(StringView(&c, 1), StringView());
+}
+
+bool String::clearAnywhere(const String & value){
+	return replaceAll(value, StringView());
+}
+
+bool String::clearAnywhere(const char * value){
+	return replaceAll(value, StringView());
+}
+
+bool String::replace(char src, char tar){
+	return replaceAll(StringView(&src, 1), StringView(&tar, 1));
+}
+
+bool String::replace(char src, const String & tar){
+	return replaceAll(StringView(&src, 1), tar);
+}
+
 bool String::replace(char src, const char * tar){
-	auto& str = *(AA_HANDLE_MANAGER[this]);
-	auto len = str.length();
-	for(size_t i = 0; i < len; ++i){
-		if(str[i] == src){
-			str = str.replace(i, 1, tar);
-			auto newLen = str.length();
-			i += newLen - len;
-			len = newLen;
+	return replaceAll(StringView(&src, 1), tar);
+}
+
+bool String::replace(const String & src, char tar){
+	return replaceAll(src, StringView(&tar, 1));
+}
+
+bool String::replace(const String & src, const String & tar){
+	return replaceAll(src, tar);
+}
+
+bool String::replace(const String & src, const char * tar){
+	return replaceAll(src, tar);
+}
+
+bool String::replace(const char * src, char tar){
+	return replaceAll(src, StringView(&tar, 1));
+}
+
+bool String::replace(const char * src, const String & tar){
+	return replaceAll(src, tar);
+}
+
+bool String::replace(const char * src, const char * tar){
+	return replaceAll(src, tar);
+}
+
+bool String::replaceAll(StringView src, StringView tar){
+	if(src.empty())
+		return false;
+	// src 和 tar 不能指向自身的内容
+	StringView self(*this);
+	auto pos = self.find(src);
+	if(pos == StringView::c_npos)
+		return true;
+	if(tar.size() <= src.size()){
+		// 写入位置始终不超过读取位置, 可以原地进行
+		auto out = buffer() + pos;
+		auto read = uint64(pos);
+		while(pos != StringView::c_npos){
+			memmove(out, buffer() + read, uint64(pos) - read);
+			out += uint64(pos) - read;
+			memmove(out, tar.data(), tar.size());
+			out += tar.size();
+			read = uint64(pos) + src.size();
+			pos = self.find(src, read);
 		}
+		memmove(out, buffer() + read, self.size() - read);
+		out += self.size() - read;
+		setLength(uint64(out - buffer()));
+		resetValue();
+		return true;
 	}
-	resetValue();
+	String ret;
+	ret.reserve(self.size() + tar.size() - src.size());
+	uint64 read = 0;
+	while(pos != StringView::c_npos){
+		ret.append(self.data() + read, uint64(pos) - read);
+		ret.append(tar.data(), tar.size());
+		read = uint64(pos) + src.size();
+		pos = self.find(src, read);
+	}
+	ret.append(self.data() + read, self.size() - read);
+	*this = std::move(ret);
 	return true;
 }
 
 void String::resetValue(){
 #if defined _DEBUG && defined OS_WINDOWS
-	v = AA_HANDLE_MANAGER[this]->c_str();
+	v = c_str();
 #endif
 }
 
 }
-
-#undef AA_HANDLE_MANAGER
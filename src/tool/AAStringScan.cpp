@@ -0,0 +1,366 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+#include "AAStringScan.hxx"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define AA_STRING_SCAN_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC 不需要为使用指令集的函数单独标记; GCC 和 Clang 用 target 属性, 使整个库仍能以基础指令集编译
+#if defined _MSC_VER
+#define AA_TARGET_SSE2
+#define AA_TARGET_AVX2
+#else
+#define AA_TARGET_SSE2 __attribute__((target("sse2")))
+#define AA_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace ArmyAnt{
+
+static inline bool isSpaceByte(char c){
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static inline bool isEscapedByte(char c){
+	return c == '"' || c == '\\' || uint8(c) < 0x20;
+}
+
+/*************************** Scalar ***************************/
+
+static const char* findQuoteOrBackslashScalar(const char* begin, const char* end, char quote){
+	while(begin < end && *begin != quote && *begin != '\\')
+		++begin;
+	return begin;
+}
+
+static const char* findEscapedCharScalar(const char* begin, const char* end){
+	while(begin < end && !isEscapedByte(*begin))
+		++begin;
+	return begin;
+}
+
+static const char* skipSpaceScalar(const char* begin, const char* end){
+	while(begin < end && isSpaceByte(*begin))
+		++begin;
+	return begin;
+}
+
+static const char* findStringScalar(const char* begin, const char* end, const char* str, uint64 length){
+	while(uint64(end - begin) >= length){
+		// 先用 memchr 跳到首字符可能匹配的位置
+		auto pos = static_cast<const char*>(memchr(begin, str[0], uint64(end - begin) - length + 1));
+		if(pos == nullptr)
+			return end;
+		if(memcmp(pos, str, length) == 0)
+			return pos;
+		begin = pos + 1;
+	}
+	return end;
+}
+
+static const char* findLastCharScalar(const char* begin, const char* end, char c){
+	for(auto i = end; i > begin;){
+		if(*--i == c)
+			return i;
+	}
+	return end;
+}
+
+static const StringScan c_scalarScan = {
+	findQuoteOrBackslashScalar,
+	findEscapedCharScalar,
+	skipSpaceScalar,
+	findStringScalar,
+	findLastCharScalar,
+	StringScanLevel::Scalar
+};
+
+#ifdef AA_STRING_SCAN_X86
+
+static inline uint32 getLowestBit(uint32 mask){
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return uint32(index);
+#else
+	return uint32(__builtin_ctz(mask));
+#endif
+}
+
+static inline uint32 getHighestBit(uint32 mask){
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse(&index, mask);
+	return uint32(index);
+#else
+	return uint32(31 - __builtin_clz(mask));
+#endif
+}
+
+/*************************** SSE2 ***************************/
+
+AA_TARGET_SSE2 static const char* findQuoteOrBackslashSSE2(const char* begin, const char* end, char quote){
+	auto quoteMask = _mm_set1_epi8(quote);
+	auto backslashMask = _mm_set1_epi8('\\');
+	for(; end - begin >= 16; begin += 16){
+		auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+		auto mask = uint32(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, quoteMask), _mm_cmpeq_epi8(block, backslashMask))));
+		if(mask != 0)
+			return begin + getLowestBit(mask);
+	}
+	return findQuoteOrBackslashScalar(begin, end, quote);
+}
+
+AA_TARGET_SSE2 static const char* findEscapedCharSSE2(const char* begin, const char* end){
+	auto quoteMask = _mm_set1_epi8('"');
+	auto backslashMask = _mm_set1_epi8('\\');
+	auto controlMask = _mm_set1_epi8(0x1F);
+	for(; end - begin >= 16; begin += 16){
+		auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+		// 无符号比较 block <= 0x1F 等价于 min(block, 0x1F) == block
+		auto control = _mm_cmpeq_epi8(_mm_min_epu8(block, controlMask), block);
+		auto special = _mm_or_si128(_mm_cmpeq_epi8(block, quoteMask), _mm_cmpeq_epi8(block, backslashMask));
+		auto mask = uint32(_mm_movemask_epi8(_mm_or_si128(control, special)));
+		if(mask != 0)
+			return begin + getLowestBit(mask);
+	}
+	return findEscapedCharScalar(begin, end);
+}
+
+AA_TARGET_SSE2 static const char* skipSpaceSSE2(const char* begin, const char* end){
+	auto spaceMask = _mm_set1_epi8(' ');
+	auto tabMask = _mm_set1_epi8('\t');
+	auto crMask = _mm_set1_epi8('\r');
+	auto lfMask = _mm_set1_epi8('\n');
+	for(; end - begin >= 16; begin += 16){
+		auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+		auto space = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, spaceMask), _mm_cmpeq_epi8(block, tabMask)),
+								  _mm_or_si128(_mm_cmpeq_epi8(block, crMask), _mm_cmpeq_epi8(block, lfMask)));
+		auto mask = ~uint32(_mm_movemask_epi8(space)) & 0xFFFF;
+		if(mask != 0)
+			return begin + getLowestBit(mask);
+	}
+	return skipSpaceScalar(begin, end);
+}
+
+// 同时比较候选位置的首字符和尾字符, 两者都相同时才比较整个子串
+AA_TARGET_SSE2 static const char* findStringSSE2(const char* begin, const char* end, const char* str, uint64 length){
+	if(length == 1)
+		return findStringScalar(begin, end, str, length);
+	auto firstMask = _mm_set1_epi8(str[0]);
+	auto lastMask = _mm_set1_epi8(str[length - 1]);
+	for(; uint64(end - begin) >= length - 1 + 16; begin += 16){
+		auto first = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(begin)), firstMask);
+		auto last = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(begin + length - 1)), lastMask);
+		auto mask = uint32(_mm_movemask_epi8(_mm_and_si128(first, last)));
+		while(mask != 0){
+			auto pos = begin + getLowestBit(mask);
+			if(memcmp(pos + 1, str + 1, length - 2) == 0)
+				return pos;
+			mask &= mask - 1;
+		}
+	}
+	return findStringScalar(begin, end, str, length);
+}
+
+AA_TARGET_SSE2 static const char* findLastCharSSE2(const char* begin, const char* end, char c){
+	auto charMask = _mm_set1_epi8(c);
+	auto i = end;
+	for(; i - begin >= 16;){
+		i -= 16;
+		auto mask = uint32(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(i)), charMask)));
+		if(mask != 0)
+			return i + getHighestBit(mask);
+	}
+	auto ret = findLastCharScalar(begin, i, c);
+	return ret == i ? end : ret;
+}
+
+static const StringScan c_sse2Scan = {
+	findQuoteOrBackslashSSE2,
+	findEscapedCharSSE2,
+	skipSpaceSSE2,
+	findStringSSE2,
+	findLastCharSSE2,
+	StringScanLevel::SSE2
+};
+
+/*************************** AVX2 ***************************/
+
+AA_TARGET_AVX2 static const char* findQuoteOrBackslashAVX2(const char* begin, const char* end, char quote){
+	auto quoteMask = _mm256_set1_epi8(quote);
+	auto backslashMask = _mm256_set1_epi8('\\');
+	// JSON 中的字符串大多很短, 先用低128位检查开头的16字节
+	if(end - begin >= 16){
+		auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+		auto mask = uint32(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, _mm256_castsi256_si128(quoteMask)), _mm_cmpeq_epi8(block, _mm256_castsi256_si128(backslashMask)))));
+		if(mask != 0)
+			return begin + getLowestBit(mask);
+		begin += 16;
+	}
+	for(; end - begin >= 32; begin += 32){
+		auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+		auto mask = uint32(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(block, quoteMask), _mm256_cmpeq_epi8(block, backslashMask))));
+		if(mask != 0)
+			return begin + getLowestBit(mask);
+	}
+	return findQuoteOrBackslashSSE2(begin, end, quote);
+}
+
+AA_TARGET_AVX2 static const char* findEscapedCharAVX2(const char* begin, const char* end){
+	auto quoteMask = _mm256_set1_epi8('"');
+	auto backslashMask = _mm256_set1_epi8('\\');
+	auto controlMask = _mm256_set1_epi8(0x1F);
+	if(end - begin >= 16){
+		auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+		auto control = _mm_cmpeq_epi8(_mm_min_epu8(block, _mm256_castsi256_si128(controlMask)), block);
+		auto special = _mm_or_si128(_mm_cmpeq_epi8(block, _mm256_castsi256_si128(quoteMask)), _mm_cmpeq_epi8(block, _mm256_castsi256_si128(backslashMask)));
+		auto mask = uint32(_mm_movemask_epi8(_mm_or_si128(control, special)));
+		if(mask != 0)
+			return begin + getLowestBit(mask);
+		begin += 16;
+	}
+	for(; end - begin >= 32; begin += 32){
+		auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+		auto control = _mm256_cmpeq_epi8(_mm256_min_epu8(block, controlMask), block);
+		auto special = _mm256_or_si256(_mm256_cmpeq_epi8(block, quoteMask), _mm256_cmpeq_epi8(block, backslashMask));
+		auto mask = uint32(_mm256_movemask_epi8(_mm256_or_si256(control, special)));
+		if(mask != 0)
+			return begin + getLowestBit(mask);
+	}
+	return findEscapedCharSSE2(begin, end);
+}
+
+AA_TARGET_AVX2 static const char* skipSpaceAVX2(const char* begin, const char* end){
+	auto spaceMask = _mm256_set1_epi8(' ');
+	auto tabMask = _mm256_set1_epi8('\t');
+	auto crMask = _mm256_set1_epi8('\r');
+	auto lfMask = _mm256_set1_epi8('\n');
+	for(; end - begin >= 32; begin += 32){
+		auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+		auto space = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, spaceMask), _mm256_cmpeq_epi8(block, tabMask)),
+									 _mm256_or_si256(_mm256_cmpeq_epi8(block, crMask), _mm256_cmpeq_epi8(block, lfMask)));
+		auto mask = ~uint32(_mm256_movemask_epi8(space));
+		if(mask != 0)
+			return begin + getLowestBit(mask);
+	}
+	return skipSpaceSSE2(begin, end);
+}
+
+AA_TARGET_AVX2 static const char* findStringAVX2(const char* begin, const char* end, const char* str, uint64 length){
+	if(length == 1)
+		return findStringScalar(begin, end, str, length);
+	auto firstMask = _mm256_set1_epi8(str[0]);
+	auto lastMask = _mm256_set1_epi8(str[length - 1]);
+	for(; uint64(end - begin) >= length - 1 + 32; begin += 32){
+		auto first = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin)), firstMask);
+		auto last = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin + length - 1)), lastMask);
+		auto mask = uint32(_mm256_movemask_epi8(_mm256_and_si256(first, last)));
+		while(mask != 0){
+			auto pos = begin + getLowestBit(mask);
+			if(memcmp(pos + 1, str + 1, length - 2) == 0)
+				return pos;
+			mask &= mask - 1;
+		}
+	}
+	return findStringSSE2(begin, end, str, length);
+}
+
+AA_TARGET_AVX2 static const char* findLastCharAVX2(const char* begin, const char* end, char c){
+	auto charMask = _mm256_set1_epi8(c);
+	auto i = end;
+	for(; i - begin >= 32;){
+		i -= 32;
+		auto mask = uint32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(i)), charMask)));
+		if(mask != 0)
+			return i + getHighestBit(mask);
+	}
+	auto ret = findLastCharSSE2(begin, i, c);
+	return ret == i ? end : ret;
+}
+
+static const StringScan c_avx2Scan = {
+	findQuoteOrBackslashAVX2,
+	findEscapedCharAVX2,
+	skipSpaceAVX2,
+	findStringAVX2,
+	findLastCharAVX2,
+	StringScanLevel::AVX2
+};
+
+#endif // AA_STRING_SCAN_X86
+
+const StringScan& StringScan::get(){
+	static const StringScan& ret = get(getSupportedLevel());
+	return ret;
+}
+
+const StringScan& StringScan::get(StringScanLevel level){
+	switch(level){
+#ifdef AA_STRING_SCAN_X86
+		case StringScanLevel::AVX2:
+			return c_avx2Scan;
+		case StringScanLevel::SSE2:
+			return c_sse2Scan;
+#endif
+		default:
+			return c_scalarScan;
+	}
+}
+
+StringScanLevel StringScan::getSupportedLevel(){
+#if defined AA_STRING_SCAN_X86 && defined _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	auto maxLeaf = info[0];
+	__cpuid(info, 1);
+	bool hasSSE2 = (info[3] & (1 << 26)) != 0;
+	// AVX2 还需要操作系统保存 YMM 寄存器
+	bool hasOSAVX = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+	if(hasOSAVX && maxLeaf >= 7){
+		__cpuidex(info, 7, 0);
+		if((info[1] & (1 << 5)) != 0)
+			return StringScanLevel::AVX2;
+	}
+	if(hasSSE2)
+		return StringScanLevel::SSE2;
+#elif defined AA_STRING_SCAN_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+		return StringScanLevel::AVX2;
+	if(__builtin_cpu_supports("sse2"))
+		return StringScanLevel::SSE2;
+#endif
+	return StringScanLevel::Scalar;
+}
+
+} // namespace ArmyAnt
+
+#undef AA_TARGET_SSE2
+#undef AA_TARGET_AVX2
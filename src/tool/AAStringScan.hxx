@@ -0,0 +1,63 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+#ifndef AA_STRING_SCAN_PRIVATE_HEADER_2026_10_17
+#define AA_STRING_SCAN_PRIVATE_HEADER_2026_10_17
+
+#include "../../inc/AADefine.h"
+#include "../../inc/AA_start.h"
+
+namespace ArmyAnt{
+
+enum class StringScanLevel : uint8{
+	Scalar,
+	SSE2,
+	AVX2
+};
+
+/*	* 字节扫描函数表, 供 String, StringView 和 JSON 的解析与序列化使用
+	* 程序启动后第一次调用 get 时按 CPU 支持的指令集选择一次, 之后不再改变
+	* 所有函数都在 [begin, end) 中查找, 找不到时返回 end, 不会读取 end 之后的内存
+	*/
+struct ARMYANTLIB_API StringScan{
+	// 第一个等于 quote 或 '\\' 的字符
+	const char* (*findQuoteOrBackslash)(const char* begin, const char* end, char quote);
+	// 第一个在 JSON 字符串中需要转义的字符, 即 '"', '\\' 和小于0x20的控制字符
+	const char* (*findEscapedChar)(const char* begin, const char* end);
+	// 第一个不是 ' ', '\t', '\r', '\n' 的字符
+	const char* (*skipSpace)(const char* begin, const char* end);
+	// 第一次出现 str 的位置, length 不能为0
+	const char* (*findString)(const char* begin, const char* end, const char* str, uint64 length);
+	// 最后一个等于 c 的字符
+	const char* (*findLastChar)(const char* begin, const char* end, char c);
+	StringScanLevel level;
+
+	static const StringScan& get();
+	// 指定指令集的函数表, 用于测试和性能对比. 调用者需要保证 CPU 支持该指令集
+	static const StringScan& get(StringScanLevel level);
+	static StringScanLevel getSupportedLevel();
+};
+
+} // namespace ArmyAnt
+
+#endif // AA_STRING_SCAN_PRIVATE_HEADER_2026_10_17
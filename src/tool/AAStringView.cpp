@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+
+#include "../../inc/AAString.h"
+#include "AAStringScan.hxx"
+#include <cstdlib>
+
+namespace ArmyAnt{
+
+static inline bool isSpaceChar(char c){
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+int64 StringView::find(char c, uint64 start) const{
+	if(start >= length)
+		return c_npos;
+	auto ret = static_cast<const char*>(memchr(head + start, c, length - start));
+	if(ret == nullptr)
+		return c_npos;
+	return int64(ret - head);
+}
+
+int64 StringView::find(StringView str, uint64 start) const{
+	if(str.length == 0)
+		return start <= length ? int64(start) : c_npos;
+	if(start >= length || str.length > length - start)
+		return c_npos;
+	auto ret = StringScan::get().findString(head + start, head + length, str.head, str.length);
+	return ret == head + length ? c_npos : int64(ret - head);
+}
+
+int64 StringView::findLast(char c) const{
+	auto ret = StringScan::get().findLastChar(head, head + length, c);
+	return ret == head + length ? c_npos : int64(ret - head);
+}
+
+bool StringView::startsWith(StringView str) const{
+	return str.length <= length && memcmp(head, str.head, str.length) == 0;
+}
+
+bool StringView::endsWith(StringView str) const{
+	return str.length <= length && memcmp(head + length - str.length, str.head, str.length) == 0;
+}
+
+int32 StringView::compare(StringView str) const{
+	auto ret = memcmp(head, str.head, length < str.length ? length : str.length);
+	if(ret != 0)
+		return ret;
+	if(length == str.length)
+		return 0;
+	return length < str.length ? -1 : 1;
+}
+
+StringView StringView::subView(int64 start, int64 end) const{
+	auto size = int64(length);
+	if(start < 0)
+		start += size;
+	if(end <= 0)
+		end += size;
+	if(end > size)
+		end = size;
+	if(start < 0 || end < 0 || start > end)
+		return StringView();
+	return StringView(head + start, uint64(end - start));
+}
+
+StringView StringView::trimFront() const{
+	uint64 first = 0;
+	while(first < length && isSpaceChar(head[first]))
+		++first;
+	return StringView(head + first, length - first);
+}
+
+StringView StringView::trimBack() const{
+	auto last = length;
+	while(last > 0 && isSpaceChar(head[last - 1]))
+		--last;
+	return StringView(head, last);
+}
+
+StringView StringView::trim() const{
+	return trimFront().trimBack();
+}
+
+uint32 StringView::split(char separator, StringView * results, uint32 maxCount) const{
+	uint32 count = 0;
+	uint64 start = 0;
+	while(true){
+		auto pos = find(separator, start);
+		auto end = pos == c_npos ? length : uint64(pos);
+		if(results != nullptr && count < maxCount)
+			results[count] = StringView(head + start, end - start);
+		++count;
+		if(pos == c_npos)
+			break;
+		start = end + 1;
+	}
+	return count;
+}
+
+int32 StringView::toInteger() const{
+	return int32(toLong());
+}
+
+int64 StringView::toLong() const{
+	// 视图不保证以'\0'结尾, 因此不能直接调用 atoll
+	auto str = trimFront();
+	uint64 i = 0;
+	bool isNegative = false;
+	if(i < str.length && (str.head[i] == '-' || str.head[i] == '+'))
+		isNegative = str.head[i++] == '-';
+	int64 ret = 0;
+	for(; i < str.length && str.head[i] >= '0' && str.head[i] <= '9'; ++i)
+		ret = ret * 10 + (str.head[i] - '0');
+	return isNegative ? -ret : ret;
+}
+
+double StringView::toDemical() const{
+	char buffer[64];
+	if(length < sizeof(buffer)){
+		memcpy(buffer, head, length);
+		buffer[length] = '\0';
+		return atof(buffer);
+	}
+	return atof(String(*this).c_str());
+}
+
+}
@@ -23,41 +23,312 @@
 
 #include "../../inc/AATimeUtilities.h"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
 #include <ctime>
-#ifdef OS_LINUX
-#include <sys/time.h>
+#include <mutex>
+#include <thread>
+
+#if defined OS_WINDOWS
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define AA_TIME_TSC 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
 #endif
 
 namespace ArmyAnt{
 
 namespace TimeUtilities{
 
-ArmyAnt::String getTimeStamp(){
+namespace{
+
+// ʱƵʺ㶨, Ҹͬʱ, ʱ
+bool detectTscInvariant(){
+#if defined AA_TIME_TSC && defined _MSC_VER
+	int info[4];
+	__cpuid(info, 0x80000000);
+	if(unsigned(info[0]) < 0x80000007)
+		return false;
+	__cpuid(info, 0x80000007);
+	return (info[3] & (1 << 8)) != 0;
+#elif defined AA_TIME_TSC
+	unsigned eax, ebx, ecx, edx;
+	if(__get_cpuid_max(0x80000000, nullptr) < 0x80000007 || !__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+		return false;
+	return (edx & (1 << 8)) != 0;
+#else
+	return false;
+#endif
+}
+
+// ʹþֲ̬, 뵥Ԫľ̬ʼʱҲܵõȷĽ
+bool isTscInvariant(){
+	static const bool ret = detectTscInvariant();
+	return ret;
+}
+
+// ʽΪ"Sat Oct 17 13:32:52 2026", out32ֽ, س
+uint32 formatTime(int64 second, char* out){
+	auto time = time_t(second);
+	tm local;
 #if defined OS_WINDOWS
-	auto tm = _time64(0);
-	char ret[64] = "";
-	_ctime64_s(ret, &tm);
-	auto retStr = ArmyAnt::String(ret);
-	retStr.replace('\n', "");
+	localtime_s(&local, &time);
 #else
-	auto tm = time(0);
-	auto retStr = ArmyAnt::String(ctime(&tm));
+	localtime_r(&time, &local);
 #endif
-	return retStr;
+	return uint32(strftime(out, 32, "%a %b %e %H:%M:%S %Y", &local));
+}
+
+// άǽʱ, ǰʱıʱĺ̨߳
+// 1ûжȡʱֹͣ, ֮һζȡ·: ȡþȷʱ, Ѻ̨߳
+// ߳һֱڵ˳, , ̬Ҳʹ
+class Ticker{
+public:
+	static Ticker& getInstance(){
+		static auto instance = new Ticker();
+		return *instance;
+	}
+
+	// ̨߳ʱ, isUsedѱʱҲд, ֮䲻
+	int64 getCoarseWall(){
+		if(isSleeping.load(std::memory_order_acquire))
+			return wake();
+		if(!isUsed.load(std::memory_order_relaxed))
+			isUsed.store(true, std::memory_order_relaxed);
+		return coarseWall.load(std::memory_order_relaxed);
+	}
+
+	// ̵̨߳һУ׼֮ǰ, ĵʱʱʱ
+	double getNanosecondsPerTick()const{
+		auto ret = nanosecondsPerTick.load(std::memory_order_relaxed);
+		return ret > 0 ? ret : measureNanosecondsPerTick();
+	}
+
+	// seqlockȡ, ̵̨߳ĸ²ụȴ
+	uint32 copyTimeStamp(char* out){
+		auto second = getCoarseWall() / 1000000000;
+		uint64 words[4];
+		uint32 len;
+		int64 textSecond;
+		while(true){
+			auto sequence = timeStampSequence.load(std::memory_order_acquire);
+			if(sequence & 1)
+				continue;
+			for(int i = 0; i < 4; ++i)
+				words[i] = timeStampText[i].load(std::memory_order_relaxed);
+			len = timeStampLen.load(std::memory_order_relaxed);
+			textSecond = timeStampSecond.load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if(timeStampSequence.load(std::memory_order_relaxed) == sequence)
+				break;
+		}
+		// ̸̨߳ձ, δıʱ, иʽ
+		if(textSecond != second){
+			static thread_local int64 cachedSecond = -1;
+			static thread_local char cachedText[32] = "";
+			static thread_local uint32 cachedLen = 0;
+			if(cachedSecond != second){
+				cachedLen = formatTime(second, cachedText);
+				cachedSecond = second;
+			}
+			memcpy(out, cachedText, sizeof(cachedText));
+			return cachedLen;
+		}
+		memcpy(out, words, sizeof(words));
+		out[len] = '\0';
+		return len;
+	}
+
+private:
+	Ticker() :isUsed(true), isSleeping(false), coarseWall(getWallNanoseconds()), timeStampSequence(0), timeStampSecond(-1), timeStampLen(0), nanosecondsPerTick(0.0){
+		for(int i = 0; i < 4; ++i)
+			timeStampText[i].store(0, std::memory_order_relaxed);
+		updateTimeStamp(coarseWall.load(std::memory_order_relaxed));
+		startTicks = getTicks();
+		startNanoseconds = getMonotonicNanoseconds();
+		std::thread(&Ticker::update, this).detach();
+	}
+
+	void update(){
+		uint32 idleTicks = 0;
+		for(uint32 tick = 1; ; ++tick){
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			refresh();
+			// һtickУ׼, ֮ʱ
+			if(isTscInvariant() && (tick == 1 || tick % 1000 == 0))
+				calibrate();
+			if(isUsed.exchange(false, std::memory_order_relaxed)){
+				idleTicks = 0;
+				continue;
+			}
+			if(++idleTicks < 1000)
+				continue;
+			std::unique_lock<std::mutex> lock(mutex);
+			// ڼisSleeping֮isUsed, ǡڴڼֹͣʱ, Ǵζȡõֹͣǰһtickʱ
+			// ֮ĶȡῴisSleepingѺ̨߳
+			if(isUsed.load(std::memory_order_relaxed))
+				continue;
+			isSleeping.store(true, std::memory_order_release);
+			condition.wait(lock, [this](){ return !isSleeping.load(std::memory_order_relaxed); });
+			lock.unlock();
+			idleTicks = 0;
+			refresh();
+		}
+	}
+
+	void refresh(){
+		auto now = getWallNanoseconds();
+		coarseWall.store(now, std::memory_order_relaxed);
+		updateTimeStamp(now);
+	}
+
+	// ·, ֻںֹ̨߳ͣ: ؾȷʱ, Ѻ̨߳
+	int64 wake(){
+		auto now = getWallNanoseconds();
+		coarseWall.store(now, std::memory_order_relaxed);
+		isUsed.store(true, std::memory_order_relaxed);
+		std::lock_guard<std::mutex> lock(mutex);
+		if(isSleeping.load(std::memory_order_relaxed)){
+			isSleeping.store(false, std::memory_order_relaxed);
+			condition.notify_one();
+		}
+		return now;
+	}
+
+	// ֻڹ캯ͺ̨߳е, ûвд
+	void updateTimeStamp(int64 wallNanoseconds){
+		auto second = wallNanoseconds / 1000000000;
+		if(second == timeStampSecond.load(std::memory_order_relaxed))
+			return;
+		char text[32] = "";
+		auto len = formatTime(second, text);
+		uint64 words[4];
+		memcpy(words, text, sizeof(words));
+		auto sequence = timeStampSequence.load(std::memory_order_relaxed);
+		timeStampSequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for(int i = 0; i < 4; ++i)
+			timeStampText[i].store(words[i], std::memory_order_relaxed);
+		timeStampLen.store(len, std::memory_order_relaxed);
+		timeStampSecond.store(second, std::memory_order_relaxed);
+		timeStampSequence.store(sequence + 2, std::memory_order_release);
+	}
+
+	void calibrate(){
+		nanosecondsPerTick.store(measureNanosecondsPerTick(), std::memory_order_relaxed);
+	}
+
+	double measureNanosecondsPerTick()const{
+		auto ticks = getTicks() - startTicks;
+		auto nanoseconds = getMonotonicNanoseconds() - startNanoseconds;
+		return ticks > 0 ? double(nanoseconds) / double(ticks) : 1.0;
+	}
+
+private:
+	std::atomic<bool> isUsed;		// , ̨߳ÿtick
+	std::mutex mutex;				// ֹ̨߳ͣͻʱ
+	std::condition_variable condition;
+	std::atomic<bool> isSleeping;	// ֹ̨߳ͣ, ֻڼʱ޸
+	std::atomic<int64> coarseWall;
+	// ǰʱı. ıҲԭӱ, ̨̲߳дʱݾ
+	std::atomic<uint32> timeStampSequence;
+	std::atomic<int64> timeStampSecond;
+	std::atomic<uint64> timeStampText[4];
+	std::atomic<uint32> timeStampLen;
+	// ʱУ׼ͻ, ں̵̨߳һУ׼ǰΪ0
+	int64 startTicks = 0;
+	int64 startNanoseconds = 0;
+	std::atomic<double> nanosecondsPerTick;
+};
+
+}
+
+ArmyAnt::String getTimeStamp(){
+	char text[32];
+	formatCoarseTimeStamp(text);
+	return ArmyAnt::String(text);
 }
 
 int64 getCurrentTime(){
 #if defined OS_WINDOWS
-	auto tm = _time64(0);
-	char ret[64] = "";
-	_ctime64_s(ret, &tm);
-	return int64(tm);
+	return int64(_time64(0));
+#else
+	return int64(time(0));
+#endif
+}
+
+int64 getMonotonicNanoseconds(){
+#if defined OS_WINDOWS
+	static const auto frequency = [](){
+		LARGE_INTEGER ret;
+		QueryPerformanceFrequency(&ret);
+		return int64(ret.QuadPart);
+	}();
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	// ֿ, 10^9ʱ
+	auto value = int64(counter.QuadPart);
+	return value / frequency * 1000000000 + value % frequency * 1000000000 / frequency;
+#elif defined CLOCK_MONOTONIC
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return int64(now.tv_sec) * 1000000000 + now.tv_nsec;
+#else
+	return int64(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+int64 getWallNanoseconds(){
+#if defined OS_WINDOWS
+	FILETIME now;
+	GetSystemTimePreciseAsFileTime(&now);
+	// FILETIME1601100
+	auto value = (int64(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+	return (value - 116444736000000000LL) * 100;
+#elif defined CLOCK_REALTIME
+	timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return int64(now.tv_sec) * 1000000000 + now.tv_nsec;
 #else
-	auto tm = time(0);
-	return int64(ctime(&tm));
+	return int64(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
 #endif
 }
 
+int64 getCoarseWallNanoseconds(){
+	return Ticker::getInstance().getCoarseWall();
 }
 
+uint32 formatCoarseTimeStamp(char * out){
+	return Ticker::getInstance().copyTimeStamp(out);
 }
+
+int64 getTicks(){
+#if defined AA_TIME_TSC
+	if(isTscInvariant())
+		return int64(__rdtsc());
+#endif
+	return getMonotonicNanoseconds();
+}
+
+int64 ticksToNanoseconds(int64 ticks){
+	if(!isTscInvariant())
+		return ticks;
+	return int64(double(ticks) * Ticker::getInstance().getNanosecondsPerTick());
+}
+
+}
+
+}
+
+#undef AA_TIME_TSC
@@ -0,0 +1,99 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+
+/*	* 句柄管理器的微基准测试
+	* 对比 HandleManagerMode::MapMutex (std::map + 全局互斥锁) 与 HandleManagerMode::Sharded (分片无锁读哈希表)
+	* 在 1 ~ 64 个线程下的查询吞吐量. 每个线程持有自己的一批外部对象, 反复查询其内部实例,
+	* 并且每 16 次查询穿插一次对象的创建和销毁, 模拟 String 等短生命周期对象
+	* 用法: benchHandleManager [每线程操作次数, 默认2000000]
+	*/
+
+#include "../../inc/AAClassPrivateHandle.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace{
+
+struct BenchOuter{
+	int64 padding;
+};
+
+struct BenchInner{
+	int64 value = 0;
+};
+
+const int c_objectsPerThread = 256;
+
+template <ArmyAnt::HandleManagerMode mode>
+void benchThread(int64 operations, int64* checksum){
+	auto& manager = ArmyAnt::ClassPrivateHandleManager<BenchOuter, BenchInner, mode>::getInstance();
+	std::vector<BenchOuter> objects(c_objectsPerThread);
+	for(int i = 0; i < c_objectsPerThread; ++i)
+		manager.GetHandle(&objects[i]);
+	BenchOuter temporary;
+	int64 sum = 0;
+	for(int64 i = 0; i < operations; ++i){
+		if((i & 15) == 15){
+			manager.GetHandle(&temporary);
+			delete manager.ReleaseHandle(&temporary);
+		} else{
+			sum += manager[&objects[i % c_objectsPerThread]]->value;
+		}
+	}
+	for(int i = 0; i < c_objectsPerThread; ++i)
+		delete manager.ReleaseHandle(&objects[i]);
+	*checksum = sum;
+}
+
+template <ArmyAnt::HandleManagerMode mode>
+double runBench(int threadCount, int64 operations){
+	std::vector<std::thread> threads;
+	std::vector<int64> checksums(threadCount);
+	auto start = std::chrono::steady_clock::now();
+	for(int i = 0; i < threadCount; ++i)
+		threads.push_back(std::thread(benchThread<mode>, operations, &checksums[i]));
+	for(auto& t : threads)
+		t.join();
+	auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	// 返回所有线程合计的每秒操作数 (百万次)
+	return double(operations) * threadCount / seconds / 1000000.0;
+}
+
+}
+
+int main(int argc, char* argv[]){
+	int64 operations = argc > 1 ? atoll(argv[1]) : 2000000;
+	const int threadCounts[] = {1, 2, 4, 8, 16, 32, 64};
+	std::cout << "threads\tmap+mutex(Mops/s)\tsharded(Mops/s)\tspeedup" << std::endl;
+	for(auto threadCount : threadCounts){
+		auto locked = runBench<ArmyAnt::HandleManagerMode::MapMutex>(threadCount, operations);
+		auto sharded = runBench<ArmyAnt::HandleManagerMode::Sharded>(threadCount, operations);
+		std::cout << threadCount << "\t" << locked << "\t" << sharded << "\t" << sharded / locked << std::endl;
+	}
+	return 0;
+}
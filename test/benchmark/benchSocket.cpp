@@ -0,0 +1,531 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+
+/*	* AASocket 各类套接字在本机回环上的基准测试, 结果以 JSON 输出到标准输出, 便于与基线比较, 进度信息输出到标准错误
+	* tcp_server: TCPServer 回显, 客户端为 boost::asio 异步连接, 1 ~ 10000 个并发连接, 每个连接保持一条消息往返
+	* tcp_client: TCPServer 回显, 客户端为 TCPClient
+	* udp: UDPSilgle 回显, 客户端为另一个 UDPSilgle
+	* websocket: TCPWebSocketServer 回显, 客户端为 TCPWebSocketClient
+	* accept: 同时发起连接, 统计服务器每秒接受的连接数
+	* 往返用例给出每秒往返次数, 每秒回显的数据量(单向, MB), 往返时间的 p50/p99/p999(微秒)
+	* 用法: benchSocket [每个用例的时长(秒), 默认1] [最大并发连接数, 默认10000] [服务器反应器数, 默认2] > result.json
+	*/
+
+#include "../../inc/AASocket.h"
+
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined OS_UNIX
+#include <sys/resource.h>
+#endif
+
+namespace{
+
+using ArmyAnt::Socket;
+typedef std::chrono::steady_clock Clock;
+
+struct Options{
+	double seconds;
+	uint32 maxConnections;
+	uint32 reactors;
+};
+
+// 一个往返用例的公共状态, 预热结束后才开始计数
+struct Measure{
+	std::atomic<bool> isRunning;
+	std::atomic<bool> isMeasuring;
+	std::atomic<uint64> messages;
+	Measure() :isRunning(true), isMeasuring(false), messages(0){}
+};
+
+// 一条往返的消息流, 只在该流的回调中访问, 用例结束后再汇总
+struct Flow{
+	Clock::time_point sentTime;
+	uint64 receivedLen = 0;			// 当前消息已收到的字节数
+	std::vector<uint32> samples;	// 往返时间(纳秒)
+
+	void onSent(){
+		sentTime = Clock::now();
+		receivedLen = 0;
+	}
+	// 收到len字节, 收齐一条消息时记录往返时间并返回true
+	bool onReceived(uint64 len, uint32 messageSize, Measure& measure){
+		receivedLen += len;
+		if(receivedLen < messageSize)
+			return false;
+		if(measure.isMeasuring){
+			auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - sentTime).count();
+			samples.push_back(uint32(std::min<int64>(ns, 0xffffffff)));
+			++measure.messages;
+		}
+		return true;
+	}
+};
+
+struct Result{
+	std::string name;
+	std::string transport;
+	std::string client;
+	uint32 connections = 0;
+	uint32 messageSize = 0;
+	double messagesPerSecond = 0;
+	double megaBytesPerSecond = 0;
+	double p50 = 0;
+	double p99 = 0;
+	double p999 = 0;
+	double acceptsPerSecond = 0;
+	bool isRoundTrip = true;
+};
+
+std::vector<Result> g_results;
+// 每个用例使用新的端口. 放在Linux默认的临时端口范围(32768 ~ 60999)之外, 以免与上万个客户端连接占用的本地端口冲突
+uint16 g_port = 61000;
+
+void ignoreError(const ArmyAnt::SocketException&, const ArmyAnt::IPAddr&, uint16, ArmyAnt::String, void*){}
+
+// 预热, 计时, 然后停止往返, 按所有流的采样计算结果
+void measureRoundTrips(Result& result, const Options& options, Measure& measure, const std::vector<Flow*>& flows, std::function<void()> onStalled = nullptr){
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	measure.isMeasuring = true;
+	auto start = Clock::now();
+	auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.seconds));
+	while(Clock::now() < end){
+		auto messages = measure.messages.load();
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		if(onStalled != nullptr && measure.messages == messages)
+			onStalled();
+	}
+	measure.isMeasuring = false;
+	auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	measure.isRunning = false;
+	// 等待进行中的回调结束
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+	std::vector<uint32> samples;
+	for(auto i = flows.begin(); i != flows.end(); ++i)
+		samples.insert(samples.end(), (*i)->samples.begin(), (*i)->samples.end());
+	result.messagesPerSecond = samples.size() / elapsed;
+	result.megaBytesPerSecond = result.messagesPerSecond * result.messageSize / 1024.0 / 1024.0;
+	if(!samples.empty()){
+		auto percentile = [&samples](double p){
+			auto n = std::min<std::size_t>(std::size_t(p * samples.size()), samples.size() - 1);
+			std::nth_element(samples.begin(), samples.begin() + n, samples.end());
+			return samples[n] / 1000.0;
+		};
+		result.p50 = percentile(0.5);
+		result.p99 = percentile(0.99);
+		result.p999 = percentile(0.999);
+	}
+}
+
+void startEchoServer(ArmyAnt::TCPServer& server, uint16 port, const Options& options){
+	server.setThreadNum(options.reactors);
+	server.setGettingCallBack([&server](uint32 index, const void* data, mac_uint len, void*){
+		server.send(index, const_cast<void*>(data), len, false);
+	});
+	server.setErrorReportCallBack(ignoreError);
+	if(!server.start(port))
+		std::cerr << "server start failed on port " << port << std::endl;
+}
+
+// boost::asio异步客户端连接, 写出一条消息, 读回同样长度后发送下一条
+class AsioFlow : public Flow, public std::enable_shared_from_this<AsioFlow>{
+public:
+	AsioFlow(boost::asio::io_service& service, uint32 messageSize, Measure& measure)
+		:socket(service), sending(messageSize, 'x'), receiving(messageSize), measure(measure){}
+
+	void start(){
+		auto self = shared_from_this();
+		onSent();
+		boost::asio::async_write(socket, boost::asio::buffer(sending), [self](boost::system::error_code err, std::size_t){
+			if(err)
+				return;
+			boost::asio::async_read(self->socket, boost::asio::buffer(self->receiving), [self](boost::system::error_code err, std::size_t size){
+				if(err)
+					return;
+				self->onReceived(size, uint32(self->sending.size()), self->measure);
+				if(self->measure.isRunning)
+					self->start();
+			});
+		});
+	}
+
+	boost::asio::ip::tcp::socket socket;
+
+private:
+	std::vector<char> sending;
+	std::vector<char> receiving;
+	Measure& measure;
+};
+
+void benchTcpServer(const Options& options, uint32 connections, uint32 messageSize){
+	Result result;
+	result.transport = "tcp";
+	result.client = "asio";
+	result.connections = connections;
+	result.messageSize = messageSize;
+	result.name = "tcp_server/c" + std::to_string(connections) + "/s" + std::to_string(messageSize);
+	auto port = g_port++;
+	ArmyAnt::TCPServer server;
+	startEchoServer(server, port, options);
+
+	Measure measure;
+	boost::asio::io_service service;
+	boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), port);
+	std::vector<std::shared_ptr<AsioFlow>> clients;
+	std::vector<Flow*> flows;
+	for(uint32 i = 0; i < connections; ++i){
+		std::shared_ptr<AsioFlow> client(new AsioFlow(service, messageSize, measure));
+		boost::system::error_code err;
+		client->socket.connect(endpoint, err);
+		if(err){
+			std::cerr << result.name << ": connect failed after " << i << " connections, " << err.message() << std::endl;
+			break;
+		}
+		client->socket.set_option(boost::asio::ip::tcp::no_delay(true));
+		clients.push_back(client);
+		flows.push_back(client.get());
+	}
+	for(auto i = clients.begin(); i != clients.end(); ++i)
+		(*i)->start();
+	std::vector<std::thread> threads;
+	for(int i = 0; i < 2; ++i)
+		threads.emplace_back([&service](){ service.run(); });
+
+	measureRoundTrips(result, options, measure, flows);
+	for(auto i = clients.begin(); i != clients.end(); ++i){
+		boost::system::error_code err;
+		(*i)->socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, err);
+	}
+	for(auto i = threads.begin(); i != threads.end(); ++i)
+		i->join();
+	server.stop(0);
+	g_results.push_back(result);
+}
+
+void benchTcpClient(const Options& options, uint32 connections, uint32 messageSize){
+	Result result;
+	result.transport = "tcp";
+	result.client = "TCPClient";
+	result.connections = connections;
+	result.messageSize = messageSize;
+	result.name = "tcp_client/c" + std::to_string(connections) + "/s" + std::to_string(messageSize);
+	auto port = g_port++;
+	ArmyAnt::TCPServer server;
+	startEchoServer(server, port, options);
+
+	Measure measure;
+	std::string message(messageSize, 'x');
+	std::vector<std::unique_ptr<ArmyAnt::TCPClient>> clients;
+	std::vector<std::unique_ptr<Flow>> flowData;
+	std::vector<Flow*> flows;
+	for(uint32 i = 0; i < connections; ++i){
+		std::unique_ptr<ArmyAnt::TCPClient> client(new ArmyAnt::TCPClient());
+		std::unique_ptr<Flow> flow(new Flow());
+		auto c = client.get();
+		auto f = flow.get();
+		client->setServerAddr(ArmyAnt::IPAddr_v4(127, 0, 0, 1));
+		client->setServerPort(port);
+		client->setErrorReportCallBack(ignoreError);
+		client->setLostServerCallBack([](void*){}, nullptr);
+		client->setGettingCallBack([c, f, &message, &measure](const void*, mac_uint len, void*){
+			if(f->onReceived(len, uint32(message.size()), measure) && measure.isRunning){
+				f->onSent();
+				c->send(message.data(), message.size());
+			}
+		});
+		if(!client->connectServer(false)){
+			std::cerr << result.name << ": connect failed" << std::endl;
+			break;
+		}
+		clients.push_back(std::move(client));
+		flows.push_back(f);
+		flowData.push_back(std::move(flow));
+	}
+	for(std::size_t i = 0; i < clients.size(); ++i){
+		flows[i]->onSent();
+		clients[i]->send(message.data(), message.size());
+	}
+
+	measureRoundTrips(result, options, measure, flows);
+	for(auto i = clients.begin(); i != clients.end(); ++i)
+		(*i)->disconnectServer(100);
+	server.stop(0);
+	g_results.push_back(result);
+}
+
+void benchWebSocket(const Options& options, uint32 connections, uint32 messageSize){
+	Result result;
+	result.transport = "websocket";
+	result.client = "TCPWebSocketClient";
+	result.connections = connections;
+	result.messageSize = messageSize;
+	result.name = "websocket/c" + std::to_string(connections) + "/s" + std::to_string(messageSize);
+	auto port = g_port++;
+	ArmyAnt::TCPWebSocketServer server;
+	startEchoServer(server, port, options);
+
+	Measure measure;
+	std::string message(messageSize, 'x');
+	std::vector<std::unique_ptr<ArmyAnt::TCPWebSocketClient>> clients;
+	std::vector<std::unique_ptr<Flow>> flowData;
+	std::vector<Flow*> flows;
+	for(uint32 i = 0; i < connections; ++i){
+		std::unique_ptr<ArmyAnt::TCPWebSocketClient> client(new ArmyAnt::TCPWebSocketClient());
+		std::unique_ptr<Flow> flow(new Flow());
+		auto c = client.get();
+		auto f = flow.get();
+		client->setServerAddr(ArmyAnt::IPAddr_v4(127, 0, 0, 1));
+		client->setServerPort(port);
+		client->setErrorReportCallBack(ignoreError);
+		client->setLostServerCallBack([](void*){}, nullptr);
+		// 每条websocket消息回调一次
+		client->setGettingCallBack([c, f, &message, &measure](const void*, mac_uint len, void*){
+			if(f->onReceived(len, uint32(message.size()), measure) && measure.isRunning){
+				f->onSent();
+				c->send(message.data(), message.size());
+			}
+		});
+		if(!client->connectServer(0, false)){
+			std::cerr << result.name << ": connect failed" << std::endl;
+			break;
+		}
+		clients.push_back(std::move(client));
+		flows.push_back(f);
+		flowData.push_back(std::move(flow));
+	}
+	for(std::size_t i = 0; i < clients.size(); ++i){
+		flows[i]->onSent();
+		clients[i]->send(message.data(), message.size());
+	}
+
+	measureRoundTrips(result, options, measure, flows);
+	for(auto i = clients.begin(); i != clients.end(); ++i)
+		(*i)->disconnectServer(100);
+	server.stop(0);
+	g_results.push_back(result);
+}
+
+void benchUdp(const Options& options, uint32 messageSize){
+	Result result;
+	result.transport = "udp";
+	result.client = "UDPSilgle";
+	result.connections = 1;
+	result.messageSize = messageSize;
+	result.name = "udp/c1/s" + std::to_string(messageSize);
+
+	ArmyAnt::UDPSilgle server;
+	server.setErrorReportCallBack(ignoreError);
+	server.setGettingCallBack([&server](const ArmyAnt::IPAddr& addr, uint16 port, uint8* data, mac_uint len, void*){
+		server.send(addr, port, data, len);
+	});
+	if(!server.startListening(true, 0)){
+		std::cerr << result.name << ": server listen failed" << std::endl;
+		return;
+	}
+	auto serverPort = server.getLocalPort();
+	ArmyAnt::IPAddr_v4 loopback(127, 0, 0, 1);
+
+	// 消息开头是序号, 丢包后重发, 迟到的旧回复按序号丢弃
+	Measure measure;
+	Flow flow;
+	std::mutex mutex;
+	uint64 sequence = 0;
+	std::vector<char> message(std::max<uint32>(messageSize, sizeof(sequence)), 'x');
+	ArmyAnt::UDPSilgle client;
+	auto sendNext = [&](){
+		++sequence;
+		memcpy(message.data(), &sequence, sizeof(sequence));
+		flow.onSent();
+		client.send(loopback, serverPort, message.data(), message.size());
+	};
+	client.setErrorReportCallBack(ignoreError);
+	client.setGettingCallBack([&](const ArmyAnt::IPAddr&, uint16, uint8* data, mac_uint len, void*){
+		std::lock_guard<std::mutex> guard(mutex);
+		if(len < sizeof(sequence) || memcmp(data, &sequence, sizeof(sequence)) != 0)
+			return;
+		if(flow.onReceived(len, messageSize, measure) && measure.isRunning)
+			sendNext();
+	});
+	if(!client.startListening(true, 0)){
+		std::cerr << result.name << ": client listen failed" << std::endl;
+		server.stopListening(0);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		sendNext();
+	}
+	std::vector<Flow*> flows(1, &flow);
+	measureRoundTrips(result, options, measure, flows, [&](){
+		std::lock_guard<std::mutex> guard(mutex);
+		if(measure.isRunning)
+			sendNext();
+	});
+	client.stopListening(0);
+	server.stopListening(0);
+	g_results.push_back(result);
+}
+
+void benchAccept(const Options& options, uint32 connections){
+	Result result;
+	result.transport = "tcp";
+	result.client = "asio";
+	result.connections = connections;
+	result.isRoundTrip = false;
+	result.name = "accept/c" + std::to_string(connections);
+	auto port = g_port++;
+	ArmyAnt::TCPServer server;
+	std::atomic<uint32> accepted(0);
+	server.setConnectCallBack([&accepted](uint32, void*){
+		++accepted;
+		return true;
+	});
+	startEchoServer(server, port, options);
+
+	boost::asio::io_service service;
+	boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), port);
+	std::vector<std::unique_ptr<boost::asio::ip::tcp::socket>> sockets;
+	auto start = Clock::now();
+	for(uint32 i = 0; i < connections; ++i){
+		sockets.emplace_back(new boost::asio::ip::tcp::socket(service));
+		sockets.back()->async_connect(endpoint, [](boost::system::error_code){});
+	}
+	std::vector<std::thread> threads;
+	for(int i = 0; i < 2; ++i)
+		threads.emplace_back([&service](){ service.run(); });
+	auto deadline = start + std::chrono::seconds(10);
+	while(accepted < connections && Clock::now() < deadline)
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+	auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	if(accepted < connections)
+		std::cerr << result.name << ": only " << accepted << " connections accepted" << std::endl;
+	result.acceptsPerSecond = accepted / elapsed;
+	for(auto i = threads.begin(); i != threads.end(); ++i)
+		i->join();
+	sockets.clear();
+	server.stop(0);
+	g_results.push_back(result);
+}
+
+// 客户端和服务器端各占一个描述符, 尽量提高上限, 超出上限的连接数降到上限再测
+uint32 getConnectionLimit(){
+#if defined OS_UNIX
+	rlimit limit;
+	if(getrlimit(RLIMIT_NOFILE, &limit) == 0){
+		if(limit.rlim_cur < limit.rlim_max){
+			limit.rlim_cur = limit.rlim_max;
+			setrlimit(RLIMIT_NOFILE, &limit);
+			getrlimit(RLIMIT_NOFILE, &limit);
+		}
+		if(limit.rlim_cur != RLIM_INFINITY)
+			return limit.rlim_cur > 256 ? uint32((limit.rlim_cur - 256) / 2) : 0;
+	}
+#endif
+	return 0xffffffff;
+}
+
+std::string toJson(const Options& options){
+	std::ostringstream out;
+	out.precision(2);
+	out << std::fixed;
+	out << "{\n  \"benchmark\": \"benchSocket\",\n  \"seconds\": " << options.seconds << ",\n  \"reactors\": " << options.reactors << ",\n  \"results\": [";
+	for(std::size_t i = 0; i < g_results.size(); ++i){
+		auto& r = g_results[i];
+		out << (i == 0 ? "\n" : ",\n");
+		out << "    {\"name\": \"" << r.name << "\", \"transport\": \"" << r.transport << "\", \"client\": \"" << r.client << "\", \"connections\": " << r.connections;
+		if(r.isRoundTrip){
+			out << ", \"messageSize\": " << r.messageSize << ", \"messagesPerSecond\": " << r.messagesPerSecond << ", \"megabytesPerSecond\": " << r.megaBytesPerSecond;
+			out << ", \"latencyUs\": {\"p50\": " << r.p50 << ", \"p99\": " << r.p99 << ", \"p999\": " << r.p999 << "}}";
+		} else{
+			out << ", \"acceptsPerSecond\": " << r.acceptsPerSecond << "}";
+		}
+	}
+	out << "\n  ]\n}\n";
+	return out.str();
+}
+
+}
+
+int main(int argc, char* argv[]){
+	Options options;
+	options.seconds = argc > 1 ? atof(argv[1]) : 1;
+	options.maxConnections = uint32(argc > 2 ? atoi(argv[2]) : 10000);
+	options.reactors = uint32(argc > 3 ? atoi(argv[3]) : 2);
+	if(options.seconds <= 0 || options.maxConnections == 0 || options.reactors == 0){
+		std::cerr << "usage: benchSocket [seconds per case] [max connections] [reactors] > result.json" << std::endl;
+		return 1;
+	}
+	auto limit = std::min(options.maxConnections, getConnectionLimit());
+	const uint32 sizes[] = {64, 1024, 16384};
+	const uint32 serverConnections[] = {1, 100, 1000, 10000};
+	const uint32 clientConnections[] = {1, 16};
+
+	for(auto c : serverConnections){
+		if(c > limit){
+			std::cerr << "tcp_server with " << c << " connections is limited to " << limit << std::endl;
+			c = limit;
+		}
+		for(auto s : sizes){
+			std::cerr << "tcp_server c" << c << " s" << s << std::endl;
+			benchTcpServer(options, c, s);
+		}
+	}
+	for(auto c : clientConnections){
+		for(auto s : sizes){
+			std::cerr << "tcp_client c" << c << " s" << s << std::endl;
+			benchTcpClient(options, c, s);
+			std::cerr << "websocket c" << c << " s" << s << std::endl;
+			benchWebSocket(options, c, s);
+		}
+	}
+	for(auto s : sizes){
+		std::cerr << "udp s" << s << std::endl;
+		benchUdp(options, s);
+	}
+	for(auto c : {uint32(1000), uint32(10000)}){
+		if(c > limit){
+			std::cerr << "accept with " << c << " connections is limited to " << limit << std::endl;
+			c = limit;
+		}
+		std::cerr << "accept c" << c << std::endl;
+		benchAccept(options, c);
+	}
+
+	std::cout << toJson(options);
+	return 0;
+}
@@ -0,0 +1,162 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+
+/*	* TCPServer 的 epoll(boost::asio) 与 io_uring 后端在本机回环上的对比
+	* 服务器回显收到的数据, 客户端在若干连接上各自保持一条消息往返, 固定时长内统计吞吐量和平均往返时间
+	* 两个后端依次在同样的参数下运行, 内核不支持 io_uring 时第二行显示实际退回的后端
+	* 用法: benchSocketBackend [连接数, 默认64] [消息大小(字节), 默认64] [每轮时长(秒), 默认3] [服务器反应器数, 默认2]
+	*/
+
+#include "../../inc/AASocket.h"
+
+#include <boost/asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace{
+
+using ArmyAnt::Socket;
+using ArmyAnt::TCPServer;
+
+struct Result{
+	Socket::IOBackend backend;
+	double messages;	// 每秒往返次数
+	double megaBytes;	// 每秒回显的数据量(MB)
+	double latencyUs;	// 平均往返时间(微秒)
+};
+
+// 单条连接的往返循环: 写出一条消息, 读回同样长度后立即发送下一条
+class EchoConnection : public std::enable_shared_from_this<EchoConnection>{
+public:
+	EchoConnection(boost::asio::io_service& service, uint32 messageSize, const std::atomic<bool>& isRunning, std::atomic<uint64>& rounds)
+		:socket(service), sending(messageSize, 'x'), receiving(messageSize), isRunning(isRunning), rounds(rounds){}
+
+	void start(){
+		auto self = shared_from_this();
+		boost::asio::async_write(socket, boost::asio::buffer(sending), [self](boost::system::error_code err, std::size_t){
+			if(err)
+				return;
+			boost::asio::async_read(self->socket, boost::asio::buffer(self->receiving), [self](boost::system::error_code err, std::size_t){
+				if(err)
+					return;
+				++self->rounds;
+				if(self->isRunning)
+					self->start();
+			});
+		});
+	}
+
+	boost::asio::ip::tcp::socket socket;
+
+private:
+	std::vector<char> sending;
+	std::vector<char> receiving;
+	const std::atomic<bool>& isRunning;
+	std::atomic<uint64>& rounds;
+};
+
+Result run(Socket::IOBackend backend, uint16 port, uint32 connections, uint32 messageSize, double seconds, uint32 reactors){
+	TCPServer server(65536, reactors);
+	server.setGettingCallBack([&server](uint32 index, const void* data, mac_uint len, void*){
+		server.send(index, const_cast<void*>(data), len, false);
+	});
+	// 结束时客户端关闭连接会报告错误, 不设定回调的话会抛出异常
+	server.setErrorReportCallBack([](const ArmyAnt::SocketException&, const ArmyAnt::IPAddr&, uint16, ArmyAnt::String, void*){});
+	server.setIOBackend(backend);
+	Result ret = {backend, 0, 0, 0};
+	if(!server.start(port)){
+		std::cerr << "server start failed on port " << port << std::endl;
+		return ret;
+	}
+	ret.backend = server.getIOBackend();
+
+	boost::asio::io_service service;
+	std::atomic<bool> isRunning(true);
+	std::atomic<uint64> rounds(0);
+	std::vector<std::shared_ptr<EchoConnection>> clients;
+	boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), port);
+	for(uint32 i = 0; i < connections; ++i){
+		std::shared_ptr<EchoConnection> client(new EchoConnection(service, messageSize, isRunning, rounds));
+		client->socket.connect(endpoint);
+		client->socket.set_option(boost::asio::ip::tcp::no_delay(true));
+		clients.push_back(client);
+	}
+	for(auto i = clients.begin(); i != clients.end(); ++i)
+		(*i)->start();
+
+	// 客户端使用两个线程, 与服务器反应器分开
+	std::vector<std::thread> threads;
+	for(int i = 0; i < 2; ++i)
+		threads.emplace_back([&service](){ service.run(); });
+	// 预热后再开始计数
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	auto startRounds = rounds.load();
+	auto start = std::chrono::steady_clock::now();
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	auto count = rounds.load() - startRounds;
+	auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	isRunning = false;
+	for(auto i = clients.begin(); i != clients.end(); ++i){
+		boost::system::error_code err;
+		(*i)->socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, err);
+	}
+	for(auto i = threads.begin(); i != threads.end(); ++i)
+		i->join();
+	clients.clear();
+	server.stop(0);
+
+	ret.messages = count / elapsed;
+	ret.megaBytes = ret.messages * messageSize / 1024.0 / 1024.0;
+	ret.latencyUs = count == 0 ? 0 : elapsed * 1000000.0 * connections / count;
+	return ret;
+}
+
+}
+
+int main(int argc, char* argv[]){
+	uint32 connections = uint32(argc > 1 ? atoi(argv[1]) : 64);
+	uint32 messageSize = uint32(argc > 2 ? atoi(argv[2]) : 64);
+	double seconds = argc > 3 ? atof(argv[3]) : 3;
+	uint32 reactors = uint32(argc > 4 ? atoi(argv[4]) : 2);
+	if(connections == 0 || messageSize == 0 || seconds <= 0 || reactors == 0){
+		std::cerr << "usage: benchSocketBackend [connections] [message size] [seconds] [reactors]" << std::endl;
+		return 1;
+	}
+	const char* backendNames[] = {"asio", "io_uring"};
+	const Socket::IOBackend backends[] = {Socket::IOBackend::Asio, Socket::IOBackend::IOUring};
+
+	std::cout << connections << " connections, " << messageSize << " bytes, " << reactors << " reactors" << std::endl;
+	std::cout << "requested\tactual\tmsg/s\tMB/s\tavg rtt(us)" << std::endl;
+	for(int i = 0; i < 2; ++i){
+		// 每轮使用不同端口, 避免上一轮的连接处于TIME_WAIT
+		auto result = run(backends[i], uint16(47300 + i), connections, messageSize, seconds, reactors);
+		std::cout << backendNames[i] << "\t" << backendNames[int(result.backend)] << "\t" << uint64(result.messages) << "\t" << result.megaBytes << "\t" << result.latencyUs << std::endl;
+	}
+	return 0;
+}
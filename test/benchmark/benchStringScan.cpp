@@ -0,0 +1,167 @@
+﻿/*
+ * Copyright (c) 2015 ArmyAnt
+ * 版权所有 (c) 2015 ArmyAnt
+ *
+ * Licensed under the BSD License, Version 2.0 (the License);
+ * 本软件使用BSD协议保护, 协议版本:2.0
+ * you may not use this file except in compliance with the License.
+ * 使用本开源代码文件的内容, 视为同意协议
+ * You can read the license content in the file "LICENSE" at the root of this project
+ * 您可以在本项目的根目录找到名为"LICENSE"的文件, 来阅读协议内容
+ * You may also obtain a copy of the License at
+ * 您也可以在此处获得协议的副本:
+ *
+ *     http://opensource.org/licenses/BSD-3-Clause
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on an AS IS BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * 除非法律要求或者版权所有者书面同意,本软件在本协议基础上的发布没有任何形式的条件和担保,无论明示的或默许的.
+ * See the License for the specific language governing permissions and limitations under the License.
+ * 请在特定限制或语言管理权限下阅读协议
+ * This file is the internal source file of this project, is not contained by the closed source release part of this software
+ * 本文件为内部源码文件, 不会包含在闭源发布的本软件中
+ */
+
+/*	* 字节扫描函数的基准测试
+	* 第一部分在数MB的输入上分别运行标量, SSE2 和 AVX2 版本的扫描函数, 输出吞吐量和相对标量版本的加速比
+	* 第二部分使用运行时选择的版本, 测量 JSON 解析与 String 搜索替换的整体耗时
+	* 用法: benchStringScan [输入大小(MB), 默认16]
+	*/
+
+#include "../../inc/AAJsonDocument.h"
+#include "../../src/tool/AAStringScan.hxx"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace{
+
+using ArmyAnt::StringScan;
+using ArmyAnt::StringScanLevel;
+
+// 带有较长字符串值和缩进的 JSON 文本, 约有 size 字节
+std::string makeJson(uint64 size){
+	std::string ret = "[\n";
+	for(uint64 i = 0; ret.size() < size; ++i){
+		ret += i == 0 ? "    {\n" : ",\n    {\n";
+		ret += "        \"id\": " + std::to_string(i) + ",\n";
+		ret += "        \"title\": \"record " + std::to_string(i) + " with a fairly long description text that has no escapes\",\n";
+		ret += "        \"path\": \"C:\\\\data\\\\records\\\\" + std::to_string(i % 97) + "\",\n";
+		ret += "        \"values\": [1.5, 2.25, -3, 1e3]\n    }";
+	}
+	ret += "\n]";
+	return ret;
+}
+
+// 长度为 1 ~ 64 的空白段, 以单个非空白字符分隔
+std::string makeSpaces(uint64 size){
+	std::string ret;
+	const char spaces[] = " \t\r\n";
+	for(uint64 i = 0; ret.size() < size; ++i){
+		ret.append(1 + (i * 7) % 64, spaces[i % 4]);
+		ret += 'x';
+	}
+	return ret;
+}
+
+template <class T_Func>
+double measure(uint64 bytes, T_Func func){
+	// 至少运行 0.2 秒, 取平均吞吐量
+	uint64 rounds = 0;
+	auto start = std::chrono::steady_clock::now();
+	double seconds = 0;
+	do{
+		func();
+		++rounds;
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	} while(seconds < 0.2);
+	return double(bytes) * rounds / seconds / 1024.0 / 1024.0;
+}
+
+volatile uint64 g_sink = 0;
+
+double benchKernel(const StringScan& scan, int kernel, const std::string& json, const std::string& spaces){
+	auto begin = json.data();
+	auto end = begin + json.size();
+	switch(kernel){
+		case 0:
+			return measure(json.size(), [&](){
+				uint64 count = 0;
+				for(auto i = scan.findQuoteOrBackslash(begin, end, '"'); i < end; i = scan.findQuoteOrBackslash(i + 1, end, '"'))
+					++count;
+				g_sink += count;
+			});
+		case 1:
+			return measure(json.size(), [&](){
+				uint64 count = 0;
+				for(auto i = scan.findEscapedChar(begin, end); i < end; i = scan.findEscapedChar(i + 1, end))
+					++count;
+				g_sink += count;
+			});
+		case 2:
+			return measure(spaces.size(), [&](){
+				auto last = spaces.data() + spaces.size();
+				uint64 count = 0;
+				for(auto i = scan.skipSpace(spaces.data(), last); i < last; i = scan.skipSpace(i + 1, last))
+					++count;
+				g_sink += count;
+			});
+		case 3:
+			return measure(json.size(), [&](){
+				g_sink += uint64(scan.findString(begin, end, "records\\\\x", 10) - begin);
+			});
+		default:
+			return measure(json.size(), [&](){
+				g_sink += uint64(scan.findLastChar(begin, end, '#') - begin);
+			});
+	}
+}
+
+double elapsedMs(std::chrono::steady_clock::time_point start){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+int main(int argc, char* argv[]){
+	uint64 size = uint64(argc > 1 ? atoll(argv[1]) : 16) * 1024 * 1024;
+	auto json = makeJson(size);
+	auto spaces = makeSpaces(size);
+	auto supported = StringScan::getSupportedLevel();
+	const char* kernelNames[] = {"findQuoteOrBackslash", "findEscapedChar", "skipSpace", "findString", "findLastChar"};
+	const char* levelNames[] = {"scalar", "sse2", "avx2"};
+
+	std::cout << "kernel\tlevel\tMB/s\tspeedup" << std::endl;
+	for(int kernel = 0; kernel < 5; ++kernel){
+		double scalar = 0;
+		for(int level = 0; level <= int(supported); ++level){
+			auto speed = benchKernel(StringScan::get(StringScanLevel(level)), kernel, json, spaces);
+			if(level == 0)
+				scalar = speed;
+			std::cout << kernelNames[kernel] << "\t" << levelNames[level] << "\t" << speed << "\t" << speed / scalar << std::endl;
+		}
+	}
+
+	std::cout << std::endl << "end to end (" << levelNames[int(StringScan::get().level)] << ", " << json.size() / 1024 / 1024 << " MB)" << std::endl;
+	ArmyAnt::JsonDocument document;
+	auto start = std::chrono::steady_clock::now();
+	bool parsed = document.parse(ArmyAnt::StringView(json.data(), json.size()));
+	std::cout << "JsonDocument::parse\t" << elapsedMs(start) << " ms" << (parsed ? "" : " (failed)") << std::endl;
+	start = std::chrono::steady_clock::now();
+	auto unit = ArmyAnt::JsonUnit::create(ArmyAnt::StringView(json.data(), json.size()));
+	std::cout << "JsonUnit::create\t" << elapsedMs(start) << " ms" << std::endl;
+	start = std::chrono::steady_clock::now();
+	auto text = unit == nullptr ? ArmyAnt::String() : unit->toJsonString();
+	std::cout << "JsonUnit::toJsonString\t" << elapsedMs(start) << " ms" << std::endl;
+	ArmyAnt::JsonUnit::release(unit);
+	ArmyAnt::String str(ArmyAnt::StringView(json.data(), json.size()));
+	start = std::chrono::steady_clock::now();
+	g_sink += uint64(ArmyAnt::StringView(str).find("not in the text"));
+	std::cout << "StringView::find\t" << elapsedMs(start) << " ms" << std::endl;
+	start = std::chrono::steady_clock::now();
+	str.replace("record", "row");
+	std::cout << "String::replace\t" << elapsedMs(start) << " ms" << std::endl;
+	return 0;
+}